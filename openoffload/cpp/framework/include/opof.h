@@ -21,10 +21,17 @@
 #define FAILURE -1
 
 #define BUFFER_MAX 64
+#define TOP_SESSIONS_MAX 256
+#define AGGREGATE_GROUPS_MAX 4096
+#define RPC_STATS_MAX 32
+#define RPC_NAME_MAX 32
+#define RPC_STATUS_CODES 17
+#define STAGE_STATS_MAX 32
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <stdbool.h>
+#include <time.h>
 
 #ifdef  __GNUC__
 #define OPOF_DEPRECATED(decl) decl __attribute__((deprecated))
@@ -55,6 +62,21 @@ typedef enum {
    _SNOOP = 3,
  } ACTION_VALUE_T;
 
+typedef enum {
+  _IN_BYTES = 0,
+  _OUT_BYTES = 1,
+  _PACKETS = 2,
+  _RATE = 3,
+} SESSION_METRIC_T;
+
+typedef enum {
+  _BY_INLIF = 0,
+  _BY_OUTLIF = 1,
+  _BY_PROTOCOL = 2,
+  _BY_ACTION_TYPE = 3,
+  _BY_STATE = 4,
+} AGGREGATE_GROUP_T;
+
 typedef enum {
   _ESTABLISHED = 0,
   _CLOSING_1   = 1,
@@ -342,8 +364,9 @@ typedef struct sessionResponseTuple {
     SESSION_STATE_T sessionState;
     SESSION_CLOSE_T sessionCloseCode;
     REQUEST_STATUS_T requestStatus;
-  //google.protobuf.Timestamp startTime = 9;
-  //google.protobuf.Timestamp endTime = 10;
+    /* wall clock times, tv_sec 0 when the backend does not track them */
+    struct timespec startTime;
+    struct timespec endTime;
 } sessionResponse_t;
 
 /** @struct statisticsRequestArgs_t
@@ -360,6 +383,97 @@ typedef struct {
   unsigned int page;
 } statisticsRequestArgs_t;
 
+/** @struct sessionFilter_t
+   *  Predicates applied by the server while scanning the session table
+   *  for getAllSessions. A criterion only applies when its enable flag
+   *  is set, minBytes and minPackets apply when non-zero. All criteria
+   *  that apply must match.
+   *
+   *  @var sessionFilter_t::nextHopId
+   *    Matches the nextHopId of either the inLif or outLif action parameters
+   *  @var sessionFilter_t::minBytes
+   *    Minimum of inBytes + outBytes
+   *  @var sessionFilter_t::minPackets
+   *    Minimum of inPackets + outPackets
+   */
+typedef struct sessionFilter_t {
+  bool sessionStateEnable;
+  SESSION_STATE_T sessionState;
+  bool protoEnable;
+  PROTOCOL_ID_T proto;
+  bool inlifEnable;
+  unsigned int inlif;
+  bool outlifEnable;
+  unsigned int outlif;
+  bool ipverEnable;
+  IP_VERSION_T ipver;
+  bool actionTypeEnable;
+  ACTION_VALUE_T actionType;
+  bool nextHopIdEnable;
+  uint32_t nextHopId;
+  unsigned long minBytes;
+  unsigned long minPackets;
+} sessionFilter_t;
+
+/** @struct aggregateStats_t
+   *  Totals of the sessions currently in the table that share one value
+   *  of the grouping requested from getAggregateStats
+   *
+   *  @var aggregateStats_t::key
+   *    The inLif, outLif, PROTOCOL_ID_T, ACTION_VALUE_T or SESSION_STATE_T
+   *    value of the group
+   */
+typedef struct aggregateStats_t {
+  unsigned int key;
+  unsigned long sessions;
+  unsigned long inPackets;
+  unsigned long outPackets;
+  unsigned long inBytes;
+  unsigned long outBytes;
+} aggregateStats_t;
+
+/** @struct rpcStats_t
+   *  Counters and latency percentiles of one SessionTable RPC since the
+   *  server started, as returned by getServerStats
+   *
+   *  @var rpcStats_t::errors
+   *    Calls that returned a status other than OK
+   *  @var rpcStats_t::statusCounts
+   *    Calls per gRPC status code, indexed by the code
+   *  @var rpcStats_t::sessions
+   *    Sessions added, returned or deleted by the calls
+   */
+typedef struct rpcStats_t {
+  char name[RPC_NAME_MAX];
+  unsigned long calls;
+  unsigned long errors;
+  unsigned long statusCounts[RPC_STATUS_CODES];
+  unsigned long sessions;
+  unsigned long p50Micros;
+  unsigned long p99Micros;
+  unsigned long p999Micros;
+  unsigned long maxMicros;
+} rpcStats_t;
+
+/** @struct stageStats_t
+   *  Time spent in one stage of an RPC handler, one value per call of
+   *  the RPC, as returned by getServerStats
+   *
+   *  @var stageStats_t::rpc
+   *    The RPC the stage belongs to, e.g. addSession
+   *  @var stageStats_t::stage
+   *    The stage, e.g. read, convert, backend
+   */
+typedef struct stageStats_t {
+  char rpc[RPC_NAME_MAX];
+  char stage[RPC_NAME_MAX];
+  unsigned long calls;
+  unsigned long totalNanos;
+  unsigned long p50Nanos;
+  unsigned long p99Nanos;
+  unsigned long maxNanos;
+} stageStats_t;
+
 typedef struct sessionRequestTuple {
     unsigned long sessId;
     unsigned int inlif;
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_AGGREGATE_H
+#define OPOF_AGGREGATE_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief Incrementally maintained aggregate counters for server backends
+*
+* Keeps session and counter totals per inLif, outLif, protocol, action type
+* and session state. Backends describe each session with an aggregateSession_t
+* and call opof_aggregate_add when it is inserted, opof_aggregate_update when
+* its counters or state change and opof_aggregate_remove when it leaves the
+* table. Reading the totals costs O(number of groups). The aggregate does no
+* locking.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "opof.h"
+
+typedef struct aggregateSession_t {
+  unsigned int inlif;
+  unsigned int outlif;
+  PROTOCOL_ID_T proto;
+  ACTION_VALUE_T actionType;
+  SESSION_STATE_T sessionState;
+  unsigned long inPackets;
+  unsigned long outPackets;
+  unsigned long inBytes;
+  unsigned long outBytes;
+} aggregateSession_t;
+
+typedef struct opof_aggregate opof_aggregate_t;
+
+opof_aggregate_t *opof_aggregate_create(void);
+void opof_aggregate_destroy(opof_aggregate_t *aggregate);
+void opof_aggregate_reset(opof_aggregate_t *aggregate);
+void opof_aggregate_add(opof_aggregate_t *aggregate, const aggregateSession_t *session);
+void opof_aggregate_remove(opof_aggregate_t *aggregate, const aggregateSession_t *session);
+void opof_aggregate_update(opof_aggregate_t *aggregate, const aggregateSession_t *before, const aggregateSession_t *after);
+int opof_aggregate_get(opof_aggregate_t *aggregate, AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_AGGREGATE_H */
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_BENCH_UTIL_H
+#define OPOF_BENCH_UTIL_H
+
+/**
+* \ingroup testlibrary
+*
+* \brief Helpers shared by the session load drivers
+*
+* Every thread of a load driver owns a range of session IDs, and the calls
+* are picked from a weighted mix of operations. Latencies are kept as a
+* bounded sample per thread, so a long run at millions of calls per second
+* does not grow without limit, and the samples of all threads are merged
+* weighted by the calls each one stands for.
+*/
+#include <stdint.h>
+
+#include <random>
+#include <utility>
+#include <vector>
+
+#define BENCH_IDS_PER_THREAD (1 << 24)
+#define BENCH_SAMPLES_MAX (1 << 16)
+
+enum BenchOp {
+  BENCH_ADD = 0,
+  BENCH_GET,
+  BENCH_DELETE,
+  BENCH_CLOSED,
+  BENCH_ALL,
+  BENCH_OP_COUNT
+};
+
+extern const char *benchOpNames[BENCH_OP_COUNT];
+
+bool parseMix(const char *mix, unsigned int weights[BENCH_OP_COUNT]);
+unsigned long benchNewId(int thread, unsigned long *nextId);
+
+/*
+* A uniform sample of at most BENCH_SAMPLES_MAX of the values added, with
+* the exact count, sum and maximum of all of them.
+*/
+class BenchSamples {
+public:
+    BenchSamples() : count_(0), sum_(0), max_(0) {}
+
+    void add(uint64_t value, std::mt19937_64 &rng);
+
+    uint64_t count() const { return count_; }
+    double sum() const { return sum_; }
+    uint64_t max() const { return max_; }
+    const std::vector<uint64_t> &values() const { return values_; }
+
+private:
+    uint64_t count_;
+    double sum_;
+    uint64_t max_;
+    std::vector<uint64_t> values_;
+};
+
+/*
+* Percentiles over the samples of several threads.
+*/
+class BenchPercentiles {
+public:
+    BenchPercentiles() : count_(0), sum_(0), max_(0), sorted_(true) {}
+
+    void add(const BenchSamples &samples);
+    uint64_t percentile(double p);
+
+    uint64_t count() const { return count_; }
+    double mean() const { return count_ != 0 ? sum_ / count_ : 0; }
+    uint64_t max() const { return max_; }
+
+private:
+    uint64_t count_;
+    double sum_;
+    uint64_t max_;
+    bool sorted_;
+    /* the sampled values with the calls each stands for */
+    std::vector<std::pair<uint64_t, double> > values_;
+};
+
+#endif //OPOF_BENCH_UTIL_H
@@ -57,6 +57,11 @@ int opof_add_session(int size, sessionTable_t *sessionHandle,  sessionRequest_t
 int opof_del_session(sessionTable_t *sessionHandle,  unsigned long  sessionId, sessionResponse_t *resp);
 int opof_get_session(sessionTable_t *sessionHandle,  unsigned long  sessionId , sessionResponse_t *resp);
 int opof_get_all_sessions(sessionTable_t *sessionHandle, uint64_t *sessionStart,int pageSize, sessionResponse_t responses[], unsigned long *sessionCount);
+int opof_get_filtered_sessions(sessionTable_t *sessionHandle, uint64_t *sessionStart,int pageSize, const sessionFilter_t *filter, sessionResponse_t responses[], unsigned long *sessionCount);
+int opof_get_top_sessions(sessionTable_t *sessionHandle, SESSION_METRIC_T metric, int count, sessionResponse_t responses[], unsigned long *sessionCount);
+int opof_get_aggregate_stats(sessionTable_t *sessionHandle, AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups, int *groupCount);
+int opof_get_server_stats(sessionTable_t *sessionHandle, rpcStats_t stats[], int maxRpcs, int *rpcCount, unsigned long *uptimeSeconds);
+int opof_get_stage_stats(sessionTable_t *sessionHandle, stageStats_t stats[], int maxStages, int *stageCount);
 int opof_get_closed_sessions(streamArgs_t *args,sessionResponse_t responses[], unsigned long *sessionCount);
 int opof_add_vlan_flow(sessionTable_t *sessionHandle, uint16_t vlan_id, uint16_t vf_index);
 int opof_remove_vlan_flow(sessionTable_t *sessionHandle, uint16_t vlan_id);
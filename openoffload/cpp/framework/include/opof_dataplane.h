@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_DATAPLANE_H
+#define OPOF_DATAPLANE_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief Packet interface of the software reference dataplane
+*
+* The software dataplane (opof_dataplane.cc) is a backend for
+* opof_serverlib.h that also runs the sessions it is given on packets. The
+* packets are Ethernet frames, tagged with at most one 802.1Q VLAN, tagged
+* with the Lif they arrive on. A packet that matches a session in either
+* direction gets the session's action and its counters are updated; the
+* rest miss and are left for the host.
+*
+* Packets are processed by up to OPOF_DATAPLANE_WORKERS_MAX workers, each
+* counting into its own shard. Session reads through opof_serverlib.h see
+* the shards as of the last aggregation, opof_dataplane_aggregate runs one
+* at once.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "opof.h"
+#include "opof_flow_hash.h"
+
+#define OPOF_DATAPLANE_BURST_MAX 256
+#define OPOF_DATAPLANE_WORKERS_MAX 64
+
+typedef enum {
+  OPOF_PACKET_FORWARD = 0,
+  OPOF_PACKET_DROP = 1,
+  OPOF_PACKET_MISS = 2,
+} OPOF_PACKET_VERDICT_T;
+
+/** @struct opof_packet_t
+   *  A packet handed to opof_dataplane_process, rewritten in place. data,
+   *  length and lif are set by the caller, the rest by the dataplane.
+   */
+typedef struct opof_packet_t {
+  uint8_t *data;
+  uint32_t length;
+  uint32_t lif;
+  uint32_t outLif;
+  OPOF_PACKET_VERDICT_T verdict;
+  unsigned long sessionId;
+} opof_packet_t;
+
+typedef struct opof_dataplane_stats_t {
+  uint64_t packets;
+  uint64_t forwarded;
+  uint64_t dropped;
+  uint64_t missed;
+  uint64_t ttlExpired;
+} opof_dataplane_stats_t;
+
+int opof_dataplane_flow_key(const uint8_t *data, uint32_t length, uint32_t lif, opof_flow_key_t *key);
+void opof_dataplane_process(unsigned int worker, opof_packet_t packets[], int count);
+unsigned int opof_dataplane_workers(void);
+void opof_dataplane_aggregate(void);
+void opof_dataplane_get_stats(opof_dataplane_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_DATAPLANE_H */
@@ -24,14 +24,21 @@
 #include <sys/types.h>
 #include <signal.h>
 
+#include "opof_log.h"
+
 #define OPOF_LOG_INFO 0
 #define OPOF_LOG_WARN 1
 #define OPOF_LOG_ERR 2
 
 #define MAXLINE 4096
 
-void err_info(FILE *fp, const char *, ...);
-void err_warn(FILE *fp, const char *, ...);
+/*
+* err_warn and err_info only queue the message on the async log and never
+* block the caller; fp is not used. Like the opof_log macros they report the
+* file and line of the call and are rate limited per call site.
+*/
+#define err_warn(fp, ...) do { (void)(fp); opof_log_warn(__VA_ARGS__); } while (0)
+#define err_info(fp, ...) do { (void)(fp); opof_log_info(__VA_ARGS__); } while (0)
 
 void err_error(FILE *fp, const char *, ...);
 void err_fatal(FILE *fp, const char *, ...);
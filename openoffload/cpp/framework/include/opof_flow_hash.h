@@ -0,0 +1,95 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_FLOW_HASH_H
+#define OPOF_FLOW_HASH_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief Bucketized cuckoo hash of flows by Lif, VLAN and 5-tuple
+*
+* Maps an opof_flow_key_t to a 64 bit value, for packet rate lookups in a
+* software dataplane or a NIC emulation. Every key has two candidate buckets
+* of OPOF_FLOW_HASH_BUCKET_SLOTS slots, each a cache line holding a 16 bit
+* signature and an entry index per slot. A lookup compares the signatures of
+* both buckets at once with AVX2, or with SSE2 when the CPU has no AVX2, and
+* compares full keys only for the slots whose signature matched. An insert
+* that finds both buckets full moves entries to their other bucket along
+* the shortest path to a free slot, which fills the table to well over 90%
+* before an insert fails.
+*
+* opof_flow_hash_lookup_burst looks up a burst of keys in stages, hashing
+* all of them and prefetching their buckets, then comparing signatures and
+* prefetching the candidate entries, then comparing keys, so the cache
+* misses of the burst overlap.
+*
+* The table does no locking.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "opof.h"
+
+#define OPOF_FLOW_HASH_BUCKET_SLOTS 8
+#define OPOF_FLOW_HASH_BURST_MAX 64
+
+typedef enum {
+  OPOF_FLOW_HASH_SCALAR = 0,
+  OPOF_FLOW_HASH_SSE2 = 1,
+  OPOF_FLOW_HASH_AVX2 = 2,
+} OPOF_FLOW_HASH_SIMD_T;
+
+/** @struct opof_flow_key_t
+   *  What a packet is matched on. IPv4 addresses take the first four bytes
+   *  of src and dst and the rest are zero, ports are in host byte order and
+   *  zero for protocols other than TCP and UDP. Keys are compared as bytes.
+   */
+typedef struct opof_flow_key_t {
+  uint32_t lif;
+  uint16_t vlan;
+  uint8_t ipver;
+  uint8_t proto;
+  uint8_t src[16];
+  uint8_t dst[16];
+  uint16_t srcPort;
+  uint16_t dstPort;
+} opof_flow_key_t;
+
+typedef struct opof_flow_hash opof_flow_hash_t;
+
+void opof_flow_key_from_request(const sessionRequest_t *request, opof_flow_key_t *key);
+
+opof_flow_hash_t *opof_flow_hash_create(unsigned long capacity);
+void opof_flow_hash_destroy(opof_flow_hash_t *table);
+void opof_flow_hash_reset(opof_flow_hash_t *table);
+int opof_flow_hash_add(opof_flow_hash_t *table, const opof_flow_key_t *key, uint64_t value);
+int opof_flow_hash_del(opof_flow_hash_t *table, const opof_flow_key_t *key);
+int opof_flow_hash_lookup(opof_flow_hash_t *table, const opof_flow_key_t *key, uint64_t *value);
+uint64_t opof_flow_hash_lookup_burst(opof_flow_hash_t *table, const opof_flow_key_t keys[], int count, uint64_t values[]);
+unsigned long opof_flow_hash_count(opof_flow_hash_t *table);
+unsigned long opof_flow_hash_capacity(opof_flow_hash_t *table);
+void opof_flow_hash_buckets(opof_flow_hash_t *table, const opof_flow_key_t *key, uint32_t *first, uint32_t *second);
+OPOF_FLOW_HASH_SIMD_T opof_flow_hash_simd(opof_flow_hash_t *table);
+OPOF_FLOW_HASH_SIMD_T opof_flow_hash_set_simd(opof_flow_hash_t *table, OPOF_FLOW_HASH_SIMD_T simd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_FLOW_HASH_H */
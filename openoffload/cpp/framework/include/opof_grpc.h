@@ -77,4 +77,15 @@ using openoffload::v1beta1::nextHopParameters;
 using openoffload::v1beta1::nextHopResponse;
 using openoffload::v1beta1::perLinkActionParameters;
 using openoffload::v1beta1::resetRequest;
+using openoffload::v1beta1::sessionFilter;
+using openoffload::v1beta1::topSessionsRequest;
+using openoffload::v1beta1::SESSION_METRIC;
+using openoffload::v1beta1::aggregateStatsRequest;
+using openoffload::v1beta1::aggregateStatsResponse;
+using openoffload::v1beta1::aggregateStats;
+using openoffload::v1beta1::AGGREGATE_GROUP;
+using openoffload::v1beta1::serverStatsRequest;
+using openoffload::v1beta1::serverStatsResponse;
+using openoffload::v1beta1::rpcStats;
+using openoffload::v1beta1::stageStats;
 #endif // _OPOF_GRPC_H
\ No newline at end of file
@@ -15,6 +15,7 @@
  */
 #ifndef OPOF_HASH_H
 #define OPOF_HASH_H
+#include <time.h>
 #include "opof.h"
 #include "uthash.h"
 
@@ -40,8 +41,11 @@ typedef struct {
 	unsigned long outBytes;
 	PROTOCOL_ID_T protocolId;
 	ACTION_VALUE_T actionValue;
+	unsigned int inNextHopId;
+	unsigned int outNextHopId;
 	SESSION_STATE_T sessionState;
 	SESSION_CLOSE_T sessionClose;
+	time_t startTime;
 	UT_hash_handle hh;
 } record_t;
 
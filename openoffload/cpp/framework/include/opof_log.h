@@ -0,0 +1,106 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_LOG_H
+#define OPOF_LOG_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief Asynchronous logging for the client and server libraries
+*
+* A log call formats its message into a slot of a per-thread ring and returns.
+* A background writer drains all rings every OPOF_LOG_FLUSH_MSEC and writes
+* the messages with one write() per batch, so a caller never blocks on I/O.
+* When a thread's ring is full the message is dropped and counted. The writer
+* reports drops as a separate line.
+*
+* Levels below OPOF_LOG_MIN_LEVEL are removed by the preprocessor, so
+* opof_log_debug() costs nothing unless the library is built with
+* -DOPOF_LOG_MIN_LEVEL=OPOF_LOG_LEVEL_DEBUG. Each call site also keeps its own
+* rate limit of OPOF_LOG_BURST messages per second. Messages over the limit
+* are suppressed, and the next message from that site says how many.
+*
+* The writer thread starts with the first message and the rings are flushed
+* at exit. Call opof_log_flush() to write out pending messages before a
+* crash handler or exec.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#define OPOF_LOG_LEVEL_DEBUG 0
+#define OPOF_LOG_LEVEL_INFO  1
+#define OPOF_LOG_LEVEL_WARN  2
+#define OPOF_LOG_LEVEL_ERROR 3
+
+#ifndef OPOF_LOG_MIN_LEVEL
+#define OPOF_LOG_MIN_LEVEL OPOF_LOG_LEVEL_INFO
+#endif
+
+#define OPOF_LOG_RING_SIZE 256
+#define OPOF_LOG_MESSAGE_MAX 224
+#define OPOF_LOG_BURST 100
+#define OPOF_LOG_FLUSH_MSEC 20
+
+/*
+* Rate limit state of one call site, a static in the macros below
+*/
+typedef struct opofLogSite {
+    uint64_t second;
+    uint32_t count;
+    uint32_t suppressed;
+} opofLogSite_t;
+
+void opof_vlog(opofLogSite_t *site, int level, const char *file, int line, const char *fmt, va_list ap);
+void opof_log(opofLogSite_t *site, int level, const char *file, int line, const char *fmt, ...)
+  __attribute__((format(printf, 5, 6)));
+int opof_log_open(const char *path);
+void opof_log_flush(void);
+uint64_t opof_log_dropped(void);
+
+#define OPOF_LOG_AT(level, ...) \
+  do { \
+    static opofLogSite_t opof_log_site_; \
+    opof_log(&opof_log_site_, level, __FILE__, __LINE__, __VA_ARGS__); \
+  } while (0)
+
+#define OPOF_LOG_NOTHING(...) do { if (0) opof_log(0, 0, 0, 0, __VA_ARGS__); } while (0)
+
+#if OPOF_LOG_MIN_LEVEL <= OPOF_LOG_LEVEL_DEBUG
+#define opof_log_debug(...) OPOF_LOG_AT(OPOF_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define opof_log_debug(...) OPOF_LOG_NOTHING(__VA_ARGS__)
+#endif
+#if OPOF_LOG_MIN_LEVEL <= OPOF_LOG_LEVEL_INFO
+#define opof_log_info(...) OPOF_LOG_AT(OPOF_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define opof_log_info(...) OPOF_LOG_NOTHING(__VA_ARGS__)
+#endif
+#if OPOF_LOG_MIN_LEVEL <= OPOF_LOG_LEVEL_WARN
+#define opof_log_warn(...) OPOF_LOG_AT(OPOF_LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define opof_log_warn(...) OPOF_LOG_NOTHING(__VA_ARGS__)
+#endif
+#define opof_log_error(...) OPOF_LOG_AT(OPOF_LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_LOG_H */
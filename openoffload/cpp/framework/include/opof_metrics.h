@@ -0,0 +1,54 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __OPOF_METRICS_H
+#define __OPOF_METRICS_H
+
+/**
+* \ingroup serverlibrary
+*
+* \brief Embedded HTTP listener exporting the server stats in Prometheus text format
+*
+* A single thread accepts one connection at a time and answers GET /metrics.
+* A scrape reads the ServerStats atomics and calls opof_get_table_stats_server()
+* for the session table occupancy, so the session handlers never wait on it.
+*/
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "opof_server_stats.h"
+
+class MetricsServer {
+public:
+    MetricsServer(const ServerStats &stats);
+    ~MetricsServer();
+
+    bool start(const std::string &address, unsigned short port);
+    void stop();
+
+private:
+    void run();
+    void handle(int fd);
+    std::string render() const;
+
+    const ServerStats &stats_;
+    int listenFd_;
+    std::atomic<bool> stopping_;
+    std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_PCAP_H
+#define OPOF_PCAP_H
+
+/**
+* \ingroup testlibrary
+*
+* \brief Classic pcap file reader and writer
+*
+* Just enough of the libpcap file format to feed the software dataplane and
+* keep what it forwards: Ethernet captures with microsecond or nanosecond
+* timestamps in either byte order are read, and files are written in host
+* byte order with microsecond timestamps. pcapng is not supported.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OPOF_PCAP_SNAPLEN 65535
+
+typedef struct opof_pcap opof_pcap_t;
+
+opof_pcap_t *opof_pcap_open_read(const char *path);
+opof_pcap_t *opof_pcap_open_write(const char *path);
+int opof_pcap_read(opof_pcap_t *pcap, uint8_t *data, size_t size, uint32_t *length, uint64_t *nanos);
+int opof_pcap_write(opof_pcap_t *pcap, const uint8_t *data, uint32_t length, uint64_t nanos);
+void opof_pcap_close(opof_pcap_t *pcap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_PCAP_H */
@@ -0,0 +1,116 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_REWRITE_H
+#define OPOF_REWRITE_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief NAT and MAC rewrite of packet bursts with incremental checksums
+*
+* opof_rewrite_compile turns the perLinkActionParameters_t of the Lif a
+* direction of a session leaves on, and the nextHopParameters_t it points
+* to, into an opof_rewrite_t once, when the session is added or the next
+* hop changes. The new addresses and ports are laid out as on the wire with
+* a mask of the bytes they replace, and because every packet of the
+* direction carries the tuple of its flow key, the change each makes to the
+* IPv4 header checksum and to the TCP or UDP checksum is summed then too,
+* as in RFC 1624.
+*
+* opof_rewrite_burst applies the compiled rewrites to a burst of packets:
+* it overwrites the MACs, decrements the TTL or hop limit, sets the VLAN ID,
+* blends the addresses and ports in, with SSE2 or AVX2 when the CPU has
+* them, and updates the checksums with the compiled sums, HC' = ~(~HC + D).
+* The cost does not depend on the length of the packet, and the L4 checksum
+* is right also for a first fragment or a packet cut short, which a sum
+* over the segment cannot handle. A UDP over IPv4 checksum of 0 means none
+* and is left alone.
+*
+* The rewrites follow the software dataplane (opof_dataplane.cc): snat and
+* dnat replace the address when their ipver is the packet's and the port
+* when it is not zero, the next hop replaces both MACs when it has
+* macRewriteEnable and then also decrements the TTL of TCP packets, and a
+* non-zero vlan replaces the VLAN ID of a tagged packet.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "opof.h"
+#include "opof_flow_hash.h"
+
+#define OPOF_REWRITE_BURST_MAX 64
+
+#define OPOF_REWRITE_MAC 0x01
+#define OPOF_REWRITE_TTL 0x02
+#define OPOF_REWRITE_VLAN 0x04
+#define OPOF_REWRITE_ADDRESSES 0x08
+#define OPOF_REWRITE_PORTS 0x10
+#define OPOF_REWRITE_IP_CHECKSUM 0x20
+#define OPOF_REWRITE_L4_CHECKSUM 0x40
+
+typedef enum {
+  OPOF_REWRITE_SCALAR = 0,
+  OPOF_REWRITE_SSE2 = 1,
+  OPOF_REWRITE_AVX2 = 2,
+} OPOF_REWRITE_SIMD_T;
+
+/** @struct opof_rewrite_t
+   *  A compiled rewrite. addresses holds the source and destination address
+   *  as in the IP header, in the first 8 bytes for IPv4, and ports the
+   *  source and destination port; the bytes outside their masks are zero.
+   *  ipDelta and l4Delta are the one's complement sums the checksums change
+   *  by. flags say which parts apply.
+   */
+typedef struct opof_rewrite_t {
+  uint8_t addresses[32];
+  uint8_t addressMask[32];
+  uint8_t macs[12];
+  uint8_t ports[4];
+  uint8_t portMask[4];
+  uint16_t vlan;
+  uint16_t ipDelta;
+  uint16_t l4Delta;
+  uint8_t ipver;
+  uint8_t proto;
+  uint8_t flags;
+} opof_rewrite_t;
+
+/** @struct opof_rewrite_packet_t
+   *  A packet of a burst: an Ethernet frame, the rewrite of its session
+   *  direction and the offsets of its headers, vlanOffset 0 when untagged.
+   */
+typedef struct opof_rewrite_packet_t {
+  uint8_t *data;
+  const opof_rewrite_t *rewrite;
+  uint16_t vlanOffset;
+  uint16_t l3;
+  uint16_t l4;
+} opof_rewrite_packet_t;
+
+void opof_rewrite_compile(const opof_flow_key_t *key, const perLinkActionParameters_t *link,
+  const nextHopParameters_t *nextHop, opof_rewrite_t *rewrite);
+uint64_t opof_rewrite_burst(const opof_rewrite_packet_t packets[], int count);
+OPOF_REWRITE_SIMD_T opof_rewrite_simd(void);
+OPOF_REWRITE_SIMD_T opof_rewrite_set_simd(OPOF_REWRITE_SIMD_T simd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_REWRITE_H */
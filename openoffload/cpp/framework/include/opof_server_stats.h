@@ -0,0 +1,217 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __OPOF_SERVER_STATS_H
+#define __OPOF_SERVER_STATS_H
+
+/**
+* \ingroup serverlibrary
+*
+* \brief Per-RPC counters and latency histograms for SessionTableImpl
+*
+* Every RPC handler records its call count, the gRPC status it returned,
+* the number of sessions it processed and its latency. All counters are
+* relaxed atomics, so recording never takes a lock. Latencies go into a
+* log-linear (HDR-style) histogram of microseconds with 16 sub-buckets
+* per power of two, which bounds the percentile error to about 6%.
+*
+* Unless stage timers are disabled with opof_set_stage_timers(0), the addSession,
+* getClosedSessions and getAllSessions handlers also split their time into
+* stages measured with the TSC. A StageTimer accumulates the ticks of each
+* stage on the stack and records one value per stage when the RPC ends, so
+* each stage boundary costs one TSC read and no shared writes: four per
+* session in addSession, a few per page in the other two.
+*/
+extern "C" {
+#include "opof.h"
+}
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include "opof_grpc.h"
+#include "opof_trace.h"
+
+extern "C" {
+  unsigned int opof_set_stage_timers(unsigned int enable);
+  unsigned int opof_get_stage_timers(void);
+}
+
+/*
+* Stages of the instrumented handlers. Serialization of unary responses
+* happens in gRPC after the handler returns and is not covered.
+*/
+enum OpofStage {
+  OPOF_STAGE_ADD_READ = 0,        // reader->Read, receive and parse one request
+  OPOF_STAGE_ADD_CONVERT,         // convertSessionRequest2c
+  OPOF_STAGE_ADD_BACKEND,         // opof_add_session_server
+  OPOF_STAGE_ADD_RESPONSE,        // recording per-session errors
+  OPOF_STAGE_CLOSED_BACKEND,      // opof_get_closed_sessions_server
+  OPOF_STAGE_CLOSED_CONVERT,      // filling the sessionResponse
+  OPOF_STAGE_CLOSED_WRITE,        // writer->Write, serialize and send
+  OPOF_STAGE_ALL_ALLOC,           // allocating the backend page
+  OPOF_STAGE_ALL_BACKEND,         // opof_get_(all|filtered)_sessions_server
+  OPOF_STAGE_ALL_CONVERT,         // filling sessionResponses
+  OPOF_STAGE_COUNT
+};
+
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int BUCKETS = 2 * SUB_BUCKETS + (64 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+    LatencyHistogram();
+    void record(uint64_t value);
+    uint64_t count() const;
+    uint64_t countAtOrBelow(uint64_t value) const;
+    uint64_t sum() const;
+    uint64_t max() const;
+    uint64_t percentile(double p) const;
+
+private:
+    static int bucketIndex(uint64_t value);
+    static uint64_t bucketHighest(int index);
+
+    std::atomic<uint64_t> counts_[BUCKETS];
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+struct RpcStats {
+    RpcStats();
+
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> sessions;
+    std::atomic<uint64_t> statusCounts[RPC_STATUS_CODES];
+    std::atomic<uint64_t> backendErrors[RPC_STATUS_CODES];
+    LatencyHistogram latency;
+};
+
+struct StageStats {
+    StageStats();
+
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> totalTicks;
+    LatencyHistogram ticks;
+};
+
+class ServerStats {
+public:
+    ServerStats();
+
+    void record(OpofRpc rpc, StatusCode code, uint64_t sessions, uint64_t micros);
+    void recordStage(OpofStage stage, uint64_t ticks);
+    void recordSessions(uint64_t added, uint64_t deleted, uint64_t closed);
+    void recordBackendError(OpofRpc rpc, int status);
+    void fill(serverStatsResponse *response) const;
+    void dump(std::ostream &out) const;
+    void prometheus(std::ostream &out) const;
+    uint64_t uptimeSeconds() const;
+
+    static const char *rpcName(OpofRpc rpc);
+    static const char *stageName(OpofStage stage);
+
+private:
+    double ticksPerNano() const;
+
+    RpcStats rpcs_[OPOF_RPC_COUNT];
+    StageStats stages_[OPOF_STAGE_COUNT];
+    std::atomic<uint64_t> sessionsAdded_;
+    std::atomic<uint64_t> sessionsDeleted_;
+    std::atomic<uint64_t> sessionsClosed_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t startTicks_;
+};
+
+/**
+* \brief Times one RPC and records it when the handler returns
+*
+* Handlers create one on entry and return through done(), which records the
+* call with the status being returned and passes the status through. Both
+* ends are also traced as the streamOpen and streamClose events.
+*/
+class RpcTimer {
+public:
+    RpcTimer(ServerStats &stats, OpofRpc rpc)
+    : stats_(stats), rpc_(rpc), sessions_(0), start_(std::chrono::steady_clock::now()) {
+      opof_trace(OPOF_TRACE_STREAM_OPEN, rpc_, 0, 0);
+    };
+
+    void addSessions(uint64_t sessions) { sessions_ += sessions; }
+
+    Status done(const Status &status) {
+      std::chrono::microseconds elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_);
+      stats_.record(rpc_, status.error_code(), sessions_, elapsed.count());
+      opof_trace(OPOF_TRACE_STREAM_CLOSE, rpc_, 0, status.error_code());
+      return status;
+    }
+
+private:
+    ServerStats &stats_;
+    OpofRpc rpc_;
+    uint64_t sessions_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+* \brief Splits the time of one RPC into stages
+*
+* lap(stage) charges the ticks since the previous lap, or since the timer was
+* created, to the stage. Laps of the same stage add up over the RPC and each
+* stage that saw a lap is recorded once when the timer goes out of scope.
+* When stage timers are disabled lap() does nothing.
+*/
+class StageTimer {
+public:
+    StageTimer(ServerStats &stats)
+    : stats_(stats), enabled_(opof_get_stage_timers() != 0), mark_(0) {
+      for (int i = 0; i < OPOF_STAGE_COUNT; i++){
+        ticks_[i] = 0;
+      }
+      if (enabled_){
+        mark_ = opof_ticks();
+      }
+    };
+
+    ~StageTimer() {
+      if (!enabled_){
+        return;
+      }
+      for (int i = 0; i < OPOF_STAGE_COUNT; i++){
+        if (ticks_[i]){
+          stats_.recordStage((OpofStage)i, ticks_[i]);
+        }
+      }
+    }
+
+    void lap(OpofStage stage) {
+      if (enabled_){
+        uint64_t now = opof_ticks();
+        ticks_[stage] += now - mark_;
+        mark_ = now;
+      }
+    }
+
+private:
+    ServerStats &stats_;
+    bool enabled_;
+    uint64_t mark_;
+    uint64_t ticks_[OPOF_STAGE_COUNT];
+};
+
+#endif
@@ -38,6 +38,10 @@ int opof_get_session_server(unsigned long sessionId, sessionResponse_t *response
 int opof_del_session_server(unsigned long sessionId, sessionResponse_t *response);
 int opof_get_closed_sessions_server(statisticsRequestArgs_t *request, sessionResponse_t responses[]);
 int opof_get_all_sessions_server(int pageSize, uint64_t *startSession,int pageCount, sessionResponse_t **responses);
+int opof_get_filtered_sessions_server(int pageSize, uint64_t *startSession, const sessionFilter_t *filter, sessionResponse_t **responses);
+int opof_get_top_sessions_server(SESSION_METRIC_T metric, int count, sessionResponse_t responses[]);
+int opof_get_aggregate_stats_server(AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups);
+int opof_get_table_stats_server(unsigned long *sessionCount, unsigned long *capacity);
 int opof_add_vlan_flow_server(uint16_t vlan_id, uint16_t vf_index);
 int opof_remove_vlan_flow_server(uint16_t vlan_id);
 size_t opof_get_vlan_flow_count_server();
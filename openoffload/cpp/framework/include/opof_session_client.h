@@ -69,8 +69,12 @@ public:
     int addSessionClient(int size, sessionRequest_t **s, addSessionResponse_t *resp);
     int getSessionClient(int session, sessionResponse_t *resp);
     int deleteSessionClient(int session, sessionResponse_t *resp);
-    int getAllSessions(int pageSize, uint64_t *start_session, uint64_t *sessions, sessionResponse_t responses[],unsigned long *sessionCount);
+    int getAllSessions(int pageSize, uint64_t *start_session, uint64_t *sessions, sessionResponse_t responses[],unsigned long *sessionCount, const sessionFilter_t *filter = NULL);
     int getClosedSessions(statisticsRequestArgs_t *args, sessionResponse_t responses[], unsigned long *sessionCount);
+    int getTopSessions(SESSION_METRIC_T metric, int count, sessionResponse_t responses[], unsigned long *sessionCount);
+    int getAggregateStats(AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups, int *groupCount);
+    int getServerStats(rpcStats_t stats[], int maxRpcs, int *rpcCount, unsigned long *uptimeSeconds);
+    int getStageStats(stageStats_t stats[], int maxStages, int *stageCount);
     int addVlanFlow(uint16_t vlan_id, uint16_t vf_index);
     size_t getVlanFlowCount();
     int getVlanFlows(uint16_t *vlan_ids, uint16_t *vf_indices, size_t vlanFlowMaxCount, size_t * vlanFlowActualCount);
@@ -27,6 +27,7 @@ extern "C" {
 #include "opof.h"
 }
 #include "opof_grpc.h"
+#include "opof_server_stats.h"
 
 
 class SessionTableImpl final : public SessionTable::Service {
@@ -38,6 +39,9 @@ public:
     Status deleteSession(ServerContext* context, const sessionId* sid, sessionResponse* response) override;
     Status getAllSessions(ServerContext* context, const sessionRequestArgs* request, sessionResponses *responseArray) override;
     Status getClosedSessions(ServerContext* context,  const sessionRequestArgs* response,ServerWriter<sessionResponse>* writer) override;
+    Status getTopSessions(ServerContext* context, const topSessionsRequest* request, sessionResponses *responses) override;
+    Status getAggregateStats(ServerContext* context, const aggregateStatsRequest* request, aggregateStatsResponse *response) override;
+    Status getServerStats(ServerContext* context, const serverStatsRequest* request, serverStatsResponse *response) override;
     Status addVlanFlow(ServerContext* context, const vlanFlowDef* request, sessionResponse* response) override;
     Status removeVlanFlow(ServerContext* context, const vlanFlowDef* request, sessionResponse* response) override;
     Status getVlanFlows(ServerContext* context, const vlanFlowListRequest* request, vlanFlowList* response) override;
@@ -46,6 +50,10 @@ public:
     Status destroyNextHop(ServerContext* context, const nextHopParameters *nextHop, nextHopResponse *response) override;
     Status clearNextHops(ServerContext* context, const nextHopParameters* ignored, nextHopResponse* response);
 
+    const ServerStats &stats() const { return stats_; }
+
+private:
+    ServerStats stats_;
 };
 
 
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_TOPN_H
+#define OPOF_TOPN_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief Bounded top-N tracker for server backends
+*
+* A min-heap of at most capacity sessions keyed by a metric value, with a hash
+* index on sessionId. Backends call opof_topn_update whenever a session counter
+* changes and opof_topn_remove when a session leaves the table. A query only
+* looks at the tracked sessions, so its cost is bounded by the capacity and not
+* by the size of the session table.
+*
+* Once the tracker is full a session only enters it by beating the current
+* minimum, so after sessions are removed the result is approximate until the
+* freed slots are refilled by later updates. Size the capacity a few times
+* larger than the largest N requested. The tracker does no locking.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+typedef struct opof_topn opof_topn_t;
+
+opof_topn_t *opof_topn_create(int capacity);
+void opof_topn_destroy(opof_topn_t *topn);
+void opof_topn_reset(opof_topn_t *topn);
+void opof_topn_update(opof_topn_t *topn, unsigned long sessionId, uint64_t value);
+void opof_topn_remove(opof_topn_t *topn, unsigned long sessionId);
+int opof_topn_get(opof_topn_t *topn, int n, unsigned long sessionIds[], uint64_t values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_TOPN_H */
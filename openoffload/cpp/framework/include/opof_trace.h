@@ -0,0 +1,153 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __OPOF_TRACE_H
+#define __OPOF_TRACE_H
+
+/**
+* \ingroup serverlibrary
+*
+* \brief Per-thread binary trace ring (flight recorder)
+*
+* Every thread that records an event owns a ring of OPOF_TRACE_RING_SIZE
+* fixed-size records. Recording is a TSC read and a 32 byte store into the
+* thread's own ring, with no lock and no shared cache line, so it can stay
+* on at production rates. A ring overwrites its oldest records and always
+* holds the last events of its thread.
+*
+* opof_trace_dump() copies all rings into a binary file; opof_trace_decode
+* turns the file back into a per-request timeline. Tracing is off until
+* opof_set_trace(1), and while off an event costs one load and a branch.
+*/
+#include <stdint.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define OPOF_TRACE_RING_SIZE 16384
+#define OPOF_TRACE_MAGIC "OPOFTRC1"
+#define OPOF_TRACE_VERSION 1
+
+extern "C" {
+  extern unsigned int g_trace;
+  unsigned int opof_set_trace(unsigned int enable);
+  unsigned int opof_get_trace(void);
+  const char *opof_set_trace_file(const char *path);
+  const char *opof_get_trace_file(void);
+  int opof_trace_dump(const char *path);
+  int opof_trace_dump_on_signal(int signo);
+}
+
+enum OpofRpc {
+  OPOF_RPC_GET_SERVICE_VERSION = 0,
+  OPOF_RPC_RESET,
+  OPOF_RPC_ADD_SESSION,
+  OPOF_RPC_GET_SESSION,
+  OPOF_RPC_DELETE_SESSION,
+  OPOF_RPC_GET_ALL_SESSIONS,
+  OPOF_RPC_GET_CLOSED_SESSIONS,
+  OPOF_RPC_GET_TOP_SESSIONS,
+  OPOF_RPC_GET_AGGREGATE_STATS,
+  OPOF_RPC_ADD_VLAN_FLOW,
+  OPOF_RPC_REMOVE_VLAN_FLOW,
+  OPOF_RPC_GET_VLAN_FLOWS,
+  OPOF_RPC_CLEAR_VLAN_FLOWS,
+  OPOF_RPC_SET_NEXT_HOP,
+  OPOF_RPC_DESTROY_NEXT_HOP,
+  OPOF_RPC_CLEAR_NEXT_HOPS,
+  OPOF_RPC_GET_SERVER_STATS,
+  OPOF_RPC_COUNT
+};
+
+extern const char *const opofRpcNames[OPOF_RPC_COUNT];
+
+enum OpofTraceEvent {
+  OPOF_TRACE_STREAM_OPEN = 1,     // RPC started, server handler entered or client call created
+  OPOF_TRACE_REQUEST_SENT,        // client wrote one request to the stream
+  OPOF_TRACE_REQUEST_DECODED,     // server read and converted one request
+  OPOF_TRACE_BACKEND_START,       // backend hook called
+  OPOF_TRACE_BACKEND_END,         // backend hook returned, arg is its status or count
+  OPOF_TRACE_RESPONSE_WRITTEN,    // one streamed response written
+  OPOF_TRACE_STREAM_CLOSE,        // RPC finished, arg is the gRPC status code
+  OPOF_TRACE_EVENT_COUNT
+};
+
+extern const char *const opofTraceEventNames[OPOF_TRACE_EVENT_COUNT];
+
+/*
+* One event. seq is the low 32 bits of the position in the ring, so the
+* decoder can tell where a ring wrapped.
+*/
+struct OpofTraceRecord {
+    uint64_t ticks;
+    uint64_t sessionId;
+    uint32_t thread;
+    uint32_t arg;
+    uint16_t event;
+    uint16_t rpc;
+    uint32_t seq;
+};
+
+/*
+* Header of a dump file, which is followed by `records` OpofTraceRecords. The two
+* (ticks, realtime nanoseconds) pairs taken when the library was loaded and when
+* the file was written let the decoder convert ticks to wall clock time. The first
+* is not retaken when tracing is turned on, so the span between them, and with it
+* the tick rate the decoder derives, is as long as the process has run.
+*/
+struct OpofTraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t records;
+    uint64_t startTicks;
+    int64_t startNanos;
+    uint64_t dumpTicks;
+    int64_t dumpNanos;
+    uint32_t threads;
+    uint32_t pid;
+};
+
+/**
+* \brief Cheap monotonic tick counter, the TSC on x86 and nanoseconds elsewhere
+*/
+static inline uint64_t opof_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void opofTraceRecord(OpofTraceEvent event, OpofRpc rpc, uint64_t sessionId, uint32_t arg);
+
+/**
+* \brief Record one event in the calling thread's ring when tracing is enabled
+*
+* \param event      The event
+* \param rpc        The RPC the event belongs to
+* \param sessionId  The session, 0 when the event is not about one session
+* \param arg        Event specific value, a status or a count
+*/
+static inline void opof_trace(OpofTraceEvent event, OpofRpc rpc, uint64_t sessionId, uint32_t arg) {
+  if (g_trace){
+    opofTraceRecord(event, rpc, sessionId, arg);
+  }
+}
+
+#endif
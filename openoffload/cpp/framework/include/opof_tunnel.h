@@ -0,0 +1,318 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @file opof_tunnel.h
+ *
+ * C structs of the ipTunnelService in protos/tunneloffload.proto. They
+ * follow the proto messages field for field; a oneof becomes an enum saying
+ * which member is present, and bytes fields become fixed size arrays.
+ */
+#ifndef OPOF_TUNNEL_H
+#define OPOF_TUNNEL_H
+
+#include <stdint.h>
+
+#include "opof.h"
+
+/* most tunnels in one createIpTunnel stream, the width of errorStatus */
+#define TUNNEL_BUFFER_MAX 64
+#define TUNNEL_INTERFACE_MAX 32
+#define TUNNEL_IPSEC_KEY_MAX 32
+#define TUNNEL_IPSEC_SAS_MAX 8
+#define TUNNEL_GENEVE_OPTIONS_MAX 8
+#define TUNNEL_GENEVE_OPTION_DATA_MAX 128
+#define TUNNEL_ERROR_STRING_MAX 128
+#define TUNNEL_IPSEC_TYPES_MAX 4
+#define TUNNEL_ENC_TYPES_MAX 12
+
+typedef enum {
+  _TUNNEL_ACCEPTED = 0,
+  _TUNNEL_REJECTED = 1,
+  _TUNNEL_TABLE_FULL = 2,
+  _TUNNEL_TABLE_UNAVAILABLE = 3,
+  _TUNNEL_ALREADY_EXISTS = 4,
+} ADD_TUNNEL_STATUS_T;
+
+typedef enum {
+  _TUNNEL_OP_NONE = 0,
+  _TUNNEL_CREATE = 1,
+  _TUNNEL_UPDATE = 2,
+  _TUNNEL_DELETE = 3,
+} TUNNEL_OPERATION_T;
+
+typedef enum {
+  _TUNNEL_ACTION_NONE = 0,
+  _TUNNEL_FORWARD = 1,
+  _TUNNEL_RECIRCULATE = 2,
+} TUNNEL_ACTION_T;
+
+typedef enum {
+  _AES256GCM64 = 0,
+  _AES256GCM96 = 1,
+  _AES256GCM128 = 2,
+  _AES128GCM64 = 3,
+  _AES128GCM96 = 4,
+  _AES128GCM128 = 5,
+  _AES256CCM64 = 6,
+  _AES256CCM96 = 7,
+  _AES256CCM128 = 8,
+  _AES128CCM64 = 9,
+  _AES128CCM96 = 10,
+  _AES128CCM128 = 11,
+} IPSEC_ENC_TYPE_T;
+
+typedef enum {
+  _IPSEC_TRANSPORT = 0,
+  _IPSEC_TUNNEL = 1,
+  _IPSEC_TRANSPORT_NAT_TRAVERSAL = 2,
+  _IPSEC_TUNNEL_NAT_TRAVERSAL = 3,
+} IPSEC_TUNNEL_TYPE_T;
+
+/* which member of the ipTunnelRequest tunnel oneof is present */
+typedef enum {
+  _IP_TUNNEL_NONE = 0,
+  _IP_TUNNEL_IPSEC_ENC = 1,
+  _IP_TUNNEL_IPSEC_DEC = 2,
+  _IP_TUNNEL_GENEVE_ENCAP = 3,
+  _IP_TUNNEL_GENEVE_DECAP = 4,
+  _IP_TUNNEL_NAT = 5,
+} IP_TUNNEL_TYPE_T;
+
+/* which member of the MatchCriteria match oneof is present */
+typedef enum {
+  _TUNNEL_MATCH_NONE = 0,
+  _TUNNEL_MATCH_IPSEC = 1,
+  _TUNNEL_MATCH_GENEVE = 2,
+  _TUNNEL_MATCH_VXLAN = 3,
+} TUNNEL_MATCH_T;
+
+typedef enum {
+  _MATCH_MISSING_FIELDS = 0,
+  _MATCH_INVALID_TUNNEL_ID = 1,
+  _MATCH_INVALID_CAPABILITIES = 2,
+  _MATCH_INVALID_FIELD = 3,
+} MATCH_ERROR_T;
+
+typedef enum {
+  _TUNNEL_NOT_SUPPORTED = 0,
+} TUNNEL_ERROR_T;
+
+typedef enum {
+  _IPSEC_INVALID_KEY = 0,
+  _IPSEC_NON_SUPPORTED_ENCRYPTION = 1,
+  _IPSEC_NON_SUPPORTED_TUNNEL_TYPE = 2,
+  _IPSEC_MISSING_FIELDS = 3,
+} IPSEC_ERROR_T;
+
+typedef enum {
+  _GENEVE_INVALID_OPTION = 0,
+  _GENEVE_TOO_MANY_OPTIONS = 1,
+  _GENEVE_INVALID_FIELD = 2,
+} GENEVE_ERROR_T;
+
+/** @struct tunnelMacPair_t
+   *  A MacPair, only present when enable is set
+   */
+typedef struct tunnelMacPair_t {
+  bool enable;
+  uint8_t sourceMac[6];
+  uint8_t destinationMac[6];
+} tunnelMacPair_t;
+
+/** @struct tunnelIpPair_t
+   *  An IPV4Pair or IPV6Pair, only present when enable is set
+   */
+typedef struct tunnelIpPair_t {
+  bool enable;
+  IP_VERSION_T ipver;
+  struct in_addr sourceIp;
+  struct in_addr destinationIp;
+  struct in6_addr sourceIpv6;
+  struct in6_addr destinationIpv6;
+} tunnelIpPair_t;
+
+/** @struct tunnelIpMatch_t
+   *  An IPV4Match or IPV6Match, only present when enable is set
+   */
+typedef struct tunnelIpMatch_t {
+  bool enable;
+  IP_VERSION_T ipver;
+  struct in_addr sourceIp;
+  struct in_addr destinationIp;
+  struct in6_addr sourceIpv6;
+  struct in6_addr destinationIpv6;
+  uint8_t sourceIpPrefix;
+  uint8_t destinationIpPrefix;
+} tunnelIpMatch_t;
+
+/** @struct tunnelMatch_t
+   *  The MatchCriteria of a tunnel
+   *
+   *  @var tunnelMatch_t::ingressInterface
+   *    Empty matches untagged traffic
+   *  @var tunnelMatch_t::tunnelId
+   *    Matches the traffic leaving another tunnel, 0 for none
+   *  @var tunnelMatch_t::matchType
+   *    Which of spi and sn, or vni with the inner match fields, apply
+   *  @var tunnelMatch_t::protocolType
+   *    GENEVE only, 0x6558 for Trans Ether Bridging
+   */
+typedef struct tunnelMatch_t {
+  char ingressInterface[TUNNEL_INTERFACE_MAX];
+  tunnelMacPair_t macMatch;
+  tunnelIpMatch_t ipMatch;
+  uint64_t tunnelId;
+  TUNNEL_MATCH_T matchType;
+  uint32_t spi;
+  uint32_t sn;
+  uint32_t vni;
+  tunnelMacPair_t innerMacMatch;
+  uint32_t protocolType;
+  tunnelIpMatch_t innerIpMatch;
+} tunnelMatch_t;
+
+/** @struct ipsecSA_t
+   *  IPSecSAParams, the key is keyLength bytes of binary key material
+   */
+typedef struct ipsecSA_t {
+  uint32_t spi;
+  uint8_t keyLength;
+  uint8_t key[TUNNEL_IPSEC_KEY_MAX];
+  TUNNEL_OPERATION_T operation;
+} ipsecSA_t;
+
+/** @struct ipsecTunnel_t
+   *  IPSecEnc or IPSecDec. Encryption has exactly one SA and may have tunnel
+   *  addresses, decryption has up to TUNNEL_IPSEC_SAS_MAX SAs.
+   */
+typedef struct ipsecTunnel_t {
+  IPSEC_TUNNEL_TYPE_T tunnelType;
+  IPSEC_ENC_TYPE_T encryptionType;
+  int numberSAs;
+  ipsecSA_t sas[TUNNEL_IPSEC_SAS_MAX];
+  tunnelIpPair_t tunnelIps;
+} ipsecTunnel_t;
+
+/** @struct geneveOption_t
+   *  A GENEVEOption, kept at the width of the proto fields so the backend
+   *  can reject values too large for the header: optionClass has 16 bits,
+   *  type 8 bits and length 5 bits, in units of 4 data bytes.
+   */
+typedef struct geneveOption_t {
+  uint32_t optionClass;
+  uint32_t type;
+  uint32_t length;
+  uint8_t dataLength;
+  uint8_t data[TUNNEL_GENEVE_OPTION_DATA_MAX];
+} geneveOption_t;
+
+/** @struct geneveEncap_t
+   *  GENEVEEncap, the fields of RFC 8926
+   */
+typedef struct geneveEncap_t {
+  tunnelIpPair_t outerIps;
+  tunnelMacPair_t innerMacPair;
+  uint32_t optionLength;
+  bool controlPacket;
+  bool criticalOptionPresent;
+  uint32_t vni;
+  uint32_t protocolType;
+  int numberOptions;
+  geneveOption_t options[TUNNEL_GENEVE_OPTIONS_MAX];
+} geneveEncap_t;
+
+/** @struct ipTunnelRequest_t
+   *  One ipTunnelRequest. tunnelType says which of ipsec, geneve and
+   *  natSourceIp hold the tunnel; GENEVE decap has no parameters.
+   */
+typedef struct ipTunnelRequest_t {
+  uint64_t tunnelId;
+  TUNNEL_OPERATION_T operation;
+  tunnelMatch_t match;
+  TUNNEL_ACTION_T nextAction;
+  IP_TUNNEL_TYPE_T tunnelType;
+  ipsecTunnel_t ipsec;
+  geneveEncap_t geneve;
+  uint32_t natSourceIp;
+} ipTunnelRequest_t;
+
+/** @struct tunnelError_t
+   *  The Error of a tunnel, only present when error is set. The codes of
+   *  tunnelAdditionError are all 0 by default, errorString says which one
+   *  applies.
+   */
+typedef struct tunnelError_t {
+  bool error;
+  MATCH_ERROR_T matchError;
+  TUNNEL_ERROR_T tunnelError;
+  IPSEC_ERROR_T ipsecError;
+  GENEVE_ERROR_T geneveError;
+  char errorString[TUNNEL_ERROR_STRING_MAX];
+} tunnelError_t;
+
+typedef struct tunnelCounters_t {
+  uint64_t inPackets;
+  uint64_t outPackets;
+  uint64_t inBytes;
+  uint64_t outBytes;
+  uint64_t inPacketsDrops;
+  uint64_t outPacketsDrops;
+  uint64_t inBytesDrops;
+  uint64_t outBytesDrops;
+} tunnelCounters_t;
+
+typedef struct ipTunnelResponse_t {
+  uint64_t tunnelId;
+  ipTunnelRequest_t ipTunnel;
+  tunnelCounters_t counters;
+  tunnelError_t error;
+} ipTunnelResponse_t;
+
+typedef struct ipTunnelStatsResponse_t {
+  uint64_t tunnelId;
+  tunnelCounters_t counters;
+  tunnelError_t error;
+} ipTunnelStatsResponse_t;
+
+typedef struct createIpTunnelResponse_t {
+  uint64_t tunnelId;
+  tunnelError_t error;
+} createIpTunnelResponse_t;
+
+/** @struct createIpTunnelResponses_t
+   *  The result of one createIpTunnel stream. responses only holds the
+   *  tunnels that failed, errorStatus has bit i set when the i'th tunnel of
+   *  the stream failed.
+   */
+typedef struct createIpTunnelResponses_t {
+  ADD_TUNNEL_STATUS_T requestStatus;
+  uint64_t errorStatus;
+  int numberResponses;
+  createIpTunnelResponse_t responses[TUNNEL_BUFFER_MAX];
+} createIpTunnelResponses_t;
+
+typedef struct tunnelCapabilities_t {
+  bool ingressInterfaceMatching;
+  bool vxlanMatching;
+  bool geneveMatching;
+  bool tunnelMatching;
+  bool spiMatching;
+  int numberTunnelTypes;
+  IPSEC_TUNNEL_TYPE_T tunnelTypeSupported[TUNNEL_IPSEC_TYPES_MAX];
+  int numberEncryptionTypes;
+  IPSEC_ENC_TYPE_T encryptionSupported[TUNNEL_ENC_TYPES_MAX];
+  uint32_t numberGeneveOptionsSupported;
+} tunnelCapabilities_t;
+
+#endif  /* OPOF_TUNNEL_H */
@@ -0,0 +1,61 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+*
+* \class TunnelTableClient
+*
+* \ingroup clientlibrary
+*
+* \brief Internal C++ Client of the ipTunnelService called by the external C Interfaces
+*
+*/
+
+#ifndef __OPOF_TUNNEL_CLIENT_H
+#define __OPOF_TUNNEL_CLIENT_H
+
+
+extern "C" {
+#include "opof.h"
+#include "opof_tunnel.h"
+}
+#include "opof_tunnel_grpc.h"
+
+class TunnelTableClient {
+public:
+	/** \brief Constructor
+	 *
+	 */
+    TunnelTableClient(std::shared_ptr<Channel> channel)
+    : stub_(ipTunnelService::NewStub(channel)) {};
+
+    int getCapabilities(tunnelCapabilities_t *capabilities);
+     /** \brief sends the tunnels to the server in one createIpTunnel stream
+      *
+      * \param size       The number of tunnels, at most TUNNEL_BUFFER_MAX
+      * \param requests   The tunnels to create, update or delete
+      * \param response   Returns the status of the stream and the tunnels that failed
+      * \return int error code
+      */
+    int createTunnels(int size, ipTunnelRequest_t **requests, createIpTunnelResponses_t *response);
+    int getTunnel(uint64_t tunnelId, ipTunnelResponse_t *response);
+    int getTunnelStats(uint64_t tunnelId, ipTunnelStatsResponse_t *response);
+    int getAllTunnels(unsigned int tunnelsPerRequest, ipTunnelResponse_t responses[], int maxTunnels, int *tunnelCount);
+    int getAllTunnelsStats(unsigned int tunnelsPerRequest, ipTunnelStatsResponse_t responses[], int maxTunnels, int *tunnelCount);
+private:
+    std::unique_ptr<ipTunnelService::Stub> stub_;
+};
+
+
+#endif
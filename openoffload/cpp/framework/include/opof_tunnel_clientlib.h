@@ -0,0 +1,50 @@
+// Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+/** \defgroup tunnelclientcinterface C Tunnel Client Interface
+*
+* \brief External C Client Interfaces of the ipTunnelService
+*
+* The tunnel counterpart of opof_clientlib.h. opof_create_tunnelTable
+* returns a handle to a TunnelTableClient, the other functions take it. The
+* functions return the gRPC status code of the call, 0 on success.
+*/
+#ifndef OPOF_TUNNEL_CLIENTLIB_H
+#define OPOF_TUNNEL_CLIENTLIB_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "opof.h"
+#include "opof_tunnel.h"
+
+struct tunnelTable;
+typedef struct tunnelTable tunnelTable_t;
+
+tunnelTable_t *opof_create_tunnelTable(const char *host, unsigned int port, const char *public_key);
+void opof_delete_tunnelTable(tunnelTable_t *tunnelHandle);
+unsigned int opof_get_tunnel_deadline(void);
+unsigned int opof_set_tunnel_deadline(int deadline);
+int opof_get_tunnel_capabilities(tunnelTable_t *tunnelHandle, tunnelCapabilities_t *capabilities);
+int opof_create_tunnels(tunnelTable_t *tunnelHandle, int size, ipTunnelRequest_t **requests, createIpTunnelResponses_t *response);
+int opof_get_tunnel(tunnelTable_t *tunnelHandle, uint64_t tunnelId, ipTunnelResponse_t *response);
+int opof_get_tunnel_stats(tunnelTable_t *tunnelHandle, uint64_t tunnelId, ipTunnelStatsResponse_t *response);
+int opof_get_all_tunnels(tunnelTable_t *tunnelHandle, int tunnelsPerRequest, ipTunnelResponse_t responses[], int maxTunnels, int *tunnelCount);
+int opof_get_all_tunnels_stats(tunnelTable_t *tunnelHandle, int tunnelsPerRequest, ipTunnelStatsResponse_t responses[], int maxTunnels, int *tunnelCount);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_TUNNEL_ENCAP_H
+#define OPOF_TUNNEL_ENCAP_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief Encapsulation header templates of GENEVE and IPsec tunnels
+*
+* opof_tunnel_encap_compile checks a GENEVE encap or IPsec encryption tunnel
+* once, when it is created or updated, and builds the bytes every packet of
+* the tunnel is prefixed with. The GENEVE checks are the ones of
+* tests/basicIPT/tunnels_server.py plus the 252 bytes the header has room
+* for; optionLength and the critical bit are derived from the options.
+*
+* A GENEVE template holds the outer IPv4 or IPv6 header, UDP to port 6081,
+* the GENEVE header and options, and with protocolType 0x6558 the inner
+* Ethernet header. An IPsec template holds the outer IP header in the tunnel
+* modes, UDP 4500 in the NAT traversal modes and the ESP header with room for
+* the IV, using the last SA of the tunnel. The constant part of the IPv4
+* header checksum and of the IPv6 UDP checksum is summed at compile time.
+*
+* opof_tunnel_encap then copies the template in front of an IP packet and
+* patches the lengths, the UDP source port or IPv6 flow label from the flow
+* hash, the inner EtherType and the checksums. For ESP it also patches the
+* sequence number and IV and appends the trailer and zeroed room for the
+* ICV, the encryption itself is left to the caller. In the transport modes
+* the packet keeps its IP header and the template goes after it. The UDP
+* checksum is 0 over IPv4 and for ESP in UDP.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "opof_tunnel.h"
+
+/* IPv6, UDP, GENEVE, 63 words of options and the inner Ethernet header */
+#define OPOF_TUNNEL_ENCAP_HEADER_MAX 322
+/* ESP pads the payload to 4 bytes and adds the pad length, next header and ICV */
+#define OPOF_TUNNEL_ENCAP_TRAILER_MAX (3 + 2 + 16)
+
+/** @struct opof_tunnel_encap_t
+   *  A compiled template. The offsets are into header, udp, esp and
+   *  innerEthernet say which parts are present.
+   */
+typedef struct opof_tunnel_encap_t {
+  uint64_t tunnelId;
+  IP_TUNNEL_TYPE_T tunnelType;
+  IP_VERSION_T ipver;
+  bool transport;
+  bool udp;
+  bool udpChecksum;
+  bool esp;
+  bool innerEthernet;
+  uint8_t protocol;
+  uint8_t ivLength;
+  uint8_t icvLength;
+  uint16_t length;
+  uint16_t udpOffset;
+  uint16_t espOffset;
+  uint16_t etherTypeOffset;
+  uint32_t ipSum;
+  uint32_t udpSum;
+  uint8_t header[OPOF_TUNNEL_ENCAP_HEADER_MAX];
+} opof_tunnel_encap_t;
+
+int opof_tunnel_encap_compile(const ipTunnelRequest_t *request, opof_tunnel_encap_t *encap, tunnelError_t *error);
+int opof_tunnel_encap(const opof_tunnel_encap_t *encap, const uint8_t *packet, size_t length, uint32_t flowHash,
+  uint64_t sequence, uint8_t *out, size_t size, size_t *written);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_TUNNEL_ENCAP_H */
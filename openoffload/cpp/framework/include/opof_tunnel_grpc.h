@@ -0,0 +1,67 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __OPOF_TUNNEL_GRPC_H
+#define __OPOF_TUNNEL_GRPC_H
+
+#include "opof_grpc.h"
+
+#include "tunneloffload.grpc.pb.h"
+#include "tunneloffload.pb.h"
+
+/*
+ * tunneloffload reuses names of openoffload (NAT) and of the C structs
+ * (tunnelId, counters, Error), those are only reached through the typedefs.
+ */
+using tunneloffload::v1alpha1::ipTunnelService;
+using tunneloffload::v1alpha1::CapabilityRequest;
+using tunneloffload::v1alpha1::CapabilityResponse;
+using tunneloffload::v1alpha1::ipTunnelRequest;
+using tunneloffload::v1alpha1::createIpTunnelResponses;
+using tunneloffload::v1alpha1::createIpTunnelResponse;
+using tunneloffload::v1alpha1::ipTunnelResponse;
+using tunneloffload::v1alpha1::ipTunnelResponses;
+using tunneloffload::v1alpha1::ipTunnelStatsResponse;
+using tunneloffload::v1alpha1::ipTunnelStatsResponses;
+using tunneloffload::v1alpha1::tunnelRequestArgs;
+using tunneloffload::v1alpha1::tunnelAdditionError;
+using tunneloffload::v1alpha1::MatchCriteria;
+using tunneloffload::v1alpha1::IPSecTunnel;
+using tunneloffload::v1alpha1::IPSecEnc;
+using tunneloffload::v1alpha1::IPSecDec;
+using tunneloffload::v1alpha1::IPSecSAParams;
+using tunneloffload::v1alpha1::GENEVE;
+using tunneloffload::v1alpha1::GENEVEEncap;
+using tunneloffload::v1alpha1::GENEVEOption;
+using tunneloffload::v1alpha1::MacPair;
+using tunneloffload::v1alpha1::IPV4Pair;
+using tunneloffload::v1alpha1::IPV6Pair;
+using tunneloffload::v1alpha1::IPV4Match;
+using tunneloffload::v1alpha1::IPV6Match;
+using tunneloffload::v1alpha1::ADD_TUNNEL_STATUS;
+using tunneloffload::v1alpha1::OPERATION;
+using tunneloffload::v1alpha1::ACTION;
+using tunneloffload::v1alpha1::ENC_TYPE;
+using tunneloffload::v1alpha1::IPSecTunnelType;
+using tunneloffload::v1alpha1::MatchError;
+using tunneloffload::v1alpha1::TunnelError;
+using tunneloffload::v1alpha1::IPSecError;
+using tunneloffload::v1alpha1::GeneveError;
+
+typedef tunneloffload::v1alpha1::tunnelId tunnelIdRequest;
+typedef tunneloffload::v1alpha1::counters tunnelCounters;
+typedef tunneloffload::v1alpha1::Error tunnelErrorMessage;
+typedef tunneloffload::v1alpha1::NAT tunnelNat;
+
+#endif // __OPOF_TUNNEL_GRPC_H
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_TUNNEL_LPM_H
+#define OPOF_TUNNEL_LPM_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief Longest prefix match index of the tunnel MatchCriteria
+*
+* Resolves the tunnel a packet maps to. Tunnels are indexed by the
+* destination prefix of their ipMatch, in a DIR-24-8 table for IPv4 and in a
+* path compressed tree bitmap with 8 bit strides for IPv6. The IPv4 table
+* allocates its 64MB tbl24 with the first IPv4 prefix.
+*
+* The tunnels sharing a destination prefix are ordered by the length of their
+* source prefix, then by whether they match an SPI or VNI, then by whether
+* they match a tunnelId, then by tunnelId. A lookup returns the first of them
+* that matches the packet on the longest destination prefix, falling back to
+* shorter prefixes when none does, and last to the tunnels without ipMatch.
+* SPI 0 matches any SPI, the VNI of a GENEVE match is always compared. The
+* ingress interface and MAC matches are not part of the index.
+*
+* Adds, updates and removes change the index in place, so they follow the
+* _CREATE, _UPDATE and _DELETE of createIpTunnel. The index does no locking.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "opof_tunnel.h"
+
+/** @struct tunnelFlow_t
+   *  The fields of a packet the index looks at, the outer addresses and the
+   *  tunnel header. tunnelId is the tunnel the packet left, 0 for none.
+   */
+typedef struct tunnelFlow_t {
+  IP_VERSION_T ipver;
+  struct in_addr sourceIp;
+  struct in_addr destinationIp;
+  struct in6_addr sourceIpv6;
+  struct in6_addr destinationIpv6;
+  uint64_t tunnelId;
+  TUNNEL_MATCH_T matchType;
+  uint32_t spi;
+  uint32_t vni;
+} tunnelFlow_t;
+
+typedef struct opof_tunnel_lpm opof_tunnel_lpm_t;
+
+opof_tunnel_lpm_t *opof_tunnel_lpm_create(void);
+void opof_tunnel_lpm_destroy(opof_tunnel_lpm_t *lpm);
+int opof_tunnel_lpm_add(opof_tunnel_lpm_t *lpm, uint64_t tunnelId, const tunnelMatch_t *match);
+int opof_tunnel_lpm_update(opof_tunnel_lpm_t *lpm, uint64_t tunnelId, const tunnelMatch_t *match);
+int opof_tunnel_lpm_remove(opof_tunnel_lpm_t *lpm, uint64_t tunnelId);
+uint64_t opof_tunnel_lpm_lookup(const opof_tunnel_lpm_t *lpm, const tunnelFlow_t *flow);
+unsigned long opof_tunnel_lpm_count(const opof_tunnel_lpm_t *lpm);
+size_t opof_tunnel_lpm_memory(const opof_tunnel_lpm_t *lpm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_TUNNEL_LPM_H */
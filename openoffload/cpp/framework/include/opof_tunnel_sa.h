@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_TUNNEL_SA_H
+#define OPOF_TUNNEL_SA_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief IPsec SA table keyed by SPI, with RCU style readers
+*
+* Holds the SAs of the IPsec tunnels. The decryption SAs are found by SPI
+* in a chained hash table sized at create time, and every tunnel has an
+* active SA set, the SAs its packets may use. Encryption tunnels have one
+* SA and a rekey replaces it, decryption SAs follow the operation of each
+* IPSecSAParams: _DELETE removes the SPI, anything else adds or rekeys it.
+*
+* Updates are make before break: the new SAs are linked into the SPI table
+* first, then the tunnel's new set is published with a single pointer swap,
+* and only then are the old SAs unlinked. Writers serialize on a mutex
+* inside the table, readers take no lock: they register once, then wrap
+* lookups and stats reads in opof_tunnel_sa_read_lock and
+* opof_tunnel_sa_read_unlock. Unlinked SAs and sets are freed once every
+* reader that could still see them has left its read section. A tunnel's
+* stats never go backwards: an SA's counters move to its tunnel when the
+* SA is unlinked, and what readers count on it after that when it is freed.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "opof_tunnel.h"
+
+#define OPOF_TUNNEL_SA_READERS_MAX 64
+
+/** @struct opof_tunnel_sa_t
+   *  An SA as seen by readers. It stays valid until the read section it was
+   *  found in ends, packets and bytes are counted by the datapath.
+   */
+typedef struct opof_tunnel_sa_t {
+  uint32_t spi;
+  uint64_t tunnelId;
+  bool encryption;
+  IPSEC_ENC_TYPE_T encryptionType;
+  uint8_t keyLength;
+  uint8_t key[TUNNEL_IPSEC_KEY_MAX];
+  uint64_t packets;
+  uint64_t bytes;
+} opof_tunnel_sa_t;
+
+typedef struct opof_tunnel_sa_table opof_tunnel_sa_table_t;
+
+opof_tunnel_sa_table_t *opof_tunnel_sa_create(unsigned long capacity);
+void opof_tunnel_sa_destroy(opof_tunnel_sa_table_t *table);
+int opof_tunnel_sa_apply(opof_tunnel_sa_table_t *table, uint64_t tunnelId, const ipsecTunnel_t *ipsec, bool encryption);
+int opof_tunnel_sa_remove(opof_tunnel_sa_table_t *table, uint64_t tunnelId);
+void opof_tunnel_sa_reclaim(opof_tunnel_sa_table_t *table);
+unsigned long opof_tunnel_sa_count(opof_tunnel_sa_table_t *table);
+
+int opof_tunnel_sa_reader_register(opof_tunnel_sa_table_t *table);
+void opof_tunnel_sa_reader_unregister(opof_tunnel_sa_table_t *table, int reader);
+void opof_tunnel_sa_read_lock(opof_tunnel_sa_table_t *table, int reader);
+void opof_tunnel_sa_read_unlock(opof_tunnel_sa_table_t *table, int reader);
+opof_tunnel_sa_t *opof_tunnel_sa_find(opof_tunnel_sa_table_t *table, uint32_t spi);
+opof_tunnel_sa_t *opof_tunnel_sa_active(opof_tunnel_sa_table_t *table, uint64_t tunnelId);
+int opof_tunnel_sa_stats(opof_tunnel_sa_table_t *table, uint64_t tunnelId, uint64_t *packets, uint64_t *bytes);
+
+/* counts a packet on an SA found in the current read section */
+static inline void opof_tunnel_sa_account(opof_tunnel_sa_t *sa, uint32_t bytes){
+  __atomic_add_fetch(&sa->packets, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&sa->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_TUNNEL_SA_H */
@@ -0,0 +1,47 @@
+// Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#ifndef OPOF_TUNNEL_SERVERLIB_H
+#define OPOF_TUNNEL_SERVERLIB_H
+
+/** \defgroup tunnelservercinterface C Tunnel Server Interface
+*
+*
+* \brief The backend hooks of the ipTunnelService, implemented by the offload device
+*
+* The hooks return the status codes of opof.h. A create, update or delete
+* that fails sets the tunnelError_t to tell the client why.
+*/
+#include "opof.h"
+#include "opof_tunnel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int opof_get_tunnel_capabilities_server(tunnelCapabilities_t *capabilities);
+int opof_get_tunnel_table_stats_server(unsigned long *tunnelCount, unsigned long *capacity);
+int opof_create_tunnel_server(ipTunnelRequest_t *request, tunnelError_t *error);
+int opof_update_tunnel_server(ipTunnelRequest_t *request, tunnelError_t *error);
+int opof_delete_tunnel_server(uint64_t tunnelId, tunnelError_t *error);
+int opof_get_tunnel_server(uint64_t tunnelId, ipTunnelResponse_t *response);
+int opof_get_tunnel_stats_server(uint64_t tunnelId, ipTunnelStatsResponse_t *response);
+int opof_get_all_tunnels_server(int pageSize, uint64_t *startTunnel, ipTunnelResponse_t responses[]);
+int opof_get_all_tunnels_stats_server(int pageSize, uint64_t *startTunnel, ipTunnelStatsResponse_t responses[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __OPOF_TUNNEL_SERVICE_H
+#define __OPOF_TUNNEL_SERVICE_H
+
+/**
+* \ingroup serverlibrary
+*
+* \brief The ipTunnelService, calling the hooks of opof_tunnel_serverlib.h
+*
+*/
+extern "C" {
+#include "opof.h"
+#include "opof_tunnel.h"
+}
+#include "opof_tunnel_grpc.h"
+
+class TunnelTableImpl final : public ipTunnelService::Service {
+public:
+    Status Capabilities(ServerContext* context, const CapabilityRequest* request, CapabilityResponse* response) override;
+    Status createIpTunnel(ServerContext* context, ServerReader<ipTunnelRequest>* reader, createIpTunnelResponses* response) override;
+    Status getIpTunnel(ServerContext* context, const tunnelIdRequest* request, ipTunnelResponse* response) override;
+    Status getIpTunnelStats(ServerContext* context, const tunnelIdRequest* request, ipTunnelStatsResponse* response) override;
+    Status getAllIpTunnels(ServerContext* context, const tunnelRequestArgs* request, ServerWriter<ipTunnelResponses>* writer) override;
+    Status getAllIpTunnelsStats(ServerContext* context, const tunnelRequestArgs* request, ServerWriter<ipTunnelStatsResponses>* writer) override;
+};
+
+#endif
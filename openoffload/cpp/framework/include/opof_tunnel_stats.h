@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OPOF_TUNNEL_STATS_H
+#define OPOF_TUNNEL_STATS_H
+
+/**
+* \ingroup servercinterface
+*
+* \brief Per core sharded tunnel counters
+*
+* Every tunnel has a slot, and every shard has its own block of the eight
+* counters of each slot, one cache line per tunnel. The datapath counts on
+* the shard of the core it runs on, so cores do not share the lines they
+* write, and a read sums the slot over all shards. Reads take no lock and
+* do not stop the counting, the sum of a slot read while packets are counted
+* is not a snapshot of one instant.
+*
+* Slots are handed out and back by opof_tunnel_stats_alloc and
+* opof_tunnel_stats_free, which the caller serializes. A new slot starts at
+* zero, and a slot must not be counted on once it is freed.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "opof_tunnel.h"
+
+#define OPOF_TUNNEL_STATS_SHARDS_MAX 256
+
+typedef struct opof_tunnel_stats opof_tunnel_stats_t;
+
+opof_tunnel_stats_t *opof_tunnel_stats_create(unsigned long capacity, int shards);
+void opof_tunnel_stats_destroy(opof_tunnel_stats_t *stats);
+int opof_tunnel_stats_shards(opof_tunnel_stats_t *stats);
+int opof_tunnel_stats_current_shard(opof_tunnel_stats_t *stats);
+long opof_tunnel_stats_alloc(opof_tunnel_stats_t *stats);
+void opof_tunnel_stats_free(opof_tunnel_stats_t *stats, long slot);
+tunnelCounters_t *opof_tunnel_stats_counters(opof_tunnel_stats_t *stats, int shard, long slot);
+void opof_tunnel_stats_read(opof_tunnel_stats_t *stats, long slot, tunnelCounters_t *counters);
+
+/* adds to one counter of a shard, see opof_tunnel_stats_counters */
+static inline void opof_tunnel_stats_add(uint64_t *counter, uint64_t value){
+  __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* OPOF_TUNNEL_STATS_H */
@@ -0,0 +1,39 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPOF_TUNNEL_UTIL_H
+#define OPOF_TUNNEL_UTIL_H
+
+extern "C" {
+#include "opof.h"
+#include "opof_tunnel.h"
+}
+#include "opof_tunnel_grpc.h"
+
+void convertTunnelRequest2cpp(const ipTunnelRequest_t *request_c, ipTunnelRequest *request);
+int convertTunnelRequest2c(const ipTunnelRequest &request, ipTunnelRequest_t *request_c, tunnelError_t *error);
+void convertTunnelCounters2cpp(const tunnelCounters_t *counters_c, tunnelCounters *counters);
+void convertTunnelCounters2c(const tunnelCounters &counters, tunnelCounters_t *counters_c);
+void convertTunnelError2cpp(const tunnelError_t *error_c, tunnelErrorMessage *error);
+void convertTunnelError2c(const tunnelErrorMessage &error, tunnelError_t *error_c);
+void convertTunnelResponse2cpp(const ipTunnelResponse_t *response_c, ipTunnelResponse *response);
+void convertTunnelResponse2c(const ipTunnelResponse &response, ipTunnelResponse_t *response_c);
+void convertTunnelStatsResponse2cpp(const ipTunnelStatsResponse_t *response_c, ipTunnelStatsResponse *response);
+void convertTunnelStatsResponse2c(const ipTunnelStatsResponse &response, ipTunnelStatsResponse_t *response_c);
+void convertCreateTunnelResponses2c(const createIpTunnelResponses &response, createIpTunnelResponses_t *response_c);
+void convertTunnelCapabilities2cpp(const tunnelCapabilities_t *capabilities_c, CapabilityResponse *capabilities);
+void convertTunnelCapabilities2c(const CapabilityResponse &capabilities, tunnelCapabilities_t *capabilities_c);
+void setTunnelError(tunnelError_t *error, const char *errorString);
+
+#endif
@@ -55,4 +55,22 @@ void convertPerLinkActionParams2cpp(
 void convertPerLinkActionParams2c(
   const perLinkActionParameters *params_pb,
   struct perLinkActionParameters_t *params_c);
+void convertSessionFilter2cpp(
+  const struct sessionFilter_t *filter_c,
+  sessionFilter *filter_pb);
+void convertSessionFilter2c(
+  const sessionFilter *filter_pb,
+  struct sessionFilter_t *filter_c);
+void convertAggregateStats2cpp(
+  const struct aggregateStats_t *stats_c,
+  aggregateStats *stats_pb);
+void convertAggregateStats2c(
+  const aggregateStats *stats_pb,
+  struct aggregateStats_t *stats_c);
+void convertRpcStats2c(
+  const rpcStats *stats_pb,
+  struct rpcStats_t *stats_c);
+void convertStageStats2c(
+  const stageStats *stats_pb,
+  struct stageStats_t *stats_c);
 #endif
@@ -0,0 +1,164 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Incrementally maintained aggregate counters for server backends
+*
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "uthash.h"
+#include "opof_aggregate.h"
+
+#define AGGREGATE_GROUP_TYPES (_BY_STATE + 1)
+
+typedef struct aggregate_node {
+  unsigned int key;
+  aggregateStats_t stats;
+  UT_hash_handle hh;
+} aggregate_node_t;
+
+struct opof_aggregate {
+  aggregate_node_t *groups[AGGREGATE_GROUP_TYPES];
+};
+
+static unsigned int group_key(const aggregateSession_t *session, int groupBy){
+  switch (groupBy){
+    case _BY_INLIF:
+      return session->inlif;
+    case _BY_OUTLIF:
+      return session->outlif;
+    case _BY_PROTOCOL:
+      return session->proto;
+    case _BY_ACTION_TYPE:
+      return session->actionType;
+    case _BY_STATE:
+    default:
+      return session->sessionState;
+  }
+}
+
+/*
+* Adds (sign = 1) or subtracts (sign = -1) one session and its counters
+* to the group it belongs to. Groups are freed once their last session
+* is gone so reads only visit groups that have sessions.
+*/
+static void account(opof_aggregate_t *aggregate, const aggregateSession_t *session, int sign){
+  aggregate_node_t *node;
+  unsigned int key;
+
+  for (int g = 0; g < AGGREGATE_GROUP_TYPES; g++){
+    key = group_key(session, g);
+    HASH_FIND_INT(aggregate->groups[g], &key, node);
+    if (node == NULL){
+      if (sign < 0){
+        continue;
+      }
+      node = (aggregate_node_t *)calloc(1, sizeof(*node));
+      if (node == NULL){
+        continue;
+      }
+      node->key = key;
+      node->stats.key = key;
+      HASH_ADD_INT(aggregate->groups[g], key, node);
+    }
+    node->stats.sessions += sign;
+    node->stats.inPackets += sign * session->inPackets;
+    node->stats.outPackets += sign * session->outPackets;
+    node->stats.inBytes += sign * session->inBytes;
+    node->stats.outBytes += sign * session->outBytes;
+    if (node->stats.sessions == 0){
+      HASH_DEL(aggregate->groups[g], node);
+      free(node);
+    }
+  }
+}
+
+opof_aggregate_t *opof_aggregate_create(void){
+  return (opof_aggregate_t *)calloc(1, sizeof(opof_aggregate_t));
+}
+
+void opof_aggregate_reset(opof_aggregate_t *aggregate){
+  aggregate_node_t *node, *tmp;
+
+  for (int g = 0; g < AGGREGATE_GROUP_TYPES; g++){
+    HASH_ITER(hh, aggregate->groups[g], node, tmp){
+      HASH_DEL(aggregate->groups[g], node);
+      free(node);
+    }
+  }
+}
+
+void opof_aggregate_destroy(opof_aggregate_t *aggregate){
+  if (aggregate == NULL){
+    return;
+  }
+  opof_aggregate_reset(aggregate);
+  free(aggregate);
+}
+
+/** \ingroup servercinterface
+* \brief Account for a session inserted in the session table
+*/
+void opof_aggregate_add(opof_aggregate_t *aggregate, const aggregateSession_t *session){
+  account(aggregate, session, 1);
+}
+
+/** \ingroup servercinterface
+* \brief Account for a session deleted or closed from the session table
+*/
+void opof_aggregate_remove(opof_aggregate_t *aggregate, const aggregateSession_t *session){
+  account(aggregate, session, -1);
+}
+
+/** \ingroup servercinterface
+* \brief Account for a counter update or state change of a session
+*
+* \param before   The session as it was last added or updated
+* \param after    The session with the new counters and state
+*/
+void opof_aggregate_update(opof_aggregate_t *aggregate, const aggregateSession_t *before, const aggregateSession_t *after){
+  account(aggregate, before, -1);
+  account(aggregate, after, 1);
+}
+
+/** \ingroup servercinterface
+* \brief Read the totals for one grouping
+*
+* \param aggregate  The aggregate counters
+* \param groupBy    The grouping to return
+* \param stats      Returns one entry per group with sessions
+* \param maxGroups  The size of the stats array
+* \return the number of groups returned
+*/
+int opof_aggregate_get(opof_aggregate_t *aggregate, AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups){
+  aggregate_node_t *node, *tmp;
+  int count = 0;
+
+  if (groupBy < 0 || groupBy >= AGGREGATE_GROUP_TYPES){
+    return 0;
+  }
+  HASH_ITER(hh, aggregate->groups[groupBy], node, tmp){
+    if (count == maxGroups){
+      break;
+    }
+    stats[count++] = node->stats;
+  }
+  return count;
+}
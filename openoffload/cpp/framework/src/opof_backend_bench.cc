@@ -0,0 +1,435 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Load driver for a backend, without gRPC or protobuf
+*
+* opof_bench measures a backend through the whole server. This harness links
+* the backend itself, any implementation of opof_serverlib.h, and calls its
+* session hooks directly, so what it measures is the backend alone. The
+* Makefile links it with the object named by BENCH_BACKEND, opof_server_test.o
+* unless overridden:
+*
+*   make opof_backend_bench BENCH_BACKEND=opof_nos_sim.o
+*
+* Each thread picks calls from a weighted mix of add, get, delete, closed and
+* all like opof_bench does, and records the latency of every call, in a
+* histogram and in a bounded sample for the percentiles. Threads own
+* disjoint session ID ranges and only get or delete sessions they added. The
+* number of live sessions is capped so the run does not fill the table.
+*
+* The backends in this tree, opof_server_test.c included, lock their own
+* tables and run without --lock. A backend that is not thread safe needs it
+* when run with more than one thread. Every call then holds one mutex, as a
+* server serializing its backend would, and the wait for it is part of the
+* latency.
+*
+* Results are printed as JSON: per call the count, calls per second, errors,
+* the mean, p50/p90/p99/p999 and max latency in nanoseconds, and a histogram
+* of the latencies in power of two buckets keyed by their upper bound.
+*/
+extern "C" {
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_error.h"
+#include "opof_serverlib.h"
+#include "opof_test.h"
+#include "opof_test_util.h"
+}
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opof_bench_util.h"
+
+#define BENCH_THREADS_MAX 64
+#define BENCH_HISTOGRAM_BUCKETS 40
+
+struct BenchConfig {
+    int threads;
+    int pageSize;
+    int sessions;
+    double duration;
+    double warmup;
+    bool lock;
+    unsigned int weights[BENCH_OP_COUNT];
+    std::string mix;
+};
+
+struct OpResult {
+    OpResult() : calls(0), sessions(0), errors(0), notFound(0), histogram() {}
+
+    uint64_t calls;
+    uint64_t sessions;
+    uint64_t errors;
+    uint64_t notFound;
+    uint64_t histogram[BENCH_HISTOGRAM_BUCKETS];
+    BenchSamples nanos;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+
+static std::mutex backendMutex;
+
+/*
+* The power of two bucket of a latency: the first whose upper bound is at
+* least the latency, the last takes everything longer.
+*/
+static inline int histogramBucket(uint64_t nanos) {
+  int bucket = nanos > 1 ? 64 - __builtin_clzll(nanos - 1) : 0;
+  return std::min(bucket, BENCH_HISTOGRAM_BUCKETS - 1);
+}
+
+class BackendThread {
+public:
+    BackendThread(const BenchConfig &config, int id)
+    : config_(config), id_(id), nextId_(1), rng_(id + 1) {
+      request_ = createSessionRequest(1, 0);
+      liveCap_ = std::max(1, config.sessions / config.threads);
+      for (int op = 0; op < BENCH_OP_COUNT; op++){
+        totalWeight_ += config.weights[op];
+      }
+      for (int i = 0; i < BUFFER_MAX; i++){
+        pagePointers_[i] = &page_[i];
+      }
+    }
+
+    ~BackendThread() {
+      free(request_[0]);
+      free(request_);
+    }
+
+    void run(BenchClock::time_point measure, BenchClock::time_point stop);
+    void cleanup();
+
+    OpResult ops[BENCH_OP_COUNT];
+
+private:
+    BenchOp pick();
+    int call(BenchOp op, size_t index, int *count);
+    unsigned long newId();
+
+    const BenchConfig &config_;
+    int id_;
+    sessionRequest_t **request_;
+    sessionResponse_t response_;
+    addSessionResponse_t addResponse_;
+    sessionResponse_t page_[BUFFER_MAX];
+    sessionResponse_t *pagePointers_[BUFFER_MAX];
+    std::vector<unsigned long> live_;
+    size_t liveCap_;
+    unsigned long nextId_;
+    unsigned int totalWeight_ = 0;
+    std::mt19937_64 rng_;
+};
+
+unsigned long BackendThread::newId() {
+  return benchNewId(id_, &nextId_);
+}
+
+BenchOp BackendThread::pick() {
+  unsigned int r = rng_() % totalWeight_;
+  int op = 0;
+  while (r >= config_.weights[op]){
+    r -= config_.weights[op];
+    op++;
+  }
+  if (op == BENCH_ADD && live_.size() >= liveCap_){
+    op = BENCH_DELETE;
+  }
+  if ((op == BENCH_GET || op == BENCH_DELETE) && live_.empty()){
+    op = BENCH_ADD;
+  }
+  return (BenchOp)op;
+}
+
+/*
+* The backend call alone, count is set to the sessions returned by closed
+* and all.
+*/
+int BackendThread::call(BenchOp op, size_t index, int *count) {
+  switch (op){
+    case BENCH_ADD:
+      return opof_add_session_server(request_[0], &addResponse_);
+    case BENCH_GET:
+      return opof_get_session_server(live_[index], &response_);
+    case BENCH_DELETE:
+      return opof_del_session_server(live_[index], &response_);
+    case BENCH_CLOSED: {
+      statisticsRequestArgs_t args = {};
+      args.pageSize = config_.pageSize;
+      *count = opof_get_closed_sessions_server(&args, page_);
+      return _OK;
+    }
+    case BENCH_ALL: {
+      uint64_t start = UINT_MAX;
+      *count = opof_get_all_sessions_server(config_.pageSize, &start, 0, pagePointers_);
+      return _OK;
+    }
+    default:
+      return _INTERNAL;
+  }
+}
+
+void BackendThread::run(BenchClock::time_point measure, BenchClock::time_point stop) {
+  for (;;){
+    BenchOp op = pick();
+    size_t index = 0;
+    int count = 0;
+    int status;
+
+    if (op == BENCH_ADD){
+      request_[0]->sessId = newId();
+    } else if (op == BENCH_GET || op == BENCH_DELETE){
+      index = rng_() % live_.size();
+    }
+
+    BenchClock::time_point begin = BenchClock::now();
+    if (config_.lock){
+      std::lock_guard<std::mutex> lock(backendMutex);
+      status = call(op, index, &count);
+    } else {
+      status = call(op, index, &count);
+    }
+    BenchClock::time_point end = BenchClock::now();
+
+    uint64_t sessions = count;
+    if (op == BENCH_ADD && status == _OK){
+      live_.push_back(request_[0]->sessId);
+      sessions = 1;
+    } else if (op == BENCH_GET || op == BENCH_DELETE){
+      sessions = status == _OK ? 1 : 0;
+      /* the backend may have closed and removed the session on its own */
+      if (op == BENCH_DELETE || status == _NOT_FOUND){
+        live_[index] = live_.back();
+        live_.pop_back();
+      }
+    }
+
+    if (end >= stop){
+      break;
+    }
+    if (begin < measure){
+      continue;
+    }
+    OpResult &r = ops[op];
+    r.calls++;
+    r.sessions += sessions;
+    if (status == _NOT_FOUND){
+      r.notFound++;
+    } else if (status != _OK){
+      r.errors++;
+    }
+    uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+    r.histogram[histogramBucket(nanos)]++;
+    r.nanos.add(nanos, rng_);
+  }
+}
+
+void BackendThread::cleanup() {
+  for (unsigned long sessionId : live_){
+    if (config_.lock){
+      std::lock_guard<std::mutex> lock(backendMutex);
+      opof_del_session_server(sessionId, &response_);
+    } else {
+      opof_del_session_server(sessionId, &response_);
+    }
+  }
+  live_.clear();
+}
+
+static void printHistogram(FILE *out, const uint64_t buckets[BENCH_HISTOGRAM_BUCKETS]) {
+  bool first = true;
+  fprintf(out, "\"histogram\": {");
+  for (int bucket = 0; bucket < BENCH_HISTOGRAM_BUCKETS; bucket++){
+    if (buckets[bucket] == 0){
+      continue;
+    }
+    fprintf(out, "%s\"%llu\": %lu", first ? "" : ", ", 1ULL << bucket, (unsigned long)buckets[bucket]);
+    first = false;
+  }
+  fprintf(out, "}");
+}
+
+static void printJson(FILE *out, const BenchConfig &config, const std::vector<BackendThread *> &threads, double elapsed) {
+  fprintf(out, "{\n");
+  fprintf(out, "  \"config\": {\"threads\": %d, \"pageSize\": %d, \"sessions\": %d, "
+    "\"durationSeconds\": %.3f, \"warmupSeconds\": %.3f, \"lock\": %s, \"mix\": \"%s\"},\n",
+    config.threads, config.pageSize, config.sessions, config.duration, config.warmup,
+    config.lock ? "true" : "false", config.mix.c_str());
+  fprintf(out, "  \"elapsedSeconds\": %.3f,\n", elapsed);
+  fprintf(out, "  \"operations\": {");
+  bool first = true;
+  for (int op = 0; op < BENCH_OP_COUNT; op++){
+    OpResult total;
+    BenchPercentiles nanos;
+    for (BackendThread *thread : threads){
+      const OpResult &r = thread->ops[op];
+      total.calls += r.calls;
+      total.sessions += r.sessions;
+      total.errors += r.errors;
+      total.notFound += r.notFound;
+      for (int bucket = 0; bucket < BENCH_HISTOGRAM_BUCKETS; bucket++){
+        total.histogram[bucket] += r.histogram[bucket];
+      }
+      nanos.add(r.nanos);
+    }
+    if (total.calls == 0){
+      continue;
+    }
+    fprintf(out, "%s\n    \"%s\": {\"calls\": %lu, \"sessions\": %lu, \"errors\": %lu, \"notFound\": %lu, "
+      "\"callsPerSecond\": %.1f, \"sessionsPerSecond\": %.1f, \"meanNanos\": %.1f, "
+      "\"p50Nanos\": %lu, \"p90Nanos\": %lu, \"p99Nanos\": %lu, \"p999Nanos\": %lu, \"maxNanos\": %lu, ",
+      first ? "" : ",", benchOpNames[op],
+      (unsigned long)total.calls, (unsigned long)total.sessions,
+      (unsigned long)total.errors, (unsigned long)total.notFound,
+      total.calls / elapsed, total.sessions / elapsed, nanos.mean(),
+      (unsigned long)nanos.percentile(0.5), (unsigned long)nanos.percentile(0.9),
+      (unsigned long)nanos.percentile(0.99), (unsigned long)nanos.percentile(0.999),
+      (unsigned long)nanos.max());
+    printHistogram(out, total.histogram);
+    fprintf(out, "}");
+    first = false;
+  }
+  fprintf(out, "\n  }\n}\n");
+}
+
+static void usage(void) {
+  printf("\nCommand line arguments for the OpenOffload backend benchmark version: %s \n", OPOF_VERSION);
+  printf("\t-t, --threads         Threads calling the backend (default 1)\n");
+  printf("\t-l, --lock            Serialize the backend calls, only for a backend that is not thread safe\n");
+  printf("\t-g, --pagesize        Page size of closed and all (default 64)\n");
+  printf("\t-s, --sessions        Cap on live sessions over all threads (default 500)\n");
+  printf("\t-d, --duration        Measured seconds (default 10)\n");
+  printf("\t-w, --warmup          Unmeasured seconds before the measurement (default 1)\n");
+  printf("\t-x, --mix             Operation weights (default add=4,get=4,delete=2,closed=1,all=0)\n");
+  printf("\t-o, --output          Write the JSON results to this file instead of stdout\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  BenchConfig config;
+  const char *output = NULL;
+  char *str_part;
+  int c;
+
+  config.threads = 1;
+  config.pageSize = BUFFER_MAX;
+  config.sessions = 500;
+  config.duration = 10;
+  config.warmup = 1;
+  config.lock = false;
+  config.mix = "add=4,get=4,delete=2,closed=1,all=0";
+
+  static struct option longopts[] = {
+    {"threads", required_argument, 0, 't'},
+    {"lock", no_argument, 0, 'l'},
+    {"pagesize", required_argument, 0, 'g'},
+    {"sessions", required_argument, 0, 's'},
+    {"duration", required_argument, 0, 'd'},
+    {"warmup", required_argument, 0, 'w'},
+    {"mix", required_argument, 0, 'x'},
+    {"output", required_argument, 0, 'o'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+  while ((c = getopt_long(argc, argv, "t:lg:s:d:w:x:o:h", longopts, NULL)) != -1){
+    switch (c){
+      case 't':
+        config.threads = strtoul(optarg, &str_part, 10);
+        break;
+      case 'l':
+        config.lock = true;
+        break;
+      case 'g':
+        config.pageSize = strtoul(optarg, &str_part, 10);
+        break;
+      case 's':
+        config.sessions = strtoul(optarg, &str_part, 10);
+        break;
+      case 'd':
+        config.duration = strtod(optarg, &str_part);
+        break;
+      case 'w':
+        config.warmup = strtod(optarg, &str_part);
+        break;
+      case 'x':
+        config.mix = optarg;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'h':
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  if (!parseMix(config.mix.c_str(), config.weights)){
+    fprintf(stderr, "Invalid mix: %s\n", config.mix.c_str());
+    exit(1);
+  }
+  if (config.threads < 1 || config.threads > BENCH_THREADS_MAX || config.pageSize < 1 || config.pageSize > BUFFER_MAX){
+    fprintf(stderr, "threads must be 1 to %d, pagesize 1 to %d\n", BENCH_THREADS_MAX, BUFFER_MAX);
+    exit(1);
+  }
+
+  std::vector<BackendThread *> benchThreads;
+  for (int i = 0; i < config.threads; i++){
+    benchThreads.push_back(new BackendThread(config, i));
+  }
+
+  BenchClock::time_point start = BenchClock::now();
+  BenchClock::time_point measure = start + std::chrono::duration_cast<BenchClock::duration>(
+    std::chrono::duration<double>(config.warmup));
+  BenchClock::time_point stop = measure + std::chrono::duration_cast<BenchClock::duration>(
+    std::chrono::duration<double>(config.duration));
+  std::vector<std::thread> threads;
+  for (BackendThread *thread : benchThreads){
+    threads.emplace_back(&BackendThread::run, thread, measure, stop);
+  }
+  for (std::thread &thread : threads){
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(BenchClock::now() - measure).count();
+
+  FILE *out = stdout;
+  if (output != NULL && (out = fopen(output, "w")) == NULL){
+    perror(output);
+    out = stdout;
+  }
+  printJson(out, config, benchThreads, elapsed);
+  if (out != stdout){
+    fclose(out);
+  }
+
+  for (BackendThread *thread : benchThreads){
+    thread->cleanup();
+    delete thread;
+  }
+  return 0;
+}
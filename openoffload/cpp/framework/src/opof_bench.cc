@@ -0,0 +1,595 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Multi-threaded load driver for an offload server
+*
+* Each thread picks operations from a weighted mix of add, get, delete,
+* closed and all, issues them through the C client library and records the
+* wall-clock latency of every call. Threads own disjoint session ID ranges
+* and only get or delete sessions they added, so they never contend on a
+* session. The number of live sessions is capped so the run does not fill
+* the session table; an add that would pass the cap becomes a delete.
+*
+* Results are printed as JSON: the configuration, then per operation the
+* call and session counts, the errors and the p50/p99/p999/max latency in
+* microseconds. The percentiles come from a sample of the calls, see
+* opof_bench_util.h, the maximum from all of them. Calls made during the
+* warmup are not counted. Sessions still live at the end are deleted untimed.
+*
+* By default each thread is a closed loop: it sends the next call when the
+* previous one returns, paced by --rate if given, and a call's latency runs
+* from when it was sent. A server stall then only slows the senders down and
+* hides in the call rate. With --arrival constant or poisson the calls are
+* instead due on a fixed timeline, evenly spaced or with exponential gaps, at
+* --rate calls per second over all threads. A call that falls due while its
+* thread still waits on the previous one is sent as soon as that returns, and
+* its latency runs from when it was due, so every call queued behind a stall
+* pays for it. The service time from the actual send is reported next to it.
+* Each thread has one call in flight, so use enough threads that the rate
+* per thread stays well under one over the normal service time.
+*/
+extern "C" {
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_clientlib.h"
+#include "opof_test.h"
+#include "opof_test_util.h"
+
+unsigned int opof_set_deadline(int deadline);
+}
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opof_bench_util.h"
+
+#define BENCH_THREADS_MAX 64
+
+enum BenchArrival {
+  BENCH_ARRIVAL_CLOSED = 0,
+  BENCH_ARRIVAL_CONSTANT,
+  BENCH_ARRIVAL_POISSON,
+  BENCH_ARRIVAL_COUNT
+};
+
+static const char *arrivalNames[BENCH_ARRIVAL_COUNT] = {"closed", "constant", "poisson"};
+
+struct BenchConfig {
+    std::string address;
+    unsigned short port;
+    int threads;
+    int handles;
+    int batch;
+    int pageSize;
+    int sessions;
+    double duration;
+    double warmup;
+    double rate;
+    int deadline;
+    BenchArrival arrival;
+    unsigned int weights[BENCH_OP_COUNT];
+    std::string mix;
+};
+
+struct OpResult {
+    OpResult() : calls(0), sessions(0), errors(0), notFound(0), maxLagNanos(0) {}
+
+    uint64_t calls;
+    uint64_t sessions;
+    uint64_t errors;
+    uint64_t notFound;
+    uint64_t maxLagNanos;
+    BenchSamples nanos;
+    BenchSamples serviceNanos;
+};
+
+struct ThreadResult {
+    ThreadResult() : unsent(0) {}
+
+    OpResult ops[BENCH_OP_COUNT];
+    uint64_t unsent;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+
+class BenchThread {
+public:
+    BenchThread(const BenchConfig &config, int id, sessionTable_t *handle)
+    : config_(config), id_(id), handle_(handle), nextId_(1), rng_(id + 1) {
+      requests_ = createSessionRequest(config.batch, 0);
+      liveCap_ = std::max(config.batch, config.sessions / config.threads);
+      for (int op = 0; op < BENCH_OP_COUNT; op++){
+        totalWeight_ += config.weights[op];
+      }
+    }
+
+    ~BenchThread() {
+      for (int i = 0; i < config_.batch; i++){
+        free(requests_[i]);
+      }
+      free(requests_);
+    }
+
+    void run(BenchClock::time_point start, BenchClock::time_point measure, BenchClock::time_point stop);
+    void runOpenLoop(BenchClock::time_point start, BenchClock::time_point measure, BenchClock::time_point stop);
+    void cleanup();
+
+    ThreadResult result;
+
+private:
+    BenchOp pick();
+    void issue(BenchOp op, bool record, BenchClock::time_point due);
+    unsigned long newId();
+
+    const BenchConfig &config_;
+    int id_;
+    sessionTable_t *handle_;
+    sessionRequest_t **requests_;
+    std::vector<unsigned long> live_;
+    size_t liveCap_;
+    unsigned long nextId_;
+    unsigned int totalWeight_ = 0;
+    std::mt19937_64 rng_;
+};
+
+unsigned long BenchThread::newId() {
+  return benchNewId(id_, &nextId_);
+}
+
+BenchOp BenchThread::pick() {
+  unsigned int r = rng_() % totalWeight_;
+  int op = 0;
+  while (r >= config_.weights[op]){
+    r -= config_.weights[op];
+    op++;
+  }
+  if (op == BENCH_ADD && live_.size() + config_.batch > liveCap_){
+    op = BENCH_DELETE;
+  }
+  if ((op == BENCH_GET || op == BENCH_DELETE) && live_.empty()){
+    op = BENCH_ADD;
+  }
+  return (BenchOp)op;
+}
+
+/*
+* due is when an open loop call was scheduled, unused in a closed loop.
+*/
+void BenchThread::issue(BenchOp op, bool record, BenchClock::time_point due) {
+  thread_local sessionResponse_t responses[BUFFER_MAX];
+  thread_local sessionResponse_t response;
+  thread_local addSessionResponse_t addResponse;
+  unsigned long sessionCount = 0;
+  uint64_t sessions = 0;
+  size_t index = 0;
+  int status = _OK;
+
+  if (op == BENCH_ADD){
+    for (int i = 0; i < config_.batch; i++){
+      requests_[i]->sessId = newId();
+    }
+  } else if (op == BENCH_GET || op == BENCH_DELETE){
+    index = rng_() % live_.size();
+  }
+
+  BenchClock::time_point begin = BenchClock::now();
+  switch (op){
+    case BENCH_ADD:
+      addResponse.number_errors = 0;
+      status = opof_add_session(config_.batch, handle_, requests_, &addResponse);
+      break;
+    case BENCH_GET:
+      status = opof_get_session(handle_, live_[index], &response);
+      break;
+    case BENCH_DELETE:
+      status = opof_del_session(handle_, live_[index], &response);
+      break;
+    case BENCH_CLOSED: {
+      streamArgs_t args;
+      args.handle = handle_;
+      args.pageSize = config_.pageSize;
+      status = opof_get_closed_sessions(&args, responses, &sessionCount);
+      break;
+    }
+    case BENCH_ALL: {
+      uint64_t start = UINT_MAX;
+      status = opof_get_all_sessions(handle_, &start, config_.pageSize, responses, &sessionCount);
+      break;
+    }
+    default:
+      break;
+  }
+  BenchClock::time_point end = BenchClock::now();
+
+  /* keep the live set in step with the server whether or not the call is recorded */
+  switch (op){
+    case BENCH_ADD:
+      if (status == _OK){
+        for (int i = 0; i < config_.batch; i++){
+          bool rejected = false;
+          for (int e = 0; e < addResponse.number_errors && e < BUFFER_MAX; e++){
+            if (addResponse.sessionErrors[e].sessionId == requests_[i]->sessId){
+              rejected = true;
+              break;
+            }
+          }
+          if (!rejected){
+            live_.push_back(requests_[i]->sessId);
+            sessions++;
+          }
+        }
+      }
+      break;
+    case BENCH_GET:
+    case BENCH_DELETE:
+      if (status == _OK){
+        sessions = 1;
+      }
+      /* the backend may have closed and removed the session on its own */
+      if (op == BENCH_DELETE || status == _NOT_FOUND){
+        live_[index] = live_.back();
+        live_.pop_back();
+      }
+      break;
+    case BENCH_CLOSED:
+      /* an empty poll is answered with NOT_FOUND */
+      if (status == _NOT_FOUND){
+        status = _OK;
+      }
+      sessions = sessionCount;
+      break;
+    case BENCH_ALL:
+      sessions = sessionCount;
+      break;
+    default:
+      break;
+  }
+
+  if (!record){
+    return;
+  }
+  OpResult &r = result.ops[op];
+  r.calls++;
+  r.sessions += sessions;
+  if (status == _NOT_FOUND){
+    r.notFound++;
+  } else if (status != _OK){
+    r.errors++;
+  }
+  if (config_.arrival == BENCH_ARRIVAL_CLOSED){
+    r.nanos.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count(), rng_);
+  } else {
+    uint64_t lag = begin > due ? std::chrono::duration_cast<std::chrono::nanoseconds>(begin - due).count() : 0;
+    r.nanos.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - due).count(), rng_);
+    r.serviceNanos.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count(), rng_);
+    r.maxLagNanos = std::max(r.maxLagNanos, lag);
+  }
+}
+
+void BenchThread::run(BenchClock::time_point start, BenchClock::time_point measure, BenchClock::time_point stop) {
+  std::chrono::nanoseconds interval(0);
+  if (config_.rate > 0){
+    interval = std::chrono::nanoseconds((uint64_t)(1e9 * config_.threads / config_.rate));
+  }
+  BenchClock::time_point next = start;
+
+  for (;;){
+    if (interval.count() > 0){
+      std::this_thread::sleep_until(next);
+      next += interval;
+    }
+    BenchClock::time_point now = BenchClock::now();
+    if (now >= stop){
+      break;
+    }
+    issue(pick(), now >= measure, now);
+  }
+}
+
+void BenchThread::runOpenLoop(BenchClock::time_point start, BenchClock::time_point measure, BenchClock::time_point stop) {
+  double threadRate = config_.rate / config_.threads;
+  std::exponential_distribution<double> gap(threadRate);
+  BenchClock::duration interval = std::chrono::duration_cast<BenchClock::duration>(
+    std::chrono::duration<double>(1.0 / threadRate));
+  /* spread the threads over the first interval so constant arrivals do not come in bursts */
+  BenchClock::time_point due = start + interval * id_ / config_.threads;
+
+  for (;;){
+    if (config_.arrival == BENCH_ARRIVAL_POISSON){
+      due += std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(gap(rng_)));
+    } else {
+      due += interval;
+    }
+    if (due >= stop){
+      break;
+    }
+    BenchClock::time_point now = BenchClock::now();
+    if (now >= stop){
+      /* out of time with calls still due; count them rather than drop them silently */
+      while (due < stop){
+        if (due >= measure){
+          result.unsent++;
+        }
+        due += config_.arrival == BENCH_ARRIVAL_POISSON ?
+          std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(gap(rng_))) : interval;
+      }
+      break;
+    }
+    if (now < due){
+      std::this_thread::sleep_until(due);
+    }
+    issue(pick(), due >= measure, due);
+  }
+}
+
+void BenchThread::cleanup() {
+  sessionResponse_t response;
+  for (unsigned long sessionId : live_){
+    opof_del_session(handle_, sessionId, &response);
+  }
+  live_.clear();
+}
+
+static void printJson(FILE *out, const BenchConfig &config, const std::vector<BenchThread *> &threads, double elapsed) {
+  fprintf(out, "{\n");
+  fprintf(out, "  \"config\": {\"address\": \"%s\", \"port\": %u, \"threads\": %d, \"handles\": %d, "
+    "\"batch\": %d, \"pageSize\": %d, \"sessions\": %d, \"durationSeconds\": %.3f, \"warmupSeconds\": %.3f, "
+    "\"rate\": %.1f, \"arrival\": \"%s\", \"deadlineMsec\": %d, \"mix\": \"%s\"},\n",
+    config.address.c_str(), config.port, config.threads, config.handles,
+    config.batch, config.pageSize, config.sessions, config.duration, config.warmup,
+    config.rate, arrivalNames[config.arrival], config.deadline, config.mix.c_str());
+  fprintf(out, "  \"elapsedSeconds\": %.3f,\n", elapsed);
+  if (config.arrival != BENCH_ARRIVAL_CLOSED){
+    uint64_t unsent = 0;
+    for (BenchThread *thread : threads){
+      unsent += thread->result.unsent;
+    }
+    fprintf(out, "  \"unsentCalls\": %lu,\n", (unsigned long)unsent);
+  }
+  fprintf(out, "  \"operations\": {");
+  bool first = true;
+  for (int op = 0; op < BENCH_OP_COUNT; op++){
+    OpResult total;
+    BenchPercentiles nanos, serviceNanos;
+    for (BenchThread *thread : threads){
+      const OpResult &r = thread->result.ops[op];
+      total.calls += r.calls;
+      total.sessions += r.sessions;
+      total.errors += r.errors;
+      total.notFound += r.notFound;
+      total.maxLagNanos = std::max(total.maxLagNanos, r.maxLagNanos);
+      nanos.add(r.nanos);
+      serviceNanos.add(r.serviceNanos);
+    }
+    if (total.calls == 0){
+      continue;
+    }
+    fprintf(out, "%s\n    \"%s\": {\"calls\": %lu, \"sessions\": %lu, \"errors\": %lu, \"notFound\": %lu, "
+      "\"callsPerSecond\": %.1f, \"sessionsPerSecond\": %.1f, "
+      "\"p50Micros\": %.1f, \"p99Micros\": %.1f, \"p999Micros\": %.1f, \"maxMicros\": %.1f",
+      first ? "" : ",", benchOpNames[op],
+      (unsigned long)total.calls, (unsigned long)total.sessions,
+      (unsigned long)total.errors, (unsigned long)total.notFound,
+      total.calls / elapsed, total.sessions / elapsed,
+      nanos.percentile(0.5) / 1e3, nanos.percentile(0.99) / 1e3,
+      nanos.percentile(0.999) / 1e3, nanos.max() / 1e3);
+    if (config.arrival != BENCH_ARRIVAL_CLOSED){
+      fprintf(out, ", \"serviceP50Micros\": %.1f, \"serviceP99Micros\": %.1f, \"maxLagMicros\": %.1f",
+        serviceNanos.percentile(0.5) / 1e3, serviceNanos.percentile(0.99) / 1e3,
+        total.maxLagNanos / 1e3);
+    }
+    fprintf(out, "}");
+    first = false;
+  }
+  fprintf(out, "\n  }\n}\n");
+}
+
+static void usage(void) {
+  printf("\nCommand line arguments for the OpenOffload benchmark version: %s \n", OPOF_VERSION);
+  printf("\t-a, --address         Address of gRPC Server\n");
+  printf("\t-p, --port            gRPC Port \n");
+  printf("\t-t, --threads         Client threads (default 1)\n");
+  printf("\t-c, --handles         Client handles shared round-robin by the threads (default 1)\n");
+  printf("\t-b, --batch           Sessions per add (default 64)\n");
+  printf("\t-g, --pagesize        Page size of closed and all (default 64)\n");
+  printf("\t-s, --sessions        Cap on live sessions over all threads (default 1000)\n");
+  printf("\t-d, --duration        Measured seconds (default 10)\n");
+  printf("\t-w, --warmup          Unmeasured seconds before the measurement (default 1)\n");
+  printf("\t-r, --rate            Target calls per second over all threads, 0 for as fast as possible\n");
+  printf("\t-A, --arrival         closed (default), or constant or poisson for an open loop at --rate\n");
+  printf("\t-x, --mix             Operation weights (default add=4,get=4,delete=2,closed=1,all=0)\n");
+  printf("\t-D, --deadline        Client deadline in milli seconds (default 100)\n");
+  printf("\t-o, --output          Write the JSON results to this file instead of stdout\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  BenchConfig config;
+  const char *output = NULL;
+  char *str_part;
+  char cert[2048] = "";
+  int c;
+
+  config.address = "localhost";
+  config.port = 3443;
+  config.threads = 1;
+  config.handles = 1;
+  config.batch = BUFFER_MAX;
+  config.pageSize = BUFFER_MAX;
+  config.sessions = 1000;
+  config.duration = 10;
+  config.warmup = 1;
+  config.rate = 0;
+  config.deadline = 100;
+  config.arrival = BENCH_ARRIVAL_CLOSED;
+  config.mix = "add=4,get=4,delete=2,closed=1,all=0";
+
+  static struct option longopts[] = {
+    {"address", required_argument, 0, 'a'},
+    {"port", required_argument, 0, 'p'},
+    {"threads", required_argument, 0, 't'},
+    {"handles", required_argument, 0, 'c'},
+    {"batch", required_argument, 0, 'b'},
+    {"pagesize", required_argument, 0, 'g'},
+    {"sessions", required_argument, 0, 's'},
+    {"duration", required_argument, 0, 'd'},
+    {"warmup", required_argument, 0, 'w'},
+    {"rate", required_argument, 0, 'r'},
+    {"arrival", required_argument, 0, 'A'},
+    {"mix", required_argument, 0, 'x'},
+    {"deadline", required_argument, 0, 'D'},
+    {"output", required_argument, 0, 'o'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+  while ((c = getopt_long(argc, argv, "a:p:t:c:b:g:s:d:w:r:A:x:D:o:h", longopts, NULL)) != -1){
+    switch (c){
+      case 'a':
+        config.address = optarg;
+        break;
+      case 'p':
+        config.port = strtoul(optarg, &str_part, 10);
+        break;
+      case 't':
+        config.threads = strtoul(optarg, &str_part, 10);
+        break;
+      case 'c':
+        config.handles = strtoul(optarg, &str_part, 10);
+        break;
+      case 'b':
+        config.batch = strtoul(optarg, &str_part, 10);
+        break;
+      case 'g':
+        config.pageSize = strtoul(optarg, &str_part, 10);
+        break;
+      case 's':
+        config.sessions = strtoul(optarg, &str_part, 10);
+        break;
+      case 'd':
+        config.duration = strtod(optarg, &str_part);
+        break;
+      case 'w':
+        config.warmup = strtod(optarg, &str_part);
+        break;
+      case 'r':
+        config.rate = strtod(optarg, &str_part);
+        break;
+      case 'A': {
+        int arrival;
+        for (arrival = 0; arrival < BENCH_ARRIVAL_COUNT; arrival++){
+          if (strcmp(optarg, arrivalNames[arrival]) == 0){
+            break;
+          }
+        }
+        if (arrival == BENCH_ARRIVAL_COUNT){
+          fprintf(stderr, "Invalid arrival: %s\n", optarg);
+          exit(1);
+        }
+        config.arrival = (BenchArrival)arrival;
+        break;
+      }
+      case 'x':
+        config.mix = optarg;
+        break;
+      case 'D':
+        config.deadline = strtoul(optarg, &str_part, 10);
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'h':
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  if (!parseMix(config.mix.c_str(), config.weights)){
+    fprintf(stderr, "Invalid mix: %s\n", config.mix.c_str());
+    exit(1);
+  }
+  if (config.threads < 1 || config.threads > BENCH_THREADS_MAX || config.handles < 1 ||
+      config.batch < 1 || config.batch > BUFFER_MAX || config.pageSize < 1 || config.pageSize > BUFFER_MAX){
+    fprintf(stderr, "threads must be 1 to %d, handles at least 1, batch and pagesize 1 to %d\n",
+      BENCH_THREADS_MAX, BUFFER_MAX);
+    exit(1);
+  }
+  if (config.arrival != BENCH_ARRIVAL_CLOSED && config.rate <= 0){
+    fprintf(stderr, "--arrival %s needs a --rate\n", arrivalNames[config.arrival]);
+    exit(1);
+  }
+  opof_set_deadline(config.deadline);
+#ifdef SSL
+  if (get_key(CERT_FILE, cert) != SUCCESS){
+    fprintf(stderr, "Could not read %s\n", CERT_FILE);
+    exit(1);
+  }
+#endif
+
+  std::vector<sessionTable_t *> handles;
+  for (int i = 0; i < config.handles; i++){
+    handles.push_back(opof_create_sessionTable(config.address.c_str(), config.port, cert));
+  }
+  std::vector<BenchThread *> benchThreads;
+  for (int i = 0; i < config.threads; i++){
+    benchThreads.push_back(new BenchThread(config, i, handles[i % config.handles]));
+  }
+
+  BenchClock::time_point start = BenchClock::now();
+  BenchClock::time_point measure = start + std::chrono::duration_cast<BenchClock::duration>(
+    std::chrono::duration<double>(config.warmup));
+  BenchClock::time_point stop = measure + std::chrono::duration_cast<BenchClock::duration>(
+    std::chrono::duration<double>(config.duration));
+  std::vector<std::thread> threads;
+  for (BenchThread *thread : benchThreads){
+    threads.emplace_back(config.arrival == BENCH_ARRIVAL_CLOSED ? &BenchThread::run : &BenchThread::runOpenLoop,
+      thread, start, measure, stop);
+  }
+  for (std::thread &thread : threads){
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(BenchClock::now() - measure).count();
+
+  FILE *out = stdout;
+  if (output != NULL && (out = fopen(output, "w")) == NULL){
+    perror(output);
+    out = stdout;
+  }
+  printJson(out, config, benchThreads, elapsed);
+  if (out != stdout){
+    fclose(out);
+  }
+
+  for (BenchThread *thread : benchThreads){
+    thread->cleanup();
+    delete thread;
+  }
+  for (sessionTable_t *handle : handles){
+    opof_delete_sessionTable(handle);
+  }
+  return 0;
+}
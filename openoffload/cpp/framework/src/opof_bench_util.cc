@@ -0,0 +1,134 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "opof_bench_util.h"
+
+const char *benchOpNames[BENCH_OP_COUNT] = {"add", "get", "delete", "closed", "all"};
+
+/**
+* \ingroup testlibrary
+* \brief Parse "add=4,get=4,delete=2" into weights, operations not named
+*        get 0
+*
+* \return false for an unknown operation or when all weights are 0
+*
+*/
+bool parseMix(const char *mix, unsigned int weights[BENCH_OP_COUNT]) {
+  std::string spec(mix);
+  size_t pos = 0;
+
+  for (int op = 0; op < BENCH_OP_COUNT; op++){
+    weights[op] = 0;
+  }
+  while (pos < spec.size()){
+    size_t end = spec.find(',', pos);
+    if (end == std::string::npos){
+      end = spec.size();
+    }
+    std::string item = spec.substr(pos, end - pos);
+    size_t eq = item.find('=');
+    if (eq == std::string::npos){
+      return false;
+    }
+    int op;
+    for (op = 0; op < BENCH_OP_COUNT; op++){
+      if (item.compare(0, eq, benchOpNames[op]) == 0 && strlen(benchOpNames[op]) == eq){
+        break;
+      }
+    }
+    if (op == BENCH_OP_COUNT){
+      return false;
+    }
+    weights[op] = strtoul(item.c_str() + eq + 1, NULL, 10);
+    pos = end + 1;
+  }
+  unsigned int total = 0;
+  for (int op = 0; op < BENCH_OP_COUNT; op++){
+    total += weights[op];
+  }
+  return total > 0;
+}
+
+/**
+* \ingroup testlibrary
+* \brief The next session ID of a thread's range, the thread is the ID
+*        divided by BENCH_IDS_PER_THREAD. IDs wrap within the range and 0
+*        is never used.
+*
+*/
+unsigned long benchNewId(int thread, unsigned long *nextId) {
+  unsigned long id = (unsigned long)thread * BENCH_IDS_PER_THREAD + *nextId;
+  *nextId = *nextId % (BENCH_IDS_PER_THREAD - 1) + 1;
+  return id;
+}
+
+/*
+* Reservoir sampling: once the sample is full, the n-th value replaces a
+* random one with probability BENCH_SAMPLES_MAX / n.
+*/
+void BenchSamples::add(uint64_t value, std::mt19937_64 &rng) {
+  count_++;
+  sum_ += value;
+  max_ = std::max(max_, value);
+  if (values_.size() < BENCH_SAMPLES_MAX){
+    values_.push_back(value);
+    return;
+  }
+  uint64_t slot = rng() % count_;
+  if (slot < BENCH_SAMPLES_MAX){
+    values_[slot] = value;
+  }
+}
+
+void BenchPercentiles::add(const BenchSamples &samples) {
+  if (samples.count() == 0){
+    return;
+  }
+  double weight = (double)samples.count() / samples.values().size();
+  for (uint64_t value : samples.values()){
+    values_.push_back(std::make_pair(value, weight));
+  }
+  count_ += samples.count();
+  sum_ += samples.sum();
+  max_ = std::max(max_, samples.max());
+  sorted_ = false;
+}
+
+/*
+* The smallest sampled value with more than p of the calls at or below it.
+*/
+uint64_t BenchPercentiles::percentile(double p) {
+  if (values_.empty()){
+    return 0;
+  }
+  if (!sorted_){
+    std::sort(values_.begin(), values_.end());
+    sorted_ = true;
+  }
+  double below = 0;
+  for (const std::pair<uint64_t, double> &value : values_){
+    below += value.second;
+    if (below > p * count_){
+      return value.first;
+    }
+  }
+  return values_.back().first;
+}
@@ -20,6 +20,7 @@
 
 extern "C" {
 #include "opof.h"
+#include "opof_log.h"
 }
 
 #include "opof_grpc.h"
@@ -60,14 +61,14 @@ sessionTable_t * opof_create_sessionTable(const char * host, unsigned int port,
  #ifdef SSL 
   	auto channel_creds = grpc::SslCredentials(grpc::SslCredentialsOptions(sslOpts));
   	//SessionTableClient client(grpc::CreateChannel("localhost:3443", channel_creds));
-  	std::cout << "INFO: Creating Secure Client Connection to: " << address << std::endl;
+  	opof_log_info("Creating Secure Client Connection to: %s", address.c_str());
   	client = new SessionTableClient(grpc::CreateChannel(address, channel_creds));
  #else
-  	std::cout << "INFO: Creating Insecure Client Connection to: " << address << std::endl;
+  	opof_log_info("Creating Insecure Client Connection to: %s", address.c_str());
   	client = new SessionTableClient(grpc::CreateChannel(address, grpc::InsecureChannelCredentials()));
  #endif
   	sessionHandle->obj = client;
-  	std::cout << "INFO: Created SessionTableClient" << std::endl;
+  	opof_log_info("Created SessionTableClient");
   	return sessionHandle;
   	
 }
@@ -225,7 +226,104 @@ int opof_get_all_sessions(sessionTable_t *sessionHandle, uint64_t *startSession,
 	status = client->getAllSessions(pageSize, startSession, sessionCount,responses, sessionCount);
 	return status;
 }
+/**  \ingroup clientcinterface
+* \brief Get a page of the sessions matching a filter from the offload device
+*
+* The opof_get_filtered_sessions interface works like opof_get_all_sessions, but the
+* server only returns the sessions matching the sessionFilter_t predicates. The filter
+* is evaluated by the server while it scans its session table.
+*
+* \param sessionHandle 			 Handle pointing to the C++ instance
+* \param *startSession           The paging cursor, UINT_MAX to start a new scan
+* \param pageSize                The maximum number of sessions to return
+* \param *filter                 The predicates the sessions must match
+* \param responses               Array of at least pageSize sessionResponse_t
+* \param *sessionCount           The number of sessions returned, 0 at the end of the scan
+* \return SUCCESS or FAILURE
+*
+*/
+int opof_get_filtered_sessions(sessionTable_t *sessionHandle, uint64_t *startSession,int pageSize, const sessionFilter_t *filter, sessionResponse_t responses[], unsigned long *sessionCount){
+	SessionTableClient *client;
+
+	client = static_cast<SessionTableClient *>(sessionHandle->obj);
 
+	return client->getAllSessions(pageSize, startSession, sessionCount, responses, sessionCount, filter);
+}
+/**  \ingroup clientcinterface
+* \brief Get the sessions with the largest value of a metric
+*
+* The opof_get_top_sessions interface is a C wrapper on the underlying gRPC C++ code. The server
+* keeps the ranking up to date as session counters change, so the call does not scan the session table.
+*
+* \param sessionHandle 			 Handle pointing to the C++ instance
+* \param metric                  _IN_BYTES, _OUT_BYTES, _PACKETS or _RATE
+* \param count                   The maximum number of sessions, at most TOP_SESSIONS_MAX
+* \param responses               Array of at least count sessionResponse_t, in descending metric order
+* \param *sessionCount           The number of sessions returned
+* \return SUCCESS or FAILURE
+*
+*/
+int opof_get_top_sessions(sessionTable_t *sessionHandle, SESSION_METRIC_T metric, int count, sessionResponse_t responses[], unsigned long *sessionCount){
+	SessionTableClient *client = static_cast<SessionTableClient *>(sessionHandle->obj);
+	return client->getTopSessions(metric, count, responses, sessionCount);
+}
+/**  \ingroup clientcinterface
+* \brief Get session and counter totals per inLif, outLif, protocol, action type or state
+*
+* The opof_get_aggregate_stats interface is a C wrapper on the underlying gRPC C++ code. The
+* server keeps the totals up to date as sessions are added, deleted and updated, so the call
+* costs O(number of groups) and does not scan the session table.
+*
+* \param sessionHandle 			 Handle pointing to the C++ instance
+* \param groupBy                 _BY_INLIF, _BY_OUTLIF, _BY_PROTOCOL, _BY_ACTION_TYPE or _BY_STATE
+* \param stats                   Array of maxGroups aggregateStats_t, in no particular order
+* \param maxGroups               The size of the stats array, at most AGGREGATE_GROUPS_MAX are returned
+* \param *groupCount             The number of groups returned
+* \return SUCCESS or FAILURE
+*
+*/
+int opof_get_aggregate_stats(sessionTable_t *sessionHandle, AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups, int *groupCount){
+	SessionTableClient *client = static_cast<SessionTableClient *>(sessionHandle->obj);
+	return client->getAggregateStats(groupBy, stats, maxGroups, groupCount);
+}
+/**  \ingroup clientcinterface
+* \brief Get the per-RPC counters and latency percentiles of the server
+*
+* The opof_get_server_stats interface is a C wrapper on the underlying gRPC C++ code. The
+* server returns one entry per SessionTable RPC with the calls, errors by gRPC status code,
+* sessions processed and p50/p99/p99.9/max latency since it started.
+*
+* \param sessionHandle 			 Handle pointing to the C++ instance
+* \param stats                   Array of maxRpcs rpcStats_t, RPC_STATS_MAX covers every RPC
+* \param maxRpcs                 The size of the stats array
+* \param *rpcCount               The number of RPCs returned
+* \param *uptimeSeconds          The time since the server started
+* \return SUCCESS or FAILURE
+*
+*/
+int opof_get_server_stats(sessionTable_t *sessionHandle, rpcStats_t stats[], int maxRpcs, int *rpcCount, unsigned long *uptimeSeconds){
+	SessionTableClient *client = static_cast<SessionTableClient *>(sessionHandle->obj);
+	return client->getServerStats(stats, maxRpcs, rpcCount, uptimeSeconds);
+}
+/**  \ingroup clientcinterface
+* \brief Get the time the server spends in each stage of the session handlers
+*
+* The opof_get_stage_stats interface is a C wrapper on the underlying gRPC C++ code. The
+* addSession, getClosedSessions and getAllSessions handlers split their time into stages
+* (read, convert, backend, write...) and the server returns one entry per stage that ran.
+* Nothing is returned when the server runs with stage timers disabled.
+*
+* \param sessionHandle 			 Handle pointing to the C++ instance
+* \param stats                   Array of maxStages stageStats_t, STAGE_STATS_MAX covers every stage
+* \param maxStages               The size of the stats array
+* \param *stageCount             The number of stages returned
+* \return SUCCESS or FAILURE
+*
+*/
+int opof_get_stage_stats(sessionTable_t *sessionHandle, stageStats_t stats[], int maxStages, int *stageCount){
+	SessionTableClient *client = static_cast<SessionTableClient *>(sessionHandle->obj);
+	return client->getStageStats(stats, maxStages, stageCount);
+}
 
 int opof_add_vlan_flow(sessionTable_t *sessionHandle, uint16_t vlan_id, uint16_t vf_index)
 {
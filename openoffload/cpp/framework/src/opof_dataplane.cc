@@ -0,0 +1,1097 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Software reference dataplane backend for opof_serverlib.h
+*
+* Holds the sessions added through opof_add_session_server and executes
+* them on the packets given to opof_dataplane_process, so that offload can be
+* measured end to end without a SmartNIC. Link it instead of
+* opof_server_test.o; opof_dataplane_bench feeds it from pcap files.
+*
+* A session matches packets in two directions. Packets arriving on inLif
+* with vlan_inLif and the session's 5-tuple go out on outLif and count as
+* in; packets arriving on outLif with vlan_outLif and the reversed 5-tuple,
+* as translated by actionParams_outLif, go out on inLif and count as out.
+* The link parameters of the Lif a packet leaves on are applied to it:
+*
+*   - _DROP drops both directions. _FORWARD, _MIRROR and _SNOOP forward,
+*     the copies _MIRROR and _SNOOP send to the host are not modelled.
+*   - snat and dnat overwrite the source and destination address, and the
+*     port when it is not zero. The other direction is not translated back
+*     on its own, the client sets the reverse translation on the other link.
+*   - the next hop, when it has macRewriteEnable, overwrites both MACs and,
+*     for TCP, decrements the TTL or hop limit. Packets whose TTL runs out
+*     are dropped.
+*   - a non-zero vlan overwrites the VLAN ID of a tagged packet.
+*
+* TCP sessions follow the FIN and RST flags of their packets in either
+* direction: the first FIN moves the session to _CLOSING_1, a FIN from the
+* other side to _CLOSING_2, and the ACK after both FINs to _CLOSED with
+* _FINACK; an RST closes it at once with _RST. Sequence numbers are not
+* checked. A session of any protocol with a cacheTimeout closes with
+* _TIMEOUT once the aggregator has seen its counters stand still for that
+* many seconds. Closed sessions keep matching packets until
+* getClosedSessions reports them, which removes them.
+*
+* Each direction of a session has its rewrite compiled by
+* opof_rewrite_compile when the session is added and again when a next hop
+* changes, and the packets a burst forwards are rewritten together by
+* opof_rewrite_burst, which updates the IPv4 header and TCP and UDP
+* checksums incrementally. That also keeps the L4 checksum right when the
+* packet does not hold the whole segment, as with a first fragment or a
+* short capture. GTP-U sessions are kept but never match, the dataplane does
+* not look inside tunnels.
+*
+* Sessions live in an ordered map by ID for paging, and each direction has
+* an entry in an opof_flow_hash_t by opof_flow_key_t, which
+* opof_dataplane_process looks up OPOF_FLOW_HASH_BURST_MAX packets at a time.
+*
+* Packets are processed by workers, each with a mutex that it holds for a
+* burst and its own cache aligned block of counters, four per session slot,
+* so workers running at once share no line they write. Changes to what
+* packets see, the flow hash, the next hops and the compiled rewrites, take
+* tableMutex and then every worker's mutex. Reads of sessions take
+* tableMutex alone. A background thread folds the workers' counters into
+* the sessions every aggregation period, and those folded counters are what
+* get, all, top and aggregate report; a deleted session reports its exact
+* final counters.
+*
+* Settings are read from the environment when the first call comes in:
+*
+*   OPOF_DATAPLANE_CAPACITY        most sessions in the table (1000000)
+*   OPOF_DATAPLANE_WORKERS         workers, up to OPOF_DATAPLANE_WORKERS_MAX
+*                                  (online CPUs)
+*   OPOF_DATAPLANE_AGGREGATE_MSEC  aggregation period (1000)
+*/
+extern "C" {
+#include <arpa/inet.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "opof.h"
+#include "opof_error.h"
+#include "opof_log.h"
+#include "opof_serverlib.h"
+#include "opof_test.h"
+#include "opof_aggregate.h"
+#include "opof_dataplane.h"
+#include "opof_flow_hash.h"
+#include "opof_rewrite.h"
+}
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86dd
+#define IPV4_FRAGMENT_OFFSET 0x1fff
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_RST 0x04
+#define TCP_FLAG_ACK 0x10
+
+/*
+* The close state of a session in one word, changed by compare and swap
+* from any worker: SESSION_STATE_T in bits 0-1, SESSION_CLOSE_T in bits 2-3
+* and a bit per direction that has sent a FIN.
+*/
+#define CLOSE_STATE_MASK 0x03
+#define CLOSE_CODE_SHIFT 2
+#define CLOSE_FIN_IN 0x10
+#define CLOSE_FIN_OUT 0x20
+
+/*
+* The counters are the folded ones, as of the last aggregation, and
+* activeNanos is when the aggregation last saw them move. closeState and
+* endNanos are only accessed atomically. rewrites holds the rewrite of the
+* packets from inLif to outLif and of those from outLif to inLif.
+*/
+struct DataplaneSession {
+    sessionRequest_t request;
+    int64_t startNanos;
+    int64_t activeNanos;
+    int64_t endNanos;
+    uint32_t closeState;
+    uint32_t slot;
+    unsigned long inPackets;
+    unsigned long outPackets;
+    unsigned long inBytes;
+    unsigned long outBytes;
+    opof_rewrite_t rewrites[2];
+};
+
+typedef std::map<unsigned long, DataplaneSession> DataplaneSessionMap;
+
+/*
+* The flow hash value of a direction of a session: the session's address,
+* with the low bit set for the direction from outLif to inLif. Map nodes do
+* not move, so the address holds until the session is removed.
+*/
+#define FLOW_OUT 1ULL
+
+static uint64_t flowValue(DataplaneSession *session, bool out) {
+  return (uint64_t)(uintptr_t)session | (out ? FLOW_OUT : 0);
+}
+
+static DataplaneSession *flowSession(uint64_t value) {
+  return (DataplaneSession *)(uintptr_t)(value & ~FLOW_OUT);
+}
+
+/* where the headers of a parsed packet are, offsets from the start of the frame */
+struct PacketView {
+    uint32_t vlanOffset;
+    uint32_t l3;
+    uint32_t l4;
+    uint32_t l4Length;
+};
+
+/* what one worker has counted for a session slot */
+struct SlotCounters {
+    uint64_t inPackets;
+    uint64_t outPackets;
+    uint64_t inBytes;
+    uint64_t outBytes;
+};
+
+/*
+* Counters only the worker writes, on cache lines no other worker has, and
+* the sessions it closed that getClosedSessions has not collected yet.
+*/
+struct alignas(64) DataplaneWorker {
+    std::mutex mutex;
+    opof_dataplane_stats_t stats;
+    SlotCounters *counters;
+    std::mutex closedMutex;
+    std::vector<unsigned long> closed;
+};
+
+struct DataplaneConfig {
+    unsigned long capacity;
+    unsigned int workers;
+    unsigned int aggregateMsec;
+};
+
+static DataplaneConfig config;
+static std::once_flag started;
+
+static std::mutex tableMutex;
+/* never destroyed, the aggregator may still be folding at exit */
+static DataplaneSessionMap &sessions = *new DataplaneSessionMap();
+static std::vector<uint32_t> freeSlots;
+static std::deque<unsigned long> closedQueue;
+static opof_flow_hash_t *flows;
+static std::map<uint16_t, uint16_t> vlanFlows;
+static std::map<uint32_t, nextHopParameters_t> nextHops;
+static DataplaneWorker workers[OPOF_DATAPLANE_WORKERS_MAX];
+
+/* the caller holds tableMutex, no burst runs while this is in scope */
+struct AllWorkersLock {
+    AllWorkersLock() {
+      for (unsigned int i = 0; i < config.workers; i++){
+        workers[i].mutex.lock();
+      }
+    }
+    ~AllWorkersLock() {
+      for (unsigned int i = config.workers; i > 0; i--){
+        workers[i - 1].mutex.unlock();
+      }
+    }
+};
+
+/* only the owning worker writes a counter, so no locked add is needed */
+static inline void count(uint64_t *counter, uint64_t value) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t load(const uint64_t *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static unsigned long envNumber(const char *name, unsigned long value) {
+  const char *s = getenv(name);
+  return s != NULL && *s != '\0' ? strtoul(s, NULL, 10) : value;
+}
+
+static int64_t nowNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void toTimespec(int64_t nanos, struct timespec *ts) {
+  ts->tv_sec = nanos / 1000000000;
+  ts->tv_nsec = nanos % 1000000000;
+}
+
+static SESSION_STATE_T stateOf(uint32_t closeState) {
+  return (SESSION_STATE_T)(closeState & CLOSE_STATE_MASK);
+}
+
+static SESSION_CLOSE_T closeCodeOf(uint32_t closeState) {
+  return (SESSION_CLOSE_T)(closeState >> CLOSE_CODE_SHIFT & 0x3);
+}
+
+static uint32_t closed(uint32_t closeState, SESSION_CLOSE_T code) {
+  return (closeState & (CLOSE_FIN_IN | CLOSE_FIN_OUT)) | _CLOSED | code << CLOSE_CODE_SHIFT;
+}
+
+/* the state after a TCP packet with flags, out for the outLif to inLif direction */
+static uint32_t nextCloseState(uint32_t closeState, uint8_t flags, bool out) {
+  uint32_t fins = closeState & (CLOSE_FIN_IN | CLOSE_FIN_OUT);
+
+  if (stateOf(closeState) == _CLOSED){
+    return closeState;
+  }
+  if ((flags & TCP_FLAG_RST) != 0){
+    return closed(closeState, _RST);
+  }
+  if ((flags & TCP_FLAG_FIN) != 0){
+    fins |= out ? CLOSE_FIN_OUT : CLOSE_FIN_IN;
+    return fins | (fins == (CLOSE_FIN_IN | CLOSE_FIN_OUT) ? _CLOSING_2 : _CLOSING_1);
+  }
+  if ((flags & (TCP_FLAG_ACK | TCP_FLAG_SYN)) == TCP_FLAG_ACK && stateOf(closeState) == _CLOSING_2){
+    return closed(closeState, _FINACK);
+  }
+  return closeState;
+}
+
+/*
+* Moves the session to next unless another thread changed its state first,
+* and returns whether it did. The caller that closes a session queues it.
+*/
+static bool changeCloseState(DataplaneSession &s, uint32_t expected, uint32_t next, int64_t now) {
+  if (!__atomic_compare_exchange_n(&s.closeState, &expected, next, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    return false;
+  }
+  if (stateOf(next) == _CLOSED){
+    __atomic_store_n(&s.endNanos, now, __ATOMIC_RELAXED);
+  }
+  return true;
+}
+
+/* the caller holds the worker's mutex */
+static void trackTcp(DataplaneWorker &worker, DataplaneSession &s, uint8_t flags, bool out) {
+  uint32_t closeState = __atomic_load_n(&s.closeState, __ATOMIC_RELAXED);
+  uint32_t next;
+
+  while ((next = nextCloseState(closeState, flags, out)) != closeState){
+    if (changeCloseState(s, closeState, next, stateOf(next) == _CLOSED ? nowNanos() : 0)){
+      if (stateOf(next) == _CLOSED){
+        std::lock_guard<std::mutex> lock(worker.closedMutex);
+        worker.closed.push_back(s.request.sessId);
+      }
+      return;
+    }
+    closeState = __atomic_load_n(&s.closeState, __ATOMIC_RELAXED);
+  }
+}
+
+/* the caller holds tableMutex */
+static void foldSession(DataplaneSession &s) {
+  SlotCounters sum = {0, 0, 0, 0};
+
+  for (unsigned int i = 0; i < config.workers; i++){
+    const SlotCounters &c = workers[i].counters[s.slot];
+    sum.inPackets += load(&c.inPackets);
+    sum.outPackets += load(&c.outPackets);
+    sum.inBytes += load(&c.inBytes);
+    sum.outBytes += load(&c.outBytes);
+  }
+  s.inPackets = sum.inPackets;
+  s.outPackets = sum.outPackets;
+  s.inBytes = sum.inBytes;
+  s.outBytes = sum.outBytes;
+}
+
+/* folds every session and closes the ones idle past their cacheTimeout */
+static void foldAll() {
+  std::lock_guard<std::mutex> lock(tableMutex);
+  int64_t now = nowNanos();
+  for (DataplaneSessionMap::iterator it = sessions.begin(); it != sessions.end(); ++it){
+    DataplaneSession &s = it->second;
+    unsigned long packets = s.inPackets + s.outPackets;
+    foldSession(s);
+    if (s.inPackets + s.outPackets != packets){
+      s.activeNanos = now;
+      continue;
+    }
+    uint32_t closeState = __atomic_load_n(&s.closeState, __ATOMIC_RELAXED);
+    if (s.request.cacheTimeout != 0 && stateOf(closeState) != _CLOSED &&
+        now - s.activeNanos >= (int64_t)s.request.cacheTimeout * 1000000000 &&
+        changeCloseState(s, closeState, closed(closeState, _TIMEOUT), now)){
+      closedQueue.push_back(it->first);
+    }
+  }
+}
+
+static void aggregate() {
+  for (;;){
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.aggregateMsec));
+    foldAll();
+  }
+}
+
+static void start() {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  /* two flow hash entries per session, indexed by 32 bits */
+  config.capacity = std::min(envNumber("OPOF_DATAPLANE_CAPACITY", 1000000), (unsigned long)INT32_MAX);
+  config.workers = std::max(1UL, std::min(envNumber("OPOF_DATAPLANE_WORKERS", cpus > 0 ? cpus : 1),
+                                          (unsigned long)OPOF_DATAPLANE_WORKERS_MAX));
+  config.aggregateMsec = std::max(1UL, envNumber("OPOF_DATAPLANE_AGGREGATE_MSEC", 1000));
+  flows = opof_flow_hash_create(config.capacity * 2);
+  if (flows == NULL){
+    opof_log_error("Software dataplane: no memory for %lu flows", config.capacity * 2);
+    exit(1);
+  }
+  /* a slot is zeroed when it is handed out, untouched slots cost no memory */
+  for (unsigned int i = 0; i < config.workers; i++){
+    if (posix_memalign((void **)&workers[i].counters, 64, config.capacity * sizeof(SlotCounters)) != 0){
+      opof_log_error("Software dataplane: no memory for the counters of worker %u", i);
+      exit(1);
+    }
+  }
+  for (unsigned long slot = config.capacity; slot > 0; slot--){
+    freeSlots.push_back((uint32_t)(slot - 1));
+  }
+  std::thread(aggregate).detach();
+  opof_log_info("Software dataplane: capacity %lu, %u workers, aggregate every %u msec",
+    config.capacity, config.workers, config.aggregateMsec);
+}
+
+static void ensureStarted() {
+  std::call_once(started, start);
+}
+
+static uint16_t get16(const uint8_t *p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static bool hasPorts(uint8_t proto) {
+  return proto == _TCP || proto == _UDP;
+}
+
+/*
+* Finds the headers and the match key of a frame. Returns false for what
+* no session can match: frames that are not IP, non-first fragments and TCP
+* or UDP packets too short to hold their ports.
+*/
+static bool parse(const uint8_t *data, uint32_t length, uint32_t lif, opof_flow_key_t *key, PacketView *view) {
+  uint32_t offset = 14;
+  uint32_t end;
+  uint16_t type;
+
+  memset(key, 0, sizeof(*key));
+  key->lif = lif;
+  view->vlanOffset = 0;
+  if (length < offset){
+    return false;
+  }
+  type = get16(data + 12);
+  if (type == ETHERTYPE_VLAN){
+    if (length < offset + 4){
+      return false;
+    }
+    view->vlanOffset = offset;
+    key->vlan = get16(data + offset) & 0x0fff;
+    type = get16(data + offset + 2);
+    offset += 4;
+  }
+  view->l3 = offset;
+  if (type == ETHERTYPE_IPV4){
+    const uint8_t *ip = data + offset;
+    if (length < offset + 20 || (ip[0] >> 4) != 4){
+      return false;
+    }
+    uint32_t headerLength = (ip[0] & 0x0f) * 4;
+    uint32_t totalLength = get16(ip + 2);
+    uint16_t fragment = get16(ip + 6);
+    if (headerLength < 20 || totalLength < headerLength || length < offset + headerLength){
+      return false;
+    }
+    key->ipver = _IPV4;
+    key->proto = ip[9];
+    memcpy(key->src, ip + 12, 4);
+    memcpy(key->dst, ip + 16, 4);
+    if ((fragment & IPV4_FRAGMENT_OFFSET) != 0 && hasPorts(key->proto)){
+      return false;
+    }
+    view->l4 = offset + headerLength;
+    end = offset + totalLength;
+  } else if (type == ETHERTYPE_IPV6){
+    const uint8_t *ip = data + offset;
+    if (length < offset + 40 || (ip[0] >> 4) != 6){
+      return false;
+    }
+    key->ipver = _IPV6;
+    key->proto = ip[6];
+    memcpy(key->src, ip + 8, 16);
+    memcpy(key->dst, ip + 24, 16);
+    view->l4 = offset + 40;
+    end = view->l4 + get16(ip + 4);
+  } else {
+    return false;
+  }
+  view->l4Length = std::min(end, length) - view->l4;
+  if (hasPorts(key->proto)){
+    if (view->l4Length < (key->proto == _TCP ? 20U : 8U)){
+      return false;
+    }
+    key->srcPort = get16(data + view->l4);
+    key->dstPort = get16(data + view->l4 + 2);
+  }
+  return true;
+}
+
+static void natAddress(uint8_t *address, const nat_t &nat, uint8_t ipver) {
+  if (ipver == _IPV4){
+    memcpy(address, &nat.ipv4.s_addr, 4);
+  } else {
+    memcpy(address, nat.ipv6.s6_addr, 16);
+  }
+}
+
+/* the key of the replies arriving on outLif, after the outLif translation */
+static void outKey(const sessionRequest_t &r, opof_flow_key_t *key) {
+  const perLinkActionParameters_t &link = r.actionParams.actionParams_outLif;
+  opof_flow_key_t in;
+
+  opof_flow_key_from_request(&r, &in);
+  *key = in;
+  key->lif = r.outlif;
+  key->vlan = r.vlan_outLif;
+  memcpy(key->src, in.dst, 16);
+  memcpy(key->dst, in.src, 16);
+  key->srcPort = in.dstPort;
+  key->dstPort = in.srcPort;
+  if (link.dnatEnable && link.dnat.ipver == r.ipver){
+    memset(key->src, 0, 16);
+    natAddress(key->src, link.dnat, r.ipver);
+    if (link.dnat.port != 0 && hasPorts(r.proto)){
+      key->srcPort = link.dnat.port;
+    }
+  }
+  if (link.snatEnable && link.snat.ipver == r.ipver){
+    memset(key->dst, 0, 16);
+    natAddress(key->dst, link.snat, r.ipver);
+    if (link.snat.port != 0 && hasPorts(r.proto)){
+      key->dstPort = link.snat.port;
+    }
+  }
+}
+
+static void compileRewrite(const opof_flow_key_t &key, const perLinkActionParameters_t &link, opof_rewrite_t *rewrite) {
+  std::map<uint32_t, nextHopParameters_t>::const_iterator hop = nextHops.find(link.nextHopId);
+  opof_rewrite_compile(&key, &link, hop != nextHops.end() ? &hop->second : NULL, rewrite);
+}
+
+/*
+* Each direction is rewritten by the link parameters of the Lif it leaves
+* on. The caller holds tableMutex, and every worker's mutex once the
+* session is in the flow hash.
+*/
+static void compileRewrites(DataplaneSession &s) {
+  const actionParameters_t &action = s.request.actionParams;
+  opof_flow_key_t key;
+
+  opof_flow_key_from_request(&s.request, &key);
+  compileRewrite(key, action.actionParams_outLif, &s.rewrites[0]);
+  outKey(s.request, &key);
+  compileRewrite(key, action.actionParams_inLif, &s.rewrites[1]);
+}
+
+/* of the sessions using nextHopId, or of all; the caller holds tableMutex and every worker's mutex */
+static void recompileRewrites(bool all, uint32_t nextHopId) {
+  for (DataplaneSessionMap::iterator it = sessions.begin(); it != sessions.end(); ++it){
+    const actionParameters_t &action = it->second.request.actionParams;
+    if (all || action.actionParams_inLif.nextHopId == nextHopId || action.actionParams_outLif.nextHopId == nextHopId){
+      compileRewrites(it->second);
+    }
+  }
+}
+
+static void fillResponse(unsigned long sessionId, const DataplaneSession &s, sessionResponse_t *response) {
+  memset(response, 0, sizeof(*response));
+  response->sessionId = sessionId;
+  response->inPackets = s.inPackets;
+  response->outPackets = s.outPackets;
+  response->inBytes = s.inBytes;
+  response->outBytes = s.outBytes;
+  uint32_t closeState = __atomic_load_n(&s.closeState, __ATOMIC_RELAXED);
+  response->sessionState = stateOf(closeState);
+  response->sessionCloseCode = closeCodeOf(closeState);
+  response->requestStatus = _ACCEPTED;
+  toTimespec(s.startNanos, &response->startTime);
+  if (response->sessionState == _CLOSED){
+    toTimespec(__atomic_load_n(&s.endNanos, __ATOMIC_RELAXED), &response->endTime);
+  }
+}
+
+static void describe(const DataplaneSession &s, aggregateSession_t *a) {
+  memset(a, 0, sizeof(*a));
+  a->inlif = s.request.inlif;
+  a->outlif = s.request.outlif;
+  a->proto = s.request.proto;
+  a->actionType = s.request.actionParams.actionType;
+  a->sessionState = stateOf(__atomic_load_n(&s.closeState, __ATOMIC_RELAXED));
+  a->inPackets = s.inPackets;
+  a->outPackets = s.outPackets;
+  a->inBytes = s.inBytes;
+  a->outBytes = s.outBytes;
+}
+
+/* drops the entry of key when it is the session's own */
+static void unindex(const opof_flow_key_t &key, DataplaneSession *session) {
+  uint64_t value;
+  if (opof_flow_hash_lookup(flows, &key, &value) == _OK && flowSession(value) == session){
+    opof_flow_hash_del(flows, &key);
+  }
+}
+
+/* the caller holds tableMutex and every worker's mutex */
+static void removeSession(DataplaneSessionMap::iterator it) {
+  opof_flow_key_t key;
+
+  opof_flow_key_from_request(&it->second.request, &key);
+  unindex(key, &it->second);
+  outKey(it->second.request, &key);
+  unindex(key, &it->second);
+  freeSlots.push_back(it->second.slot);
+  sessions.erase(it);
+}
+
+static bool matchFilter(const DataplaneSession &s, const sessionFilter_t *filter) {
+  const sessionRequest_t &r = s.request;
+
+  if (filter->sessionStateEnable && filter->sessionState != stateOf(__atomic_load_n(&s.closeState, __ATOMIC_RELAXED))){
+    return false;
+  }
+  if (filter->protoEnable && r.proto != filter->proto){
+    return false;
+  }
+  if (filter->inlifEnable && r.inlif != filter->inlif){
+    return false;
+  }
+  if (filter->outlifEnable && r.outlif != filter->outlif){
+    return false;
+  }
+  if (filter->ipverEnable && r.ipver != filter->ipver){
+    return false;
+  }
+  if (filter->actionTypeEnable && r.actionParams.actionType != filter->actionType){
+    return false;
+  }
+  if (filter->nextHopIdEnable && r.actionParams.actionParams_inLif.nextHopId != filter->nextHopId &&
+      r.actionParams.actionParams_outLif.nextHopId != filter->nextHopId){
+    return false;
+  }
+  if (s.inBytes + s.outBytes < filter->minBytes){
+    return false;
+  }
+  if (s.inPackets + s.outPackets < filter->minPackets){
+    return false;
+  }
+  return true;
+}
+
+static int pageSessions(int pageSize, uint64_t *startSession, const sessionFilter_t *filter, sessionResponse_t **responses) {
+  int n = 0;
+
+  std::lock_guard<std::mutex> lock(tableMutex);
+  DataplaneSessionMap::iterator it = *startSession == UINT_MAX ? sessions.begin() : sessions.upper_bound(*startSession);
+  for (; it != sessions.end() && n < pageSize; ++it){
+    *startSession = it->first;
+    if (filter != NULL && !matchFilter(it->second, filter)){
+      continue;
+    }
+    fillResponse(it->first, it->second, responses[n++]);
+  }
+  return n;
+}
+
+static uint64_t metricOf(const DataplaneSession &s, SESSION_METRIC_T metric, int64_t now) {
+  switch (metric){
+    case _IN_BYTES:
+      return s.inBytes;
+    case _OUT_BYTES:
+      return s.outBytes;
+    case _PACKETS:
+      return s.inPackets + s.outPackets;
+    default:
+      return (s.inBytes + s.outBytes) / std::max<int64_t>((now - s.startNanos) / 1000000000, 1);
+  }
+}
+
+/*
+* Counts a packet and sets its verdict, value is 0 for a packet that matched
+* nothing. Returns the rewrite of a packet to forward, which
+* forwardRewritten applies, and NULL for the rest. The caller holds the
+* worker's mutex.
+*/
+static const opof_rewrite_t *processPacket(DataplaneWorker &worker, opof_packet_t &p, const opof_flow_key_t &key,
+                                           const PacketView &view, uint64_t value) {
+  opof_dataplane_stats_t &stats = worker.stats;
+
+  p.verdict = OPOF_PACKET_MISS;
+  p.sessionId = 0;
+  p.outLif = 0;
+  count(&stats.packets, 1);
+  if (value == 0){
+    count(&stats.missed, 1);
+    return NULL;
+  }
+  DataplaneSession &s = *flowSession(value);
+  const actionParameters_t &action = s.request.actionParams;
+  SlotCounters &counters = worker.counters[s.slot];
+  bool out = (value & FLOW_OUT) != 0;
+  p.sessionId = s.request.sessId;
+  if (out){
+    count(&counters.outPackets, 1);
+    count(&counters.outBytes, p.length);
+  } else {
+    count(&counters.inPackets, 1);
+    count(&counters.inBytes, p.length);
+  }
+  /* parse left at least a whole TCP header */
+  if (key.proto == _TCP){
+    trackTcp(worker, s, p.data[view.l4 + 13], out);
+  }
+  if (action.actionType == _DROP){
+    p.verdict = OPOF_PACKET_DROP;
+    count(&stats.dropped, 1);
+    return NULL;
+  }
+  p.verdict = OPOF_PACKET_FORWARD;
+  p.outLif = out ? s.request.inlif : s.request.outlif;
+  return &s.rewrites[out ? 1 : 0];
+}
+
+/* rewrites the packets processPacket forwards, dropping those whose TTL ran out */
+static void forwardRewritten(DataplaneWorker &worker, opof_packet_t packets[], const opof_rewrite_packet_t burst[],
+                             const int indexes[], int n) {
+  opof_dataplane_stats_t &stats = worker.stats;
+  uint64_t rewritten = opof_rewrite_burst(burst, n);
+
+  for (int i = 0; i < n; i++){
+    opof_packet_t &p = packets[indexes[i]];
+    if ((rewritten >> i & 1) != 0){
+      count(&stats.forwarded, 1);
+      continue;
+    }
+    p.verdict = OPOF_PACKET_DROP;
+    p.outLif = 0;
+    count(&stats.dropped, 1);
+    count(&stats.ttlExpired, 1);
+  }
+}
+
+extern "C" {
+  /**
+  * \ingroup servercinterface
+  * \brief finds the match key of a frame, as opof_dataplane_process would
+  *
+  * \param  data    The Ethernet frame
+  * \param  length  Its length
+  * \param  lif     The Lif it arrives on
+  * \param  key     The key
+  * \return _OK, or _INVALID_ARGUMENT when no session could match the frame
+  *
+  */
+  int opof_dataplane_flow_key(const uint8_t *data, uint32_t length, uint32_t lif, opof_flow_key_t *key){
+    PacketView view;
+    return parse(data, length, lif, key, &view) ? _OK : _INVALID_ARGUMENT;
+  }
+
+  /**
+  * \ingroup servercinterface
+  * \brief runs a burst of packets through the sessions
+  *
+  * Sets the verdict of every packet, and the Lif it leaves on and its
+  * session when it is forwarded. Forwarded packets are rewritten in place
+  * and never grow or shrink. Bursts of different workers run at once, a
+  * worker's bursts one after the other.
+  *
+  * \param  worker   The worker, taken modulo opof_dataplane_workers
+  * \param  packets  The packets
+  * \param  count    How many
+  *
+  */
+  void opof_dataplane_process(unsigned int worker, opof_packet_t packets[], int count){
+    static_assert(OPOF_REWRITE_BURST_MAX >= OPOF_FLOW_HASH_BURST_MAX, "a lookup burst must fit a rewrite burst");
+    opof_flow_key_t keys[OPOF_FLOW_HASH_BURST_MAX];
+    PacketView views[OPOF_FLOW_HASH_BURST_MAX];
+    uint64_t values[OPOF_FLOW_HASH_BURST_MAX];
+    opof_rewrite_packet_t rewrites[OPOF_FLOW_HASH_BURST_MAX];
+    int indexes[OPOF_FLOW_HASH_BURST_MAX];
+
+    ensureStarted();
+    DataplaneWorker &w = workers[worker % config.workers];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    for (int base = 0; base < count; base += OPOF_FLOW_HASH_BURST_MAX){
+      int n = std::min(count - base, OPOF_FLOW_HASH_BURST_MAX);
+      uint64_t parsed = 0;
+      for (int i = 0; i < n; i++){
+        if (parse(packets[base + i].data, packets[base + i].length, packets[base + i].lif, &keys[i], &views[i])){
+          parsed |= 1ULL << i;
+        }
+      }
+      uint64_t hits = opof_flow_hash_lookup_burst(flows, keys, n, values) & parsed;
+      int forwarded = 0;
+      for (int i = 0; i < n; i++){
+        opof_packet_t &p = packets[base + i];
+        const opof_rewrite_t *rewrite = processPacket(w, p, keys[i], views[i], (hits >> i & 1) != 0 ? values[i] : 0);
+        if (rewrite != NULL){
+          opof_rewrite_packet_t &r = rewrites[forwarded];
+          r.data = p.data;
+          r.rewrite = rewrite;
+          r.vlanOffset = (uint16_t)views[i].vlanOffset;
+          r.l3 = (uint16_t)views[i].l3;
+          r.l4 = (uint16_t)views[i].l4;
+          indexes[forwarded++] = base + i;
+        }
+      }
+      forwardRewritten(w, packets, rewrites, indexes, forwarded);
+    }
+  }
+
+  unsigned int opof_dataplane_workers(void){
+    ensureStarted();
+    return config.workers;
+  }
+
+  /** \ingroup servercinterface
+  * \brief folds the workers' counters into the sessions now
+  *
+  * Session reads report the counters as of the last aggregation, which the
+  * background thread runs every OPOF_DATAPLANE_AGGREGATE_MSEC. Counting
+  * goes on while the counters are folded.
+  *
+  */
+  void opof_dataplane_aggregate(void){
+    ensureStarted();
+    foldAll();
+  }
+
+  /* sums the workers' stats, which keep counting meanwhile */
+  void opof_dataplane_get_stats(opof_dataplane_stats_t *result){
+    ensureStarted();
+    memset(result, 0, sizeof(*result));
+    for (unsigned int i = 0; i < config.workers; i++){
+      const opof_dataplane_stats_t &stats = workers[i].stats;
+      result->packets += load(&stats.packets);
+      result->forwarded += load(&stats.forwarded);
+      result->dropped += load(&stats.dropped);
+      result->missed += load(&stats.missed);
+      result->ttlExpired += load(&stats.ttlExpired);
+    }
+  }
+
+  int opof_get_version(
+      char * vendor,    size_t vendorMaxLength,
+      char * name,      size_t nameMaxLength,
+      char * version,   size_t versionMaxLength,
+      char * copyright, size_t copyrightMaxLength){
+    snprintf(vendor, vendorMaxLength, "OpenOffload");
+    snprintf(name, nameMaxLength, "Software reference dataplane");
+    snprintf(version, versionMaxLength, "%s", OPOF_VERSION);
+    snprintf(copyright, copyrightMaxLength, "Apache License 2.0");
+    return _OK;
+  }
+
+  int opof_reset_server(void){
+    ensureStarted();
+    std::lock_guard<std::mutex> lock(tableMutex);
+    AllWorkersLock workersLock;
+    while (!sessions.empty()){
+      removeSession(sessions.begin());
+    }
+    closedQueue.clear();
+    for (unsigned int i = 0; i < config.workers; i++){
+      std::lock_guard<std::mutex> closedLock(workers[i].closedMutex);
+      workers[i].closed.clear();
+    }
+    vlanFlows.clear();
+    nextHops.clear();
+    for (unsigned int i = 0; i < config.workers; i++){
+      memset(&workers[i].stats, 0, sizeof(workers[i].stats));
+    }
+    return _OK;
+  }
+
+  /** \ingroup servercinterface
+  * \brief adds a session and the match entries of both its directions
+  *
+  * A direction whose match another session already has stays with that
+  * session, the new one is kept but sees no packets in that direction. The
+  * test clients add many sessions with one 5-tuple.
+  *
+  * \param *parameters  The session to add
+  * \param *response    Unused, errors are returned
+  * \return _OK, _ALREADY_EXISTS when the ID is taken, _INVALID_ARGUMENT for
+  *         an unknown IP version or _RESOURCE_EXHAUSTED when the table is at
+  *         capacity
+  *
+  */
+  int opof_add_session_server(sessionRequest_t *parameters, addSessionResponse_t *response){
+    ensureStarted();
+    opof_flow_key_t in, out;
+
+    if (parameters->ipver != _IPV4 && parameters->ipver != _IPV6){
+      return _INVALID_ARGUMENT;
+    }
+    opof_flow_key_from_request(parameters, &in);
+    outKey(*parameters, &out);
+    std::lock_guard<std::mutex> lock(tableMutex);
+    if (freeSlots.empty()){
+      return _RESOURCE_EXHAUSTED;
+    }
+    if (sessions.count(parameters->sessId) != 0){
+      return _ALREADY_EXISTS;
+    }
+    DataplaneSession &s = sessions[parameters->sessId];
+    memset(&s, 0, sizeof(s));
+    s.request = *parameters;
+    s.startNanos = nowNanos();
+    s.activeNanos = s.startNanos;
+    s.slot = freeSlots.back();
+    freeSlots.pop_back();
+    compileRewrites(s);
+    /* no worker counts on a free slot, and the mutexes below publish the zeros */
+    for (unsigned int i = 0; i < config.workers; i++){
+      memset(&workers[i].counters[s.slot], 0, sizeof(SlotCounters));
+    }
+    AllWorkersLock workersLock;
+    if (parameters->encapType == _NONE &&
+        (opof_flow_hash_add(flows, &in, flowValue(&s, false)) == _RESOURCE_EXHAUSTED ||
+         opof_flow_hash_add(flows, &out, flowValue(&s, true)) == _RESOURCE_EXHAUSTED)){
+      removeSession(sessions.find(parameters->sessId));
+      return _RESOURCE_EXHAUSTED;
+    }
+    return _OK;
+  }
+
+  int opof_get_session_server(unsigned long sessionId, sessionResponse_t *response){
+    ensureStarted();
+    std::lock_guard<std::mutex> lock(tableMutex);
+    DataplaneSessionMap::iterator it = sessions.find(sessionId);
+    if (it == sessions.end()){
+      return _NOT_FOUND;
+    }
+    fillResponse(sessionId, it->second, response);
+    return _OK;
+  }
+
+  int opof_del_session_server(unsigned long sessionId, sessionResponse_t *response){
+    ensureStarted();
+    std::lock_guard<std::mutex> lock(tableMutex);
+    DataplaneSessionMap::iterator it = sessions.find(sessionId);
+    if (it == sessions.end()){
+      return _NOT_FOUND;
+    }
+    AllWorkersLock workersLock;
+    foldSession(it->second);
+    fillResponse(sessionId, it->second, response);
+    if (response->sessionState != _CLOSED){
+      response->sessionState = _CLOSED;
+      toTimespec(nowNanos(), &response->endTime);
+    }
+    removeSession(it);
+    return _OK;
+  }
+
+  /** \ingroup servercinterface
+  * \brief reports closed sessions and removes them from the table
+  *
+  * Sessions are reported in about the order they closed, those the workers
+  * closed since the last call after the ones already queued.
+  *
+  */
+  int opof_get_closed_sessions_server(statisticsRequestArgs_t *request, sessionResponse_t responses[]){
+    ensureStarted();
+    int size = std::min((int)request->pageSize, BUFFER_MAX);
+    int n = 0;
+
+    std::lock_guard<std::mutex> lock(tableMutex);
+    for (unsigned int i = 0; i < config.workers; i++){
+      std::lock_guard<std::mutex> closedLock(workers[i].closedMutex);
+      closedQueue.insert(closedQueue.end(), workers[i].closed.begin(), workers[i].closed.end());
+      workers[i].closed.clear();
+    }
+    if (closedQueue.empty()){
+      return 0;
+    }
+    AllWorkersLock workersLock;
+    while (n < size && !closedQueue.empty()){
+      unsigned long sessionId = closedQueue.front();
+      closedQueue.pop_front();
+      DataplaneSessionMap::iterator it = sessions.find(sessionId);
+      /* deleted, or deleted and added again, since it closed */
+      if (it == sessions.end() || stateOf(__atomic_load_n(&it->second.closeState, __ATOMIC_RELAXED)) != _CLOSED){
+        continue;
+      }
+      foldSession(it->second);
+      fillResponse(sessionId, it->second, &responses[n++]);
+      removeSession(it);
+    }
+    return n;
+  }
+
+  int opof_get_all_sessions_server(int pageSize, uint64_t *startSession, int pageCount, sessionResponse_t **responses){
+    ensureStarted();
+    return pageSessions(pageSize, startSession, NULL, responses);
+  }
+
+  int opof_get_filtered_sessions_server(int pageSize, uint64_t *startSession, const sessionFilter_t *filter, sessionResponse_t **responses){
+    ensureStarted();
+    return pageSessions(pageSize, startSession, filter, responses);
+  }
+
+  /** \ingroup servercinterface
+  * \brief ranks every session by the metric, with the counters of the last aggregation
+  *
+  */
+  int opof_get_top_sessions_server(SESSION_METRIC_T metric, int count, sessionResponse_t responses[]){
+    ensureStarted();
+    if (metric < _IN_BYTES || metric > _RATE){
+      return 0;
+    }
+    count = std::min(count, TOP_SESSIONS_MAX);
+    std::vector<std::pair<uint64_t, unsigned long> > ranked;
+    std::lock_guard<std::mutex> lock(tableMutex);
+    int64_t now = nowNanos();
+    ranked.reserve(sessions.size());
+    for (DataplaneSessionMap::iterator it = sessions.begin(); it != sessions.end(); ++it){
+      ranked.push_back(std::make_pair(metricOf(it->second, metric, now), it->first));
+    }
+    size_t n = std::min(ranked.size(), (size_t)std::max(count, 0));
+    std::partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(),
+      std::greater<std::pair<uint64_t, unsigned long> >());
+    for (size_t i = 0; i < n; i++){
+      fillResponse(ranked[i].second, sessions[ranked[i].second], &responses[i]);
+    }
+    return (int)n;
+  }
+
+  /** \ingroup servercinterface
+  * \brief totals the counters of every session
+  *
+  */
+  int opof_get_aggregate_stats_server(AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups){
+    ensureStarted();
+    opof_aggregate_t *aggregate = opof_aggregate_create();
+    aggregateSession_t a;
+    int n;
+
+    if (aggregate == NULL){
+      return 0;
+    }
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      for (DataplaneSessionMap::iterator it = sessions.begin(); it != sessions.end(); ++it){
+        describe(it->second, &a);
+        opof_aggregate_add(aggregate, &a);
+      }
+    }
+    n = opof_aggregate_get(aggregate, groupBy, stats, maxGroups);
+    opof_aggregate_destroy(aggregate);
+    return n;
+  }
+
+  int opof_get_table_stats_server(unsigned long *count, unsigned long *capacity){
+    ensureStarted();
+    std::lock_guard<std::mutex> lock(tableMutex);
+    *count = sessions.size();
+    *capacity = config.capacity;
+    return _OK;
+  }
+
+  int opof_add_vlan_flow_server(uint16_t vlan_id, uint16_t vf_index){
+    std::lock_guard<std::mutex> lock(tableMutex);
+    vlanFlows[vlan_id] = vf_index;
+    return _OK;
+  }
+
+  int opof_remove_vlan_flow_server(uint16_t vlan_id){
+    std::lock_guard<std::mutex> lock(tableMutex);
+    return vlanFlows.erase(vlan_id) != 0 ? _OK : _NOT_FOUND;
+  }
+
+  size_t opof_get_vlan_flow_count_server(){
+    std::lock_guard<std::mutex> lock(tableMutex);
+    return vlanFlows.size();
+  }
+
+  int opof_get_vlan_flows_server(uint16_t *vlan_ids, uint16_t *vf_indices, size_t vlanFlowMaxCount, size_t *vlanFlowActualCount){
+    std::lock_guard<std::mutex> lock(tableMutex);
+    size_t n = 0;
+    for (std::map<uint16_t, uint16_t>::iterator it = vlanFlows.begin(); it != vlanFlows.end() && n < vlanFlowMaxCount; ++it){
+      vlan_ids[n] = it->first;
+      vf_indices[n] = it->second;
+      n++;
+    }
+    *vlanFlowActualCount = n;
+    return _OK;
+  }
+
+  int opof_clear_vlan_flows_server(){
+    std::lock_guard<std::mutex> lock(tableMutex);
+    vlanFlows.clear();
+    return _OK;
+  }
+
+  /* packets pick up a changed next hop from their next burst on */
+  int opof_set_next_hop_server(struct nextHopParameters_t *nextHop_c){
+    ensureStarted();
+    std::lock_guard<std::mutex> lock(tableMutex);
+    AllWorkersLock workersLock;
+    nextHops[nextHop_c->nextHopId] = *nextHop_c;
+    recompileRewrites(false, nextHop_c->nextHopId);
+    return _OK;
+  }
+
+  int opof_destroy_next_hop_server(uint32_t nextHopId){
+    ensureStarted();
+    std::lock_guard<std::mutex> lock(tableMutex);
+    AllWorkersLock workersLock;
+    if (nextHops.erase(nextHopId) == 0){
+      return _NOT_FOUND;
+    }
+    recompileRewrites(false, nextHopId);
+    return _OK;
+  }
+
+  int opof_clear_next_hops_server(){
+    ensureStarted();
+    std::lock_guard<std::mutex> lock(tableMutex);
+    AllWorkersLock workersLock;
+    nextHops.clear();
+    recompileRewrites(true, 0);
+    return _OK;
+  }
+} // extern C
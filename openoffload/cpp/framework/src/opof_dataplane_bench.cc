@@ -0,0 +1,1023 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Packet rate of the software dataplane on generated or pcap traffic
+*
+* Programs sessions into the software dataplane through
+* opof_add_session_server, runs packets through opof_dataplane_process in
+* bursts and reports the packet rate in Mpps. The packets are kept in memory
+* and copied fresh before every pass, outside the timing, so what is timed
+* is matching, rewriting and counting.
+* With --threads the packets of a pass are split in as many runs, each
+* processed by its own thread as its own worker, all at once.
+*
+* By default sessions and their traffic are generated: sessions from Lif 1
+* to Lif 2, a share of them IPv6, VLAN tagged, translated by SNAT and DNAT
+* with the reverse translation on the other link, sent to next hops that
+* rewrite MACs, or dropped, and packets in both directions of them in IMIX
+* sizes, with a share that match no session. Every generated packet has a
+* known fate, so the run checks the verdict of each, compares each forwarded
+* packet byte for byte with the packet built from the translated tuple, and
+* fails when one differs.
+*
+* With --input the packets arriving on each Lif are read from a pcap file
+* instead, merged in timestamp order, and a FORWARD session is added for
+* every flow not seen before in either direction, from its Lif to the other
+* input's Lif (or the same Lif when there is one input), with the same VLAN
+* on both sides.
+*
+* A share of the generated TCP sessions end after their traffic, in a FIN
+* from each side and the last ACK or in an RST from either side. Once all
+* passes are done getClosedSessions must report exactly those sessions,
+* with the close code they ended with. Idle sessions, which get no packets
+* and a cacheTimeout of a second, are added after them and must be reported
+* with _TIMEOUT: the run waits for the timeout and two aggregation periods
+* first, with OPOF_DATAPLANE_AGGREGATE_MSEC set to 100 unless it is set.
+*
+* Forwarded packets must carry valid IPv4 header and TCP/UDP checksums, and
+* once all passes are done the counters of the sessions must add up to the
+* packets that matched them, or the run fails. The packets of the first pass
+* can be written to pcap files per Lif they leave on, with the misses in one
+* more, and generated input can be saved to replay it with --input.
+*
+* Results are printed as JSON.
+*/
+extern "C" {
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_error.h"
+#include "opof_serverlib.h"
+#include "opof_test.h"
+#include "opof_pcap.h"
+#include "opof_dataplane.h"
+}
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#define DATAPLANE_BENCH_FRAME_MAX 1518
+#define DATAPLANE_BENCH_ALIGN 64
+#define DATAPLANE_BENCH_IN_LIF 1
+#define DATAPLANE_BENCH_OUT_LIF 2
+#define DATAPLANE_BENCH_TTL 64
+#define DATAPLANE_BENCH_CACHE_TIMEOUT 1
+#define DATAPLANE_BENCH_AGGREGATE_MSEC "100"
+#define TCP_FIN 0x01
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+struct LifFile {
+    uint32_t lif;
+    std::string path;
+};
+
+struct DataplaneBenchConfig {
+    unsigned long sessions;
+    unsigned long packets;
+    unsigned int passes;
+    unsigned int burst;
+    unsigned int threads;
+    unsigned int ipv6Percent;
+    unsigned int dropPercent;
+    unsigned int missPercent;
+    unsigned int closePercent;
+    unsigned long idle;
+    unsigned long seed;
+    std::vector<LifFile> inputs;
+    std::vector<LifFile> writes;
+    std::vector<LifFile> saves;
+    std::string misses;
+    std::string output;
+};
+
+struct Tuple {
+    uint8_t ipver;
+    uint8_t proto;
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint16_t srcPort;
+    uint16_t dstPort;
+};
+
+/* a packet in the arena, session -1 when it is not generated from one */
+struct BenchPacket {
+    uint32_t lif;
+    uint32_t offset;
+    uint32_t length;
+    uint64_t nanos;
+    long session;
+    bool reply;
+    uint32_t seq;
+    uint8_t flags;
+    OPOF_PACKET_VERDICT_T expected;
+};
+
+struct BenchResult {
+    OPOF_PACKET_VERDICT_T verdict;
+    uint32_t outLif;
+};
+
+static const uint8_t hostMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t nicMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+static const nextHopParameters_t benchNextHops[2] = {
+  {1, true, {{0x02, 0x00, 0x00, 0x00, 0x02, 0x01}, {0x02, 0x00, 0x00, 0x00, 0x02, 0xfe}}, _IPV4},
+  {2, true, {{0x02, 0x00, 0x00, 0x00, 0x01, 0x01}, {0x02, 0x00, 0x00, 0x00, 0x01, 0xfe}}, _IPV4},
+};
+
+typedef std::chrono::steady_clock BenchClock;
+
+static void put16(uint8_t *p, uint16_t value) {
+  p[0] = (uint8_t)(value >> 8);
+  p[1] = (uint8_t)value;
+}
+
+static uint16_t get16(const uint8_t *p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t sumWords(const uint8_t *p, uint32_t length, uint32_t sum) {
+  for (; length > 1; p += 2, length -= 2){
+    sum += get16(p);
+  }
+  if (length == 1){
+    sum += (uint32_t)p[0] << 8;
+  }
+  return sum;
+}
+
+static uint16_t foldSum(uint32_t sum) {
+  while (sum >> 16){
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (uint16_t)sum;
+}
+
+static size_t addressLength(uint8_t ipver) {
+  return ipver == _IPV4 ? 4 : 16;
+}
+
+static void tupleOf(const sessionRequest_t &r, Tuple *t) {
+  memset(t, 0, sizeof(*t));
+  t->ipver = r.ipver;
+  t->proto = r.proto;
+  if (r.ipver == _IPV4){
+    memcpy(t->src, &r.srcIP.s_addr, 4);
+    memcpy(t->dst, &r.dstIP.s_addr, 4);
+  } else {
+    memcpy(t->src, r.srcIPV6.s6_addr, 16);
+    memcpy(t->dst, r.dstIPV6.s6_addr, 16);
+  }
+  t->srcPort = r.srcPort;
+  t->dstPort = r.dstPort;
+}
+
+static void natTo(const nat_t &nat, uint8_t ipver, uint8_t *address, uint16_t *port) {
+  memset(address, 0, 16);
+  if (ipver == _IPV4){
+    memcpy(address, &nat.ipv4.s_addr, 4);
+  } else {
+    memcpy(address, nat.ipv6.s6_addr, 16);
+  }
+  if (nat.port != 0){
+    *port = nat.port;
+  }
+}
+
+/* the tuple a packet leaves with, after the translations of a link */
+static Tuple translate(const perLinkActionParameters_t &link, const Tuple &t) {
+  Tuple result = t;
+  if (link.snatEnable){
+    natTo(link.snat, t.ipver, result.src, &result.srcPort);
+  }
+  if (link.dnatEnable){
+    natTo(link.dnat, t.ipver, result.dst, &result.dstPort);
+  }
+  return result;
+}
+
+static Tuple reversed(const Tuple &t) {
+  Tuple result = t;
+  memcpy(result.src, t.dst, 16);
+  memcpy(result.dst, t.src, 16);
+  result.srcPort = t.dstPort;
+  result.dstPort = t.srcPort;
+  return result;
+}
+
+/* the replies of a session answer what its packets look like on outLif */
+static Tuple replyTuple(const sessionRequest_t &r) {
+  Tuple t;
+  tupleOf(r, &t);
+  return reversed(translate(r.actionParams.actionParams_outLif, t));
+}
+
+/*
+* Builds an Ethernet frame of size bytes, or just its headers when they are
+* longer, with valid checksums and a payload that depends only on seq. flags
+* are the TCP flags.
+*/
+static uint32_t buildFrame(uint8_t *frame, const Tuple &t, const uint8_t *dstMac, const uint8_t *srcMac,
+                           uint16_t vlan, uint8_t ttl, uint32_t size, uint32_t seq, uint8_t flags) {
+  uint32_t offset = 12;
+  uint32_t l4Header = t.proto == _TCP ? 20 : 8;
+  uint32_t ipHeader = t.ipver == _IPV4 ? 20 : 40;
+
+  memcpy(frame, dstMac, 6);
+  memcpy(frame + 6, srcMac, 6);
+  if (vlan != 0){
+    put16(frame + offset, 0x8100);
+    put16(frame + offset + 2, vlan);
+    offset += 4;
+  }
+  put16(frame + offset, t.ipver == _IPV4 ? 0x0800 : 0x86dd);
+  offset += 2;
+  uint32_t length = std::max(size, offset + ipHeader + l4Header);
+  uint32_t l3 = offset;
+  uint32_t l4 = l3 + ipHeader;
+  uint32_t l4Length = length - l4;
+  uint8_t *ip = frame + l3;
+
+  memset(ip, 0, ipHeader + l4Header);
+  if (t.ipver == _IPV4){
+    ip[0] = 0x45;
+    put16(ip + 2, (uint16_t)(ipHeader + l4Length));
+    put16(ip + 4, (uint16_t)seq);
+    put16(ip + 6, 0x4000);
+    ip[8] = ttl;
+    ip[9] = t.proto;
+    memcpy(ip + 12, t.src, 4);
+    memcpy(ip + 16, t.dst, 4);
+    put16(ip + 10, (uint16_t)~foldSum(sumWords(ip, 20, 0)));
+  } else {
+    ip[0] = 0x60;
+    put16(ip + 4, (uint16_t)l4Length);
+    ip[6] = t.proto;
+    ip[7] = ttl;
+    memcpy(ip + 8, t.src, 16);
+    memcpy(ip + 24, t.dst, 16);
+  }
+  uint8_t *l4p = frame + l4;
+  put16(l4p, t.srcPort);
+  put16(l4p + 2, t.dstPort);
+  if (t.proto == _TCP){
+    put16(l4p + 4, (uint16_t)(seq >> 16));
+    put16(l4p + 6, (uint16_t)seq);
+    l4p[12] = 0x50;
+    l4p[13] = flags;
+    put16(l4p + 14, 65535);
+  } else {
+    put16(l4p + 4, (uint16_t)l4Length);
+  }
+  for (uint32_t i = l4Header; i < l4Length; i++){
+    l4p[i] = (uint8_t)(seq + i);
+  }
+  uint32_t sum = sumWords(ip + (t.ipver == _IPV4 ? 12 : 8), (uint32_t)addressLength(t.ipver) * 2, 0);
+  sum += t.proto + l4Length;
+  uint16_t checksum = (uint16_t)~foldSum(sumWords(l4p, l4Length, sum));
+  if (checksum == 0 && t.proto == _UDP){
+    checksum = 0xffff;
+  }
+  put16(l4p + (t.proto == _TCP ? 16 : 6), checksum);
+  return length;
+}
+
+/*
+* Checks the IPv4 header checksum and the TCP or UDP checksum, when the
+* frame holds the whole segment. Frames that are not IP pass.
+*/
+static bool checksumsValid(const uint8_t *frame, uint32_t length) {
+  uint32_t offset = 14;
+  if (length < offset){
+    return true;
+  }
+  uint16_t type = get16(frame + 12);
+  if (type == 0x8100 && length >= 18){
+    type = get16(frame + 16);
+    offset = 18;
+  }
+  const uint8_t *ip = frame + offset;
+  uint32_t l4, end, addresses;
+  uint8_t proto;
+  if (type == 0x0800 && length >= offset + 20){
+    uint32_t headerLength = (ip[0] & 0x0f) * 4;
+    if (length < offset + headerLength || foldSum(sumWords(ip, headerLength, 0)) != 0xffff){
+      return false;
+    }
+    if ((get16(ip + 6) & 0x3fff) != 0){
+      return true;
+    }
+    proto = ip[9];
+    l4 = offset + headerLength;
+    end = offset + get16(ip + 2);
+    addresses = 12;
+  } else if (type == 0x86dd && length >= offset + 40){
+    proto = ip[6];
+    l4 = offset + 40;
+    end = l4 + get16(ip + 4);
+    addresses = 8;
+  } else {
+    return true;
+  }
+  if ((proto != _TCP && proto != _UDP) || end > length || end < l4){
+    return true;
+  }
+  if (proto == _UDP && type == 0x0800 && end - l4 >= 8 && get16(frame + l4 + 6) == 0){
+    return true;
+  }
+  uint32_t sum = sumWords(ip + addresses, type == 0x0800 ? 8 : 32, 0) + proto + (end - l4);
+  return foldSum(sumWords(frame + l4, end - l4, sum)) == 0xffff;
+}
+
+/*
+* Sessions from Lif 1 to Lif 2 with unique tuples in both directions: clients
+* in 10.0.0.0/8 or 2001:db8:1::/48, servers in 198.18.0.0/15 or
+* 2001:db8:2::/48, SNAT to 203.0.113.0/24 or 2001:db8:ffff::/48, DNAT to
+* 198.51.100.0/24 or 2001:db8:fffe::/48.
+*/
+static void generateSession(unsigned long i, std::mt19937_64 &rng, const DataplaneBenchConfig &config,
+                            sessionRequest_t *r) {
+  perLinkActionParameters_t &out = r->actionParams.actionParams_outLif;
+  perLinkActionParameters_t &in = r->actionParams.actionParams_inLif;
+  static const uint8_t v6Prefix[4] = {0x20, 0x01, 0x0d, 0xb8};
+  uint32_t id = (uint32_t)i;
+
+  memset(r, 0, sizeof(*r));
+  r->sessId = i + 1;
+  r->inlif = DATAPLANE_BENCH_IN_LIF;
+  r->outlif = DATAPLANE_BENCH_OUT_LIF;
+  r->encapType = _NONE;
+  r->ipver = rng() % 100 < config.ipv6Percent ? _IPV6 : _IPV4;
+  r->proto = rng() % 100 < 30 ? _UDP : _TCP;
+  if (r->ipver == _IPV4){
+    r->srcIP.s_addr = htonl(0x0a000000 | (id & 0x00ffffff));
+    r->dstIP.s_addr = htonl(0xc6120000 | (id & 0x0001ffff));
+  } else {
+    memcpy(r->srcIPV6.s6_addr, v6Prefix, 4);
+    memcpy(r->dstIPV6.s6_addr, v6Prefix, 4);
+    r->srcIPV6.s6_addr[5] = 1;
+    r->dstIPV6.s6_addr[5] = 2;
+    memcpy(&r->srcIPV6.s6_addr[12], &id, 4);
+    memcpy(&r->dstIPV6.s6_addr[12], &id, 4);
+  }
+  r->srcPort = 32768 + rng() % (61000 - 32768);
+  r->dstPort = r->proto == _UDP ? 53 : 443;
+  if (i % 2 == 1){
+    r->vlan_inLif = 100 + i % 8;
+    r->vlan_outLif = 200 + i % 8;
+    in.vlan = r->vlan_inLif;
+    out.vlan = r->vlan_outLif;
+  }
+  r->actionParams.actionType = rng() % 100 < config.dropPercent ? _DROP : _FORWARD;
+  out.nextHopId = benchNextHops[0].nextHopId;
+  in.nextHopId = benchNextHops[1].nextHopId;
+  if (i % 3 == 0){
+    out.snatEnable = true;
+    out.snat.ipver = r->ipver;
+    out.snat.proto = r->proto;
+    out.snat.ipv4.s_addr = htonl(0xcb007100 | (id & 0xff));
+    memcpy(out.snat.ipv6.s6_addr, v6Prefix, 4);
+    out.snat.ipv6.s6_addr[4] = 0xff;
+    out.snat.ipv6.s6_addr[5] = 0xff;
+    memcpy(&out.snat.ipv6.s6_addr[12], &id, 4);
+    out.snat.port = 1024 + (id >> 8) % (65536 - 1024);
+    in.dnatEnable = true;
+    in.dnat = out.snat;
+    in.dnat.ipv4 = r->srcIP;
+    in.dnat.ipv6 = r->srcIPV6;
+    in.dnat.port = r->srcPort;
+  }
+  if (i % 5 == 0){
+    out.dnatEnable = true;
+    out.dnat.ipver = r->ipver;
+    out.dnat.proto = r->proto;
+    out.dnat.ipv4.s_addr = htonl(0xc6336400 | (id & 0xff));
+    memcpy(out.dnat.ipv6.s6_addr, v6Prefix, 4);
+    out.dnat.ipv6.s6_addr[4] = 0xff;
+    out.dnat.ipv6.s6_addr[5] = 0xfe;
+    memcpy(&out.dnat.ipv6.s6_addr[12], &id, 4);
+    out.dnat.port = r->proto == _UDP ? 5353 : 8443;
+    in.snatEnable = true;
+    in.snat = out.dnat;
+    in.snat.ipv4 = r->dstIP;
+    in.snat.ipv6 = r->dstIPV6;
+    in.snat.port = r->dstPort;
+  }
+}
+
+/* IMIX: 7 of 64 bytes, 4 of 594 and 1 of 1518 */
+static uint32_t imixSize(std::mt19937_64 &rng) {
+  unsigned int r = rng() % 12;
+  return r < 7 ? 64 : r < 11 ? 594 : 1518;
+}
+
+static uint32_t appendPacket(std::vector<uint8_t> &arena) {
+  uint32_t offset = (uint32_t)arena.size();
+  arena.resize(offset + DATAPLANE_BENCH_FRAME_MAX + DATAPLANE_BENCH_ALIGN);
+  return offset;
+}
+
+static void trimArena(std::vector<uint8_t> &arena, uint32_t offset, uint32_t length) {
+  arena.resize(offset + (length + DATAPLANE_BENCH_ALIGN - 1) / DATAPLANE_BENCH_ALIGN * DATAPLANE_BENCH_ALIGN);
+}
+
+/* a packet of session r, its reply when reply is set */
+static void sessionPacket(std::mt19937_64 &rng, const sessionRequest_t &r, bool reply, uint8_t flags,
+                          uint32_t size, std::vector<uint8_t> &arena, BenchPacket &p) {
+  Tuple t;
+
+  if (reply){
+    t = replyTuple(r);
+  } else {
+    tupleOf(r, &t);
+  }
+  p.offset = appendPacket(arena);
+  p.seq = (uint32_t)rng();
+  p.session = (long)(r.sessId - 1);
+  p.reply = reply;
+  p.flags = flags;
+  p.expected = r.actionParams.actionType == _DROP ? OPOF_PACKET_DROP : OPOF_PACKET_FORWARD;
+  p.lif = reply ? r.outlif : r.inlif;
+  p.length = buildFrame(&arena[p.offset], t, nicMac, hostMac, reply ? r.vlan_outLif : r.vlan_inLif,
+                        DATAPLANE_BENCH_TTL, size, p.seq, flags);
+  trimArena(arena, p.offset, p.length);
+}
+
+/*
+* Adds the sessions and their packets, then the closing packets of the
+* sessions that end and the idle sessions, and sets how each session must
+* be reported closed.
+*/
+static bool generate(const DataplaneBenchConfig &config, std::vector<sessionRequest_t> &requests,
+                     std::vector<uint8_t> &arena, std::vector<BenchPacket> &packets,
+                     std::vector<SESSION_CLOSE_T> &closes) {
+  std::mt19937_64 rng(config.seed);
+  addSessionResponse_t response;
+
+  for (int h = 0; h < 2; h++){
+    nextHopParameters_t hop = benchNextHops[h];
+    opof_set_next_hop_server(&hop);
+  }
+  requests.resize(config.sessions + config.idle);
+  for (unsigned long i = 0; i < config.sessions; i++){
+    generateSession(i, rng, config, &requests[i]);
+    if (opof_add_session_server(&requests[i], &response) != _OK){
+      fprintf(stderr, "Adding session %lu failed\n", requests[i].sessId);
+      return false;
+    }
+  }
+  arena.reserve((size_t)config.packets * 512);
+  packets.resize(config.packets);
+  for (unsigned long k = 0; k < config.packets; k++){
+    BenchPacket &p = packets[k];
+    const sessionRequest_t &r = requests[rng() % config.sessions];
+    bool reply = rng() % 2 == 1;
+    uint32_t size = imixSize(rng);
+    if (rng() % 100 < config.missPercent){
+      Tuple t;
+      tupleOf(r, &t);
+      t.srcPort = 1 + rng() % 32767;
+      p.offset = appendPacket(arena);
+      p.seq = (uint32_t)rng();
+      p.session = -1;
+      p.reply = false;
+      p.flags = TCP_ACK;
+      p.expected = OPOF_PACKET_MISS;
+      p.lif = r.inlif;
+      p.length = buildFrame(&arena[p.offset], t, nicMac, hostMac, r.vlan_inLif, DATAPLANE_BENCH_TTL, size, p.seq, p.flags);
+      trimArena(arena, p.offset, p.length);
+    } else {
+      sessionPacket(rng, r, reply, TCP_ACK, size, arena, p);
+    }
+  }
+  closes.assign(config.sessions, _NOT_CLOSED);
+  for (unsigned long i = 0; i < config.sessions; i++){
+    const sessionRequest_t &r = requests[i];
+    if (r.proto != _TCP || rng() % 100 >= config.closePercent){
+      continue;
+    }
+    closes[i] = rng() % 2 ? _FINACK : _RST;
+    if (closes[i] == _FINACK){
+      packets.resize(packets.size() + 3);
+      sessionPacket(rng, r, false, TCP_FIN | TCP_ACK, 64, arena, packets[packets.size() - 3]);
+      sessionPacket(rng, r, true, TCP_FIN | TCP_ACK, 64, arena, packets[packets.size() - 2]);
+      sessionPacket(rng, r, false, TCP_ACK, 64, arena, packets[packets.size() - 1]);
+    } else {
+      packets.resize(packets.size() + 1);
+      sessionPacket(rng, r, rng() % 2 == 1, TCP_RST | TCP_ACK, 64, arena, packets.back());
+    }
+  }
+  for (unsigned long i = config.sessions; i < config.sessions + config.idle; i++){
+    generateSession(i, rng, config, &requests[i]);
+    requests[i].cacheTimeout = DATAPLANE_BENCH_CACHE_TIMEOUT;
+    if (opof_add_session_server(&requests[i], &response) != _OK){
+      fprintf(stderr, "Adding idle session %lu failed\n", requests[i].sessId);
+      return false;
+    }
+    closes.push_back(_TIMEOUT);
+  }
+  for (size_t k = 0; k < packets.size(); k++){
+    packets[k].nanos = 1600000000000000000ULL + k * 1000;
+  }
+  return true;
+}
+
+/* the frame a forwarded generated packet must leave as */
+static uint32_t expectedFrame(const BenchPacket &p, const sessionRequest_t &r, uint8_t *frame) {
+  const perLinkActionParameters_t &link = p.reply ? r.actionParams.actionParams_inLif : r.actionParams.actionParams_outLif;
+  const nextHopParameters_t &hop = benchNextHops[p.reply ? 1 : 0];
+  Tuple t;
+  if (p.reply){
+    t = replyTuple(r);
+  } else {
+    tupleOf(r, &t);
+  }
+  t = translate(link, t);
+  uint16_t vlan = p.reply ? r.vlan_outLif : r.vlan_inLif;
+  if (link.vlan != 0 && vlan != 0){
+    vlan = link.vlan;
+  }
+  return buildFrame(frame, t, hop.macRewrite.dstMac, hop.macRewrite.srcMac, vlan,
+                    r.proto == _TCP ? DATAPLANE_BENCH_TTL - 1 : DATAPLANE_BENCH_TTL, p.length, p.seq, p.flags);
+}
+
+static std::string keyBytes(const opof_flow_key_t &key) {
+  return std::string((const char *)&key, sizeof(key));
+}
+
+/*
+* Reads the inputs, merges them by time and adds a session for every new
+* flow.
+*/
+static bool readInputs(const DataplaneBenchConfig &config, std::vector<uint8_t> &arena, std::vector<BenchPacket> &packets,
+                       unsigned long *sessions) {
+  std::unordered_set<std::string> known;
+  addSessionResponse_t response;
+
+  for (const LifFile &input : config.inputs){
+    opof_pcap_t *pcap = opof_pcap_open_read(input.path.c_str());
+    if (pcap == NULL){
+      fprintf(stderr, "Cannot read %s as a pcap of Ethernet frames\n", input.path.c_str());
+      return false;
+    }
+    for (;;){
+      BenchPacket p = {};
+      p.lif = input.lif;
+      p.offset = appendPacket(arena);
+      p.session = -1;
+      int status = opof_pcap_read(pcap, &arena[p.offset], DATAPLANE_BENCH_FRAME_MAX, &p.length, &p.nanos);
+      if (status != _OK){
+        arena.resize(p.offset);
+        if (status != _NOT_FOUND){
+          fprintf(stderr, "%s is truncated\n", input.path.c_str());
+        }
+        break;
+      }
+      trimArena(arena, p.offset, p.length);
+      packets.push_back(p);
+    }
+    opof_pcap_close(pcap);
+  }
+  std::stable_sort(packets.begin(), packets.end(),
+    [](const BenchPacket &a, const BenchPacket &b) { return a.nanos < b.nanos; });
+
+  std::mt19937_64 rng(config.seed);
+  for (const BenchPacket &p : packets){
+    opof_flow_key_t key;
+    if (opof_dataplane_flow_key(&arena[p.offset], p.length, p.lif, &key) != _OK || known.count(keyBytes(key)) != 0){
+      continue;
+    }
+    sessionRequest_t r;
+    memset(&r, 0, sizeof(r));
+    r.sessId = ++*sessions;
+    r.inlif = key.lif;
+    r.outlif = key.lif;
+    for (const LifFile &input : config.inputs){
+      if (config.inputs.size() == 2 && input.lif != key.lif){
+        r.outlif = input.lif;
+      }
+    }
+    r.encapType = _NONE;
+    r.vlan_inLif = key.vlan;
+    r.vlan_outLif = key.vlan;
+    r.ipver = (IP_VERSION_T)key.ipver;
+    r.proto = (PROTOCOL_ID_T)key.proto;
+    if (key.ipver == _IPV4){
+      memcpy(&r.srcIP.s_addr, key.src, 4);
+      memcpy(&r.dstIP.s_addr, key.dst, 4);
+    } else {
+      memcpy(r.srcIPV6.s6_addr, key.src, 16);
+      memcpy(r.dstIPV6.s6_addr, key.dst, 16);
+    }
+    r.srcPort = key.srcPort;
+    r.dstPort = key.dstPort;
+    r.actionParams.actionType = rng() % 100 < config.dropPercent ? _DROP : _FORWARD;
+    if (opof_add_session_server(&r, &response) != _OK){
+      fprintf(stderr, "Adding a session for a flow on Lif %u failed\n", key.lif);
+      return false;
+    }
+    known.insert(keyBytes(key));
+    opof_flow_key_t reply = key;
+    reply.lif = r.outlif;
+    memcpy(reply.src, key.dst, 16);
+    memcpy(reply.dst, key.src, 16);
+    reply.srcPort = key.dstPort;
+    reply.dstPort = key.srcPort;
+    known.insert(keyBytes(reply));
+  }
+  return true;
+}
+
+static bool writePackets(const std::string &path, const std::vector<uint8_t> &arena, const std::vector<BenchPacket> &packets,
+                         const std::vector<BenchResult> *results, bool misses, uint32_t lif) {
+  opof_pcap_t *pcap = opof_pcap_open_write(path.c_str());
+  bool ok = pcap != NULL;
+  for (size_t i = 0; ok && i < packets.size(); i++){
+    bool selected;
+    if (results == NULL){
+      selected = packets[i].lif == lif;
+    } else if (misses){
+      selected = (*results)[i].verdict == OPOF_PACKET_MISS;
+    } else {
+      selected = (*results)[i].verdict == OPOF_PACKET_FORWARD && (*results)[i].outLif == lif;
+    }
+    if (selected){
+      ok = opof_pcap_write(pcap, &arena[packets[i].offset], packets[i].length, packets[i].nanos) == _OK;
+    }
+  }
+  opof_pcap_close(pcap);
+  if (!ok){
+    fprintf(stderr, "Cannot write %s\n", path.c_str());
+  }
+  return ok;
+}
+
+/* runs packets first to last as one worker */
+static void runPackets(unsigned int worker, size_t first, size_t last, unsigned int burstSize,
+                       std::vector<uint8_t> &work, const std::vector<BenchPacket> &packets,
+                       std::vector<BenchResult> &results) {
+  std::vector<opof_packet_t> burst(burstSize);
+
+  for (; first < last; first += burstSize){
+    int n = (int)std::min<size_t>(burstSize, last - first);
+    for (int i = 0; i < n; i++){
+      const BenchPacket &p = packets[first + i];
+      burst[i].data = &work[p.offset];
+      burst[i].length = p.length;
+      burst[i].lif = p.lif;
+    }
+    opof_dataplane_process(worker, burst.data(), n);
+    for (int i = 0; i < n; i++){
+      results[first + i].verdict = burst[i].verdict;
+      results[first + i].outLif = burst[i].outLif;
+    }
+  }
+}
+
+/*
+* Collects the closed sessions and counts those not reported with the close
+* code expected, or reported when they should still be open.
+*/
+static uint64_t collectClosed(const std::vector<SESSION_CLOSE_T> &closes, bool check, uint64_t reported[4]) {
+  sessionResponse_t page[BUFFER_MAX];
+  statisticsRequestArgs_t request = {BUFFER_MAX, 0};
+  std::vector<bool> seen(closes.size());
+  uint64_t wrong = 0;
+  int n;
+
+  while ((n = opof_get_closed_sessions_server(&request, page)) > 0){
+    for (int i = 0; i < n; i++){
+      unsigned long index = page[i].sessionId - 1;
+      reported[page[i].sessionCloseCode & 3]++;
+      if (check && (index >= closes.size() || page[i].sessionState != _CLOSED ||
+                    page[i].sessionCloseCode != closes[index] || seen[index])){
+        wrong++;
+      } else if (index < seen.size()){
+        seen[index] = true;
+      }
+    }
+  }
+  for (size_t i = 0; check && i < closes.size(); i++){
+    wrong += closes[i] != _NOT_CLOSED && !seen[i];
+  }
+  return wrong;
+}
+
+/* folds the workers' counters first, so they cover every packet run */
+static uint64_t countedPackets() {
+  std::vector<sessionResponse_t> page(BUFFER_MAX);
+  std::vector<sessionResponse_t *> pointers(BUFFER_MAX);
+  uint64_t start = UINT_MAX;
+  uint64_t packets = 0;
+  int n;
+
+  opof_dataplane_aggregate();
+  for (int i = 0; i < BUFFER_MAX; i++){
+    pointers[i] = &page[i];
+  }
+  while ((n = opof_get_all_sessions_server(BUFFER_MAX, &start, 0, pointers.data())) > 0){
+    for (int i = 0; i < n; i++){
+      packets += page[i].inPackets + page[i].outPackets;
+    }
+  }
+  return packets;
+}
+
+static bool parseLifFile(const char *arg, std::vector<LifFile> &files) {
+  char *end;
+  unsigned long lif = strtoul(arg, &end, 0);
+  if (end == arg || *end != ':' || end[1] == '\0'){
+    fprintf(stderr, "%s is not lif:file\n", arg);
+    return false;
+  }
+  files.push_back(LifFile{(uint32_t)lif, std::string(end + 1)});
+  return true;
+}
+
+static void displayHelp(void) {
+  printf("\nCommand line arguments for the OpenOffload software dataplane benchmark version: %s \n", OPOF_VERSION);
+  printf("\t-n, --sessions        Sessions generated (default 10000)\n");
+  printf("\t-k, --packets         Packets generated (default 100000)\n");
+  printf("\t-r, --passes          Passes over the packets (default 10)\n");
+  printf("\t-b, --burst           Packets per opof_dataplane_process call (default 32)\n");
+  printf("\t-t, --threads         Threads, each running a share of the packets as its own worker (default 1)\n");
+  printf("\t-6, --ipv6            Percent of IPv6 sessions (default 20)\n");
+  printf("\t-d, --drop            Percent of sessions that drop (default 10)\n");
+  printf("\t-x, --miss            Percent of generated packets that match no session (default 5)\n");
+  printf("\t-c, --close           Percent of generated TCP sessions that end in a FIN or RST (default 10)\n");
+  printf("\t-e, --idle            Idle sessions that must close with _TIMEOUT (default 100)\n");
+  printf("\t-s, --seed            Random seed (default 1)\n");
+  printf("\t-i, --input lif:file  Packets arriving on lif from a pcap instead of generated ones, repeatable\n");
+  printf("\t-w, --write lif:file  Write the packets leaving on lif to a pcap, repeatable\n");
+  printf("\t-W, --save lif:file   Write the generated packets arriving on lif to a pcap, repeatable\n");
+  printf("\t-m, --misses file     Write the packets that match no session to a pcap\n");
+  printf("\t-o, --output          Write the JSON results to this file instead of stdout\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  DataplaneBenchConfig config = {10000, 100000, 10, 32, 1, 20, 10, 5, 10, 100, 1, {}, {}, {}, "", ""};
+  static struct option longopts[] = {
+    {"sessions", required_argument, NULL, 'n'},
+    {"packets", required_argument, NULL, 'k'},
+    {"passes", required_argument, NULL, 'r'},
+    {"burst", required_argument, NULL, 'b'},
+    {"threads", required_argument, NULL, 't'},
+    {"ipv6", required_argument, NULL, '6'},
+    {"drop", required_argument, NULL, 'd'},
+    {"miss", required_argument, NULL, 'x'},
+    {"close", required_argument, NULL, 'c'},
+    {"idle", required_argument, NULL, 'e'},
+    {"seed", required_argument, NULL, 's'},
+    {"input", required_argument, NULL, 'i'},
+    {"write", required_argument, NULL, 'w'},
+    {"save", required_argument, NULL, 'W'},
+    {"misses", required_argument, NULL, 'm'},
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:k:r:b:t:6:d:x:c:e:s:i:w:W:m:o:h", longopts, NULL)) != -1){
+    switch (c){
+      case 'n':
+        config.sessions = strtoul(optarg, NULL, 0);
+        break;
+      case 'k':
+        config.packets = strtoul(optarg, NULL, 0);
+        break;
+      case 'r':
+        config.passes = strtoul(optarg, NULL, 0);
+        break;
+      case 'b':
+        config.burst = strtoul(optarg, NULL, 0);
+        break;
+      case 't':
+        config.threads = strtoul(optarg, NULL, 0);
+        break;
+      case '6':
+        config.ipv6Percent = strtoul(optarg, NULL, 0);
+        break;
+      case 'd':
+        config.dropPercent = strtoul(optarg, NULL, 0);
+        break;
+      case 'x':
+        config.missPercent = strtoul(optarg, NULL, 0);
+        break;
+      case 'c':
+        config.closePercent = strtoul(optarg, NULL, 0);
+        break;
+      case 'e':
+        config.idle = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        config.seed = strtoul(optarg, NULL, 0);
+        break;
+      case 'i':
+        if (!parseLifFile(optarg, config.inputs)){
+          return 1;
+        }
+        break;
+      case 'w':
+        if (!parseLifFile(optarg, config.writes)){
+          return 1;
+        }
+        break;
+      case 'W':
+        if (!parseLifFile(optarg, config.saves)){
+          return 1;
+        }
+        break;
+      case 'm':
+        config.misses = optarg;
+        break;
+      case 'o':
+        config.output = optarg;
+        break;
+      case 'h':
+      default:
+        displayHelp();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  if (config.sessions == 0 || config.sessions + config.idle > (1UL << 24) || config.packets == 0 || config.passes == 0 ||
+      config.burst == 0 || config.burst > OPOF_DATAPLANE_BURST_MAX ||
+      config.threads == 0 || config.threads > OPOF_DATAPLANE_WORKERS_MAX){
+    fprintf(stderr, "sessions must be 1 to %lu with the idle ones, packets and passes at least 1, burst 1 to %d, threads 1 to %d\n",
+            1UL << 24, OPOF_DATAPLANE_BURST_MAX, OPOF_DATAPLANE_WORKERS_MAX);
+    return 1;
+  }
+
+  std::vector<sessionRequest_t> requests;
+  std::vector<SESSION_CLOSE_T> closes;
+  std::vector<uint8_t> arena;
+  std::vector<BenchPacket> packets;
+  bool generated = config.inputs.empty();
+  unsigned long sessions = 0;
+
+  if (!generated){
+    config.idle = 0;
+  }
+  if (config.idle > 0){
+    setenv("OPOF_DATAPLANE_AGGREGATE_MSEC", DATAPLANE_BENCH_AGGREGATE_MSEC, 0);
+  }
+  opof_reset_server();
+  BenchClock::time_point added = BenchClock::now();
+  if (generated){
+    if (!generate(config, requests, arena, packets, closes)){
+      return 1;
+    }
+    added = BenchClock::now();
+    sessions = config.sessions + config.idle;
+  } else if (!readInputs(config, arena, packets, &sessions)){
+    return 1;
+  }
+  if (packets.empty()){
+    fprintf(stderr, "No packets to run\n");
+    return 1;
+  }
+  for (const LifFile &save : config.saves){
+    if (!writePackets(save.path, arena, packets, NULL, false, save.lif)){
+      return 1;
+    }
+  }
+
+  std::vector<uint8_t> work(arena.size());
+  std::vector<BenchResult> results(packets.size());
+  double seconds = 0;
+  for (unsigned int pass = 0; pass < config.passes; pass++){
+    memcpy(work.data(), arena.data(), arena.size());
+    BenchClock::time_point start = BenchClock::now();
+    if (config.threads == 1){
+      runPackets(0, 0, packets.size(), config.burst, work, packets, results);
+    } else {
+      /* the packets of a session land on several workers, each with its own counters */
+      std::vector<std::thread> threads;
+      for (unsigned int t = 0; t < config.threads; t++){
+        threads.push_back(std::thread(runPackets, t, packets.size() * t / config.threads,
+                                      packets.size() * (t + 1) / config.threads, config.burst,
+                                      std::ref(work), std::cref(packets), std::ref(results)));
+      }
+      for (std::thread &thread : threads){
+        thread.join();
+      }
+    }
+    seconds += std::chrono::duration<double>(BenchClock::now() - start).count();
+    if (pass != 0){
+      continue;
+    }
+    for (const LifFile &write : config.writes){
+      if (!writePackets(write.path, work, packets, &results, false, write.lif)){
+        return 1;
+      }
+    }
+    if (!config.misses.empty() && !writePackets(config.misses, work, packets, &results, true, 0)){
+      return 1;
+    }
+  }
+
+  /* every pass leaves the same verdicts and bytes, check the last */
+  uint64_t verdicts[3] = {0, 0, 0};
+  uint64_t wrongVerdicts = 0;
+  uint64_t wrongRewrites = 0;
+  uint64_t badChecksums = 0;
+  std::vector<uint8_t> expected(DATAPLANE_BENCH_FRAME_MAX + DATAPLANE_BENCH_ALIGN);
+  for (size_t i = 0; i < packets.size(); i++){
+    const BenchPacket &p = packets[i];
+    OPOF_PACKET_VERDICT_T verdict = results[i].verdict;
+    verdicts[verdict]++;
+    if (generated && verdict != p.expected){
+      wrongVerdicts++;
+      continue;
+    }
+    if (verdict != OPOF_PACKET_FORWARD){
+      continue;
+    }
+    if (!checksumsValid(&work[p.offset], p.length)){
+      badChecksums++;
+    }
+    if (generated && (expectedFrame(p, requests[p.session], expected.data()) != p.length ||
+                      memcmp(expected.data(), &work[p.offset], p.length) != 0)){
+      wrongRewrites++;
+    }
+  }
+  uint64_t matched = (verdicts[OPOF_PACKET_FORWARD] + verdicts[OPOF_PACKET_DROP]) * config.passes;
+  uint64_t counted = countedPackets();
+  /* threads may see one pass of a close out of order, the next one completes it */
+  bool checkClosed = generated && (config.threads == 1 || config.passes > 1);
+  uint64_t closedCodes[4] = {0, 0, 0, 0};
+  if (config.idle > 0){
+    unsigned long aggregateMsec = strtoul(getenv("OPOF_DATAPLANE_AGGREGATE_MSEC"), NULL, 0);
+    std::this_thread::sleep_until(added + std::chrono::seconds(DATAPLANE_BENCH_CACHE_TIMEOUT) +
+                                  std::chrono::milliseconds(2 * std::max(1UL, aggregateMsec)));
+  }
+  uint64_t wrongClosures = collectClosed(closes, checkClosed, closedCodes);
+  opof_dataplane_stats_t stats;
+  opof_dataplane_get_stats(&stats);
+  double total = (double)packets.size() * config.passes;
+  bool ok = wrongVerdicts == 0 && wrongRewrites == 0 && badChecksums == 0 && counted == matched && wrongClosures == 0;
+
+  FILE *out = stdout;
+  if (!config.output.empty()){
+    out = fopen(config.output.c_str(), "w");
+    if (out == NULL){
+      fprintf(stderr, "Cannot write %s\n", config.output.c_str());
+      return 1;
+    }
+  }
+  fprintf(out, "{\n");
+  fprintf(out, "  \"config\": {\"source\": \"%s\", \"sessions\": %lu, \"packets\": %lu, \"passes\": %u, \"burst\": %u, "
+          "\"threads\": %u, \"workers\": %u, \"ipv6Percent\": %u, \"dropPercent\": %u, \"missPercent\": %u, "
+          "\"closePercent\": %u, \"idle\": %lu},\n",
+          generated ? "generated" : "pcap", sessions, (unsigned long)packets.size(), config.passes, config.burst,
+          config.threads, opof_dataplane_workers(), config.ipv6Percent, config.dropPercent, generated ? config.missPercent : 0,
+          generated ? config.closePercent : 0, config.idle);
+  fprintf(out, "  \"mpps\": %.3f,\n", total / seconds / 1e6);
+  fprintf(out, "  \"nsPerPacket\": %.1f,\n", seconds * 1e9 / total);
+  fprintf(out, "  \"perPass\": {\"forwarded\": %lu, \"dropped\": %lu, \"missed\": %lu},\n",
+          (unsigned long)verdicts[OPOF_PACKET_FORWARD], (unsigned long)verdicts[OPOF_PACKET_DROP],
+          (unsigned long)verdicts[OPOF_PACKET_MISS]);
+  fprintf(out, "  \"dataplane\": {\"packets\": %lu, \"forwarded\": %lu, \"dropped\": %lu, \"missed\": %lu, \"ttlExpired\": %lu},\n",
+          (unsigned long)stats.packets, (unsigned long)stats.forwarded, (unsigned long)stats.dropped,
+          (unsigned long)stats.missed, (unsigned long)stats.ttlExpired);
+  fprintf(out, "  \"wrongVerdicts\": %lu,\n", (unsigned long)wrongVerdicts);
+  fprintf(out, "  \"wrongRewrites\": %lu,\n", (unsigned long)wrongRewrites);
+  fprintf(out, "  \"badChecksums\": %lu,\n", (unsigned long)badChecksums);
+  fprintf(out, "  \"closed\": {\"finack\": %lu, \"rst\": %lu, \"timeout\": %lu},\n", (unsigned long)closedCodes[_FINACK],
+          (unsigned long)closedCodes[_RST], (unsigned long)closedCodes[_TIMEOUT]);
+  fprintf(out, "  \"wrongClosures\": %lu,\n", (unsigned long)wrongClosures);
+  fprintf(out, "  \"countersMatch\": %s\n", counted == matched ? "true" : "false");
+  fprintf(out, "}\n");
+  if (out != stdout){
+    fclose(out);
+  }
+  return ok ? 0 : 1;
+}
@@ -23,6 +23,7 @@
 */
 
 #include "opof_error.h"
+#include "opof_log.h"
 
 
 
@@ -84,8 +85,14 @@ static void err_handler(FILE *fp,int level, const char *fmt, va_list ap){
 	fflush(fp);
 	return;
 }
+/*
+* err_fatal and err_error end the process, so they flush the async log and
+* write synchronously to fp. err_warn and err_info are macros in
+* opof_error.h.
+*/
 void err_fatal(FILE *fp, const char *fmt, ...){
 	va_list ap;
+	opof_log_flush();
 	va_start(ap,fmt);
 	err_handler(fp,OPOF_LOG_ERR, fmt,ap);
 	va_end(ap);
@@ -95,6 +102,7 @@ void err_fatal(FILE *fp, const char *fmt, ...){
 
 void err_error(FILE *fp, const char *fmt, ...){
 	va_list ap;
+	opof_log_flush();
 	va_start(ap,fmt);
 	err_handler(fp,OPOF_LOG_ERR, fmt,ap);
 	va_end(ap);
@@ -102,18 +110,3 @@ void err_error(FILE *fp, const char *fmt, ...){
 	exit(EXIT_FAILURE);
 }
 
-void err_warn(FILE *fp, const char *fmt, ...){
-	va_list ap;
-	va_start(ap,fmt);
-	err_handler(fp,OPOF_LOG_WARN, fmt,ap);
-	va_end(ap);
-	return;
-}
-void err_info(FILE *fp, const char *fmt, ...){
-	va_list ap;
-	va_start(ap,fmt);
-	err_handler(fp,OPOF_LOG_INFO, fmt,ap);
-	va_end(ap);
-	return;
-}
-
@@ -0,0 +1,509 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Bucketized cuckoo hash of flows by Lif, VLAN and 5-tuple
+*
+* The low bits of a key's 64 bit hash pick its primary bucket and the top 16
+* bits are its signature. The other bucket is the primary XOR a mix of the
+* signature, so either bucket of an entry can be found from the other and
+* the signature alone, which is all an insert needs to move entries. Slot
+* index 0 is never an entry and marks a free slot.
+*
+* The signature compare yields two mask bits per matching slot, the first
+* bucket in the low 16 bits of the mask and the second in the high 16.
+*
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FLOW_HASH_X86 1
+#endif
+
+#include "opof.h"
+#include "opof_flow_hash.h"
+
+#define FLOW_HASH_BFS_MAX 512
+#define FLOW_HASH_SLOT_MASK 0x5555u
+
+typedef struct flow_bucket {
+  uint16_t sig[OPOF_FLOW_HASH_BUCKET_SLOTS];
+  uint32_t index[OPOF_FLOW_HASH_BUCKET_SLOTS];
+} __attribute__((aligned(64))) flow_bucket_t;
+
+typedef struct flow_entry {
+  opof_flow_key_t key;
+  uint64_t value;
+} flow_entry_t;
+
+typedef struct bfs_node {
+  uint32_t bucket;
+  int parent;
+  int slot;
+} bfs_node_t;
+
+struct opof_flow_hash {
+  unsigned long capacity;
+  unsigned long count;
+  uint32_t bucketMask;
+  OPOF_FLOW_HASH_SIMD_T simd;
+  flow_bucket_t *buckets;
+  flow_entry_t *entries;
+  uint32_t *freeEntries;
+  unsigned long freeCount;
+};
+
+/**
+* \ingroup servercinterface
+* \brief The key of packets arriving on inLif of a session
+*
+* \param  request  The session
+* \param  key      The key
+*
+*/
+void opof_flow_key_from_request(const sessionRequest_t *request, opof_flow_key_t *key){
+  memset(key, 0, sizeof(*key));
+  key->lif = request->inlif;
+  key->vlan = request->vlan_inLif;
+  key->ipver = request->ipver;
+  key->proto = request->proto;
+  if (request->ipver == _IPV4){
+    memcpy(key->src, &request->srcIP.s_addr, 4);
+    memcpy(key->dst, &request->dstIP.s_addr, 4);
+  } else {
+    memcpy(key->src, request->srcIPV6.s6_addr, 16);
+    memcpy(key->dst, request->dstIPV6.s6_addr, 16);
+  }
+  if (request->proto == _TCP || request->proto == _UDP){
+    key->srcPort = request->srcPort;
+    key->dstPort = request->dstPort;
+  }
+}
+
+static inline uint64_t hashKey(const opof_flow_key_t *key){
+  uint64_t words[6] = {0};
+  uint64_t h = 0x2545f4914f6cdd1dULL;
+
+  memcpy(words, key, sizeof(*key));
+  for (int i = 0; i < 6; i++){
+    h ^= words[i] * 0x87c37b91114253d5ULL;
+    h = (h << 31 | h >> 33) * 0x4cf5ad432745937fULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static inline uint16_t signatureOf(uint64_t hash){
+  return (uint16_t)(hash >> 48);
+}
+
+/* never zero, so the two buckets of a key differ */
+static inline uint32_t altBucket(const opof_flow_hash_t *table, uint32_t bucket, uint16_t sig){
+  return (bucket ^ ((sig * 0x5bd1e995u) >> 7 | 1)) & table->bucketMask;
+}
+
+static inline bool keyEqual(const opof_flow_key_t *a, const opof_flow_key_t *b){
+  uint64_t x[6] = {0}, y[6] = {0};
+  uint64_t diff = 0;
+
+  memcpy(x, a, sizeof(*a));
+  memcpy(y, b, sizeof(*b));
+  for (int i = 0; i < 6; i++){
+    diff |= x[i] ^ y[i];
+  }
+  return diff == 0;
+}
+
+static uint32_t matchScalar(const flow_bucket_t *first, const flow_bucket_t *second, uint16_t sig){
+  uint32_t mask = 0;
+
+  for (int slot = 0; slot < OPOF_FLOW_HASH_BUCKET_SLOTS; slot++){
+    mask |= (uint32_t)(first->sig[slot] == sig) << (slot * 2);
+    mask |= (uint32_t)(second->sig[slot] == sig) << (16 + slot * 2);
+  }
+  return mask;
+}
+
+#ifdef FLOW_HASH_X86
+static inline uint32_t matchSse2(const flow_bucket_t *first, const flow_bucket_t *second, uint16_t sig){
+  __m128i target = _mm_set1_epi16((short)sig);
+  uint32_t low = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_load_si128((const __m128i *)first->sig), target));
+  uint32_t high = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_load_si128((const __m128i *)second->sig), target));
+  return low | high << 16;
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t matchAvx2(const flow_bucket_t *first, const flow_bucket_t *second, uint16_t sig){
+  __m256i sigs = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i *)first->sig)),
+                                         _mm_load_si128((const __m128i *)second->sig), 1);
+  return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(sigs, _mm256_set1_epi16((short)sig)));
+}
+#endif
+
+static uint32_t matchPair(const opof_flow_hash_t *table, const flow_bucket_t *first, const flow_bucket_t *second, uint16_t sig){
+#ifdef FLOW_HASH_X86
+  if (table->simd == OPOF_FLOW_HASH_AVX2){
+    return matchAvx2(first, second, sig);
+  }
+  if (table->simd == OPOF_FLOW_HASH_SSE2){
+    return matchSse2(first, second, sig);
+  }
+#endif
+  return matchScalar(first, second, sig);
+}
+
+static OPOF_FLOW_HASH_SIMD_T bestSimd(void){
+#ifdef FLOW_HASH_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")){
+    return OPOF_FLOW_HASH_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")){
+    return OPOF_FLOW_HASH_SSE2;
+  }
+#endif
+  return OPOF_FLOW_HASH_SCALAR;
+}
+
+/*
+* The slot of the first matching signature in mask whose entry has the key,
+* as bucket * OPOF_FLOW_HASH_BUCKET_SLOTS + slot with the first bucket 0 and
+* the second 1, or -1.
+*/
+static inline int findSlot(const opof_flow_hash_t *table, const flow_bucket_t *first, const flow_bucket_t *second,
+                           uint32_t mask, const opof_flow_key_t *key){
+  mask &= FLOW_HASH_SLOT_MASK | FLOW_HASH_SLOT_MASK << 16;
+  while (mask != 0){
+    int bit = __builtin_ctz(mask);
+    int slot = (bit & 15) / 2;
+    const flow_bucket_t *bucket = bit < 16 ? first : second;
+    uint32_t index = bucket->index[slot];
+    if (index != 0 && keyEqual(&table->entries[index].key, key)){
+      return (bit < 16 ? 0 : OPOF_FLOW_HASH_BUCKET_SLOTS) + slot;
+    }
+    mask &= mask - 1;
+  }
+  return -1;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Creates a table of at least capacity flows
+*
+* \param  capacity  The most flows the table holds
+* \return The table, NULL when out of memory
+*
+*/
+opof_flow_hash_t *opof_flow_hash_create(unsigned long capacity){
+  opof_flow_hash_t *table = (opof_flow_hash_t *)calloc(1, sizeof(*table));
+  unsigned long buckets = 2;
+
+  if (table == NULL){
+    return NULL;
+  }
+  /* a quarter of the slots spare keeps the insert paths short */
+  while (buckets * OPOF_FLOW_HASH_BUCKET_SLOTS * 3 < capacity * 4){
+    buckets *= 2;
+  }
+  table->capacity = capacity;
+  table->bucketMask = (uint32_t)(buckets - 1);
+  table->simd = bestSimd();
+  if (posix_memalign((void **)&table->buckets, 64, buckets * sizeof(flow_bucket_t)) != 0){
+    table->buckets = NULL;
+    opof_flow_hash_destroy(table);
+    return NULL;
+  }
+  table->entries = (flow_entry_t *)malloc((capacity + 1) * sizeof(flow_entry_t));
+  table->freeEntries = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+  if (table->entries == NULL || table->freeEntries == NULL){
+    opof_flow_hash_destroy(table);
+    return NULL;
+  }
+  opof_flow_hash_reset(table);
+  return table;
+}
+
+void opof_flow_hash_destroy(opof_flow_hash_t *table){
+  if (table == NULL){
+    return;
+  }
+  free(table->buckets);
+  free(table->entries);
+  free(table->freeEntries);
+  free(table);
+}
+
+void opof_flow_hash_reset(opof_flow_hash_t *table){
+  memset(table->buckets, 0, ((size_t)table->bucketMask + 1) * sizeof(flow_bucket_t));
+  /* handed out from 1 up */
+  for (unsigned long i = 0; i < table->capacity; i++){
+    table->freeEntries[i] = (uint32_t)(table->capacity - i);
+  }
+  table->freeCount = table->capacity;
+  table->count = 0;
+}
+
+static int freeSlot(const flow_bucket_t *bucket){
+  for (int slot = 0; slot < OPOF_FLOW_HASH_BUCKET_SLOTS; slot++){
+    if (bucket->index[slot] == 0){
+      return slot;
+    }
+  }
+  return -1;
+}
+
+/*
+* Breadth first search from both buckets of a key for a bucket with a free
+* slot, then moves the entries on the path one bucket along, last first, so
+* that a free slot ends up in one of the key's buckets. Returns that bucket,
+* or -1 when no path is found within FLOW_HASH_BFS_MAX buckets.
+*/
+static long makeRoom(opof_flow_hash_t *table, uint32_t first, uint32_t second){
+  bfs_node_t nodes[FLOW_HASH_BFS_MAX];
+  int head = 0, tail = 0;
+
+  nodes[tail++] = (bfs_node_t){first, -1, -1};
+  nodes[tail++] = (bfs_node_t){second, -1, -1};
+  while (head < tail){
+    int current = head++;
+    flow_bucket_t *bucket = &table->buckets[nodes[current].bucket];
+    int slot = freeSlot(bucket);
+    if (slot >= 0){
+      /* walk back to the root, moving each parent's entry into the free slot */
+      int node = current;
+      while (nodes[node].parent >= 0){
+        flow_bucket_t *to = &table->buckets[nodes[node].bucket];
+        flow_bucket_t *from = &table->buckets[nodes[nodes[node].parent].bucket];
+        int fromSlot = nodes[node].slot;
+        /* a bucket twice on the path may have had the entry moved already */
+        if (from->index[fromSlot] == 0 || to->index[slot] != 0 ||
+            altBucket(table, nodes[nodes[node].parent].bucket, from->sig[fromSlot]) != nodes[node].bucket){
+          return -1;
+        }
+        to->sig[slot] = from->sig[fromSlot];
+        to->index[slot] = from->index[fromSlot];
+        from->index[fromSlot] = 0;
+        from->sig[fromSlot] = 0;
+        slot = fromSlot;
+        node = nodes[node].parent;
+      }
+      return nodes[node].bucket;
+    }
+    for (slot = 0; slot < OPOF_FLOW_HASH_BUCKET_SLOTS && tail < FLOW_HASH_BFS_MAX; slot++){
+      nodes[tail++] = (bfs_node_t){altBucket(table, nodes[current].bucket, bucket->sig[slot]), current, slot};
+    }
+  }
+  return -1;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Adds a flow
+*
+* \param  table  The table
+* \param  key    The flow
+* \param  value  What lookups of the flow return
+* \return _OK, _ALREADY_EXISTS when the key is in the table or
+*         _RESOURCE_EXHAUSTED when the table is full
+*
+*/
+int opof_flow_hash_add(opof_flow_hash_t *table, const opof_flow_key_t *key, uint64_t value){
+  uint64_t hash = hashKey(key);
+  uint16_t sig = signatureOf(hash);
+  uint32_t first = (uint32_t)hash & table->bucketMask;
+  uint32_t second = altBucket(table, first, sig);
+  flow_bucket_t *bucket;
+  long room;
+  int slot;
+
+  if (findSlot(table, &table->buckets[first], &table->buckets[second],
+               matchPair(table, &table->buckets[first], &table->buckets[second], sig), key) >= 0){
+    return _ALREADY_EXISTS;
+  }
+  if (table->freeCount == 0){
+    return _RESOURCE_EXHAUSTED;
+  }
+  room = makeRoom(table, first, second);
+  if (room < 0){
+    return _RESOURCE_EXHAUSTED;
+  }
+  bucket = &table->buckets[room];
+  slot = freeSlot(bucket);
+  uint32_t index = table->freeEntries[--table->freeCount];
+  table->entries[index].key = *key;
+  table->entries[index].value = value;
+  bucket->sig[slot] = sig;
+  bucket->index[slot] = index;
+  table->count++;
+  return _OK;
+}
+
+int opof_flow_hash_del(opof_flow_hash_t *table, const opof_flow_key_t *key){
+  uint64_t hash = hashKey(key);
+  uint16_t sig = signatureOf(hash);
+  uint32_t first = (uint32_t)hash & table->bucketMask;
+  uint32_t second = altBucket(table, first, sig);
+  int found = findSlot(table, &table->buckets[first], &table->buckets[second],
+                       matchPair(table, &table->buckets[first], &table->buckets[second], sig), key);
+
+  if (found < 0){
+    return _NOT_FOUND;
+  }
+  flow_bucket_t *bucket = &table->buckets[found < OPOF_FLOW_HASH_BUCKET_SLOTS ? first : second];
+  int slot = found % OPOF_FLOW_HASH_BUCKET_SLOTS;
+  table->freeEntries[table->freeCount++] = bucket->index[slot];
+  bucket->index[slot] = 0;
+  bucket->sig[slot] = 0;
+  table->count--;
+  return _OK;
+}
+
+/* returns _OK with the value of key, or _NOT_FOUND */
+int opof_flow_hash_lookup(opof_flow_hash_t *table, const opof_flow_key_t *key, uint64_t *value){
+  uint64_t hash = hashKey(key);
+  uint16_t sig = signatureOf(hash);
+  uint32_t first = (uint32_t)hash & table->bucketMask;
+  uint32_t second = altBucket(table, first, sig);
+  const flow_bucket_t *a = &table->buckets[first];
+  const flow_bucket_t *b = &table->buckets[second];
+  int found = findSlot(table, a, b, matchPair(table, a, b, sig), key);
+
+  if (found < 0){
+    return _NOT_FOUND;
+  }
+  *value = table->entries[(found < OPOF_FLOW_HASH_BUCKET_SLOTS ? a : b)->index[found % OPOF_FLOW_HASH_BUCKET_SLOTS]].value;
+  return _OK;
+}
+
+static void matchBurstScalar(const opof_flow_hash_t *table, int count, const uint32_t *first, const uint32_t *second,
+                             const uint16_t *sigs, uint32_t *masks){
+  for (int i = 0; i < count; i++){
+    masks[i] = matchScalar(&table->buckets[first[i]], &table->buckets[second[i]], sigs[i]);
+  }
+}
+
+#ifdef FLOW_HASH_X86
+static void matchBurstSse2(const opof_flow_hash_t *table, int count, const uint32_t *first, const uint32_t *second,
+                           const uint16_t *sigs, uint32_t *masks){
+  for (int i = 0; i < count; i++){
+    masks[i] = matchSse2(&table->buckets[first[i]], &table->buckets[second[i]], sigs[i]);
+  }
+}
+
+__attribute__((target("avx2")))
+static void matchBurstAvx2(const opof_flow_hash_t *table, int count, const uint32_t *first, const uint32_t *second,
+                           const uint16_t *sigs, uint32_t *masks){
+  for (int i = 0; i < count; i++){
+    masks[i] = matchAvx2(&table->buckets[first[i]], &table->buckets[second[i]], sigs[i]);
+  }
+}
+#endif
+
+/**
+* \ingroup servercinterface
+* \brief Looks up a burst of keys
+*
+* \param  table   The table
+* \param  keys    The keys
+* \param  count   How many, at most OPOF_FLOW_HASH_BURST_MAX
+* \param  values  The value of each key found, untouched for the others
+* \return A mask with bit i set when keys[i] was found
+*
+*/
+uint64_t opof_flow_hash_lookup_burst(opof_flow_hash_t *table, const opof_flow_key_t keys[], int count, uint64_t values[]){
+  uint32_t first[OPOF_FLOW_HASH_BURST_MAX];
+  uint32_t second[OPOF_FLOW_HASH_BURST_MAX];
+  uint16_t sigs[OPOF_FLOW_HASH_BURST_MAX];
+  uint32_t masks[OPOF_FLOW_HASH_BURST_MAX];
+  uint64_t hits = 0;
+
+  if (count <= 0){
+    return 0;
+  }
+  if (count > OPOF_FLOW_HASH_BURST_MAX){
+    count = OPOF_FLOW_HASH_BURST_MAX;
+  }
+  for (int i = 0; i < count; i++){
+    uint64_t hash = hashKey(&keys[i]);
+    sigs[i] = signatureOf(hash);
+    first[i] = (uint32_t)hash & table->bucketMask;
+    second[i] = altBucket(table, first[i], sigs[i]);
+    __builtin_prefetch(&table->buckets[first[i]]);
+    __builtin_prefetch(&table->buckets[second[i]]);
+  }
+#ifdef FLOW_HASH_X86
+  if (table->simd == OPOF_FLOW_HASH_AVX2){
+    matchBurstAvx2(table, count, first, second, sigs, masks);
+  } else if (table->simd == OPOF_FLOW_HASH_SSE2){
+    matchBurstSse2(table, count, first, second, sigs, masks);
+  } else
+#endif
+  {
+    matchBurstScalar(table, count, first, second, sigs, masks);
+  }
+  for (int i = 0; i < count; i++){
+    uint32_t mask = masks[i] & (FLOW_HASH_SLOT_MASK | FLOW_HASH_SLOT_MASK << 16);
+    if (mask != 0){
+      int bit = __builtin_ctz(mask);
+      const flow_bucket_t *bucket = &table->buckets[bit < 16 ? first[i] : second[i]];
+      __builtin_prefetch(&table->entries[bucket->index[(bit & 15) / 2]]);
+    }
+  }
+  for (int i = 0; i < count; i++){
+    const flow_bucket_t *a = &table->buckets[first[i]];
+    const flow_bucket_t *b = &table->buckets[second[i]];
+    int found = findSlot(table, a, b, masks[i], &keys[i]);
+    if (found >= 0){
+      values[i] = table->entries[(found < OPOF_FLOW_HASH_BUCKET_SLOTS ? a : b)->index[found % OPOF_FLOW_HASH_BUCKET_SLOTS]].value;
+      hits |= 1ULL << i;
+    }
+  }
+  return hits;
+}
+
+unsigned long opof_flow_hash_count(opof_flow_hash_t *table){
+  return table->count;
+}
+
+unsigned long opof_flow_hash_capacity(opof_flow_hash_t *table){
+  return table->capacity;
+}
+
+/* the two buckets key can be stored in, so tests can crowd keys into them */
+void opof_flow_hash_buckets(opof_flow_hash_t *table, const opof_flow_key_t *key, uint32_t *first, uint32_t *second){
+  uint64_t hash = hashKey(key);
+
+  *first = (uint32_t)hash & table->bucketMask;
+  *second = altBucket(table, *first, signatureOf(hash));
+}
+
+OPOF_FLOW_HASH_SIMD_T opof_flow_hash_simd(opof_flow_hash_t *table){
+  return table->simd;
+}
+
+/* the compare actually used, simd capped at what the CPU has */
+OPOF_FLOW_HASH_SIMD_T opof_flow_hash_set_simd(opof_flow_hash_t *table, OPOF_FLOW_HASH_SIMD_T simd){
+  OPOF_FLOW_HASH_SIMD_T best = bestSimd();
+
+  table->simd = simd < best ? simd : best;
+  return table->simd;
+}
@@ -0,0 +1,511 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Lookup rate of the cuckoo flow hash
+*
+* Fills an opof_flow_hash_t with the flows of random sessions, by default
+* 1000000 of which a fifth are IPv6, and measures millions of lookups per
+* second of packets of which 90% belong to a flow. Lookups are measured one
+* at a time and in bursts, with each signature compare the CPU has, and
+* against a std::unordered_map of the same flows as a baseline. Every
+* lookup result is checked and a wrong one fails the run.
+*
+* Small tables of random capacities are then filled until an add fails,
+* which is at their capacity unless no path of moves frees a slot, and every
+* flow added must still be found before all are deleted again. Every other
+* table only gets flows whose two buckets are those of its first flow, so
+* the moves between them run out of room after two buckets' worth. Last, a
+* table kept near its capacity has random flows deleted and new ones added
+* in turn, checked against a std::unordered_map.
+*
+* Results are printed as JSON.
+*/
+extern "C" {
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_test.h"
+#include "opof_flow_hash.h"
+}
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define FLOW_HASH_BENCH_PACKETS (1 << 20)
+#define FLOW_HASH_BENCH_FILL_MAX 512
+#define FLOW_HASH_BENCH_CHURN_MAX (1 << 16)
+
+struct FlowHashBenchConfig {
+    unsigned long flows;
+    unsigned int ipv6Percent;
+    unsigned int hitPercent;
+    unsigned long lookups;
+    int burst;
+    unsigned long fills;
+    unsigned long churn;
+    unsigned long seed;
+    std::string output;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+typedef std::mt19937_64 BenchRandom;
+
+struct KeyHash {
+    size_t operator()(const opof_flow_key_t &key) const {
+      uint64_t words[6] = {0};
+      uint64_t h = 0;
+      memcpy(words, &key, sizeof(key));
+      for (int i = 0; i < 6; i++){
+        h = (h ^ words[i]) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+      }
+      return (size_t)h;
+    }
+};
+
+struct KeyEqual {
+    bool operator()(const opof_flow_key_t &a, const opof_flow_key_t &b) const {
+      return memcmp(&a, &b, sizeof(a)) == 0;
+    }
+};
+
+typedef std::unordered_map<opof_flow_key_t, uint64_t, KeyHash, KeyEqual> BaselineMap;
+
+struct LookupResult {
+    unsigned long lookups;
+    unsigned long hits;
+    unsigned long wrong;
+    double seconds;
+};
+
+static double secondsSince(BenchClock::time_point start) {
+  return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+static unsigned int pick(BenchRandom &random, unsigned int n) {
+  return (unsigned int)(random() % n);
+}
+
+static void randomSession(BenchRandom &random, const FlowHashBenchConfig &config, sessionRequest_t *request) {
+  memset(request, 0, sizeof(*request));
+  request->inlif = 1 + pick(random, 4);
+  request->vlan_inLif = pick(random, 2) ? 100 + pick(random, 8) : 0;
+  request->proto = pick(random, 4) ? _TCP : _UDP;
+  request->srcPort = 1024 + pick(random, 64512);
+  request->dstPort = pick(random, 2) ? 443 : 1 + pick(random, 65535);
+  if (pick(random, 100) < config.ipv6Percent){
+    request->ipver = _IPV6;
+    for (int i = 0; i < 16; i++){
+      request->srcIPV6.s6_addr[i] = (uint8_t)random();
+      request->dstIPV6.s6_addr[i] = (uint8_t)random();
+    }
+  } else {
+    request->ipver = _IPV4;
+    request->srcIP.s_addr = htonl(0x0a000000 | pick(random, 1 << 24));
+    request->dstIP.s_addr = (uint32_t)random();
+  }
+}
+
+static LookupResult measureSingle(opof_flow_hash_t *table, const std::vector<opof_flow_key_t> &packets,
+                                  const std::vector<uint64_t> &expected, unsigned long lookups) {
+  LookupResult result = {lookups, 0, 0, 0.0};
+
+  BenchClock::time_point start = BenchClock::now();
+  for (unsigned long i = 0; i < lookups; i++){
+    size_t p = i & (FLOW_HASH_BENCH_PACKETS - 1);
+    uint64_t value = 0;
+    opof_flow_hash_lookup(table, &packets[p], &value);
+    result.hits += value != 0;
+    result.wrong += value != expected[p];
+  }
+  result.seconds = secondsSince(start);
+  return result;
+}
+
+static LookupResult measureBurst(opof_flow_hash_t *table, const std::vector<opof_flow_key_t> &packets,
+                                 const std::vector<uint64_t> &expected, unsigned long lookups, int burst) {
+  LookupResult result = {lookups - lookups % burst, 0, 0, 0.0};
+  uint64_t values[OPOF_FLOW_HASH_BURST_MAX];
+
+  BenchClock::time_point start = BenchClock::now();
+  for (unsigned long i = 0; i < result.lookups; i += burst){
+    size_t p = i & (FLOW_HASH_BENCH_PACKETS - 1);
+    uint64_t hits = opof_flow_hash_lookup_burst(table, &packets[p], burst, values);
+    for (int j = 0; j < burst; j++){
+      uint64_t value = (hits >> j & 1) ? values[j] : 0;
+      result.hits += value != 0;
+      result.wrong += value != expected[p + j];
+    }
+  }
+  result.seconds = secondsSince(start);
+  return result;
+}
+
+static LookupResult measureBaseline(const BaselineMap &map, const std::vector<opof_flow_key_t> &packets,
+                                    const std::vector<uint64_t> &expected, unsigned long lookups) {
+  LookupResult result = {lookups, 0, 0, 0.0};
+
+  BenchClock::time_point start = BenchClock::now();
+  for (unsigned long i = 0; i < lookups; i++){
+    size_t p = i & (FLOW_HASH_BENCH_PACKETS - 1);
+    BaselineMap::const_iterator it = map.find(packets[p]);
+    uint64_t value = it == map.end() ? 0 : it->second;
+    result.hits += value != 0;
+    result.wrong += value != expected[p];
+  }
+  result.seconds = secondsSince(start);
+  return result;
+}
+
+static void randomKey(BenchRandom &random, const FlowHashBenchConfig &config, opof_flow_key_t *key) {
+  sessionRequest_t request;
+  randomSession(random, config, &request);
+  opof_flow_key_from_request(&request, key);
+}
+
+struct FillResult {
+    unsigned long tables;
+    unsigned long flows;
+    unsigned long capacity;
+    unsigned long early;
+    unsigned long crowded;
+    unsigned long wrong;
+};
+
+/*
+* Adds random flows to tables of 1 to FLOW_HASH_BENCH_FILL_MAX flows until
+* an add fails, which counts as early when it is before the capacity. A
+* crowded table holds more than two buckets' worth of flows in four buckets,
+* and gets only flows that share the buckets of its first, so its adds must
+* fail early, with both buckets full. Every added flow must then be found,
+* the failed one not, and each must delete once.
+*/
+static FillResult checkFills(BenchRandom &random, const FlowHashBenchConfig &config) {
+  FillResult result = {config.fills, 0, 0, 0, 0, 0};
+  std::vector<opof_flow_key_t> keys;
+  opof_flow_key_t key;
+  uint64_t value;
+
+  for (unsigned long t = 0; t < config.fills; t++){
+    bool crowded = t % 2 == 1;
+    unsigned long capacity = crowded ? 2 * OPOF_FLOW_HASH_BUCKET_SLOTS + 1 + pick(random, OPOF_FLOW_HASH_BUCKET_SLOTS) :
+                                       1 + pick(random, FLOW_HASH_BENCH_FILL_MAX);
+    opof_flow_hash_t *table = opof_flow_hash_create(capacity);
+    uint32_t pair[2] = {0, 0}, buckets[2];
+    int status;
+    if (table == NULL){
+      result.wrong++;
+      continue;
+    }
+    keys.clear();
+    for (;;){
+      randomKey(random, config, &key);
+      opof_flow_hash_buckets(table, &key, &buckets[0], &buckets[1]);
+      if (keys.empty()){
+        pair[0] = buckets[0];
+        pair[1] = buckets[1];
+      } else if (crowded && (std::min(pair[0], pair[1]) != std::min(buckets[0], buckets[1]) ||
+                             std::max(pair[0], pair[1]) != std::max(buckets[0], buckets[1]))){
+        continue;
+      }
+      status = opof_flow_hash_add(table, &key, keys.size() + 1);
+      if (status == _ALREADY_EXISTS){
+        continue;
+      }
+      if (status != _OK){
+        break;
+      }
+      keys.push_back(key);
+    }
+    if (crowded){
+      result.crowded++;
+      result.wrong += keys.size() != 2 * OPOF_FLOW_HASH_BUCKET_SLOTS;
+    } else {
+      result.flows += keys.size();
+      result.capacity += capacity;
+      result.early += keys.size() < capacity;
+    }
+    result.wrong += status != _RESOURCE_EXHAUSTED || opof_flow_hash_lookup(table, &key, &value) != _NOT_FOUND;
+    for (size_t i = 0; i < keys.size(); i++){
+      value = 0;
+      result.wrong += opof_flow_hash_lookup(table, &keys[i], &value) != _OK || value != i + 1;
+    }
+    for (size_t i = 0; i < keys.size(); i++){
+      result.wrong += opof_flow_hash_del(table, &keys[i]) != _OK;
+      result.wrong += opof_flow_hash_del(table, &keys[i]) != _NOT_FOUND;
+    }
+    result.wrong += opof_flow_hash_count(table) != 0 ||
+                    (!keys.empty() && opof_flow_hash_lookup(table, &keys[0], &value) != _NOT_FOUND);
+    opof_flow_hash_destroy(table);
+  }
+  return result;
+}
+
+struct ChurnResult {
+    unsigned long flows;
+    unsigned long changes;
+    unsigned long exhausted;
+    unsigned long wrong;
+};
+
+/*
+* Fills a table to nine tenths of its capacity, then deletes a random flow
+* and adds a new one config.churn times, checking each result against a
+* std::unordered_map, and looks every flow up at the end.
+*/
+static ChurnResult measureChurn(BenchRandom &random, const FlowHashBenchConfig &config) {
+  unsigned long capacity = std::min(config.flows, (unsigned long)FLOW_HASH_BENCH_CHURN_MAX);
+  ChurnResult result = {capacity * 9 / 10, config.churn, 0, 0};
+  opof_flow_hash_t *table = opof_flow_hash_create(capacity);
+  std::vector<opof_flow_key_t> keys;
+  BaselineMap present;
+  opof_flow_key_t key;
+  uint64_t value, next = 1;
+
+  if (table == NULL){
+    result.wrong++;
+    return result;
+  }
+  while (keys.size() < result.flows){
+    randomKey(random, config, &key);
+    if (present.count(key) == 0 && opof_flow_hash_add(table, &key, next) == _OK){
+      present[key] = next++;
+      keys.push_back(key);
+    }
+  }
+  for (unsigned long i = 0; i < config.churn; i++){
+    size_t victim = pick(random, keys.size());
+    result.wrong += opof_flow_hash_del(table, &keys[victim]) != _OK;
+    result.wrong += opof_flow_hash_lookup(table, &keys[victim], &value) != _NOT_FOUND;
+    present.erase(keys[victim]);
+    do {
+      randomKey(random, config, &key);
+    } while (present.count(key) != 0);
+    int status = opof_flow_hash_add(table, &key, next);
+    if (status == _RESOURCE_EXHAUSTED){
+      /* no path of moves within reach, rare this far below capacity */
+      result.exhausted++;
+      keys[victim] = keys.back();
+      keys.pop_back();
+      continue;
+    }
+    result.wrong += status != _OK;
+    present[key] = next++;
+    keys[victim] = key;
+  }
+  for (BaselineMap::const_iterator it = present.begin(); it != present.end(); ++it){
+    value = 0;
+    result.wrong += opof_flow_hash_lookup(table, &it->first, &value) != _OK || value != it->second;
+  }
+  opof_flow_hash_destroy(table);
+  return result;
+}
+
+static void printLookups(FILE *out, const char *name, const LookupResult &result, bool last) {
+  fprintf(out, "    \"%s\": {\"lookups\": %lu, \"hits\": %lu, \"wrong\": %lu, \"mpps\": %.2f, \"nanosPerLookup\": %.1f}%s\n",
+          name, result.lookups, result.hits, result.wrong, result.lookups / result.seconds / 1e6,
+          result.seconds * 1e9 / result.lookups, last ? "" : ",");
+}
+
+static void displayHelp(void) {
+  printf("\nCommand line arguments for the OpenOffload flow hash benchmark version: %s \n", OPOF_VERSION);
+  printf("\t-n, --flows           Flows in the table (default 1000000)\n");
+  printf("\t-6, --ipv6            Percent of IPv6 flows (default 20)\n");
+  printf("\t-m, --hit             Percent of packets that belong to a flow (default 90)\n");
+  printf("\t-l, --lookups         Lookups per measurement (default 20000000)\n");
+  printf("\t-b, --burst           Keys per burst lookup, at most %d (default 32)\n", OPOF_FLOW_HASH_BURST_MAX);
+  printf("\t-f, --fills           Small tables filled until an add fails (default 10000)\n");
+  printf("\t-c, --churn           Deletes each followed by an add near capacity (default 1000000)\n");
+  printf("\t-s, --seed            Random seed (default 1)\n");
+  printf("\t-o, --output          Write the JSON results to this file instead of stdout\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  FlowHashBenchConfig config = {1000000, 20, 90, 20000000, 32, 10000, 1000000, 1, ""};
+  static struct option longopts[] = {
+    {"flows", required_argument, NULL, 'n'},
+    {"ipv6", required_argument, NULL, '6'},
+    {"hit", required_argument, NULL, 'm'},
+    {"lookups", required_argument, NULL, 'l'},
+    {"burst", required_argument, NULL, 'b'},
+    {"fills", required_argument, NULL, 'f'},
+    {"churn", required_argument, NULL, 'c'},
+    {"seed", required_argument, NULL, 's'},
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  static const char *simdNames[] = {"scalar", "sse2", "avx2"};
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:6:m:l:b:f:c:s:o:h", longopts, NULL)) != -1){
+    switch (c){
+      case 'n':
+        config.flows = strtoul(optarg, NULL, 0);
+        break;
+      case '6':
+        config.ipv6Percent = strtoul(optarg, NULL, 0);
+        break;
+      case 'm':
+        config.hitPercent = strtoul(optarg, NULL, 0);
+        break;
+      case 'l':
+        config.lookups = strtoul(optarg, NULL, 0);
+        break;
+      case 'b':
+        config.burst = atoi(optarg);
+        break;
+      case 'f':
+        config.fills = strtoul(optarg, NULL, 0);
+        break;
+      case 'c':
+        config.churn = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        config.seed = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        config.output = optarg;
+        break;
+      case 'h':
+      default:
+        displayHelp();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  if (config.flows == 0 || config.ipv6Percent > 100 || config.hitPercent > 100 ||
+      config.burst < 1 || config.burst > OPOF_FLOW_HASH_BURST_MAX ||
+      FLOW_HASH_BENCH_PACKETS % config.burst != 0){
+    fprintf(stderr, "flows must be at least 1, ipv6 and hit 0 to 100, burst a power of two up to %d\n",
+            OPOF_FLOW_HASH_BURST_MAX);
+    return 1;
+  }
+
+  BenchRandom random(config.seed);
+  opof_flow_hash_t *table = opof_flow_hash_create(config.flows);
+  std::vector<opof_flow_key_t> keys(config.flows);
+  BaselineMap baseline;
+  sessionRequest_t request;
+
+  if (table == NULL){
+    fprintf(stderr, "No memory for %lu flows\n", config.flows);
+    return 1;
+  }
+  for (unsigned long i = 0; i < config.flows; i++){
+    randomSession(random, config, &request);
+    opof_flow_key_from_request(&request, &keys[i]);
+  }
+  BenchClock::time_point start = BenchClock::now();
+  unsigned long duplicates = 0;
+  for (unsigned long i = 0; i < config.flows; i++){
+    int status = opof_flow_hash_add(table, &keys[i], i + 1);
+    if (status == _ALREADY_EXISTS){
+      duplicates++;
+    } else if (status != _OK){
+      fprintf(stderr, "Adding flow %lu failed: %d\n", i, status);
+      return 1;
+    }
+  }
+  double addSeconds = secondsSince(start);
+  baseline.reserve(config.flows);
+  for (unsigned long i = 0; i < config.flows; i++){
+    baseline.insert(BaselineMap::value_type(keys[i], i + 1));
+  }
+
+  /*
+  * Misses are sessions that were never added, some with a flow's tuple on
+  * another Lif. expected holds the value each packet finds, 0 for none.
+  */
+  std::vector<opof_flow_key_t> packets(FLOW_HASH_BENCH_PACKETS);
+  std::vector<uint64_t> expected(FLOW_HASH_BENCH_PACKETS);
+  for (size_t i = 0; i < packets.size(); i++){
+    if (pick(random, 100) < config.hitPercent){
+      packets[i] = keys[pick(random, config.flows)];
+    } else if (pick(random, 2)){
+      packets[i] = keys[pick(random, config.flows)];
+      packets[i].lif += 4;
+    } else {
+      randomSession(random, config, &request);
+      opof_flow_key_from_request(&request, &packets[i]);
+    }
+    BaselineMap::const_iterator it = baseline.find(packets[i]);
+    expected[i] = it == baseline.end() ? 0 : it->second;
+  }
+
+  OPOF_FLOW_HASH_SIMD_T best = opof_flow_hash_simd(table);
+  std::vector<LookupResult> single, burst;
+  unsigned long wrong = 0;
+  for (int simd = OPOF_FLOW_HASH_SCALAR; simd <= best; simd++){
+    opof_flow_hash_set_simd(table, (OPOF_FLOW_HASH_SIMD_T)simd);
+    single.push_back(measureSingle(table, packets, expected, config.lookups));
+    burst.push_back(measureBurst(table, packets, expected, config.lookups, config.burst));
+    wrong += single.back().wrong + burst.back().wrong;
+  }
+  LookupResult unorderedMap = measureBaseline(baseline, packets, expected, config.lookups);
+  FillResult fills = checkFills(random, config);
+  ChurnResult churn = measureChurn(random, config);
+  wrong += fills.wrong + churn.wrong;
+
+  FILE *out = stdout;
+  if (!config.output.empty()){
+    out = fopen(config.output.c_str(), "w");
+    if (out == NULL){
+      fprintf(stderr, "Cannot write %s\n", config.output.c_str());
+      return 1;
+    }
+  }
+  fprintf(out, "{\n");
+  fprintf(out, "  \"config\": {\"flows\": %lu, \"ipv6Percent\": %u, \"hitPercent\": %u, \"lookups\": %lu, "
+          "\"burst\": %d, \"seed\": %lu},\n", config.flows, config.ipv6Percent, config.hitPercent,
+          config.lookups, config.burst, config.seed);
+  fprintf(out, "  \"duplicates\": %lu,\n", duplicates);
+  fprintf(out, "  \"addsPerSecond\": %.0f,\n", config.flows / addSeconds);
+  fprintf(out, "  \"single\": {\n");
+  for (size_t i = 0; i < single.size(); i++){
+    printLookups(out, simdNames[i], single[i], i + 1 == single.size());
+  }
+  fprintf(out, "  },\n");
+  fprintf(out, "  \"burst\": {\n");
+  for (size_t i = 0; i < burst.size(); i++){
+    printLookups(out, simdNames[i], burst[i], i + 1 == burst.size());
+  }
+  fprintf(out, "  },\n");
+  fprintf(out, "  \"baseline\": {\n");
+  printLookups(out, "unorderedMap", unorderedMap, true);
+  fprintf(out, "  },\n");
+  fprintf(out, "  \"fills\": {\"tables\": %lu, \"crowded\": %lu, \"fillPercent\": %.2f, \"early\": %lu, \"wrong\": %lu},\n",
+          fills.tables, fills.crowded, fills.capacity ? fills.flows * 100.0 / fills.capacity : 0.0, fills.early, fills.wrong);
+  fprintf(out, "  \"churn\": {\"flows\": %lu, \"changes\": %lu, \"exhausted\": %lu, \"wrong\": %lu},\n",
+          churn.flows, churn.changes, churn.exhausted, churn.wrong);
+  fprintf(out, "  \"wrong\": %lu\n", wrong);
+  fprintf(out, "}\n");
+  if (out != stdout){
+    fclose(out);
+  }
+  opof_flow_hash_destroy(table);
+  return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,692 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Firewall traffic simulator on top of the C client library
+*
+* The C counterpart of tests/pythonSimulator/fw_sessions_client_simulator.py,
+* fast enough to drive an offload device at production rates.
+*
+* Each thread plays one firewall dataplane core. New flows arrive as a
+* Poisson process at --rate flows per second over all threads and are
+* offloaded in batches of up to --batch, or after FWSIM_FLUSH_MSEC when the
+* batch does not fill. Every flow gets a random 5-tuple: IPv6 for --ipv6
+* percent of the flows, UDP for --udp percent, client addresses and
+* ephemeral source ports at random, server ports from a weighted list of
+* common services. --nat percent of the flows get source NAT on the egress
+* link, and every flow forwards to one of --nexthops next hops, which are
+* programmed with MAC rewrite at startup.
+*
+* Flow lifetimes are lognormal around --lifetime seconds, so most flows are
+* short and a few live for a long time. When a flow's lifetime ends the
+* firewall deletes the session. A separate thread polls closed sessions
+* every --closed msec and drops them from the owning thread's table, as the
+* firewall would when the device reports that a flow ended on its own.
+*
+* Flows that cannot be offloaded because a thread fell more than a second
+* behind its arrivals stay in the firewall's slow path and are counted, not
+* queued. Every --report seconds a line shows the throughput and the number
+* of offloaded sessions the firewall holds.
+*/
+extern "C" {
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_clientlib.h"
+#include "opof_test.h"
+#include "opof_test_util.h"
+
+unsigned int opof_set_deadline(int deadline);
+}
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "opof_bench_util.h"
+
+#define FWSIM_THREADS_MAX 64
+#define FWSIM_FLUSH_MSEC 1
+#define FWSIM_LIFETIME_MIN 0.01
+#define FWSIM_LIFETIME_MAX 86400.0
+
+typedef std::chrono::steady_clock SimClock;
+
+struct SimConfig {
+    std::string address;
+    unsigned short port;
+    int threads;
+    double rate;
+    int batch;
+    int pageSize;
+    double lifetime;
+    double lifetimeSigma;
+    int ipv6Percent;
+    int udpPercent;
+    int natPercent;
+    int nextHops;
+    int closedMsec;
+    double report;
+    double duration;
+    int deadline;
+    unsigned long seed;
+};
+
+/*
+* Totals over all threads, read by the reporter.
+*/
+struct SimCounters {
+    std::atomic<uint64_t> offered;
+    std::atomic<uint64_t> offloaded;
+    std::atomic<uint64_t> ipv6;
+    std::atomic<uint64_t> nat;
+    std::atomic<uint64_t> rejected;
+    std::atomic<uint64_t> addFailed;
+    std::atomic<uint64_t> slowPath;
+    std::atomic<uint64_t> deleted;
+    std::atomic<uint64_t> deleteMissing;
+    std::atomic<uint64_t> closed;
+    std::atomic<uint64_t> closedUnknown;
+    std::atomic<int64_t> active;
+};
+
+static SimCounters counters;
+static std::atomic<bool> running(true);
+
+struct ServicePort {
+    unsigned short port;
+    unsigned int weight;
+};
+
+static const ServicePort tcpPorts[] = {{443, 60}, {80, 20}, {8080, 8}, {22, 5}, {25, 4}, {3389, 3}};
+static const ServicePort udpPorts[] = {{53, 55}, {443, 30}, {123, 10}, {161, 5}};
+
+static void stop(int signo) {
+  (void)signo;
+  running = false;
+}
+
+class FirewallThread {
+public:
+    FirewallThread(const SimConfig &config, int id, sessionTable_t *handle)
+    : config_(config), id_(id), handle_(handle), nextId_(1), pending_(0),
+      rng_(config.seed + id), gap_(config.rate / config.threads),
+      lifetime_(log(config.lifetime), config.lifetimeSigma) {
+      requests_ = (sessionRequest_t **)calloc(config.batch, sizeof(sessionRequest_t *));
+      for (int i = 0; i < config.batch; i++){
+        requests_[i] = (sessionRequest_t *)calloc(1, sizeof(sessionRequest_t));
+      }
+    }
+
+    ~FirewallThread() {
+      for (int i = 0; i < config_.batch; i++){
+        free(requests_[i]);
+      }
+      free(requests_);
+    }
+
+    void run(SimClock::time_point stopTime);
+    void closed(unsigned long sessionId);
+    void cleanup();
+
+private:
+    void newFlow(SimClock::time_point now);
+    void offload(SimClock::time_point now);
+    void expire(SimClock::time_point now);
+    void drainClosed();
+    unsigned long newId();
+    unsigned short servicePort(const ServicePort *ports, size_t count);
+    void randomAddress(sessionRequest_t *request, bool source);
+    void randomNat(nat_t *nat, IP_VERSION_T ipver, PROTOCOL_ID_T proto);
+
+    typedef std::pair<SimClock::time_point, unsigned long> Expiry;
+
+    const SimConfig &config_;
+    int id_;
+    sessionTable_t *handle_;
+    sessionRequest_t **requests_;
+    double lifetimes_[BUFFER_MAX];
+    unsigned long nextId_;
+    int pending_;
+    SimClock::time_point firstPending_;
+    std::mt19937_64 rng_;
+    std::exponential_distribution<double> gap_;
+    std::lognormal_distribution<double> lifetime_;
+    std::unordered_map<unsigned long, SimClock::time_point> flows_;
+    std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry> > expiries_;
+    std::mutex closedMutex_;
+    std::vector<unsigned long> closed_;
+};
+
+unsigned long FirewallThread::newId() {
+  unsigned long id;
+  do {
+    id = benchNewId(id_, &nextId_);
+  } while (flows_.count(id) != 0);
+  return id;
+}
+
+unsigned short FirewallThread::servicePort(const ServicePort *ports, size_t count) {
+  unsigned int total = 0;
+  for (size_t i = 0; i < count; i++){
+    total += ports[i].weight;
+  }
+  unsigned int r = rng_() % total;
+  size_t i = 0;
+  while (r >= ports[i].weight){
+    r -= ports[i].weight;
+    i++;
+  }
+  return ports[i].port;
+}
+
+/*
+* Clients are in 10.0.0.0/8 or 2001:db8:1::/48, servers in 198.18.0.0/15 or
+* 2001:db8:2::/48.
+*/
+void FirewallThread::randomAddress(sessionRequest_t *request, bool source) {
+  uint64_t bits = rng_();
+  if (request->ipver == _IPV6){
+    struct in6_addr *addr = source ? &request->srcIPV6 : &request->dstIPV6;
+    static const uint8_t prefix[6] = {0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00};
+    memcpy(addr->s6_addr, prefix, sizeof(prefix));
+    addr->s6_addr[5] = source ? 1 : 2;
+    memcpy(&addr->s6_addr[8], &bits, 8);
+    bits = rng_();
+    memcpy(&addr->s6_addr[6], &bits, 2);
+  } else if (source){
+    request->srcIP.s_addr = htonl(0x0a000000 | (uint32_t)(bits & 0x00ffffff));
+  } else {
+    request->dstIP.s_addr = htonl(0xc6120000 | (uint32_t)(bits & 0x0001ffff));
+  }
+}
+
+/*
+* Source NAT to 203.0.113.0/24 or 2001:db8:ffff::/48 with a random port.
+*/
+void FirewallThread::randomNat(nat_t *nat, IP_VERSION_T ipver, PROTOCOL_ID_T proto) {
+  uint64_t bits = rng_();
+  memset(nat, 0, sizeof(*nat));
+  nat->ipver = ipver;
+  if (ipver == _IPV6){
+    static const uint8_t prefix[6] = {0x20, 0x01, 0x0d, 0xb8, 0xff, 0xff};
+    memcpy(nat->ipv6.s6_addr, prefix, sizeof(prefix));
+    nat->ipv6.s6_addr[15] = (uint8_t)bits;
+  } else {
+    nat->ipv4.s_addr = htonl(0xcb007100 | (uint32_t)(bits & 0xff));
+  }
+  nat->proto = proto;
+  nat->port = 1024 + (bits >> 8) % (65536 - 1024);
+}
+
+void FirewallThread::newFlow(SimClock::time_point now) {
+  sessionRequest_t *request = requests_[pending_];
+  bool udp = (int)(rng_() % 100) < config_.udpPercent;
+
+  if (pending_ == 0){
+    firstPending_ = now;
+  }
+  memset(request, 0, sizeof(*request));
+  request->sessId = newId();
+  request->inlif = 1;
+  request->outlif = 2;
+  request->encapType = _NONE;
+  request->ipver = (int)(rng_() % 100) < config_.ipv6Percent ? _IPV6 : _IPV4;
+  request->proto = udp ? _UDP : _TCP;
+  randomAddress(request, true);
+  randomAddress(request, false);
+  request->srcPort = 32768 + rng_() % (61000 - 32768);
+  request->dstPort = udp ? servicePort(udpPorts, sizeof(udpPorts) / sizeof(udpPorts[0])) :
+                           servicePort(tcpPorts, sizeof(tcpPorts) / sizeof(tcpPorts[0]));
+  request->actionParams.actionType = _FORWARD;
+  request->actionParams.actionParams_inLif.nextHopId = 1 + rng_() % config_.nextHops;
+  request->actionParams.actionParams_outLif.nextHopId = 1 + rng_() % config_.nextHops;
+  if ((int)(rng_() % 100) < config_.natPercent){
+    request->actionParams.actionParams_outLif.snatEnable = true;
+    randomNat(&request->actionParams.actionParams_outLif.snat, request->ipver, request->proto);
+    counters.nat++;
+  }
+  lifetimes_[pending_] = std::min(std::max(lifetime_(rng_), FWSIM_LIFETIME_MIN), FWSIM_LIFETIME_MAX);
+  request->cacheTimeout = (unsigned int)ceil(lifetimes_[pending_]);
+  if (request->ipver == _IPV6){
+    counters.ipv6++;
+  }
+  counters.offered++;
+  pending_++;
+}
+
+void FirewallThread::offload(SimClock::time_point now) {
+  thread_local addSessionResponse_t response;
+  uint64_t offloaded = 0;
+
+  response.number_errors = 0;
+  int status = opof_add_session(pending_, handle_, requests_, &response);
+  if (status != _OK){
+    counters.addFailed += pending_;
+    pending_ = 0;
+    return;
+  }
+  for (int i = 0; i < pending_; i++){
+    bool rejected = false;
+    for (int e = 0; e < response.number_errors; e++){
+      if (response.sessionErrors[e].sessionId == requests_[i]->sessId){
+        rejected = true;
+        break;
+      }
+    }
+    if (rejected){
+      continue;
+    }
+    SimClock::time_point expiry = now + std::chrono::duration_cast<SimClock::duration>(
+      std::chrono::duration<double>(lifetimes_[i]));
+    flows_[requests_[i]->sessId] = expiry;
+    expiries_.push(Expiry(expiry, requests_[i]->sessId));
+    offloaded++;
+  }
+  counters.offloaded += offloaded;
+  counters.rejected += pending_ - offloaded;
+  counters.active += offloaded;
+  pending_ = 0;
+}
+
+void FirewallThread::expire(SimClock::time_point now) {
+  sessionResponse_t response;
+  while (!expiries_.empty() && expiries_.top().first <= now){
+    Expiry expiry = expiries_.top();
+    expiries_.pop();
+    auto flow = flows_.find(expiry.second);
+    /* already reported closed, or the ID was reused by a later flow */
+    if (flow == flows_.end() || flow->second != expiry.first){
+      continue;
+    }
+    flows_.erase(flow);
+    counters.active--;
+    if (opof_del_session(handle_, expiry.second, &response) == _OK){
+      counters.deleted++;
+    } else {
+      counters.deleteMissing++;
+    }
+  }
+}
+
+void FirewallThread::closed(unsigned long sessionId) {
+  std::lock_guard<std::mutex> lock(closedMutex_);
+  closed_.push_back(sessionId);
+}
+
+void FirewallThread::drainClosed() {
+  std::vector<unsigned long> ids;
+  {
+    std::lock_guard<std::mutex> lock(closedMutex_);
+    ids.swap(closed_);
+  }
+  for (unsigned long sessionId : ids){
+    if (flows_.erase(sessionId) != 0){
+      counters.closed++;
+      counters.active--;
+    } else {
+      counters.closedUnknown++;
+    }
+  }
+}
+
+void FirewallThread::run(SimClock::time_point stopTime) {
+  SimClock::duration second = std::chrono::seconds(1);
+  SimClock::duration flush = std::chrono::milliseconds(FWSIM_FLUSH_MSEC);
+  SimClock::time_point arrival = SimClock::now();
+
+  while (running){
+    SimClock::time_point now = SimClock::now();
+    if (now >= stopTime){
+      break;
+    }
+    /* more than a second behind: the firewall keeps these flows itself */
+    while (arrival < now - second){
+      counters.offered++;
+      counters.slowPath++;
+      arrival += std::chrono::duration_cast<SimClock::duration>(std::chrono::duration<double>(gap_(rng_)));
+    }
+    while (arrival <= now && pending_ < config_.batch){
+      newFlow(now);
+      arrival += std::chrono::duration_cast<SimClock::duration>(std::chrono::duration<double>(gap_(rng_)));
+    }
+    if (pending_ == config_.batch || (pending_ > 0 && now - firstPending_ >= flush)){
+      offload(now);
+    }
+    expire(now);
+    drainClosed();
+
+    SimClock::time_point wake = std::min(arrival, now + flush);
+    if (pending_ > 0){
+      wake = std::min(wake, firstPending_ + flush);
+    }
+    if (!expiries_.empty()){
+      wake = std::min(wake, expiries_.top().first);
+    }
+    if (wake > SimClock::now()){
+      std::this_thread::sleep_until(wake);
+    }
+  }
+}
+
+void FirewallThread::cleanup() {
+  sessionResponse_t response;
+  drainClosed();
+  for (auto &flow : flows_){
+    opof_del_session(handle_, flow.first, &response);
+  }
+  counters.active -= flows_.size();
+  flows_.clear();
+}
+
+/*
+* Polls the closed sessions and hands each one to the thread that owns its ID.
+*/
+static void pollClosed(const SimConfig &config, sessionTable_t *handle, std::vector<FirewallThread *> &threads) {
+  std::vector<sessionResponse_t> responses(config.pageSize);
+  while (running){
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.closedMsec));
+    unsigned long sessionCount;
+    do {
+      streamArgs_t args;
+      args.handle = handle;
+      args.pageSize = config.pageSize;
+      sessionCount = 0;
+      if (opof_get_closed_sessions(&args, responses.data(), &sessionCount) != _OK){
+        break;
+      }
+      for (unsigned long i = 0; i < sessionCount; i++){
+        unsigned long owner = responses[i].sessionId / BENCH_IDS_PER_THREAD;
+        if (owner < threads.size()){
+          threads[owner]->closed(responses[i].sessionId);
+        } else {
+          counters.closedUnknown++;
+        }
+      }
+    } while (running && sessionCount == (unsigned long)config.pageSize);
+  }
+}
+
+static void setNextHops(const SimConfig &config, sessionTable_t *handle) {
+  for (int i = 1; i <= config.nextHops; i++){
+    nextHopParameters_t nextHop;
+    memset(&nextHop, 0, sizeof(nextHop));
+    nextHop.nextHopId = i;
+    nextHop.ipver = _IPV4;
+    nextHop.macRewriteEnable = true;
+    uint8_t srcMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    uint8_t dstMac[6] = {0x02, 0x00, 0x00, 0x00, 0x01, (uint8_t)i};
+    memcpy(nextHop.macRewrite.srcMac, srcMac, 6);
+    memcpy(nextHop.macRewrite.dstMac, dstMac, 6);
+    if (opof_set_next_hop(handle, &nextHop) != _OK){
+      fprintf(stderr, "warning: could not set next hop %d, continuing without\n", i);
+      return;
+    }
+  }
+}
+
+struct SimSnapshot {
+    uint64_t offered;
+    uint64_t offloaded;
+    uint64_t rejected;
+    uint64_t slowPath;
+    uint64_t deleted;
+    uint64_t closed;
+};
+
+static SimSnapshot snapshot() {
+  SimSnapshot s;
+  s.offered = counters.offered;
+  s.offloaded = counters.offloaded;
+  s.rejected = counters.rejected + counters.addFailed;
+  s.slowPath = counters.slowPath;
+  s.deleted = counters.deleted;
+  s.closed = counters.closed;
+  return s;
+}
+
+static void printRates(const char *label, const SimSnapshot &now, const SimSnapshot &before, double seconds) {
+  printf("%10s %12.0f %12.0f %10.0f %10.0f %10.0f %10.0f %12ld\n", label,
+    (now.offered - before.offered) / seconds, (now.offloaded - before.offloaded) / seconds,
+    (now.rejected - before.rejected) / seconds, (now.slowPath - before.slowPath) / seconds,
+    (now.deleted - before.deleted) / seconds, (now.closed - before.closed) / seconds,
+    (long)counters.active.load());
+  fflush(stdout);
+}
+
+static void usage(void) {
+  printf("\nCommand line arguments for the OpenOffload firewall simulator version: %s \n", OPOF_VERSION);
+  printf("\t-a, --address         Address of gRPC Server\n");
+  printf("\t-p, --port            gRPC Port \n");
+  printf("\t-t, --threads         Firewall threads, each with its own client handle (default 1)\n");
+  printf("\t-r, --rate            New flows per second over all threads (default 1000)\n");
+  printf("\t-b, --batch           Most flows per add (default 64)\n");
+  printf("\t-g, --pagesize        Page size of the closed session polls (default 64)\n");
+  printf("\t-l, --lifetime        Median flow lifetime in seconds (default 5)\n");
+  printf("\t-S, --sigma           Sigma of the lognormal flow lifetime (default 1.5)\n");
+  printf("\t-6, --ipv6            Percent of IPv6 flows (default 20)\n");
+  printf("\t-u, --udp             Percent of UDP flows (default 30)\n");
+  printf("\t-n, --nat             Percent of flows with source NAT (default 50)\n");
+  printf("\t-N, --nexthops        Next hops to spread the flows over (default 8)\n");
+  printf("\t-C, --closed          Closed session poll interval in milli seconds (default 100)\n");
+  printf("\t-R, --report          Report interval in seconds (default 1)\n");
+  printf("\t-d, --duration        Seconds to run, 0 until interrupted (default 60)\n");
+  printf("\t-D, --deadline        Client deadline in milli seconds (default 100)\n");
+  printf("\t-s, --seed            Random seed (default 1)\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  SimConfig config;
+  char *str_part;
+  char cert[2048] = "";
+  int c;
+
+  config.address = "localhost";
+  config.port = 3443;
+  config.threads = 1;
+  config.rate = 1000;
+  config.batch = BUFFER_MAX;
+  config.pageSize = BUFFER_MAX;
+  config.lifetime = 5;
+  config.lifetimeSigma = 1.5;
+  config.ipv6Percent = 20;
+  config.udpPercent = 30;
+  config.natPercent = 50;
+  config.nextHops = 8;
+  config.closedMsec = 100;
+  config.report = 1;
+  config.duration = 60;
+  config.deadline = 100;
+  config.seed = 1;
+
+  static struct option longopts[] = {
+    {"address", required_argument, 0, 'a'},
+    {"port", required_argument, 0, 'p'},
+    {"threads", required_argument, 0, 't'},
+    {"rate", required_argument, 0, 'r'},
+    {"batch", required_argument, 0, 'b'},
+    {"pagesize", required_argument, 0, 'g'},
+    {"lifetime", required_argument, 0, 'l'},
+    {"sigma", required_argument, 0, 'S'},
+    {"ipv6", required_argument, 0, '6'},
+    {"udp", required_argument, 0, 'u'},
+    {"nat", required_argument, 0, 'n'},
+    {"nexthops", required_argument, 0, 'N'},
+    {"closed", required_argument, 0, 'C'},
+    {"report", required_argument, 0, 'R'},
+    {"duration", required_argument, 0, 'd'},
+    {"deadline", required_argument, 0, 'D'},
+    {"seed", required_argument, 0, 's'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+  while ((c = getopt_long(argc, argv, "a:p:t:r:b:g:l:S:6:u:n:N:C:R:d:D:s:h", longopts, NULL)) != -1){
+    switch (c){
+      case 'a':
+        config.address = optarg;
+        break;
+      case 'p':
+        config.port = strtoul(optarg, &str_part, 10);
+        break;
+      case 't':
+        config.threads = strtoul(optarg, &str_part, 10);
+        break;
+      case 'r':
+        config.rate = strtod(optarg, &str_part);
+        break;
+      case 'b':
+        config.batch = strtoul(optarg, &str_part, 10);
+        break;
+      case 'g':
+        config.pageSize = strtoul(optarg, &str_part, 10);
+        break;
+      case 'l':
+        config.lifetime = strtod(optarg, &str_part);
+        break;
+      case 'S':
+        config.lifetimeSigma = strtod(optarg, &str_part);
+        break;
+      case '6':
+        config.ipv6Percent = strtoul(optarg, &str_part, 10);
+        break;
+      case 'u':
+        config.udpPercent = strtoul(optarg, &str_part, 10);
+        break;
+      case 'n':
+        config.natPercent = strtoul(optarg, &str_part, 10);
+        break;
+      case 'N':
+        config.nextHops = strtoul(optarg, &str_part, 10);
+        break;
+      case 'C':
+        config.closedMsec = strtoul(optarg, &str_part, 10);
+        break;
+      case 'R':
+        config.report = strtod(optarg, &str_part);
+        break;
+      case 'd':
+        config.duration = strtod(optarg, &str_part);
+        break;
+      case 'D':
+        config.deadline = strtoul(optarg, &str_part, 10);
+        break;
+      case 's':
+        config.seed = strtoul(optarg, &str_part, 10);
+        break;
+      case 'h':
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  if (config.threads < 1 || config.threads > FWSIM_THREADS_MAX || config.rate <= 0 ||
+      config.batch < 1 || config.batch > BUFFER_MAX || config.pageSize < 1 || config.pageSize > BUFFER_MAX ||
+      config.lifetime <= 0 || config.lifetimeSigma < 0 || config.nextHops < 1 ||
+      config.closedMsec < 1 || config.report <= 0){
+    fprintf(stderr, "threads must be 1 to %d, batch and pagesize 1 to %d, and rate, lifetime, nexthops, closed and report positive\n",
+      FWSIM_THREADS_MAX, BUFFER_MAX);
+    exit(1);
+  }
+  opof_set_deadline(config.deadline);
+#ifdef SSL
+  if (get_key(CERT_FILE, cert) != SUCCESS){
+    fprintf(stderr, "Could not read %s\n", CERT_FILE);
+    exit(1);
+  }
+#endif
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  sessionTable_t *closedHandle = opof_create_sessionTable(config.address.c_str(), config.port, cert);
+  setNextHops(config, closedHandle);
+  std::vector<sessionTable_t *> handles;
+  std::vector<FirewallThread *> firewallThreads;
+  for (int i = 0; i < config.threads; i++){
+    handles.push_back(opof_create_sessionTable(config.address.c_str(), config.port, cert));
+    firewallThreads.push_back(new FirewallThread(config, i, handles[i]));
+  }
+
+  SimClock::time_point start = SimClock::now();
+  SimClock::time_point stopTime = config.duration > 0 ?
+    start + std::chrono::duration_cast<SimClock::duration>(std::chrono::duration<double>(config.duration)) :
+    SimClock::time_point::max();
+  std::vector<std::thread> threads;
+  for (FirewallThread *thread : firewallThreads){
+    threads.emplace_back(&FirewallThread::run, thread, stopTime);
+  }
+  std::thread closedThread(pollClosed, std::cref(config), closedHandle, std::ref(firewallThreads));
+
+  printf("%10s %12s %12s %10s %10s %10s %10s %12s\n",
+    "seconds", "offered/s", "offloaded/s", "rejected/s", "slowpath/s", "deleted/s", "closed/s", "offloaded");
+  SimSnapshot first = snapshot();
+  SimSnapshot last = first;
+  SimClock::time_point lastTime = start;
+  SimClock::duration interval = std::chrono::duration_cast<SimClock::duration>(std::chrono::duration<double>(config.report));
+  while (running && SimClock::now() < stopTime){
+    SimClock::time_point next = std::min(lastTime + interval, stopTime);
+    while (running && SimClock::now() < next){
+      std::this_thread::sleep_for(std::min(std::chrono::duration_cast<SimClock::duration>(std::chrono::milliseconds(100)),
+        next - SimClock::now()));
+    }
+    SimClock::time_point now = SimClock::now();
+    SimSnapshot current = snapshot();
+    char label[32];
+    snprintf(label, sizeof(label), "%.1f", std::chrono::duration<double>(now - start).count());
+    printRates(label, current, last, std::chrono::duration<double>(now - lastTime).count());
+    last = current;
+    lastTime = now;
+  }
+  running = false;
+  for (std::thread &thread : threads){
+    thread.join();
+  }
+  closedThread.join();
+
+  double elapsed = std::chrono::duration<double>(SimClock::now() - start).count();
+  printRates("average", snapshot(), first, elapsed);
+  uint64_t offered = counters.offered - counters.slowPath;
+  printf("offloads tried %lu: %.1f%% IPv6, %.1f%% NAT; add failures %lu, deletes of sessions already gone %lu, "
+    "closed sessions not in the table %lu\n",
+    (unsigned long)offered, offered ? 100.0 * counters.ipv6 / offered : 0.0,
+    offered ? 100.0 * counters.nat / offered : 0.0, (unsigned long)counters.addFailed.load(),
+    (unsigned long)counters.deleteMissing.load(), (unsigned long)counters.closedUnknown.load());
+
+  for (FirewallThread *thread : firewallThreads){
+    thread->cleanup();
+    delete thread;
+  }
+  for (sessionTable_t *handle : handles){
+    opof_delete_sessionTable(handle);
+  }
+  opof_delete_sessionTable(closedHandle);
+  return 0;
+}
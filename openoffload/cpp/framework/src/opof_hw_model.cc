@@ -0,0 +1,579 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Hardware latency model backend for opof_serverlib.h
+*
+* A backend that costs what a NIC would, to find the batching, page size and
+* thread settings that suit a device before it exists. Run it behind the
+* server with opof_bench, or alone with opof_backend_bench.
+*
+* Every hook holds one of OPOF_HW_MODEL_CHANNELS device channels while it
+* pays a fixed cost per call, the doorbell, and a cost per session it touches:
+* the session added, read or deleted, or each session of a closed or all
+* page. With one channel the device handles one call at a time and extra
+* server threads only queue; more channels model a device that pipelines.
+* Session adds, VLAN flow adds and next hop updates are rule inserts and are
+* also held to OPOF_HW_MODEL_INSERT_RATE per second over all channels. Now
+* and then a call takes the slow path and stalls for OPOF_HW_MODEL_STALL_USEC
+* more.
+*
+* Waits spin on the clock by default, as a driver polling a completion would,
+* and are exact as long as every calling thread has a core of its own; with
+* OPOF_HW_MODEL_WAIT=sleep they sleep and give the CPU back to the other
+* threads, at the price of the scheduler's overshoot.
+*
+* The server calls opof_add_session_server once per session, so the doorbell
+* is paid per session on add. Comparing the add cost with closed and all,
+* which pay it once per page, shows what a batched add hook would save.
+*
+* Sessions carry no traffic and do not close by themselves unless
+* OPOF_HW_MODEL_LIFETIME is set; then each closes on timeout that many
+* seconds after it was added and is reported by getClosedSessions.
+*
+* Settings are read from the environment when the first call comes in:
+*
+*   OPOF_HW_MODEL_CALL_NSEC       fixed cost of every call (10000)
+*   OPOF_HW_MODEL_ITEM_NSEC       cost of every session a call touches (2000)
+*   OPOF_HW_MODEL_CHANNELS        calls the device handles at once (1)
+*   OPOF_HW_MODEL_INSERT_RATE     most inserts per second, 0 for no limit (0)
+*   OPOF_HW_MODEL_STALL_PERMILLE  calls per thousand that stall (0)
+*   OPOF_HW_MODEL_STALL_USEC      length of a stall (1000)
+*   OPOF_HW_MODEL_WAIT            busy or sleep (busy)
+*   OPOF_HW_MODEL_CAPACITY        most sessions in the table (1000000)
+*   OPOF_HW_MODEL_LIFETIME        seconds until a session times out, 0 for never (0)
+*   OPOF_HW_MODEL_SEED            random seed (1)
+*/
+extern "C" {
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "opof.h"
+#include "opof_error.h"
+#include "opof_log.h"
+#include "opof_serverlib.h"
+#include "opof_test.h"
+#include "opof_aggregate.h"
+}
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+struct HwModelConfig {
+    int64_t callNanos;
+    int64_t itemNanos;
+    unsigned int channels;
+    double insertRate;
+    unsigned int stallPermille;
+    int64_t stallNanos;
+    bool busyWait;
+    unsigned long capacity;
+    int64_t lifetimeNanos;
+    unsigned long seed;
+};
+
+struct HwSession {
+    unsigned int inLif;
+    unsigned int outLif;
+    unsigned int inNextHopId;
+    unsigned int outNextHopId;
+    uint8_t proto;
+    uint8_t ipver;
+    uint8_t actionType;
+    int64_t startNanos;
+};
+
+typedef std::chrono::steady_clock HwClock;
+typedef std::map<unsigned long, HwSession> HwSessionMap;
+
+static HwModelConfig config;
+static std::once_flag started;
+static std::atomic<unsigned int> rngSeeds(0);
+
+/* device channels, a counting semaphore */
+static std::mutex channelMutex;
+static std::condition_variable channelFree;
+static unsigned int channelsBusy = 0;
+
+/* the next free insert slot under the insert rate */
+static std::mutex insertMutex;
+static HwClock::time_point nextInsert;
+
+/* the table, and the sessions in the order they were added for the lifetime */
+static std::mutex tableMutex;
+static HwSessionMap sessions;
+static std::deque<std::pair<unsigned long, int64_t> > added;
+static opof_aggregate_t *aggregate;
+static std::map<uint16_t, uint16_t> vlanFlows;
+static std::map<uint32_t, nextHopParameters_t> nextHops;
+
+static unsigned long envNumber(const char *name, unsigned long value) {
+  const char *s = getenv(name);
+  return s != NULL && *s != '\0' ? strtoul(s, NULL, 10) : value;
+}
+
+static int64_t nowNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void start() {
+  const char *wait = getenv("OPOF_HW_MODEL_WAIT");
+
+  config.callNanos = envNumber("OPOF_HW_MODEL_CALL_NSEC", 10000);
+  config.itemNanos = envNumber("OPOF_HW_MODEL_ITEM_NSEC", 2000);
+  config.channels = std::max(1UL, envNumber("OPOF_HW_MODEL_CHANNELS", 1));
+  config.insertRate = envNumber("OPOF_HW_MODEL_INSERT_RATE", 0);
+  config.stallPermille = std::min(1000UL, envNumber("OPOF_HW_MODEL_STALL_PERMILLE", 0));
+  config.stallNanos = (int64_t)envNumber("OPOF_HW_MODEL_STALL_USEC", 1000) * 1000;
+  config.busyWait = wait == NULL || strcmp(wait, "sleep") != 0;
+  config.capacity = envNumber("OPOF_HW_MODEL_CAPACITY", 1000000);
+  config.lifetimeNanos = (int64_t)envNumber("OPOF_HW_MODEL_LIFETIME", 0) * 1000000000;
+  config.seed = envNumber("OPOF_HW_MODEL_SEED", 1);
+  aggregate = opof_aggregate_create();
+  nextInsert = HwClock::now();
+  opof_log_info("Hardware model: %ld nsec per call, %ld nsec per item, %u channels, "
+    "%.0f inserts/s, %u/1000 stalls of %ld usec, %s wait",
+    (long)config.callNanos, (long)config.itemNanos, config.channels, config.insertRate,
+    config.stallPermille, (long)(config.stallNanos / 1000), config.busyWait ? "busy" : "sleep");
+}
+
+static void ensureStarted() {
+  std::call_once(started, start);
+}
+
+static void waitUntil(HwClock::time_point until) {
+  if (config.busyWait){
+    while (HwClock::now() < until){
+    }
+  } else {
+    std::this_thread::sleep_until(until);
+  }
+}
+
+static bool stalls() {
+  thread_local std::mt19937_64 rng(config.seed + rngSeeds++);
+  return config.stallPermille != 0 && rng() % 1000 < config.stallPermille;
+}
+
+/*
+* Holds back a rule insert until the insert rate allows it. Inserts get
+* evenly spaced slots, so a burst queues rather than going through at once.
+*/
+static void waitInsertSlot() {
+  if (config.insertRate <= 0){
+    return;
+  }
+  HwClock::duration interval = std::chrono::duration_cast<HwClock::duration>(
+    std::chrono::duration<double>(1.0 / config.insertRate));
+  HwClock::time_point slot;
+  {
+    std::lock_guard<std::mutex> lock(insertMutex);
+    slot = std::max(nextInsert, HwClock::now());
+    nextInsert = slot + interval;
+  }
+  waitUntil(slot);
+}
+
+/*
+* One call on the device: a channel is held from the doorbell until the last
+* item is done.
+*/
+class DeviceCall {
+public:
+    DeviceCall() : begin_() {
+      std::unique_lock<std::mutex> lock(channelMutex);
+      channelFree.wait(lock, [] { return channelsBusy < config.channels; });
+      channelsBusy++;
+      lock.unlock();
+      begin_ = HwClock::now();
+    }
+
+    /* items is the number of sessions the call touched */
+    void complete(int items) {
+      int64_t nanos = config.callNanos + config.itemNanos * items;
+      if (stalls()){
+        nanos += config.stallNanos;
+      }
+      waitUntil(begin_ + std::chrono::nanoseconds(nanos));
+    }
+
+    ~DeviceCall() {
+      std::lock_guard<std::mutex> lock(channelMutex);
+      channelsBusy--;
+      channelFree.notify_one();
+    }
+
+private:
+    HwClock::time_point begin_;
+};
+
+static void describe(const HwSession &s, aggregateSession_t *a) {
+  memset(a, 0, sizeof(*a));
+  a->inlif = s.inLif;
+  a->outlif = s.outLif;
+  a->proto = (PROTOCOL_ID_T)s.proto;
+  a->actionType = (ACTION_VALUE_T)s.actionType;
+  a->sessionState = _ESTABLISHED;
+}
+
+static void fillResponse(unsigned long sessionId, const HwSession &s, sessionResponse_t *response) {
+  memset(response, 0, sizeof(*response));
+  response->sessionId = sessionId;
+  response->sessionState = _ESTABLISHED;
+  response->sessionCloseCode = _NOT_CLOSED;
+  response->requestStatus = _ACCEPTED;
+  response->startTime.tv_sec = s.startNanos / 1000000000;
+  response->startTime.tv_nsec = s.startNanos % 1000000000;
+}
+
+/* the caller holds tableMutex */
+static void removeSession(HwSessionMap::iterator it) {
+  aggregateSession_t a;
+  describe(it->second, &a);
+  opof_aggregate_remove(aggregate, &a);
+  sessions.erase(it);
+}
+
+extern "C" {
+  int opof_get_version(
+      char * vendor,    size_t vendorMaxLength,
+      char * name,      size_t nameMaxLength,
+      char * version,   size_t versionMaxLength,
+      char * copyright, size_t copyrightMaxLength){
+    snprintf(vendor, vendorMaxLength, "OpenOffload");
+    snprintf(name, nameMaxLength, "Hardware latency model");
+    snprintf(version, versionMaxLength, "%s", OPOF_VERSION);
+    snprintf(copyright, copyrightMaxLength, "Apache License 2.0");
+    return _OK;
+  }
+
+  int opof_reset_server(void){
+    ensureStarted();
+    DeviceCall call;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      sessions.clear();
+      added.clear();
+      opof_aggregate_reset(aggregate);
+      vlanFlows.clear();
+      nextHops.clear();
+    }
+    call.complete(0);
+    return _OK;
+  }
+
+  /** \ingroup servercinterface
+  * \brief one rule insert, held to the insert rate
+  *
+  * \return _OK, _ALREADY_EXISTS or _RESOURCE_EXHAUSTED when the table is at capacity
+  *
+  */
+  int opof_add_session_server(sessionRequest_t *parameters, addSessionResponse_t *response){
+    ensureStarted();
+    waitInsertSlot();
+    DeviceCall call;
+    HwSession s;
+    s.inLif = parameters->inlif;
+    s.outLif = parameters->outlif;
+    s.inNextHopId = parameters->actionParams.actionParams_inLif.nextHopId;
+    s.outNextHopId = parameters->actionParams.actionParams_outLif.nextHopId;
+    s.proto = parameters->proto;
+    s.ipver = parameters->ipver;
+    s.actionType = parameters->actionParams.actionType;
+    s.startNanos = nowNanos();
+    int status = _OK;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      if (sessions.size() >= config.capacity){
+        status = _RESOURCE_EXHAUSTED;
+      } else if (!sessions.insert(HwSessionMap::value_type(parameters->sessId, s)).second){
+        status = _ALREADY_EXISTS;
+      } else {
+        aggregateSession_t a;
+        describe(s, &a);
+        opof_aggregate_add(aggregate, &a);
+        if (config.lifetimeNanos != 0){
+          added.push_back(std::make_pair(parameters->sessId, s.startNanos));
+        }
+      }
+    }
+    call.complete(1);
+    return status;
+  }
+
+  int opof_get_session_server(unsigned long sessionId, sessionResponse_t *response){
+    ensureStarted();
+    DeviceCall call;
+    int status = _NOT_FOUND;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      HwSessionMap::iterator it = sessions.find(sessionId);
+      if (it != sessions.end()){
+        fillResponse(sessionId, it->second, response);
+        status = _OK;
+      }
+    }
+    call.complete(1);
+    return status;
+  }
+
+  int opof_del_session_server(unsigned long sessionId, sessionResponse_t *response){
+    ensureStarted();
+    DeviceCall call;
+    int status = _NOT_FOUND;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      HwSessionMap::iterator it = sessions.find(sessionId);
+      if (it != sessions.end()){
+        fillResponse(sessionId, it->second, response);
+        response->sessionState = _CLOSED;
+        removeSession(it);
+        status = _OK;
+      }
+    }
+    call.complete(1);
+    return status;
+  }
+
+  /** \ingroup servercinterface
+  * \brief reports the sessions older than OPOF_HW_MODEL_LIFETIME as closed on timeout
+  *
+  */
+  int opof_get_closed_sessions_server(statisticsRequestArgs_t *request,
+      sessionResponse_t responses[]){
+    ensureStarted();
+    DeviceCall call;
+    int size = request->pageSize;
+    int n = 0;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      int64_t now = nowNanos();
+      while (n < size && !added.empty() && added.front().second + config.lifetimeNanos <= now){
+        HwSessionMap::iterator it = sessions.find(added.front().first);
+        /* skip sessions deleted, or deleted and added again, since */
+        if (it != sessions.end() && it->second.startNanos == added.front().second){
+          fillResponse(it->first, it->second, &responses[n]);
+          responses[n].sessionState = _CLOSED;
+          responses[n].sessionCloseCode = _TIMEOUT;
+          int64_t end = it->second.startNanos + config.lifetimeNanos;
+          responses[n].endTime.tv_sec = end / 1000000000;
+          responses[n].endTime.tv_nsec = end % 1000000000;
+          removeSession(it);
+          n++;
+        }
+        added.pop_front();
+      }
+    }
+    call.complete(n);
+    return n;
+  }
+
+  int opof_get_all_sessions_server(int pageSize, uint64_t *startSession, int pageCount,
+      sessionResponse_t **responses){
+    ensureStarted();
+    DeviceCall call;
+    int n = 0;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      HwSessionMap::iterator it = *startSession == UINT_MAX ?
+          sessions.begin() : sessions.upper_bound(*startSession);
+      for (; it != sessions.end() && n < pageSize; ++it){
+        fillResponse(it->first, it->second, responses[n++]);
+        *startSession = it->first;
+      }
+    }
+    call.complete(n);
+    return n;
+  }
+
+  /** \ingroup servercinterface
+  * \brief pages like getAllSessions; the device pays for every session it scans
+  *
+  */
+  int opof_get_filtered_sessions_server(int pageSize, uint64_t *startSession,
+      const sessionFilter_t *filter, sessionResponse_t **responses){
+    ensureStarted();
+    DeviceCall call;
+    int n = 0;
+    int scanned = 0;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      HwSessionMap::iterator it = *startSession == UINT_MAX ?
+          sessions.begin() : sessions.upper_bound(*startSession);
+      for (; it != sessions.end() && n < pageSize; ++it){
+        const HwSession &s = it->second;
+        scanned++;
+        *startSession = it->first;
+        if ((filter->sessionStateEnable && filter->sessionState != _ESTABLISHED) ||
+            (filter->protoEnable && s.proto != filter->proto) ||
+            (filter->inlifEnable && s.inLif != filter->inlif) ||
+            (filter->outlifEnable && s.outLif != filter->outlif) ||
+            (filter->ipverEnable && s.ipver != filter->ipver) ||
+            (filter->actionTypeEnable && s.actionType != filter->actionType) ||
+            (filter->nextHopIdEnable && s.inNextHopId != filter->nextHopId &&
+                s.outNextHopId != filter->nextHopId) ||
+            filter->minBytes != 0 || filter->minPackets != 0){
+          continue;
+        }
+        fillResponse(it->first, s, responses[n++]);
+      }
+    }
+    call.complete(scanned);
+    return n;
+  }
+
+  /** \ingroup servercinterface
+  * \brief the model carries no traffic, so there are no top sessions
+  *
+  */
+  int opof_get_top_sessions_server(SESSION_METRIC_T metric, int count,
+      sessionResponse_t responses[]){
+    ensureStarted();
+    DeviceCall call;
+    call.complete(0);
+    return 0;
+  }
+
+  int opof_get_aggregate_stats_server(AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[],
+      int maxGroups){
+    ensureStarted();
+    DeviceCall call;
+    int n;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      n = opof_aggregate_get(aggregate, groupBy, stats, maxGroups);
+    }
+    call.complete(n);
+    return n;
+  }
+
+  /* the count is kept by the host, so this does not go to the device */
+  int opof_get_table_stats_server(unsigned long *count, unsigned long *capacity){
+    ensureStarted();
+    std::lock_guard<std::mutex> lock(tableMutex);
+    *count = sessions.size();
+    *capacity = config.capacity;
+    return _OK;
+  }
+
+  int opof_add_vlan_flow_server(uint16_t vlan_id, uint16_t vf_index){
+    ensureStarted();
+    waitInsertSlot();
+    DeviceCall call;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      vlanFlows[vlan_id] = vf_index;
+    }
+    call.complete(1);
+    return _OK;
+  }
+
+  int opof_remove_vlan_flow_server(uint16_t vlan_id){
+    ensureStarted();
+    DeviceCall call;
+    size_t erased;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      erased = vlanFlows.erase(vlan_id);
+    }
+    call.complete(1);
+    return erased != 0 ? _OK : _NOT_FOUND;
+  }
+
+  size_t opof_get_vlan_flow_count_server(){
+    ensureStarted();
+    std::lock_guard<std::mutex> lock(tableMutex);
+    return vlanFlows.size();
+  }
+
+  int opof_get_vlan_flows_server(uint16_t *vlan_ids, uint16_t *vf_indices, size_t vlanFlowMaxCount,
+      size_t *vlanFlowActualCount){
+    ensureStarted();
+    DeviceCall call;
+    size_t n = 0;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      for (std::map<uint16_t, uint16_t>::iterator it = vlanFlows.begin();
+          it != vlanFlows.end() && n < vlanFlowMaxCount; ++it){
+        vlan_ids[n] = it->first;
+        vf_indices[n] = it->second;
+        n++;
+      }
+    }
+    *vlanFlowActualCount = n;
+    call.complete(n);
+    return _OK;
+  }
+
+  int opof_clear_vlan_flows_server(){
+    ensureStarted();
+    DeviceCall call;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      vlanFlows.clear();
+    }
+    call.complete(0);
+    return _OK;
+  }
+
+  int opof_set_next_hop_server(struct nextHopParameters_t *nextHop_c){
+    ensureStarted();
+    waitInsertSlot();
+    DeviceCall call;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      nextHops[nextHop_c->nextHopId] = *nextHop_c;
+    }
+    call.complete(1);
+    return _OK;
+  }
+
+  int opof_destroy_next_hop_server(uint32_t nextHopId){
+    ensureStarted();
+    DeviceCall call;
+    size_t erased;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      erased = nextHops.erase(nextHopId);
+    }
+    call.complete(1);
+    return erased != 0 ? _OK : _NOT_FOUND;
+  }
+
+  int opof_clear_next_hops_server(){
+    ensureStarted();
+    DeviceCall call;
+    {
+      std::lock_guard<std::mutex> lock(tableMutex);
+      nextHops.clear();
+    }
+    call.complete(0);
+    return _OK;
+  }
+} // extern C
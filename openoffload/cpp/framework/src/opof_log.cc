@@ -0,0 +1,310 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Asynchronous logging for the client and server libraries
+*
+*/
+extern "C" {
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "opof.h"
+#include "opof_log.h"
+}
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define OPOF_LOG_RING_MASK (OPOF_LOG_RING_SIZE - 1)
+
+static_assert((OPOF_LOG_RING_SIZE & OPOF_LOG_RING_MASK) == 0, "OPOF_LOG_RING_SIZE must be a power of two");
+
+struct OpofLogEntry {
+    int64_t nanos;
+    const char *file;
+    int32_t line;
+    uint32_t thread;
+    uint32_t suppressed;
+    int16_t level;
+    uint16_t length;
+    char message[OPOF_LOG_MESSAGE_MAX];
+};
+
+/*
+* Single producer, single consumer. The owning thread fills entries and
+* publishes them by moving head; the writer copies them out and moves tail.
+* A ring is never freed; when its thread exits the next new thread takes it
+* over, and the writer keeps draining it in the meantime.
+*/
+struct OpofLogRing {
+    OpofLogEntry entries[OPOF_LOG_RING_SIZE];
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<bool> owned;
+    uint32_t thread;
+    OpofLogRing *next;
+};
+
+static std::atomic<OpofLogRing *> rings(nullptr);
+static std::atomic<uint64_t> dropped(0);
+static std::atomic<int> logFd(STDERR_FILENO);
+static std::timed_mutex drainMutex;
+static std::once_flag writerStarted;
+
+static const char *levelNames[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+
+static OpofLogRing *acquireRing() {
+  OpofLogRing *ring;
+  for (ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next){
+    bool owned = false;
+    if (!ring->owned.load(std::memory_order_relaxed) &&
+        ring->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)){
+      break;
+    }
+  }
+  if (ring == nullptr){
+    ring = new OpofLogRing();
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+    ring->owned.store(true, std::memory_order_relaxed);
+    ring->next = rings.load(std::memory_order_relaxed);
+    while (!rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)){
+    }
+  }
+  ring->thread = (uint32_t)syscall(SYS_gettid);
+  return ring;
+}
+
+struct OpofLogRingHolder {
+    OpofLogRing *ring;
+
+    ~OpofLogRingHolder() {
+      if (ring != nullptr){
+        ring->owned.store(false, std::memory_order_release);
+      }
+    }
+};
+
+static thread_local OpofLogRingHolder holder = {nullptr};
+
+static void writeAll(int fd, const std::string &data) {
+  size_t written = 0;
+  while (written < data.size()){
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n <= 0){
+      return;
+    }
+    written += n;
+  }
+}
+
+static void formatEntry(std::string &out, const OpofLogEntry &entry) {
+  char prefix[128];
+  time_t seconds = entry.nanos / 1000000000;
+  struct tm tm;
+  const char *file = strrchr(entry.file, '/');
+
+  localtime_r(&seconds, &tm);
+  size_t n = strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &tm);
+  snprintf(prefix + n, sizeof(prefix) - n, ".%06ld %s [%u] %s:%d: ",
+    (long)(entry.nanos % 1000000000) / 1000, levelNames[entry.level], entry.thread,
+    file != NULL ? file + 1 : entry.file, entry.line);
+  out.append(prefix);
+  out.append(entry.message, entry.length);
+  if (entry.suppressed){
+    out.append(" (" + std::to_string(entry.suppressed) + " similar messages suppressed)");
+  }
+  out.push_back('\n');
+}
+
+/*
+* Copy the pending entries out of every ring, order them by time and write
+* them with one write(). The caller holds drainMutex.
+*/
+static void drain() {
+  static uint64_t droppedReported = 0;
+  std::vector<OpofLogEntry> batch;
+  std::string out;
+
+  for (OpofLogRing *ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next){
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i < head; i++){
+      batch.push_back(ring->entries[i & OPOF_LOG_RING_MASK]);
+    }
+    ring->tail.store(head, std::memory_order_release);
+  }
+  std::stable_sort(batch.begin(), batch.end(), [](const OpofLogEntry &a, const OpofLogEntry &b) {
+    return a.nanos < b.nanos;
+  });
+  for (const OpofLogEntry &entry : batch){
+    formatEntry(out, entry);
+  }
+  uint64_t droppedNow = dropped.load(std::memory_order_relaxed);
+  if (droppedNow != droppedReported){
+    out.append("WARNING: log rings full, dropped " + std::to_string(droppedNow - droppedReported) + " messages\n");
+    droppedReported = droppedNow;
+  }
+  if (!out.empty()){
+    writeAll(logFd.load(std::memory_order_relaxed), out);
+  }
+}
+
+static void flushAtExit() {
+  opof_log_flush();
+}
+
+static void startWriter() {
+  atexit(flushAtExit);
+  std::thread([]() {
+    for (;;){
+      std::this_thread::sleep_for(std::chrono::milliseconds(OPOF_LOG_FLUSH_MSEC));
+      std::lock_guard<std::timed_mutex> lock(drainMutex);
+      drain();
+    }
+  }).detach();
+}
+
+/*
+* Per call site limit of OPOF_LOG_BURST messages per second. Races between
+* threads only make the limit approximate.
+*/
+static bool rateAllow(opofLogSite_t *site, uint64_t second, uint32_t *suppressed) {
+  uint64_t current = __atomic_load_n(&site->second, __ATOMIC_RELAXED);
+  if (current != second &&
+      __atomic_compare_exchange_n(&site->second, &current, second, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+  }
+  if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > OPOF_LOG_BURST){
+    __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  *suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+  return true;
+}
+
+extern "C" {
+  /** \ingroup servercinterface
+  * \brief queues one message, normally called through the opof_log_<level> macros
+  *
+  * \param site   The rate limit state of the call site, NULL for no limit
+  * \param level  OPOF_LOG_LEVEL_DEBUG to OPOF_LOG_LEVEL_ERROR
+  * \param file   __FILE__ of the call site
+  * \param line   __LINE__ of the call site
+  * \param fmt    printf format
+  * \param ap     The format arguments
+  *
+  */
+  void opof_vlog(opofLogSite_t *site, int level, const char *file, int line, const char *fmt, va_list ap){
+    struct timespec now;
+    uint32_t suppressed = 0;
+
+    if (site != NULL){
+      clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+      if (!rateAllow(site, now.tv_sec, &suppressed)){
+        return;
+      }
+    }
+    std::call_once(writerStarted, startWriter);
+    OpofLogRing *ring = holder.ring;
+    if (ring == nullptr){
+      ring = holder.ring = acquireRing();
+    }
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= OPOF_LOG_RING_SIZE){
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    OpofLogEntry &entry = ring->entries[head & OPOF_LOG_RING_MASK];
+    clock_gettime(CLOCK_REALTIME, &now);
+    entry.nanos = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    entry.file = file;
+    entry.line = line;
+    entry.thread = ring->thread;
+    entry.suppressed = suppressed;
+    entry.level = std::min(std::max(level, OPOF_LOG_LEVEL_DEBUG), OPOF_LOG_LEVEL_ERROR);
+    int n = vsnprintf(entry.message, sizeof(entry.message), fmt, ap);
+    entry.length = n < 0 ? 0 : std::min(n, OPOF_LOG_MESSAGE_MAX - 1);
+    ring->head.store(head + 1, std::memory_order_release);
+  }
+
+  void opof_log(opofLogSite_t *site, int level, const char *file, int line, const char *fmt, ...){
+    va_list ap;
+    va_start(ap, fmt);
+    opof_vlog(site, level, file, line, fmt, ap);
+    va_end(ap);
+  }
+
+  /** \ingroup servercinterface
+  * \brief sends the log to a file instead of stderr
+  *
+  * \param path  The file, opened for append and created if needed
+  * \return _OK, or _INTERNAL when the file cannot be opened
+  *
+  */
+  int opof_log_open(const char *path){
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0){
+      return _INTERNAL;
+    }
+    opof_log_flush();
+    int old = logFd.exchange(fd);
+    if (old != STDERR_FILENO){
+      close(old);
+    }
+    return _OK;
+  }
+
+  /** \ingroup servercinterface
+  * \brief writes out all queued messages before returning
+  *
+  * Waits at most 100 milliseconds for the writer thread, so it is safe to
+  * call from an exit path that interrupted the writer.
+  *
+  * \param void
+  *
+  */
+  void opof_log_flush(void){
+    if (drainMutex.try_lock_for(std::chrono::milliseconds(100))){
+      drain();
+      drainMutex.unlock();
+    }
+  }
+
+  /** \ingroup servercinterface
+  * \brief gets the number of messages dropped because a ring was full
+  *
+  * \param void
+  * \return the count since the process started
+  *
+  */
+  uint64_t opof_log_dropped(void){
+    return dropped.load(std::memory_order_relaxed);
+  }
+} // extern C
@@ -0,0 +1,190 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup serverlibrary
+*
+* \brief Embedded HTTP listener exporting the server stats in Prometheus text format
+*
+*/
+extern "C" {
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "opof.h"
+#include "opof_error.h"
+#include "opof_serverlib.h"
+}
+#include <sstream>
+
+#include "opof_metrics.h"
+
+#define METRICS_REQUEST_MAX 4096
+#define METRICS_POLL_MSEC 200
+
+MetricsServer::MetricsServer(const ServerStats &stats)
+: stats_(stats), listenFd_(-1), stopping_(false) {
+}
+
+MetricsServer::~MetricsServer() {
+  stop();
+}
+
+/**
+* \brief Bind the listener and start the accept thread
+*
+* \param address  The address to listen on, e.g. "localhost" or "0.0.0.0"
+* \param port     The HTTP port
+* \return true when the listener is running
+*/
+bool MetricsServer::start(const std::string &address, unsigned short port) {
+  struct addrinfo hints;
+  struct addrinfo *res = NULL;
+  int one = 1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(address.c_str(), std::to_string(port).c_str(), &hints, &res) != 0){
+    return false;
+  }
+  for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next){
+    listenFd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (listenFd_ < 0){
+      continue;
+    }
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listenFd_, ai->ai_addr, ai->ai_addrlen) == 0 && listen(listenFd_, 16) == 0){
+      break;
+    }
+    close(listenFd_);
+    listenFd_ = -1;
+  }
+  freeaddrinfo(res);
+  if (listenFd_ < 0){
+    return false;
+  }
+  stopping_ = false;
+  thread_ = std::thread(&MetricsServer::run, this);
+  return true;
+}
+
+void MetricsServer::stop() {
+  stopping_ = true;
+  if (thread_.joinable()){
+    thread_.join();
+  }
+  if (listenFd_ >= 0){
+    close(listenFd_);
+    listenFd_ = -1;
+  }
+}
+
+void MetricsServer::run() {
+  struct pollfd pfd;
+
+  pfd.fd = listenFd_;
+  pfd.events = POLLIN;
+  while (!stopping_){
+    if (poll(&pfd, 1, METRICS_POLL_MSEC) <= 0){
+      continue;
+    }
+    int fd = accept(listenFd_, NULL, NULL);
+    if (fd < 0){
+      continue;
+    }
+    handle(fd);
+    close(fd);
+  }
+}
+
+static void writeAll(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()){
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0){
+      return;
+    }
+    sent += n;
+  }
+}
+
+/**
+* \brief Read one request and answer it
+*
+* Only the request line is looked at. GET /metrics returns the metrics,
+* other paths 404 and other methods 405.
+*/
+void MetricsServer::handle(int fd) {
+  char request[METRICS_REQUEST_MAX];
+  size_t length = 0;
+  struct timeval timeout = {1, 0};
+  std::string status;
+  std::string body;
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  while (length < sizeof(request) - 1){
+    ssize_t n = recv(fd, request + length, sizeof(request) - 1 - length, 0);
+    if (n <= 0){
+      break;
+    }
+    length += n;
+    request[length] = '\0';
+    if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL){
+      break;
+    }
+  }
+  request[length] = '\0';
+
+  if (strncmp(request, "GET ", 4) != 0){
+    status = "405 Method Not Allowed";
+  } else if (strncmp(request + 4, "/metrics ", 9) == 0 || strncmp(request + 4, "/metrics?", 9) == 0){
+    status = "200 OK";
+    body = render();
+  } else {
+    status = "404 Not Found";
+  }
+
+  std::ostringstream response;
+  response << "HTTP/1.0 " << status << "\r\n"
+           << "Content-Type: text/plain; version=0.0.4\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Connection: close\r\n\r\n"
+           << body;
+  writeAll(fd, response.str());
+}
+
+std::string MetricsServer::render() const {
+  std::ostringstream out;
+  unsigned long sessionCount = 0;
+  unsigned long capacity = 0;
+
+  if (opof_get_table_stats_server(&sessionCount, &capacity) == _OK){
+    out << "# HELP opof_sessions Sessions in the session table\n";
+    out << "# TYPE opof_sessions gauge\n";
+    out << "opof_sessions " << sessionCount << "\n";
+    out << "# HELP opof_sessions_capacity Maximum number of sessions in the session table\n";
+    out << "# TYPE opof_sessions_capacity gauge\n";
+    out << "opof_sessions_capacity " << capacity << "\n";
+  }
+  stats_.prometheus(out);
+  return out.str();
+}
@@ -0,0 +1,731 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Session table simulator backend for opof_serverlib.h
+*
+* The C++ counterpart of tests/pythonSimulator/nos_sessions_server_simulator.py,
+* built to hold millions of sessions. Link it instead of opof_server_test.o to
+* get a server whose sessions carry traffic and end on their own.
+*
+* Every session gets a traffic profile when it is added: packets per second
+* in each direction, lognormal around OPOF_NOS_SIM_PPS, packet sizes, and a
+* lognormal lifetime around OPOF_NOS_SIM_LIFETIME seconds. The lifetime ends
+* in a FIN, which passes through _CLOSING_1 and _CLOSING_2 before _CLOSED, in
+* an RST, or in silence followed by an idle timeout of cacheTimeout seconds
+* (OPOF_NOS_SIM_IDLE_TIMEOUT when the request has none). Closed sessions carry
+* their start and end times and stay in the table until getClosedSessions
+* reports them.
+*
+* The table is split into NOS_SIM_SHARDS shards, each an ordered map under
+* its own mutex, so RPC threads only contend when they hit the same shard.
+* OPOF_NOS_SIM_WORKERS threads each own a share of the shards and sweep them
+* every OPOF_NOS_SIM_SWEEP_MSEC, bringing the counters up to date, moving
+* sessions through their close and keeping the top-N and aggregate trackers
+* of their shards current. Like hardware counters read by a periodic DMA,
+* getSession returns the counters as of the last sweep.
+*
+* Settings are read from the environment when the first call comes in:
+*
+*   OPOF_NOS_SIM_WORKERS        sweep threads (2)
+*   OPOF_NOS_SIM_CAPACITY       most sessions in the table (1000000)
+*   OPOF_NOS_SIM_SWEEP_MSEC     sweep interval (1000)
+*   OPOF_NOS_SIM_LIFETIME       median session lifetime in seconds (30)
+*   OPOF_NOS_SIM_SIGMA          sigma of the lognormal lifetime and rate (1.5)
+*   OPOF_NOS_SIM_PPS            median packets per second per direction (20)
+*   OPOF_NOS_SIM_RST_PERCENT    sessions that end in an RST (10)
+*   OPOF_NOS_SIM_IDLE_PERCENT   sessions that go idle and time out (10)
+*   OPOF_NOS_SIM_IDLE_TIMEOUT   idle timeout in seconds when cacheTimeout is 0 (30)
+*   OPOF_NOS_SIM_SEED           random seed (1)
+*/
+extern "C" {
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "opof.h"
+#include "opof_error.h"
+#include "opof_log.h"
+#include "opof_serverlib.h"
+#include "opof_test.h"
+#include "opof_topn.h"
+#include "opof_aggregate.h"
+}
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define NOS_SIM_SHARDS 256
+#define NOS_SIM_TOPN_CAPACITY (4 * TOP_SESSIONS_MAX)
+#define NOS_SIM_TOPN_METRICS (_RATE + 1)
+#define NOS_SIM_FIN_WAIT_NSEC 1000000000LL
+#define NOS_SIM_LIFETIME_MIN 0.01
+#define NOS_SIM_LIFETIME_MAX 86400.0
+
+struct NosSimConfig {
+    unsigned int workers;
+    unsigned long capacity;
+    unsigned int sweepMsec;
+    double lifetime;
+    double sigma;
+    double pps;
+    unsigned int rstPercent;
+    unsigned int idlePercent;
+    unsigned int idleTimeout;
+    unsigned long seed;
+};
+
+struct NosSession {
+    unsigned int inLif;
+    unsigned int outLif;
+    unsigned int inNextHopId;
+    unsigned int outNextHopId;
+    uint8_t proto;
+    uint8_t ipver;
+    uint8_t actionType;
+    uint8_t state;
+    uint8_t closeCode;
+    uint8_t closeReason;
+    uint16_t inSize;
+    uint16_t outSize;
+    float inPps;
+    float outPps;
+    int64_t startNanos;
+    int64_t trafficEndNanos;
+    int64_t closeNanos;
+    int64_t endNanos;
+    unsigned long inPackets;
+    unsigned long outPackets;
+    unsigned long inBytes;
+    unsigned long outBytes;
+};
+
+typedef std::map<unsigned long, NosSession> NosSessionMap;
+
+struct NosShard {
+    std::mutex mutex;
+    NosSessionMap sessions;
+    std::deque<unsigned long> closed;
+};
+
+/*
+* The trackers of the shards one worker sweeps. Lock order is the shard
+* mutex, then the worker mutex.
+*/
+struct NosWorker {
+    std::mutex mutex;
+    opof_aggregate_t *aggregate;
+    opof_topn_t *topn[NOS_SIM_TOPN_METRICS];
+};
+
+static NosSimConfig config;
+static NosShard shards[NOS_SIM_SHARDS];
+static std::vector<NosWorker *> workers;
+static std::atomic<unsigned long> sessionCount(0);
+static std::atomic<unsigned int> closedCursor(0);
+static std::atomic<unsigned int> rngSeeds(0);
+static std::once_flag started;
+
+static std::mutex configMutex;
+static std::map<uint16_t, uint16_t> vlanFlows;
+static std::map<uint32_t, nextHopParameters_t> nextHops;
+
+static unsigned long envNumber(const char *name, unsigned long value) {
+  const char *s = getenv(name);
+  return s != NULL && *s != '\0' ? strtoul(s, NULL, 10) : value;
+}
+
+static double envDouble(const char *name, double value) {
+  const char *s = getenv(name);
+  return s != NULL && *s != '\0' ? strtod(s, NULL) : value;
+}
+
+static int64_t nowNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void toTimespec(int64_t nanos, struct timespec *ts) {
+  ts->tv_sec = nanos / 1000000000;
+  ts->tv_nsec = nanos % 1000000000;
+}
+
+/* sequential IDs spread evenly, and the shard order is stable for paging */
+static size_t shardOf(unsigned long sessionId) {
+  return (size_t)(((uint64_t)sessionId * 0x9e3779b97f4a7c15ULL) >> 56) % NOS_SIM_SHARDS;
+}
+
+static NosWorker &workerOf(size_t shard) {
+  return *workers[shard % workers.size()];
+}
+
+static std::mt19937_64 &rng() {
+  thread_local std::mt19937_64 generator(config.seed + rngSeeds++);
+  return generator;
+}
+
+static void describe(const NosSession &s, aggregateSession_t *a) {
+  a->inlif = s.inLif;
+  a->outlif = s.outLif;
+  a->proto = (PROTOCOL_ID_T)s.proto;
+  a->actionType = (ACTION_VALUE_T)s.actionType;
+  a->sessionState = (SESSION_STATE_T)s.state;
+  a->inPackets = s.inPackets;
+  a->outPackets = s.outPackets;
+  a->inBytes = s.inBytes;
+  a->outBytes = s.outBytes;
+}
+
+static void track(NosWorker &worker, unsigned long sessionId, const NosSession &s, int64_t now) {
+  int64_t elapsed = std::max<int64_t>((now - s.startNanos) / 1000000000, 1);
+  opof_topn_update(worker.topn[_IN_BYTES], sessionId, s.inBytes);
+  opof_topn_update(worker.topn[_OUT_BYTES], sessionId, s.outBytes);
+  opof_topn_update(worker.topn[_PACKETS], sessionId, s.inPackets + s.outPackets);
+  opof_topn_update(worker.topn[_RATE], sessionId, (s.inBytes + s.outBytes) / elapsed);
+}
+
+static void fillResponse(unsigned long sessionId, const NosSession &s, sessionResponse_t *response) {
+  response->sessionId = sessionId;
+  response->inPackets = s.inPackets;
+  response->outPackets = s.outPackets;
+  response->inBytes = s.inBytes;
+  response->outBytes = s.outBytes;
+  response->sessionState = (SESSION_STATE_T)s.state;
+  response->sessionCloseCode = (SESSION_CLOSE_T)s.closeCode;
+  response->requestStatus = _ACCEPTED;
+  toTimespec(s.startNanos, &response->startTime);
+  if (s.endNanos != 0){
+    toTimespec(s.endNanos, &response->endTime);
+  } else {
+    response->endTime.tv_sec = 0;
+    response->endTime.tv_nsec = 0;
+  }
+}
+
+/*
+* Counters as of now and the next step of the close. Returns true when the
+* session just became _CLOSED. The caller holds the shard mutex.
+*/
+static bool advance(NosSession &s, int64_t now) {
+  if (s.state == _CLOSED){
+    return false;
+  }
+  double seconds = (std::min(now, s.trafficEndNanos) - s.startNanos) / 1e9;
+  if (seconds > 0){
+    s.inPackets = (unsigned long)(s.inPps * seconds);
+    s.outPackets = (unsigned long)(s.outPps * seconds);
+    s.inBytes = s.inPackets * s.inSize;
+    s.outBytes = s.outPackets * s.outSize;
+  }
+  if (now < s.closeNanos){
+    return false;
+  }
+  if (s.closeReason == _FINACK){
+    if (now < s.closeNanos + NOS_SIM_FIN_WAIT_NSEC / 2){
+      s.state = _CLOSING_1;
+      return false;
+    }
+    if (now < s.closeNanos + NOS_SIM_FIN_WAIT_NSEC){
+      s.state = _CLOSING_2;
+      return false;
+    }
+    s.endNanos = s.closeNanos + NOS_SIM_FIN_WAIT_NSEC;
+  } else {
+    s.endNanos = s.closeNanos;
+  }
+  s.state = _CLOSED;
+  s.closeCode = s.closeReason;
+  return true;
+}
+
+static void sweepShard(size_t index, int64_t now) {
+  NosShard &shard = shards[index];
+  NosWorker &worker = workerOf(index);
+  aggregateSession_t before, after;
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  std::lock_guard<std::mutex> workerLock(worker.mutex);
+  for (NosSessionMap::iterator it = shard.sessions.begin(); it != shard.sessions.end(); ++it){
+    NosSession &s = it->second;
+    if (s.state == _CLOSED){
+      continue;
+    }
+    describe(s, &before);
+    if (advance(s, now)){
+      shard.closed.push_back(it->first);
+    }
+    describe(s, &after);
+    opof_aggregate_update(worker.aggregate, &before, &after);
+    track(worker, it->first, s, now);
+  }
+}
+
+static void sweep(unsigned int id) {
+  for (;;){
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.sweepMsec));
+    int64_t now = nowNanos();
+    for (size_t index = id; index < NOS_SIM_SHARDS; index += workers.size()){
+      sweepShard(index, now);
+    }
+  }
+}
+
+static void start() {
+  config.workers = std::max(1UL, std::min(envNumber("OPOF_NOS_SIM_WORKERS", 2), (unsigned long)NOS_SIM_SHARDS));
+  config.capacity = envNumber("OPOF_NOS_SIM_CAPACITY", 1000000);
+  config.sweepMsec = std::max(1UL, envNumber("OPOF_NOS_SIM_SWEEP_MSEC", 1000));
+  config.lifetime = envDouble("OPOF_NOS_SIM_LIFETIME", 30);
+  config.sigma = envDouble("OPOF_NOS_SIM_SIGMA", 1.5);
+  config.pps = envDouble("OPOF_NOS_SIM_PPS", 20);
+  config.rstPercent = envNumber("OPOF_NOS_SIM_RST_PERCENT", 10);
+  config.idlePercent = envNumber("OPOF_NOS_SIM_IDLE_PERCENT", 10);
+  config.idleTimeout = envNumber("OPOF_NOS_SIM_IDLE_TIMEOUT", 30);
+  config.seed = envNumber("OPOF_NOS_SIM_SEED", 1);
+  if (config.lifetime <= 0){
+    config.lifetime = 30;
+  }
+  if (config.pps <= 0){
+    config.pps = 20;
+  }
+
+  for (unsigned int i = 0; i < config.workers; i++){
+    NosWorker *worker = new NosWorker();
+    worker->aggregate = opof_aggregate_create();
+    for (int m = 0; m < NOS_SIM_TOPN_METRICS; m++){
+      worker->topn[m] = opof_topn_create(NOS_SIM_TOPN_CAPACITY);
+    }
+    workers.push_back(worker);
+  }
+  for (unsigned int i = 0; i < config.workers; i++){
+    std::thread(sweep, i).detach();
+  }
+  opof_log_info("NOS simulator: %u workers, capacity %lu, sweep %u msec, lifetime %.1f s, %.1f pps",
+    config.workers, config.capacity, config.sweepMsec, config.lifetime, config.pps);
+}
+
+static void ensureStarted() {
+  std::call_once(started, start);
+}
+
+/*
+* Draws the traffic profile and the end of a new session.
+*/
+static void plan(NosSession &s, const sessionRequest_t *request, int64_t now) {
+  std::mt19937_64 &r = rng();
+  std::lognormal_distribution<double> lifetime(log(config.lifetime), config.sigma);
+  std::lognormal_distribution<double> pps(log(config.pps), config.sigma);
+  std::uniform_real_distribution<double> ratio(0.5, 1.5);
+  std::uniform_int_distribution<int> size(64, 1500);
+  std::uniform_int_distribution<unsigned int> percent(0, 99);
+
+  double seconds = std::min(std::max(lifetime(r), NOS_SIM_LIFETIME_MIN), NOS_SIM_LIFETIME_MAX);
+  unsigned int end = percent(r);
+  unsigned int idleTimeout = request->cacheTimeout != 0 ? request->cacheTimeout : config.idleTimeout;
+
+  s.inPps = (float)pps(r);
+  s.outPps = (float)(s.inPps * ratio(r));
+  s.inSize = size(r);
+  s.outSize = size(r);
+  s.startNanos = now;
+  s.trafficEndNanos = now + (int64_t)(seconds * 1e9);
+  s.closeNanos = s.trafficEndNanos;
+  if (end < config.rstPercent){
+    s.closeReason = _RST;
+  } else if (end < config.rstPercent + config.idlePercent){
+    s.closeReason = _TIMEOUT;
+    s.closeNanos += (int64_t)idleTimeout * 1000000000;
+  } else {
+    s.closeReason = request->proto == _TCP ? _FINACK : _TIMEOUT;
+    if (s.closeReason == _TIMEOUT){
+      s.closeNanos += (int64_t)idleTimeout * 1000000000;
+    }
+  }
+}
+
+/*
+* Takes a session out of the table and its trackers. The caller holds the
+* shard mutex.
+*/
+static void removeSession(size_t index, NosSessionMap::iterator it) {
+  NosWorker &worker = workerOf(index);
+  aggregateSession_t a;
+
+  describe(it->second, &a);
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    opof_aggregate_remove(worker.aggregate, &a);
+    for (int m = 0; m < NOS_SIM_TOPN_METRICS; m++){
+      opof_topn_remove(worker.topn[m], it->first);
+    }
+  }
+  shards[index].sessions.erase(it);
+  sessionCount--;
+}
+
+static bool matchFilter(const NosSession &s, const sessionFilter_t *filter) {
+  if (filter->sessionStateEnable && s.state != filter->sessionState){
+    return false;
+  }
+  if (filter->protoEnable && s.proto != filter->proto){
+    return false;
+  }
+  if (filter->inlifEnable && s.inLif != filter->inlif){
+    return false;
+  }
+  if (filter->outlifEnable && s.outLif != filter->outlif){
+    return false;
+  }
+  if (filter->ipverEnable && s.ipver != filter->ipver){
+    return false;
+  }
+  if (filter->actionTypeEnable && s.actionType != filter->actionType){
+    return false;
+  }
+  if (filter->nextHopIdEnable && s.inNextHopId != filter->nextHopId && s.outNextHopId != filter->nextHopId){
+    return false;
+  }
+  if (s.inBytes + s.outBytes < filter->minBytes){
+    return false;
+  }
+  if (s.inPackets + s.outPackets < filter->minPackets){
+    return false;
+  }
+  return true;
+}
+
+/*
+* Pages through the shards in order and each shard in session ID order. The
+* cursor is the last session returned, so paging survives concurrent adds
+* and deletes.
+*/
+static int pageSessions(int pageSize, uint64_t *sessionStart, const sessionFilter_t *filter, sessionResponse_t **responses) {
+  size_t index = 0;
+  bool resume = *sessionStart != UINT_MAX;
+  int n = 0;
+
+  if (resume){
+    index = shardOf(*sessionStart);
+  }
+  for (; index < NOS_SIM_SHARDS; index++){
+    NosShard &shard = shards[index];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    NosSessionMap::iterator it = resume ? shard.sessions.upper_bound(*sessionStart) : shard.sessions.begin();
+    resume = false;
+    for (; it != shard.sessions.end(); ++it){
+      if (filter != NULL && !matchFilter(it->second, filter)){
+        continue;
+      }
+      fillResponse(it->first, it->second, responses[n]);
+      *sessionStart = it->first;
+      if (++n == pageSize){
+        return n;
+      }
+    }
+  }
+  return n;
+}
+
+extern "C" {
+  int opof_get_version(
+      char * vendor,    size_t vendorMaxLength,
+      char * name,      size_t nameMaxLength,
+      char * version,   size_t versionMaxLength,
+      char * copyright, size_t copyrightMaxLength){
+    snprintf(vendor, vendorMaxLength, "OpenOffload");
+    snprintf(name, nameMaxLength, "NOS session table simulator");
+    snprintf(version, versionMaxLength, "%s", OPOF_VERSION);
+    snprintf(copyright, copyrightMaxLength, "Apache License 2.0");
+    return _OK;
+  }
+
+  /** \ingroup servercinterface
+  * \brief removes every session, VLAN flow and next hop
+  *
+  */
+  int opof_reset_server(void){
+    ensureStarted();
+    for (size_t index = 0; index < NOS_SIM_SHARDS; index++){
+      NosShard &shard = shards[index];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      sessionCount -= shard.sessions.size();
+      shard.sessions.clear();
+      shard.closed.clear();
+    }
+    for (NosWorker *worker : workers){
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      opof_aggregate_reset(worker->aggregate);
+      for (int m = 0; m < NOS_SIM_TOPN_METRICS; m++){
+        opof_topn_reset(worker->topn[m]);
+      }
+    }
+    std::lock_guard<std::mutex> lock(configMutex);
+    vlanFlows.clear();
+    nextHops.clear();
+    return _OK;
+  }
+
+  /** \ingroup servercinterface
+  * \brief adds a session and draws its traffic profile and end
+  *
+  * \param *parameters  The session to add
+  * \param *response    Unused, errors are returned
+  * \return _OK, _ALREADY_EXISTS or _RESOURCE_EXHAUSTED when the table is at capacity
+  *
+  */
+  int opof_add_session_server(sessionRequest_t *parameters, addSessionResponse_t *response){
+    ensureStarted();
+    if (sessionCount.fetch_add(1) >= config.capacity){
+      sessionCount--;
+      return _RESOURCE_EXHAUSTED;
+    }
+    NosSession s = {};
+    int64_t now = nowNanos();
+    s.inLif = parameters->inlif;
+    s.outLif = parameters->outlif;
+    s.inNextHopId = parameters->actionParams.actionParams_inLif.nextHopId;
+    s.outNextHopId = parameters->actionParams.actionParams_outLif.nextHopId;
+    s.proto = parameters->proto;
+    s.ipver = parameters->ipver;
+    s.actionType = parameters->actionParams.actionType;
+    s.state = _ESTABLISHED;
+    s.closeCode = _NOT_CLOSED;
+    plan(s, parameters, now);
+
+    size_t index = shardOf(parameters->sessId);
+    NosShard &shard = shards[index];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (!shard.sessions.insert(NosSessionMap::value_type(parameters->sessId, s)).second){
+      sessionCount--;
+      return _ALREADY_EXISTS;
+    }
+    aggregateSession_t a;
+    describe(s, &a);
+    NosWorker &worker = workerOf(index);
+    std::lock_guard<std::mutex> workerLock(worker.mutex);
+    opof_aggregate_add(worker.aggregate, &a);
+    return _OK;
+  }
+
+  int opof_get_session_server(unsigned long sessionId, sessionResponse_t *response){
+    ensureStarted();
+    NosShard &shard = shards[shardOf(sessionId)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    NosSessionMap::iterator it = shard.sessions.find(sessionId);
+    if (it == shard.sessions.end()){
+      return _NOT_FOUND;
+    }
+    fillResponse(sessionId, it->second, response);
+    return _OK;
+  }
+
+  /** \ingroup servercinterface
+  * \brief removes a session and returns its final counters
+  *
+  * A session deleted before it closed is reported _CLOSED with the time of
+  * the delete as its end and _NOT_CLOSED as the close code.
+  *
+  */
+  int opof_del_session_server(unsigned long sessionId, sessionResponse_t *response){
+    ensureStarted();
+    size_t index = shardOf(sessionId);
+    NosShard &shard = shards[index];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    NosSessionMap::iterator it = shard.sessions.find(sessionId);
+    if (it == shard.sessions.end()){
+      return _NOT_FOUND;
+    }
+    NosSession &s = it->second;
+    if (s.state != _CLOSED){
+      int64_t now = nowNanos();
+      advance(s, now);
+      s.endNanos = now;
+    }
+    fillResponse(sessionId, s, response);
+    response->sessionState = _CLOSED;
+    removeSession(index, it);
+    return _OK;
+  }
+
+  /** \ingroup servercinterface
+  * \brief reports closed sessions and removes them from the table
+  *
+  * Each call starts at the next shard, so a busy shard cannot starve the
+  * others.
+  *
+  */
+  int opof_get_closed_sessions_server(statisticsRequestArgs_t *request, sessionResponse_t responses[]){
+    ensureStarted();
+    int size = request->pageSize;
+    int n = 0;
+    unsigned int first = closedCursor++;
+
+    for (size_t k = 0; k < NOS_SIM_SHARDS && n < size; k++){
+      size_t index = (first + k) % NOS_SIM_SHARDS;
+      NosShard &shard = shards[index];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      while (n < size && !shard.closed.empty()){
+        unsigned long sessionId = shard.closed.front();
+        shard.closed.pop_front();
+        NosSessionMap::iterator it = shard.sessions.find(sessionId);
+        /* deleted, or deleted and added again, since it closed */
+        if (it == shard.sessions.end() || it->second.state != _CLOSED){
+          continue;
+        }
+        fillResponse(sessionId, it->second, &responses[n++]);
+        removeSession(index, it);
+      }
+    }
+    return n;
+  }
+
+  int opof_get_all_sessions_server(int pageSize, uint64_t *startSession, int pageCount, sessionResponse_t **responses){
+    ensureStarted();
+    return pageSessions(pageSize, startSession, NULL, responses);
+  }
+
+  int opof_get_filtered_sessions_server(int pageSize, uint64_t *startSession, const sessionFilter_t *filter, sessionResponse_t **responses){
+    ensureStarted();
+    return pageSessions(pageSize, startSession, filter, responses);
+  }
+
+  /** \ingroup servercinterface
+  * \brief merges the top-N trackers of the workers
+  *
+  */
+  int opof_get_top_sessions_server(SESSION_METRIC_T metric, int count, sessionResponse_t responses[]){
+    ensureStarted();
+    if (metric < 0 || metric >= NOS_SIM_TOPN_METRICS){
+      return 0;
+    }
+    count = std::min(count, TOP_SESSIONS_MAX);
+    std::vector<std::pair<uint64_t, unsigned long> > ranked;
+    unsigned long sessionIds[TOP_SESSIONS_MAX];
+    uint64_t values[TOP_SESSIONS_MAX];
+    for (NosWorker *worker : workers){
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      int n = opof_topn_get(worker->topn[metric], count, sessionIds, values);
+      for (int i = 0; i < n; i++){
+        ranked.push_back(std::make_pair(values[i], sessionIds[i]));
+      }
+    }
+    std::sort(ranked.begin(), ranked.end(), std::greater<std::pair<uint64_t, unsigned long> >());
+    int n = 0;
+    for (size_t i = 0; i < ranked.size() && n < count; i++){
+      if (opof_get_session_server(ranked[i].second, &responses[n]) == _OK){
+        n++;
+      }
+    }
+    return n;
+  }
+
+  /** \ingroup servercinterface
+  * \brief merges the aggregate counters of the workers, ordered by group key
+  *
+  */
+  int opof_get_aggregate_stats_server(AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups){
+    ensureStarted();
+    std::vector<aggregateStats_t> groups(AGGREGATE_GROUPS_MAX);
+    std::map<unsigned int, aggregateStats_t> merged;
+    for (NosWorker *worker : workers){
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      int n = opof_aggregate_get(worker->aggregate, groupBy, groups.data(), AGGREGATE_GROUPS_MAX);
+      for (int i = 0; i < n; i++){
+        aggregateStats_t &total = merged[groups[i].key];
+        total.key = groups[i].key;
+        total.sessions += groups[i].sessions;
+        total.inPackets += groups[i].inPackets;
+        total.outPackets += groups[i].outPackets;
+        total.inBytes += groups[i].inBytes;
+        total.outBytes += groups[i].outBytes;
+      }
+    }
+    int n = 0;
+    for (std::map<unsigned int, aggregateStats_t>::iterator it = merged.begin(); it != merged.end() && n < maxGroups; ++it){
+      stats[n++] = it->second;
+    }
+    return n;
+  }
+
+  int opof_get_table_stats_server(unsigned long *count, unsigned long *capacity){
+    ensureStarted();
+    *count = sessionCount.load(std::memory_order_relaxed);
+    *capacity = config.capacity;
+    return _OK;
+  }
+
+  int opof_add_vlan_flow_server(uint16_t vlan_id, uint16_t vf_index){
+    std::lock_guard<std::mutex> lock(configMutex);
+    vlanFlows[vlan_id] = vf_index;
+    return _OK;
+  }
+
+  int opof_remove_vlan_flow_server(uint16_t vlan_id){
+    std::lock_guard<std::mutex> lock(configMutex);
+    return vlanFlows.erase(vlan_id) != 0 ? _OK : _NOT_FOUND;
+  }
+
+  size_t opof_get_vlan_flow_count_server(){
+    std::lock_guard<std::mutex> lock(configMutex);
+    return vlanFlows.size();
+  }
+
+  int opof_get_vlan_flows_server(uint16_t *vlan_ids, uint16_t *vf_indices, size_t vlanFlowMaxCount, size_t *vlanFlowActualCount){
+    std::lock_guard<std::mutex> lock(configMutex);
+    size_t n = 0;
+    for (std::map<uint16_t, uint16_t>::iterator it = vlanFlows.begin(); it != vlanFlows.end() && n < vlanFlowMaxCount; ++it){
+      vlan_ids[n] = it->first;
+      vf_indices[n] = it->second;
+      n++;
+    }
+    *vlanFlowActualCount = n;
+    return _OK;
+  }
+
+  int opof_clear_vlan_flows_server(){
+    std::lock_guard<std::mutex> lock(configMutex);
+    vlanFlows.clear();
+    return _OK;
+  }
+
+  int opof_set_next_hop_server(struct nextHopParameters_t *nextHop_c){
+    std::lock_guard<std::mutex> lock(configMutex);
+    nextHops[nextHop_c->nextHopId] = *nextHop_c;
+    return _OK;
+  }
+
+  int opof_destroy_next_hop_server(uint32_t nextHopId){
+    std::lock_guard<std::mutex> lock(configMutex);
+    return nextHops.erase(nextHopId) != 0 ? _OK : _NOT_FOUND;
+  }
+
+  int opof_clear_next_hops_server(){
+    std::lock_guard<std::mutex> lock(configMutex);
+    nextHops.clear();
+    return _OK;
+  }
+} // extern C
@@ -0,0 +1,197 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Classic pcap file reader and writer
+*
+* A file is a 24 byte header followed by records of a 16 byte header and the
+* captured bytes. The magic number of the file header tells the byte order
+* of every field and whether the fraction of a timestamp is in microseconds
+* or nanoseconds.
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_pcap.h"
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_IO_BUFFER (1 << 20)
+
+typedef struct pcap_file_header {
+  uint32_t magic;
+  uint16_t versionMajor;
+  uint16_t versionMinor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+} pcap_file_header_t;
+
+typedef struct pcap_record_header {
+  uint32_t seconds;
+  uint32_t fraction;
+  uint32_t capturedLength;
+  uint32_t wireLength;
+} pcap_record_header_t;
+
+struct opof_pcap {
+  FILE *file;
+  bool swapped;
+  bool nanoseconds;
+};
+
+static uint32_t field32(const opof_pcap_t *pcap, uint32_t value){
+  return pcap->swapped ? __builtin_bswap32(value) : value;
+}
+
+static opof_pcap_t *pcapOpen(const char *path, const char *mode){
+  opof_pcap_t *pcap = (opof_pcap_t *)calloc(1, sizeof(*pcap));
+
+  if (pcap == NULL){
+    return NULL;
+  }
+  pcap->file = fopen(path, mode);
+  if (pcap->file == NULL){
+    free(pcap);
+    return NULL;
+  }
+  setvbuf(pcap->file, NULL, _IOFBF, PCAP_IO_BUFFER);
+  return pcap;
+}
+
+/**
+* \ingroup testlibrary
+* \brief Opens a capture for reading
+*
+* \param  path  The pcap file
+* \return The capture, NULL when the file cannot be read or is not a
+*         classic pcap of Ethernet frames
+*
+*/
+opof_pcap_t *opof_pcap_open_read(const char *path){
+  opof_pcap_t *pcap = pcapOpen(path, "rb");
+  pcap_file_header_t header;
+
+  if (pcap == NULL){
+    return NULL;
+  }
+  if (fread(&header, sizeof(header), 1, pcap->file) != 1){
+    opof_pcap_close(pcap);
+    return NULL;
+  }
+  if (header.magic == PCAP_MAGIC_USEC || header.magic == PCAP_MAGIC_NSEC){
+    pcap->swapped = false;
+  } else if (header.magic == __builtin_bswap32(PCAP_MAGIC_USEC) || header.magic == __builtin_bswap32(PCAP_MAGIC_NSEC)){
+    pcap->swapped = true;
+  } else {
+    opof_pcap_close(pcap);
+    return NULL;
+  }
+  pcap->nanoseconds = field32(pcap, header.magic) == PCAP_MAGIC_NSEC;
+  if (field32(pcap, header.linktype) != PCAP_LINKTYPE_ETHERNET){
+    opof_pcap_close(pcap);
+    return NULL;
+  }
+  return pcap;
+}
+
+opof_pcap_t *opof_pcap_open_write(const char *path){
+  opof_pcap_t *pcap = pcapOpen(path, "wb");
+  pcap_file_header_t header = {PCAP_MAGIC_USEC, 2, 4, 0, 0, OPOF_PCAP_SNAPLEN, PCAP_LINKTYPE_ETHERNET};
+
+  if (pcap == NULL){
+    return NULL;
+  }
+  if (fwrite(&header, sizeof(header), 1, pcap->file) != 1){
+    opof_pcap_close(pcap);
+    return NULL;
+  }
+  return pcap;
+}
+
+/**
+* \ingroup testlibrary
+* \brief Reads the next packet
+*
+* Packets longer than size are cut to size, as if captured with a smaller
+* snaplen.
+*
+* \param  pcap    The capture
+* \param  data    Where the packet is copied
+* \param  size    The size of data
+* \param  length  The bytes copied
+* \param  nanos   The capture time in nanoseconds since the epoch
+* \return _OK, _NOT_FOUND at the end of the file, _INVALID_ARGUMENT when the
+*         file ends inside a record
+*
+*/
+int opof_pcap_read(opof_pcap_t *pcap, uint8_t *data, size_t size, uint32_t *length, uint64_t *nanos){
+  pcap_record_header_t header;
+  uint32_t captured;
+  size_t n;
+
+  n = fread(&header, 1, sizeof(header), pcap->file);
+  if (n == 0){
+    return _NOT_FOUND;
+  }
+  if (n != sizeof(header)){
+    return _INVALID_ARGUMENT;
+  }
+  captured = field32(pcap, header.capturedLength);
+  if (captured > OPOF_PCAP_SNAPLEN * 4){
+    return _INVALID_ARGUMENT;
+  }
+  *length = captured < size ? captured : (uint32_t)size;
+  if (fread(data, 1, *length, pcap->file) != *length){
+    return _INVALID_ARGUMENT;
+  }
+  if (captured > *length && fseek(pcap->file, captured - *length, SEEK_CUR) != 0){
+    return _INVALID_ARGUMENT;
+  }
+  *nanos = (uint64_t)field32(pcap, header.seconds) * 1000000000 +
+    (uint64_t)field32(pcap, header.fraction) * (pcap->nanoseconds ? 1 : 1000);
+  return _OK;
+}
+
+/* returns _OK, or _INTERNAL when the write fails */
+int opof_pcap_write(opof_pcap_t *pcap, const uint8_t *data, uint32_t length, uint64_t nanos){
+  pcap_record_header_t header;
+
+  header.seconds = (uint32_t)(nanos / 1000000000);
+  header.fraction = (uint32_t)(nanos % 1000000000 / 1000);
+  header.capturedLength = length;
+  header.wireLength = length;
+  if (fwrite(&header, sizeof(header), 1, pcap->file) != 1 ||
+      fwrite(data, 1, length, pcap->file) != length){
+    return _INTERNAL;
+  }
+  return _OK;
+}
+
+void opof_pcap_close(opof_pcap_t *pcap){
+  if (pcap == NULL){
+    return;
+  }
+  fclose(pcap->file);
+  free(pcap);
+}
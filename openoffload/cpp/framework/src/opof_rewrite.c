@@ -0,0 +1,389 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief NAT and MAC rewrite of packet bursts with incremental checksums
+*
+* The checksum sums follow RFC 1624: a 16 bit word changing from m to m'
+* adds ~m + m' to the one's complement sum, so HC' = ~(~HC + ~m + m'), and
+* the ~m + m' of every word a rewrite changes is added up at compile time.
+* A TTL decrement changes the word holding the TTL and protocol by -0x100,
+* which is 0xfeff whatever the TTL was.
+*
+* The address blend is (old & ~mask) | new, eight bytes at a time, 16 with
+* SSE2 and the 32 bytes of both IPv6 addresses at once with AVX2. The
+* blend in use is picked once per burst, not per packet.
+*
+*/
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REWRITE_X86 1
+#endif
+
+#include "opof.h"
+#include "opof_rewrite.h"
+
+#define REWRITE_TTL_WORD_DELTA 0xfeff
+#define REWRITE_PREFETCH_AHEAD 4
+
+static int currentSimd = -1;
+
+static inline uint16_t get16(const uint8_t *p){
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline void put16(uint8_t *p, uint16_t value){
+  p[0] = (uint8_t)(value >> 8);
+  p[1] = (uint8_t)value;
+}
+
+static inline bool hasPorts(uint8_t proto){
+  return proto == _TCP || proto == _UDP;
+}
+
+static uint16_t fold(uint32_t sum){
+  while (sum >> 16){
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (uint16_t)sum;
+}
+
+/* what changing length bytes from before to after adds to a checksum's sum */
+static uint32_t changeSum(const uint8_t *before, const uint8_t *after, int length){
+  uint32_t sum = 0;
+
+  for (int i = 0; i < length; i += 2){
+    sum += (uint16_t)~get16(before + i) + (uint32_t)get16(after + i);
+  }
+  return sum;
+}
+
+static void natAddress(uint8_t *address, const nat_t *nat, uint8_t ipver){
+  if (ipver == _IPV4){
+    memcpy(address, &nat->ipv4.s_addr, 4);
+  } else {
+    memcpy(address, nat->ipv6.s6_addr, 16);
+  }
+}
+
+static OPOF_REWRITE_SIMD_T bestSimd(void){
+#ifdef REWRITE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")){
+    return OPOF_REWRITE_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")){
+    return OPOF_REWRITE_SSE2;
+  }
+#endif
+  return OPOF_REWRITE_SCALAR;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Compiles the rewrite of the packets of one direction of a session
+*
+* \param  key      The flow key the packets match, their tuple before the rewrite
+* \param  link     The link parameters of the Lif they leave on
+* \param  nextHop  The next hop of link, NULL when there is none
+* \param  rewrite  The compiled rewrite
+*
+*/
+void opof_rewrite_compile(const opof_flow_key_t *key, const perLinkActionParameters_t *link,
+                          const nextHopParameters_t *nextHop, opof_rewrite_t *rewrite){
+  int length = key->ipver == _IPV4 ? 4 : 16;
+  uint32_t addressSum = 0;
+  uint32_t portSum = 0;
+
+  memset(rewrite, 0, sizeof(*rewrite));
+  rewrite->ipver = key->ipver;
+  rewrite->proto = key->proto;
+  if (link->snatEnable && link->snat.ipver == key->ipver){
+    natAddress(rewrite->addresses, &link->snat, key->ipver);
+    memset(rewrite->addressMask, 0xff, length);
+    addressSum += changeSum(key->src, rewrite->addresses, length);
+    if (link->snat.port != 0 && hasPorts(key->proto)){
+      put16(rewrite->ports, link->snat.port);
+      memset(rewrite->portMask, 0xff, 2);
+      portSum += (uint16_t)~key->srcPort + (uint32_t)link->snat.port;
+      rewrite->flags |= OPOF_REWRITE_PORTS;
+    }
+    rewrite->flags |= OPOF_REWRITE_ADDRESSES;
+  }
+  if (link->dnatEnable && link->dnat.ipver == key->ipver){
+    natAddress(rewrite->addresses + length, &link->dnat, key->ipver);
+    memset(rewrite->addressMask + length, 0xff, length);
+    addressSum += changeSum(key->dst, rewrite->addresses + length, length);
+    if (link->dnat.port != 0 && hasPorts(key->proto)){
+      put16(rewrite->ports + 2, link->dnat.port);
+      memset(rewrite->portMask + 2, 0xff, 2);
+      portSum += (uint16_t)~key->dstPort + (uint32_t)link->dnat.port;
+      rewrite->flags |= OPOF_REWRITE_PORTS;
+    }
+    rewrite->flags |= OPOF_REWRITE_ADDRESSES;
+  }
+  if (nextHop != NULL && nextHop->macRewriteEnable){
+    memcpy(rewrite->macs, nextHop->macRewrite.dstMac, 6);
+    memcpy(rewrite->macs + 6, nextHop->macRewrite.srcMac, 6);
+    rewrite->flags |= OPOF_REWRITE_MAC;
+    if (key->proto == _TCP){
+      rewrite->flags |= OPOF_REWRITE_TTL;
+    }
+  }
+  if (link->vlan != 0){
+    rewrite->vlan = link->vlan & 0x0fff;
+    rewrite->flags |= OPOF_REWRITE_VLAN;
+  }
+  if (key->ipver == _IPV4 && (rewrite->flags & (OPOF_REWRITE_ADDRESSES | OPOF_REWRITE_TTL)) != 0){
+    rewrite->ipDelta = fold(addressSum + ((rewrite->flags & OPOF_REWRITE_TTL) != 0 ? REWRITE_TTL_WORD_DELTA : 0));
+    rewrite->flags |= OPOF_REWRITE_IP_CHECKSUM;
+  }
+  if (hasPorts(key->proto) && (rewrite->flags & (OPOF_REWRITE_ADDRESSES | OPOF_REWRITE_PORTS)) != 0){
+    rewrite->l4Delta = fold(addressSum + portSum);
+    rewrite->flags |= OPOF_REWRITE_L4_CHECKSUM;
+  }
+}
+
+static inline void updateChecksum(uint8_t *checksum, uint16_t delta){
+  uint32_t sum = (uint32_t)(uint16_t)~get16(checksum) + delta;
+
+  sum = (sum & 0xffff) + (sum >> 16);
+  put16(checksum, (uint16_t)~sum);
+}
+
+/* the TTL, MACs and VLAN; false, with the packet untouched, when the TTL ran out */
+static inline bool rewriteLink(const opof_rewrite_packet_t *p, const opof_rewrite_t *r){
+  uint8_t *data = p->data;
+
+  if ((r->flags & OPOF_REWRITE_TTL) != 0){
+    uint8_t *ttl = data + p->l3 + (r->ipver == _IPV4 ? 8 : 7);
+    if (*ttl <= 1){
+      return false;
+    }
+    (*ttl)--;
+  }
+  if ((r->flags & OPOF_REWRITE_MAC) != 0){
+    memcpy(data, r->macs, 12);
+  }
+  if ((r->flags & OPOF_REWRITE_VLAN) != 0 && p->vlanOffset != 0){
+    uint8_t *tci = data + p->vlanOffset;
+    put16(tci, (uint16_t)((get16(tci) & 0xf000) | r->vlan));
+  }
+  return true;
+}
+
+/* the ports and both checksums, after the addresses */
+static inline void rewriteTransport(const opof_rewrite_packet_t *p, const opof_rewrite_t *r){
+  uint8_t *l4 = p->data + p->l4;
+
+  if ((r->flags & OPOF_REWRITE_PORTS) != 0){
+    uint32_t ports, value, mask;
+    memcpy(&ports, l4, 4);
+    memcpy(&value, r->ports, 4);
+    memcpy(&mask, r->portMask, 4);
+    ports = (ports & ~mask) | value;
+    memcpy(l4, &ports, 4);
+  }
+  if ((r->flags & OPOF_REWRITE_IP_CHECKSUM) != 0){
+    updateChecksum(p->data + p->l3 + 10, r->ipDelta);
+  }
+  if ((r->flags & OPOF_REWRITE_L4_CHECKSUM) != 0){
+    uint8_t *checksum = l4 + (r->proto == _TCP ? 16 : 6);
+    if (r->proto == _UDP){
+      if (r->ipver == _IPV4 && get16(checksum) == 0){
+        return;
+      }
+      updateChecksum(checksum, r->l4Delta);
+      if (get16(checksum) == 0){
+        put16(checksum, 0xffff);
+      }
+    } else {
+      updateChecksum(checksum, r->l4Delta);
+    }
+  }
+}
+
+static inline void blend64(uint8_t *p, const uint8_t *value, const uint8_t *mask){
+  uint64_t word, v, m;
+
+  memcpy(&word, p, 8);
+  memcpy(&v, value, 8);
+  memcpy(&m, mask, 8);
+  word = (word & ~m) | v;
+  memcpy(p, &word, 8);
+}
+
+static inline void blendAddressesScalar(uint8_t *ip, const opof_rewrite_t *r){
+  if (r->ipver == _IPV4){
+    blend64(ip + 12, r->addresses, r->addressMask);
+  } else {
+    for (int i = 0; i < 32; i += 8){
+      blend64(ip + 8 + i, r->addresses + i, r->addressMask + i);
+    }
+  }
+}
+
+#ifdef REWRITE_X86
+static inline __m128i blend128(__m128i old, const uint8_t *value, const uint8_t *mask){
+  return _mm_or_si128(_mm_andnot_si128(_mm_loadu_si128((const __m128i *)mask), old),
+                      _mm_loadu_si128((const __m128i *)value));
+}
+
+static inline void blendAddressesSse2(uint8_t *ip, const opof_rewrite_t *r){
+  if (r->ipver == _IPV4){
+    __m128i old = _mm_loadl_epi64((const __m128i *)(ip + 12));
+    _mm_storel_epi64((__m128i *)(ip + 12), blend128(old, r->addresses, r->addressMask));
+  } else {
+    __m128i src = _mm_loadu_si128((const __m128i *)(ip + 8));
+    __m128i dst = _mm_loadu_si128((const __m128i *)(ip + 24));
+    _mm_storeu_si128((__m128i *)(ip + 8), blend128(src, r->addresses, r->addressMask));
+    _mm_storeu_si128((__m128i *)(ip + 24), blend128(dst, r->addresses + 16, r->addressMask + 16));
+  }
+}
+
+__attribute__((target("avx2")))
+static inline void blendAddressesAvx2(uint8_t *ip, const opof_rewrite_t *r){
+  if (r->ipver == _IPV4){
+    blendAddressesSse2(ip, r);
+  } else {
+    __m256i old = _mm256_loadu_si256((const __m256i *)(ip + 8));
+    __m256i mask = _mm256_loadu_si256((const __m256i *)r->addressMask);
+    __m256i value = _mm256_loadu_si256((const __m256i *)r->addresses);
+    _mm256_storeu_si256((__m256i *)(ip + 8), _mm256_or_si256(_mm256_andnot_si256(mask, old), value));
+  }
+}
+#endif
+
+static uint64_t burstScalar(const opof_rewrite_packet_t packets[], int count){
+  uint64_t done = 0;
+
+  for (int i = 0; i < count; i++){
+    const opof_rewrite_packet_t *p = &packets[i];
+    const opof_rewrite_t *r = p->rewrite;
+    if (i + REWRITE_PREFETCH_AHEAD < count){
+      __builtin_prefetch(packets[i + REWRITE_PREFETCH_AHEAD].rewrite);
+    }
+    if (!rewriteLink(p, r)){
+      continue;
+    }
+    if ((r->flags & OPOF_REWRITE_ADDRESSES) != 0){
+      blendAddressesScalar(p->data + p->l3, r);
+    }
+    rewriteTransport(p, r);
+    done |= 1ULL << i;
+  }
+  return done;
+}
+
+#ifdef REWRITE_X86
+static uint64_t burstSse2(const opof_rewrite_packet_t packets[], int count){
+  uint64_t done = 0;
+
+  for (int i = 0; i < count; i++){
+    const opof_rewrite_packet_t *p = &packets[i];
+    const opof_rewrite_t *r = p->rewrite;
+    if (i + REWRITE_PREFETCH_AHEAD < count){
+      __builtin_prefetch(packets[i + REWRITE_PREFETCH_AHEAD].rewrite);
+    }
+    if (!rewriteLink(p, r)){
+      continue;
+    }
+    if ((r->flags & OPOF_REWRITE_ADDRESSES) != 0){
+      blendAddressesSse2(p->data + p->l3, r);
+    }
+    rewriteTransport(p, r);
+    done |= 1ULL << i;
+  }
+  return done;
+}
+
+__attribute__((target("avx2")))
+static uint64_t burstAvx2(const opof_rewrite_packet_t packets[], int count){
+  uint64_t done = 0;
+
+  for (int i = 0; i < count; i++){
+    const opof_rewrite_packet_t *p = &packets[i];
+    const opof_rewrite_t *r = p->rewrite;
+    if (i + REWRITE_PREFETCH_AHEAD < count){
+      __builtin_prefetch(packets[i + REWRITE_PREFETCH_AHEAD].rewrite);
+    }
+    if (!rewriteLink(p, r)){
+      continue;
+    }
+    if ((r->flags & OPOF_REWRITE_ADDRESSES) != 0){
+      blendAddressesAvx2(p->data + p->l3, r);
+    }
+    rewriteTransport(p, r);
+    done |= 1ULL << i;
+  }
+  return done;
+}
+#endif
+
+/**
+* \ingroup servercinterface
+* \brief Rewrites a burst of packets in place
+*
+* Every packet must carry the tuple of the flow key its rewrite was
+* compiled from, and hold its IP header and its TCP or UDP header.
+*
+* \param  packets  The packets
+* \param  count    How many, at most OPOF_REWRITE_BURST_MAX
+* \return A mask with bit i set when packets[i] was rewritten, clear when
+*         its TTL ran out and it was left as it was
+*
+*/
+uint64_t opof_rewrite_burst(const opof_rewrite_packet_t packets[], int count){
+  if (count <= 0){
+    return 0;
+  }
+  if (count > OPOF_REWRITE_BURST_MAX){
+    count = OPOF_REWRITE_BURST_MAX;
+  }
+#ifdef REWRITE_X86
+  OPOF_REWRITE_SIMD_T simd = opof_rewrite_simd();
+  if (simd == OPOF_REWRITE_AVX2){
+    return burstAvx2(packets, count);
+  }
+  if (simd == OPOF_REWRITE_SSE2){
+    return burstSse2(packets, count);
+  }
+#endif
+  return burstScalar(packets, count);
+}
+
+/* the blend in use, the best the CPU has unless set otherwise */
+OPOF_REWRITE_SIMD_T opof_rewrite_simd(void){
+  int simd = __atomic_load_n(&currentSimd, __ATOMIC_RELAXED);
+
+  if (simd < 0){
+    simd = bestSimd();
+    __atomic_store_n(&currentSimd, simd, __ATOMIC_RELAXED);
+  }
+  return (OPOF_REWRITE_SIMD_T)simd;
+}
+
+/* the blend actually used, simd capped at what the CPU has */
+OPOF_REWRITE_SIMD_T opof_rewrite_set_simd(OPOF_REWRITE_SIMD_T simd){
+  OPOF_REWRITE_SIMD_T best = bestSimd();
+
+  __atomic_store_n(&currentSimd, simd < best ? simd : best, __ATOMIC_RELAXED);
+  return simd < best ? simd : best;
+}
@@ -0,0 +1,528 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Cycles per packet of the NAT and MAC rewrite of packet bursts
+*
+* Builds a pool of packets in IMIX sizes, by default 1024 sessions of which
+* 30% are UDP, each with a random mix of SNAT, DNAT, port translation, next
+* hop MAC rewrite and VLAN rewrite, and a few packets with a TTL of 1. Each
+* session's rewrite is compiled once and opof_rewrite_burst is measured in
+* TSC cycles and nanoseconds per packet with each blend the CPU has, IPv4
+* and IPv6 apart. The baseline applies the same rewrites and computes the
+* IPv4 header and TCP and UDP checksums again from scratch, as the software
+* dataplane did before. The pool is copied fresh before every pass, outside
+* the timing, and every rewritten packet is compared byte for byte with the
+* baseline's; a difference fails the run.
+*
+* Results are printed as JSON.
+*/
+extern "C" {
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_test.h"
+#include "opof_flow_hash.h"
+#include "opof_rewrite.h"
+}
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define REWRITE_BENCH_TSC 1
+#endif
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#define REWRITE_BENCH_POOL 1024
+#define REWRITE_BENCH_FRAME_MAX 1518
+#define REWRITE_BENCH_TTL 64
+
+struct RewriteBenchConfig {
+    unsigned long sessions;
+    unsigned int udpPercent;
+    unsigned long packets;
+    int burst;
+    unsigned long seed;
+    std::string output;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+typedef std::mt19937_64 BenchRandom;
+
+struct BenchSession {
+    sessionRequest_t request;
+    perLinkActionParameters_t link;
+    nextHopParameters_t nextHop;
+    opof_flow_key_t key;
+    opof_rewrite_t rewrite;
+};
+
+struct BenchPacket {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t session;
+    uint16_t vlanOffset;
+    uint16_t l3;
+    uint16_t l4;
+};
+
+/* the packets of one IP version, work is rewritten and copied back from pristine */
+struct Pool {
+    std::vector<BenchSession> sessions;
+    std::vector<BenchPacket> packets;
+    std::vector<uint8_t> pristine;
+    std::vector<uint8_t> work;
+    std::vector<uint8_t> expected;
+    std::vector<opof_rewrite_packet_t> bursts;
+};
+
+struct CostResult {
+    unsigned long packets;
+    unsigned long rewritten;
+    unsigned long wrong;
+    uint64_t cycles;
+    double seconds;
+};
+
+static unsigned int pick(BenchRandom &random, unsigned int n) {
+  return (unsigned int)(random() % n);
+}
+
+static uint64_t tsc() {
+#ifdef REWRITE_BENCH_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static void put16(uint8_t *p, uint16_t value) {
+  p[0] = (uint8_t)(value >> 8);
+  p[1] = (uint8_t)value;
+}
+
+static uint16_t get16(const uint8_t *p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t sumWords(const uint8_t *p, uint32_t length, uint32_t sum) {
+  for (; length > 1; p += 2, length -= 2){
+    sum += get16(p);
+  }
+  if (length == 1){
+    sum += (uint32_t)p[0] << 8;
+  }
+  return sum;
+}
+
+static uint16_t foldSum(uint32_t sum) {
+  while (sum >> 16){
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (uint16_t)sum;
+}
+
+static void ipv4HeaderChecksum(uint8_t *ip) {
+  put16(ip + 10, 0);
+  put16(ip + 10, (uint16_t)~foldSum(sumWords(ip, (ip[0] & 0x0f) * 4, 0)));
+}
+
+/* over the pseudo header and the segment, which runs to the end of the frame */
+static void l4Checksum(uint8_t *frame, const BenchPacket &p, uint8_t ipver, uint8_t proto) {
+  uint8_t *ip = frame + p.l3;
+  uint8_t *l4 = frame + p.l4;
+  uint8_t *checksum = l4 + (proto == _TCP ? 16 : 6);
+  uint32_t length = p.length - p.l4;
+
+  if (proto == _UDP && ipver == _IPV4 && get16(checksum) == 0){
+    return;
+  }
+  uint32_t sum = ipver == _IPV4 ? sumWords(ip + 12, 8, 0) : sumWords(ip + 8, 32, 0);
+  put16(checksum, 0);
+  uint16_t value = (uint16_t)~foldSum(sumWords(l4, length, sum + proto + length));
+  if (value == 0 && proto == _UDP){
+    value = 0xffff;
+  }
+  put16(checksum, value);
+}
+
+static void randomNat(BenchRandom &random, uint8_t ipver, nat_t *nat) {
+  nat->ipver = (IP_VERSION_T)ipver;
+  if (ipver == _IPV4){
+    nat->ipv4.s_addr = (uint32_t)random();
+  } else {
+    for (int i = 0; i < 16; i++){
+      nat->ipv6.s6_addr[i] = (uint8_t)random();
+    }
+  }
+  nat->port = pick(random, 2) ? (uint16_t)(1 + pick(random, 65535)) : 0;
+}
+
+static void randomSession(BenchRandom &random, const RewriteBenchConfig &config, uint8_t ipver, BenchSession *s) {
+  sessionRequest_t &r = s->request;
+
+  memset(s, 0, sizeof(*s));
+  r.inlif = 1;
+  r.outlif = 2;
+  r.vlan_inLif = pick(random, 2) ? (uint16_t)(100 + pick(random, 8)) : 0;
+  r.ipver = (IP_VERSION_T)ipver;
+  r.proto = pick(random, 100) < config.udpPercent ? _UDP : _TCP;
+  r.srcPort = (uint16_t)(1024 + pick(random, 64512));
+  r.dstPort = pick(random, 2) ? 443 : (uint16_t)(1 + pick(random, 65535));
+  if (ipver == _IPV4){
+    r.srcIP.s_addr = htonl(0x0a000000 | pick(random, 1 << 24));
+    r.dstIP.s_addr = (uint32_t)random();
+  } else {
+    for (int i = 0; i < 16; i++){
+      r.srcIPV6.s6_addr[i] = (uint8_t)random();
+      r.dstIPV6.s6_addr[i] = (uint8_t)random();
+    }
+  }
+  s->link.snatEnable = pick(random, 2);
+  if (s->link.snatEnable){
+    randomNat(random, ipver, &s->link.snat);
+  }
+  s->link.dnatEnable = pick(random, 2);
+  if (s->link.dnatEnable){
+    randomNat(random, ipver, &s->link.dnat);
+  }
+  s->link.vlan = pick(random, 10) < 3 ? (uint16_t)(200 + pick(random, 8)) : 0;
+  if (pick(random, 10) < 8){
+    s->nextHop.nextHopId = 1;
+    s->nextHop.macRewriteEnable = true;
+    for (int i = 0; i < 6; i++){
+      s->nextHop.macRewrite.dstMac[i] = (uint8_t)random();
+      s->nextHop.macRewrite.srcMac[i] = (uint8_t)random();
+    }
+  }
+  opof_flow_key_from_request(&r, &s->key);
+  opof_rewrite_compile(&s->key, &s->link, s->nextHop.macRewriteEnable ? &s->nextHop : NULL, &s->rewrite);
+}
+
+/* IMIX: 7 of 64 bytes, 4 of 594 and 1 of 1518 */
+static uint32_t imixSize(BenchRandom &random) {
+  unsigned int r = pick(random, 12);
+  return r < 7 ? 64 : r < 11 ? 594 : 1518;
+}
+
+/* a packet of session s with valid checksums, or just its headers when they are longer than size */
+static uint32_t buildFrame(BenchRandom &random, const BenchSession &s, uint32_t size, uint8_t ttl, uint8_t *frame,
+                           BenchPacket *p) {
+  const sessionRequest_t &r = s.request;
+  uint32_t offset = 12;
+  uint32_t ipHeader = r.ipver == _IPV4 ? 20 : 40;
+  uint32_t l4Header = r.proto == _TCP ? 20 : 8;
+
+  for (int i = 0; i < 12; i++){
+    frame[i] = (uint8_t)random();
+  }
+  p->vlanOffset = 0;
+  if (r.vlan_inLif != 0){
+    put16(frame + offset, 0x8100);
+    put16(frame + offset + 2, (uint16_t)(pick(random, 8) << 13 | r.vlan_inLif));
+    p->vlanOffset = offset + 2;
+    offset += 4;
+  }
+  put16(frame + offset, r.ipver == _IPV4 ? 0x0800 : 0x86dd);
+  offset += 2;
+  uint32_t length = std::max(size, offset + ipHeader + l4Header);
+  p->length = length;
+  p->l3 = offset;
+  p->l4 = offset + ipHeader;
+  uint32_t l4Length = length - p->l4;
+  uint8_t *ip = frame + p->l3;
+  uint8_t *l4 = frame + p->l4;
+
+  memset(ip, 0, ipHeader + l4Header);
+  if (r.ipver == _IPV4){
+    ip[0] = 0x45;
+    put16(ip + 2, (uint16_t)(ipHeader + l4Length));
+    put16(ip + 4, (uint16_t)random());
+    put16(ip + 6, 0x4000);
+    ip[8] = ttl;
+    ip[9] = r.proto;
+    memcpy(ip + 12, s.key.src, 4);
+    memcpy(ip + 16, s.key.dst, 4);
+    ipv4HeaderChecksum(ip);
+  } else {
+    ip[0] = 0x60;
+    put16(ip + 4, (uint16_t)l4Length);
+    ip[6] = r.proto;
+    ip[7] = ttl;
+    memcpy(ip + 8, s.key.src, 16);
+    memcpy(ip + 24, s.key.dst, 16);
+  }
+  put16(l4, r.srcPort);
+  put16(l4 + 2, r.dstPort);
+  if (r.proto == _TCP){
+    put16(l4 + 4, (uint16_t)random());
+    put16(l4 + 6, (uint16_t)random());
+    l4[12] = 0x50;
+    l4[13] = 0x10;
+    put16(l4 + 14, 65535);
+  } else {
+    put16(l4 + 4, (uint16_t)l4Length);
+  }
+  for (uint32_t i = l4Header; i < l4Length; i++){
+    l4[i] = (uint8_t)random();
+  }
+  /* one in ten UDP over IPv4 packets has no checksum */
+  if (r.proto != _UDP || r.ipver != _IPV4 || pick(random, 10) != 0){
+    l4Checksum(frame, *p, r.ipver, r.proto);
+  }
+  return length;
+}
+
+static void buildPool(BenchRandom &random, const RewriteBenchConfig &config, uint8_t ipver, Pool *pool) {
+  pool->sessions.resize(config.sessions);
+  for (BenchSession &s : pool->sessions){
+    randomSession(random, config, ipver, &s);
+  }
+  pool->pristine.resize(REWRITE_BENCH_POOL * REWRITE_BENCH_FRAME_MAX);
+  uint32_t offset = 0;
+  for (int i = 0; i < REWRITE_BENCH_POOL; i++){
+    BenchPacket p;
+    p.session = pick(random, (unsigned int)config.sessions);
+    p.offset = offset;
+    uint8_t ttl = pick(random, 100) == 0 ? 1 : REWRITE_BENCH_TTL;
+    offset += buildFrame(random, pool->sessions[p.session], imixSize(random), ttl, &pool->pristine[offset], &p);
+    /* the next frame starts on a cache line, as received frames do */
+    offset = (offset + 63) & ~63U;
+    pool->packets.push_back(p);
+  }
+  pool->pristine.resize(offset);
+  pool->work = pool->pristine;
+  pool->expected = pool->pristine;
+  for (const BenchPacket &p : pool->packets){
+    opof_rewrite_packet_t b;
+    b.data = &pool->work[p.offset];
+    b.rewrite = &pool->sessions[p.session].rewrite;
+    b.vlanOffset = p.vlanOffset;
+    b.l3 = p.l3;
+    b.l4 = p.l4;
+    pool->bursts.push_back(b);
+  }
+}
+
+/*
+* The rewrite as the dataplane did it before it had compiled rewrites: the
+* fields from the link parameters and next hop, then every checksum summed
+* again. Returns false when the TTL runs out.
+*/
+static bool rewriteFromScratch(uint8_t *frame, const BenchPacket &p, const BenchSession &s) {
+  const sessionRequest_t &r = s.request;
+  const perLinkActionParameters_t &link = s.link;
+  uint8_t *ip = frame + p.l3;
+  uint8_t *l4 = frame + p.l4;
+  int length = r.ipver == _IPV4 ? 4 : 16;
+  bool translated = false;
+  bool ttlChanged = false;
+
+  if (s.nextHop.macRewriteEnable){
+    if (r.proto == _TCP){
+      uint8_t *ttl = ip + (r.ipver == _IPV4 ? 8 : 7);
+      if (*ttl <= 1){
+        return false;
+      }
+      (*ttl)--;
+      ttlChanged = true;
+    }
+    memcpy(frame, s.nextHop.macRewrite.dstMac, 6);
+    memcpy(frame + 6, s.nextHop.macRewrite.srcMac, 6);
+  }
+  if (link.vlan != 0 && p.vlanOffset != 0){
+    put16(frame + p.vlanOffset, (uint16_t)((get16(frame + p.vlanOffset) & 0xf000) | link.vlan));
+  }
+  if (link.snatEnable){
+    memcpy(ip + (r.ipver == _IPV4 ? 12 : 8), r.ipver == _IPV4 ? (const uint8_t *)&link.snat.ipv4.s_addr : link.snat.ipv6.s6_addr, length);
+    if (link.snat.port != 0){
+      put16(l4, link.snat.port);
+    }
+    translated = true;
+  }
+  if (link.dnatEnable){
+    memcpy(ip + (r.ipver == _IPV4 ? 16 : 24), r.ipver == _IPV4 ? (const uint8_t *)&link.dnat.ipv4.s_addr : link.dnat.ipv6.s6_addr, length);
+    if (link.dnat.port != 0){
+      put16(l4 + 2, link.dnat.port);
+    }
+    translated = true;
+  }
+  if (r.ipver == _IPV4 && (translated || ttlChanged)){
+    ipv4HeaderChecksum(ip);
+  }
+  if (translated){
+    l4Checksum(frame, p, r.ipver, r.proto);
+  }
+  return true;
+}
+
+static double secondsSince(BenchClock::time_point start) {
+  return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+/* baseline fills pool.expected from its first pass, the others are checked against it */
+static CostResult measure(Pool &pool, const RewriteBenchConfig &config, bool baseline) {
+  CostResult result = {0, 0, 0, 0, 0.0};
+
+  while (result.packets < config.packets){
+    memcpy(pool.work.data(), pool.pristine.data(), pool.work.size());
+    BenchClock::time_point start = BenchClock::now();
+    uint64_t begin = tsc();
+    if (baseline){
+      for (const BenchPacket &p : pool.packets){
+        result.rewritten += rewriteFromScratch(&pool.work[p.offset], p, pool.sessions[p.session]);
+      }
+    } else {
+      for (size_t i = 0; i < pool.bursts.size(); i += config.burst){
+        result.rewritten += __builtin_popcountll(opof_rewrite_burst(&pool.bursts[i], config.burst));
+      }
+    }
+    result.cycles += tsc() - begin;
+    result.seconds += secondsSince(start);
+    if (result.packets == 0){
+      if (baseline){
+        pool.expected = pool.work;
+      }
+      for (const BenchPacket &p : pool.packets){
+        result.wrong += memcmp(&pool.work[p.offset], &pool.expected[p.offset], p.length) != 0;
+      }
+    }
+    result.packets += pool.packets.size();
+  }
+  return result;
+}
+
+static void printCost(FILE *out, const char *name, const CostResult &result, bool last) {
+  fprintf(out, "    \"%s\": {\"packets\": %lu, \"rewritten\": %lu, \"wrong\": %lu, \"cyclesPerPacket\": %.1f, "
+          "\"nanosPerPacket\": %.2f, \"mpps\": %.1f}%s\n", name, result.packets, result.rewritten, result.wrong,
+          (double)result.cycles / result.packets, result.seconds * 1e9 / result.packets,
+          result.packets / result.seconds / 1e6, last ? "" : ",");
+}
+
+static void displayHelp(void) {
+  printf("\nCommand line arguments for the OpenOffload rewrite benchmark version: %s \n", OPOF_VERSION);
+  printf("\t-n, --sessions        Sessions the packets belong to (default 1024)\n");
+  printf("\t-u, --udp             Percent of UDP sessions, the rest are TCP (default 30)\n");
+  printf("\t-p, --packets         Packets per measurement (default 10000000)\n");
+  printf("\t-b, --burst           Packets per burst, a power of two up to %d (default 32)\n", OPOF_REWRITE_BURST_MAX);
+  printf("\t-s, --seed            Random seed (default 1)\n");
+  printf("\t-o, --output          Write the JSON results to this file instead of stdout\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  RewriteBenchConfig config = {1024, 30, 10000000, 32, 1, ""};
+  static struct option longopts[] = {
+    {"sessions", required_argument, NULL, 'n'},
+    {"udp", required_argument, NULL, 'u'},
+    {"packets", required_argument, NULL, 'p'},
+    {"burst", required_argument, NULL, 'b'},
+    {"seed", required_argument, NULL, 's'},
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  static const char *simdNames[] = {"scalar", "sse2", "avx2"};
+  static const uint8_t ipvers[] = {_IPV4, _IPV6};
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:u:p:b:s:o:h", longopts, NULL)) != -1){
+    switch (c){
+      case 'n':
+        config.sessions = strtoul(optarg, NULL, 0);
+        break;
+      case 'u':
+        config.udpPercent = strtoul(optarg, NULL, 0);
+        break;
+      case 'p':
+        config.packets = strtoul(optarg, NULL, 0);
+        break;
+      case 'b':
+        config.burst = atoi(optarg);
+        break;
+      case 's':
+        config.seed = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        config.output = optarg;
+        break;
+      case 'h':
+      default:
+        displayHelp();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  if (config.sessions == 0 || config.udpPercent > 100 || config.burst < 1 ||
+      config.burst > OPOF_REWRITE_BURST_MAX || REWRITE_BENCH_POOL % config.burst != 0){
+    fprintf(stderr, "sessions must be at least 1, udp 0 to 100, burst a power of two up to %d\n",
+            OPOF_REWRITE_BURST_MAX);
+    return 1;
+  }
+
+  BenchRandom random(config.seed);
+  OPOF_REWRITE_SIMD_T best = opof_rewrite_simd();
+  std::vector<CostResult> results[2];
+  unsigned long wrong = 0;
+
+  uint64_t tscStart = tsc();
+  BenchClock::time_point clockStart = BenchClock::now();
+  for (int v = 0; v < 2; v++){
+    Pool pool;
+    buildPool(random, config, ipvers[v], &pool);
+    results[v].push_back(measure(pool, config, true));
+    for (int simd = OPOF_REWRITE_SCALAR; simd <= best; simd++){
+      opof_rewrite_set_simd((OPOF_REWRITE_SIMD_T)simd);
+      results[v].push_back(measure(pool, config, false));
+      wrong += results[v].back().wrong + (results[v].back().rewritten != results[v][0].rewritten);
+    }
+  }
+  double tscGhz = (tsc() - tscStart) / secondsSince(clockStart) / 1e9;
+
+  FILE *out = stdout;
+  if (!config.output.empty()){
+    out = fopen(config.output.c_str(), "w");
+    if (out == NULL){
+      fprintf(stderr, "Cannot write %s\n", config.output.c_str());
+      return 1;
+    }
+  }
+  fprintf(out, "{\n");
+  fprintf(out, "  \"config\": {\"sessions\": %lu, \"udpPercent\": %u, \"packets\": %lu, \"burst\": %d, \"seed\": %lu},\n",
+          config.sessions, config.udpPercent, config.packets, config.burst, config.seed);
+  fprintf(out, "  \"tscGhz\": %.2f,\n", tscGhz);
+  for (int v = 0; v < 2; v++){
+    fprintf(out, "  \"%s\": {\n", v == 0 ? "ipv4" : "ipv6");
+    printCost(out, "recompute", results[v][0], false);
+    for (size_t i = 1; i < results[v].size(); i++){
+      printCost(out, simdNames[i - 1], results[v][i], i + 1 == results[v].size());
+    }
+    fprintf(out, "  },\n");
+  }
+  fprintf(out, "  \"wrong\": %lu\n", wrong);
+  fprintf(out, "}\n");
+  if (out != stdout){
+    fclose(out);
+  }
+  return wrong == 0 ? 0 : 1;
+}
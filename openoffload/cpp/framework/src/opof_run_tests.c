@@ -21,6 +21,7 @@
   *
   */
   #include <limits.h>
+  #include <string.h>
   #include <stdbool.h>
   #include <arpa/inet.h>
   #include <sys/types.h>          
@@ -73,6 +74,11 @@ int getRetryAttempts(void){
   int opof_test9(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose);
   int opof_test10(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose);
   int opof_test11(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose);
+  int opof_test12(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose);
+  int opof_test13(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose);
+  int opof_test14(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose);
+  int opof_test15(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose);
+  int opof_test16(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose);
 
 
   void opof_list_tests(){
@@ -88,6 +94,11 @@ int getRetryAttempts(void){
     printf("\tTest 9: Test session client timeout and reconnect\n");
     printf("\tTest 10: Test session client timeout and reconnect\n");
     printf("\tTest 11: Use addSession to create a large number of sessions (IPV6), then call getClosedSessions\n");
+    printf("\tTest 12: Use addSession to create sessions on two inLifs, then call getAllSessions with an inLif filter\n");
+    printf("\tTest 13: Use addSession to create a large number of sessions, then call getTopSessions by inBytes\n");
+    printf("\tTest 14: Use addSession to create sessions on two inLifs, then check getAggregateStats after adds and a delete\n");
+    printf("\tTest 15: Use addSession and getSession, then check the counters and latencies returned by getServerStats\n");
+    printf("\tTest 16: Use addSession and getAllSessions, then check the per-stage handler timers\n");
     printf("\n");
   }
 
@@ -133,6 +144,21 @@ int getRetryAttempts(void){
     case 11:
       status = opof_test11(address,  max_sessions, pageSize,port, cert,verbose);
       break;
+    case 12:
+      status = opof_test12(address,  max_sessions, pageSize,port, cert,verbose);
+      break;
+    case 13:
+      status = opof_test13(address,  max_sessions, pageSize,port, cert,verbose);
+      break;
+    case 14:
+      status = opof_test14(address,  max_sessions, pageSize,port, cert,verbose);
+      break;
+    case 15:
+      status = opof_test15(address,  max_sessions, pageSize,port, cert,verbose);
+      break;
+    case 16:
+      status = opof_test16(address,  max_sessions, pageSize,port, cert,verbose);
+      break;
     default:
       printf("ERROR: Unknown Test ID: %d\n", testid);
       status = FAILURE;
@@ -1425,3 +1451,533 @@ int opof_test11(const char *address, int max_sessions, unsigned int pageSize,uns
   return SUCCESS;
 }
 
+int opof_test12(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose){
+
+  unsigned long nsessions = 1;
+  int status;
+  int total_sessions;
+  int matched_sessions = 0;
+  int expected_sessions = 0;
+
+  sessionTable_t *handle;
+
+  sessionRequest_t **request;
+  addSessionResponse_t addResp;
+  sessionFilter_t filter = {0};
+
+  total_sessions = max_sessions;
+  sessionResponse_t responses[BUFFER_MAX];
+  int sessionCount =1;
+  int bufferSize;
+  handle = opof_create_sessionTable(address, port, cert);
+  int sessionId=0;
+
+  uint64_t sessionStart = UINT_MAX;
+  /*
+  *  Clean up any exisitng data in cache
+  */
+  if (opof_delete_all_sessions(handle,pageSize) == FAILURE){
+    return FAILURE;
+  }
+  printf("\n\nRunning Test 12; Testing get all Sessions with a filter");
+  printf("\tNumber of Sessions: %d page size: %d\n",max_sessions, pageSize);
+  //
+  printf("\n\tAdding %d sessions to cache, even sessions on inLif 3\n", max_sessions);
+  while(max_sessions > 0){
+
+    sessionCount = max_sessions - pageSize;
+    if (sessionCount < 0){
+      bufferSize = max_sessions;
+    } else {
+      bufferSize = pageSize;
+    }
+    request = createSessionRequest(bufferSize, sessionId);
+    for (int i=0; i < bufferSize; i++){
+      if ((request[i]->sessId % 2) == 0){
+        request[i]->inlif = 3;
+        expected_sessions++;
+      }
+    }
+    status = opof_add_session(bufferSize,handle, request, &addResp);
+    for (int i=0; i < bufferSize; i++){
+      free(request[i]);
+    }
+    free(request);
+    if (status != _OK){
+      printf("ERROR: Adding sessions: %d\n",status);
+      return FAILURE;
+    }
+     max_sessions = sessionCount;
+     sessionId += bufferSize;
+  }
+
+  if (expected_sessions == 0){
+    printf("ERROR: No sessions added on inLif 3 to filter\n");
+    return FAILURE;
+  }
+  filter.inlifEnable = true;
+  filter.inlif = 3;
+  printf("\n\tGetting sessions on inLif 3 from cache\n");
+  if (verbose){
+    print_response_header();
+  }
+  while (nsessions > 0 ){
+    status = opof_get_filtered_sessions(handle, &sessionStart, pageSize, &filter, responses, &nsessions);
+    if (status != _OK){
+      printf("ERROR: Getting filtered sessions: %d\n",status);
+      return FAILURE;
+    }
+    for (int i=0; i < nsessions; i++){
+      if (verbose){
+        print_response(&responses[i]);
+      }
+      if (responses[i].sessionId % 2){
+        printf("ERROR: Session: %lu does not match the filter\n",responses[i].sessionId);
+        return FAILURE;
+      }
+      matched_sessions++;
+    }
+  }
+  printf("\n\tGot %d of %d sessions matching the filter, expected %d\n",matched_sessions, total_sessions, expected_sessions);
+  if (matched_sessions != expected_sessions){
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+int opof_test13(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose){
+
+  int status;
+  int total_sessions;
+  unsigned long nsessions = 0;
+  int topCount = 10;
+
+  sessionTable_t *handle;
+
+  sessionRequest_t **request;
+  addSessionResponse_t addResp;
+  sessionResponse_t resp;
+  sessionResponse_t responses[BUFFER_MAX];
+
+  total_sessions = max_sessions;
+  int sessionCount =1;
+  int bufferSize;
+  handle = opof_create_sessionTable(address, port, cert);
+  int sessionId=0;
+
+  /*
+  *  Clean up any exisitng data in cache
+  */
+  if (opof_delete_all_sessions(handle,pageSize) == FAILURE){
+    return FAILURE;
+  }
+  printf("\n\nRunning Test 13; Testing get top sessions");
+  printf("\tNumber of Sessions: %d page size: %d\n",max_sessions, pageSize);
+  //
+  printf("\n\tAdding %d sessions to cache\n", max_sessions);
+  while(max_sessions > 0){
+
+    sessionCount = max_sessions - pageSize;
+    if (sessionCount < 0){
+      bufferSize = max_sessions;
+    } else {
+      bufferSize = pageSize;
+    }
+    request = createSessionRequest(bufferSize, sessionId);
+    status = opof_add_session(bufferSize,handle, request, &addResp);
+    for (int i=0; i < bufferSize; i++){
+      free(request[i]);
+    }
+    free(request);
+    if (status != _OK){
+      printf("ERROR: Adding sessions: %d\n",status);
+      return FAILURE;
+    }
+     max_sessions = sessionCount;
+     sessionId += bufferSize;
+  }
+  if (topCount > total_sessions){
+    topCount = total_sessions;
+  }
+  printf("\n\tGetting top %d sessions by inBytes\n", topCount);
+  status = opof_get_top_sessions(handle, _IN_BYTES, topCount, responses, &nsessions);
+  if (status != _OK || nsessions != topCount){
+    printf("ERROR: Getting top sessions: %d returned: %lu\n",status, nsessions);
+    return FAILURE;
+  }
+  if (verbose){
+    print_response_header();
+    for (int i=0; i < nsessions; i++){
+      print_response(&responses[i]);
+    }
+  }
+  for (int i=1; i < nsessions; i++){
+    if (responses[i].inBytes > responses[i-1].inBytes){
+      printf("ERROR: Top sessions are not in descending order at: %d\n",i);
+      return FAILURE;
+    }
+  }
+  for (int i=0; i < total_sessions; i++){
+    status = opof_get_session(handle, i, &resp);
+    if (status == _OK && resp.inBytes > responses[0].inBytes){
+      printf("ERROR: Session: %d has more inBytes than the top session\n",i);
+      return FAILURE;
+    }
+  }
+  printf("\n\tDeleting the top session: %lu\n", responses[0].sessionId);
+  status = opof_del_session(handle, responses[0].sessionId, &resp);
+  if (status != _OK){
+    printf("ERROR: Deleting session: %d\n",status);
+    return FAILURE;
+  }
+  /* with one session added, none is left to rank */
+  unsigned long expected = total_sessions > 1 ? 1 : 0;
+  status = opof_get_top_sessions(handle, _IN_BYTES, 1, &resp, &nsessions);
+  if (status != _OK || nsessions != expected || (nsessions > 0 && resp.sessionId == responses[0].sessionId)){
+    printf("ERROR: Deleted session is still in the top sessions\n");
+    return FAILURE;
+  }
+  printf("\n\tTop sessions returned in descending order of %d sessions\n", total_sessions);
+  return SUCCESS;
+}
+
+static aggregateStats_t *find_group(aggregateStats_t stats[], int groupCount, unsigned int key){
+  for (int i=0; i < groupCount; i++){
+    if (stats[i].key == key){
+      return &stats[i];
+    }
+  }
+  return NULL;
+}
+
+int opof_test14(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose){
+
+  int status;
+  int total_sessions;
+  int odd_sessions = 0;
+  int groupCount = 0;
+  unsigned long sessions = 0;
+  unsigned long inBytes = 0;
+
+  sessionTable_t *handle;
+
+  sessionRequest_t **request;
+  addSessionResponse_t addResp;
+  sessionResponse_t resp;
+  aggregateStats_t stats[BUFFER_MAX];
+  aggregateStats_t *group;
+
+  total_sessions = max_sessions;
+  int sessionCount =1;
+  int bufferSize;
+  handle = opof_create_sessionTable(address, port, cert);
+  int sessionId=0;
+
+  /*
+  *  Clean up any exisitng data in cache
+  */
+  if (opof_delete_all_sessions(handle,pageSize) == FAILURE){
+    return FAILURE;
+  }
+  printf("\n\nRunning Test 14; Testing aggregate stats");
+  printf("\tNumber of Sessions: %d page size: %d\n",max_sessions, pageSize);
+  //
+  printf("\n\tAdding %d sessions to cache, odd sessions on inLif 3\n", max_sessions);
+  while(max_sessions > 0){
+
+    sessionCount = max_sessions - pageSize;
+    if (sessionCount < 0){
+      bufferSize = max_sessions;
+    } else {
+      bufferSize = pageSize;
+    }
+    request = createSessionRequest(bufferSize, sessionId);
+    for (int i=0; i < bufferSize; i++){
+      if (request[i]->sessId % 2){
+        request[i]->inlif = 3;
+        odd_sessions++;
+      }
+    }
+    status = opof_add_session(bufferSize,handle, request, &addResp);
+    for (int i=0; i < bufferSize; i++){
+      free(request[i]);
+    }
+    free(request);
+    if (status != _OK){
+      printf("ERROR: Adding sessions: %d\n",status);
+      return FAILURE;
+    }
+     max_sessions = sessionCount;
+     sessionId += bufferSize;
+  }
+
+  printf("\n\tGetting aggregate stats by inLif\n");
+  status = opof_get_aggregate_stats(handle, _BY_INLIF, stats, BUFFER_MAX, &groupCount);
+  if (status != _OK){
+    printf("ERROR: Getting aggregate stats: %d\n",status);
+    return FAILURE;
+  }
+  for (int i=0; i < groupCount; i++){
+    if (verbose){
+      printf("\tinLif: %u sessions: %lu inBytes: %lu outBytes: %lu\n",
+        stats[i].key, stats[i].sessions, stats[i].inBytes, stats[i].outBytes);
+    }
+    sessions += stats[i].sessions;
+    inBytes += stats[i].inBytes;
+  }
+  group = find_group(stats, groupCount, 3);
+  if (sessions != total_sessions || (group ? group->sessions : 0) != odd_sessions){
+    printf("ERROR: Expected %d sessions, %d on inLif 3, got %lu\n", total_sessions, odd_sessions, sessions);
+    return FAILURE;
+  }
+
+  printf("\n\tChecking aggregate stats by state against inLif\n");
+  status = opof_get_aggregate_stats(handle, _BY_STATE, stats, BUFFER_MAX, &groupCount);
+  if (status != _OK){
+    printf("ERROR: Getting aggregate stats: %d\n",status);
+    return FAILURE;
+  }
+  for (int i=0; i < groupCount; i++){
+    sessions -= stats[i].sessions;
+    inBytes -= stats[i].inBytes;
+  }
+  if (sessions != 0 || inBytes != 0){
+    printf("ERROR: Totals by state do not match the totals by inLif\n");
+    return FAILURE;
+  }
+
+  if (total_sessions > 1){
+    printf("\n\tDeleting session 1 on inLif 3\n");
+    status = opof_del_session(handle, 1, &resp);
+    if (status != _OK){
+      printf("ERROR: Deleting session: %d\n",status);
+      return FAILURE;
+    }
+    status = opof_get_aggregate_stats(handle, _BY_INLIF, stats, BUFFER_MAX, &groupCount);
+    group = find_group(stats, groupCount, 3);
+    if (status != _OK || (group ? group->sessions : 0) != odd_sessions - 1){
+      printf("ERROR: Deleted session is still counted on inLif 3\n");
+      return FAILURE;
+    }
+  }
+  printf("\n\tAggregate stats match %d sessions\n", total_sessions);
+  return SUCCESS;
+}
+
+static rpcStats_t *find_rpc(rpcStats_t stats[], int rpcCount, const char *name){
+  for (int i=0; i < rpcCount; i++){
+    if (strcmp(stats[i].name, name) == 0){
+      return &stats[i];
+    }
+  }
+  return NULL;
+}
+
+int opof_test15(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose){
+
+  int status;
+  int total_sessions;
+  int rpcCount = 0;
+  unsigned long uptime;
+
+  sessionTable_t *handle;
+
+  sessionRequest_t **request;
+  addSessionResponse_t addResp;
+  sessionResponse_t resp;
+  rpcStats_t before[RPC_STATS_MAX];
+  rpcStats_t after[RPC_STATS_MAX];
+  rpcStats_t *addBefore, *addAfter, *getBefore, *getAfter;
+
+  total_sessions = max_sessions;
+  int sessionCount =1;
+  int bufferSize;
+  handle = opof_create_sessionTable(address, port, cert);
+  int sessionId=0;
+
+  /*
+  *  Clean up any exisitng data in cache
+  */
+  if (opof_delete_all_sessions(handle,pageSize) == FAILURE){
+    return FAILURE;
+  }
+  printf("\n\nRunning Test 15; Testing server stats");
+  printf("\tNumber of Sessions: %d page size: %d\n",max_sessions, pageSize);
+  status = opof_get_server_stats(handle, before, RPC_STATS_MAX, &rpcCount, &uptime);
+  addBefore = find_rpc(before, rpcCount, "addSession");
+  getBefore = find_rpc(before, rpcCount, "getSession");
+  if (status != _OK || addBefore == NULL || getBefore == NULL){
+    printf("ERROR: Getting server stats: %d\n",status);
+    return FAILURE;
+  }
+  //
+  printf("\n\tAdding and getting %d sessions\n", max_sessions);
+  while(max_sessions > 0){
+
+    sessionCount = max_sessions - pageSize;
+    if (sessionCount < 0){
+      bufferSize = max_sessions;
+    } else {
+      bufferSize = pageSize;
+    }
+    request = createSessionRequest(bufferSize, sessionId);
+    status = opof_add_session(bufferSize,handle, request, &addResp);
+    for (int i=0; i < bufferSize; i++){
+      free(request[i]);
+    }
+    free(request);
+    if (status != _OK){
+      printf("ERROR: Adding sessions: %d\n",status);
+      return FAILURE;
+    }
+     max_sessions = sessionCount;
+     sessionId += bufferSize;
+  }
+  for (int i=0; i < total_sessions; i++){
+    status = opof_get_session(handle, i, &resp);
+    if (status != _OK){
+      printf("ERROR: Getting session: %d\n",status);
+      return FAILURE;
+    }
+  }
+  /* One lookup that must fail, so the NOT_FOUND count moves */
+  opof_get_session(handle, total_sessions, &resp);
+
+  status = opof_get_server_stats(handle, after, RPC_STATS_MAX, &rpcCount, &uptime);
+  addAfter = find_rpc(after, rpcCount, "addSession");
+  getAfter = find_rpc(after, rpcCount, "getSession");
+  if (status != _OK || addAfter == NULL || getAfter == NULL){
+    printf("ERROR: Getting server stats: %d\n",status);
+    return FAILURE;
+  }
+  if (verbose){
+    printf("\tUptime: %lus\n", uptime);
+    for (int i=0; i < rpcCount; i++){
+      printf("\t%-20s calls: %lu errors: %lu sessions: %lu p50: %luus p99: %luus p999: %luus max: %luus\n",
+        after[i].name, after[i].calls, after[i].errors, after[i].sessions,
+        after[i].p50Micros, after[i].p99Micros, after[i].p999Micros, after[i].maxMicros);
+    }
+  }
+  if (addAfter->sessions - addBefore->sessions != total_sessions){
+    printf("ERROR: addSession counted %lu sessions, expected %d\n", addAfter->sessions - addBefore->sessions, total_sessions);
+    return FAILURE;
+  }
+  if (getAfter->calls - getBefore->calls != total_sessions + 1 ||
+      getAfter->statusCounts[_NOT_FOUND] - getBefore->statusCounts[_NOT_FOUND] != 1){
+    printf("ERROR: getSession counted %lu calls, expected %d\n", getAfter->calls - getBefore->calls, total_sessions + 1);
+    return FAILURE;
+  }
+  if (getAfter->p50Micros > getAfter->p99Micros || getAfter->p99Micros > getAfter->p999Micros ||
+      getAfter->p999Micros > getAfter->maxMicros){
+    printf("ERROR: getSession latency percentiles are not ordered\n");
+    return FAILURE;
+  }
+  printf("\n\tServer stats counted %d sessions, getSession p50: %luus p99: %luus\n",
+    total_sessions, getAfter->p50Micros, getAfter->p99Micros);
+  return SUCCESS;
+}
+
+static stageStats_t *find_stage(stageStats_t stats[], int stageCount, const char *rpc, const char *stage){
+  for (int i=0; i < stageCount; i++){
+    if (strcmp(stats[i].rpc, rpc) == 0 && strcmp(stats[i].stage, stage) == 0){
+      return &stats[i];
+    }
+  }
+  return NULL;
+}
+
+int opof_test16(const char *address, int max_sessions, unsigned int pageSize,unsigned short port, const char *cert, bool verbose){
+
+  int status;
+  int stageCount = 0;
+  unsigned long nsessions = 1;
+  uint64_t sessionStart = UINT_MAX;
+  const char *addStages[] = {"read", "convert", "backend", "response"};
+  const char *allStages[] = {"alloc", "backend", "convert"};
+
+  sessionTable_t *handle;
+
+  sessionRequest_t **request;
+  addSessionResponse_t addResp;
+  sessionResponse_t responses[BUFFER_MAX];
+  stageStats_t stats[STAGE_STATS_MAX];
+  stageStats_t *stage;
+
+  int sessionCount =1;
+  int bufferSize;
+  handle = opof_create_sessionTable(address, port, cert);
+  int sessionId=0;
+
+  /*
+  *  Clean up any exisitng data in cache
+  */
+  if (opof_delete_all_sessions(handle,pageSize) == FAILURE){
+    return FAILURE;
+  }
+  printf("\n\nRunning Test 16; Testing per-stage handler timers");
+  printf("\tNumber of Sessions: %d page size: %d\n",max_sessions, pageSize);
+  //
+  printf("\n\tAdding %d sessions to cache\n", max_sessions);
+  while(max_sessions > 0){
+
+    sessionCount = max_sessions - pageSize;
+    if (sessionCount < 0){
+      bufferSize = max_sessions;
+    } else {
+      bufferSize = pageSize;
+    }
+    request = createSessionRequest(bufferSize, sessionId);
+    status = opof_add_session(bufferSize,handle, request, &addResp);
+    for (int i=0; i < bufferSize; i++){
+      free(request[i]);
+    }
+    free(request);
+    if (status != _OK){
+      printf("ERROR: Adding sessions: %d\n",status);
+      return FAILURE;
+    }
+     max_sessions = sessionCount;
+     sessionId += bufferSize;
+  }
+  printf("\n\tGetting all sessions from cache\n");
+  while (nsessions > 0){
+    status = opof_get_all_sessions(handle, &sessionStart, pageSize, responses, &nsessions);
+    if (status != _OK){
+      printf("ERROR: Getting all sessions: %d\n",status);
+      return FAILURE;
+    }
+  }
+
+  status = opof_get_stage_stats(handle, stats, STAGE_STATS_MAX, &stageCount);
+  if (status != _OK){
+    printf("ERROR: Getting stage stats: %d\n",status);
+    return FAILURE;
+  }
+  if (stageCount == 0){
+    printf("ERROR: No stage stats returned, is the server running with stage timers disabled?\n");
+    return FAILURE;
+  }
+  if (verbose){
+    for (int i=0; i < stageCount; i++){
+      printf("\t%-20s %-10s calls: %lu total: %luns p50: %luns p99: %luns max: %luns\n",
+        stats[i].rpc, stats[i].stage, stats[i].calls, stats[i].totalNanos,
+        stats[i].p50Nanos, stats[i].p99Nanos, stats[i].maxNanos);
+    }
+  }
+  for (int i=0; i < sizeof(addStages)/sizeof(addStages[0]); i++){
+    stage = find_stage(stats, stageCount, "addSession", addStages[i]);
+    if (stage == NULL || stage->calls == 0 || stage->p50Nanos > stage->maxNanos){
+      printf("ERROR: Missing addSession stage: %s\n", addStages[i]);
+      return FAILURE;
+    }
+  }
+  for (int i=0; i < sizeof(allStages)/sizeof(allStages[0]); i++){
+    stage = find_stage(stats, stageCount, "getAllSessions", allStages[i]);
+    if (stage == NULL || stage->calls == 0 || stage->p50Nanos > stage->maxNanos){
+      printf("ERROR: Missing getAllSessions stage: %s\n", allStages[i]);
+      return FAILURE;
+    }
+  }
+  printf("\n\tServer reported %d handler stages\n", stageCount);
+  return SUCCESS;
+}
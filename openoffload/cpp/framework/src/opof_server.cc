@@ -25,9 +25,58 @@ extern "C" {
 #include "opof_util.h"
 #include "opof_grpc.h"
 #include "opof_session_server.h"
+#include "opof_metrics.h"
+#include "opof_trace.h"
 
+#include <condition_variable>
+#include <csignal>
+#include <mutex>
+#include <thread>
 
-extern "C" void opof_server(const char *address, unsigned short port, const char* cert, const char* key);
+extern "C" {
+  void opof_server(const char *address, unsigned short port, const char* cert, const char* key);
+  //
+  unsigned int g_stats_interval = 0;
+  /** \ingroup serverlibrary
+  * \brief gets the interval in seconds at which the server dumps its RPC stats
+  *
+  * \param void
+  * \return the interval, 0 when the periodic dump is disabled
+  *
+  */
+  unsigned int opof_get_stats_interval(void){
+    return g_stats_interval;
+  }
+  /** \ingroup serverlibrary
+  * \brief sets the interval in seconds at which the server dumps its RPC stats
+  *
+  * Must be called before opof_server(). 0 disables the periodic dump.
+  *
+  * \param seconds
+  * \return the new interval
+  *
+  */
+  unsigned int opof_set_stats_interval(unsigned int seconds){
+    g_stats_interval = seconds;
+    return g_stats_interval;
+  }
+  //
+  unsigned short g_metrics_port = 0;
+  /** \ingroup serverlibrary
+  * \brief sets the HTTP port of the Prometheus metrics listener
+  *
+  * Must be called before opof_server(). 0 disables the listener. The listener
+  * binds to the same address as the gRPC server and serves GET /metrics.
+  *
+  * \param port
+  * \return the new port
+  *
+  */
+  unsigned short opof_set_metrics_port(unsigned short port){
+    g_metrics_port = port;
+    return g_metrics_port;
+  }
+} // extern C
 
 /**
 * \brief  gRPC C++ Server Implementation
@@ -81,8 +130,47 @@ void opof_server(const char* address, unsigned short port, const char* cert, con
   std::unique_ptr<Server> server(builder.BuildAndStart());
   std::cout << "Server listening on: " << cppaddress << std::endl;
 
+  MetricsServer metrics(service.stats());
+  if (g_metrics_port > 0){
+    if (metrics.start(address, g_metrics_port)){
+      std::cout << "Metrics listening on: " << address << ":" << g_metrics_port << "/metrics" << std::endl;
+    } else {
+      std::cout << "Error: could not start metrics listener on port " << g_metrics_port << std::endl;
+    }
+  }
+
+  if (opof_get_trace()){
+    if (opof_trace_dump_on_signal(SIGUSR1) == _OK){
+      std::cout << "Tracing, send SIGUSR1 to write the trace to: " << opof_get_trace_file() << std::endl;
+    } else {
+      std::cout << "Error: could not install the trace dump signal handler" << std::endl;
+    }
+  }
+
+  std::mutex dumpMutex;
+  std::condition_variable dumpCv;
+  bool stopping = false;
+  std::thread dumper;
+  if (g_stats_interval > 0){
+    dumper = std::thread([&]() {
+      std::unique_lock<std::mutex> lock(dumpMutex);
+      while (!dumpCv.wait_for(lock, std::chrono::seconds(g_stats_interval), [&]() { return stopping; })){
+        service.stats().dump(std::cout);
+      }
+    });
+  }
+
   // Wait for the server to shutdown. Note that some other thread must be
   // responsible for shutting down the server for this call to ever return.
   server->Wait();
-  
+
+  if (dumper.joinable()){
+    {
+      std::lock_guard<std::mutex> lock(dumpMutex);
+      stopping = true;
+    }
+    dumpCv.notify_one();
+    dumper.join();
+  }
+  metrics.stop();
 }
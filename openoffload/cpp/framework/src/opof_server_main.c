@@ -38,12 +38,18 @@
 #include "opof.h"
 #include "opof_test.h"
 #include "opof_error.h"
+#include "opof_log.h"
 
 /*
  * Declare functions
  */
 void signal_handler(int sig);
 void opof_server(const char *address, unsigned short port, const char *cert, const char *key);
+unsigned int opof_set_stats_interval(unsigned int seconds);
+unsigned int opof_set_stage_timers(unsigned int enable);
+unsigned short opof_set_metrics_port(unsigned short port);
+unsigned int opof_set_trace(unsigned int enable);
+const char *opof_set_trace_file(const char *path);
 /*
  * Main routine
  */
@@ -71,12 +77,17 @@ int main(int argc, char ** argv){
         {"version", no_argument,0,'v'},
         {"address", no_argument, 0, 'a'},
         {"port", no_argument, 0 ,'p'},
+        {"stats", required_argument, 0 ,'s'},
+        {"timers", required_argument, 0 ,'t'},
+        {"metrics", required_argument, 0 ,'m'},
+        {"trace", required_argument, 0 ,'T'},
+        {"log", required_argument, 0 ,'L'},
         {"help",no_argument,0,'h'},
     };
     /*
      * Loop over input
      */
-    while (( c = getopt_long(argc,argv, "a:p:vh",longopts,NULL))!=    -1){
+    while (( c = getopt_long(argc,argv, "a:p:s:t:m:T:L:vh",longopts,NULL))!=    -1){
         switch(c) {
             case 'v':
                 printf("\nVersion of OPOF Program: %s\n\n", OPOF_VERSION);
@@ -88,10 +99,34 @@ int main(int argc, char ** argv){
             case 'a':
                 strncpy(address, optarg,63);
                 break;
+            case 's':
+                opof_set_stats_interval(strtoul(optarg, &str_part,10));
+                break;
+            case 't':
+                opof_set_stage_timers(strtoul(optarg, &str_part,10));
+                break;
+            case 'm':
+                opof_set_metrics_port(strtoul(optarg, &str_part,10));
+                break;
+            case 'T':
+                opof_set_trace(1);
+                opof_set_trace_file(optarg);
+                break;
+            case 'L':
+                if (opof_log_open(optarg) != _OK){
+                    fprintf(stderr, "Could not open log file: %s\n", optarg);
+                    exit(1);
+                }
+                break;
             case 'h':
                 printf("\nCommand line arguments for OpenOffload server tests version: %s \n", OPOF_VERSION);
                 printf("\t-p, --port            gRPC Port \n");
                 printf("\t-a, --address         Address of gRPC Server\n");
+                printf("\t-s, --stats           Dump RPC stats every N seconds\n");
+                printf("\t-t, --timers          Per-stage handler timers, 1 on (default) or 0 off\n");
+                printf("\t-m, --metrics         HTTP port serving Prometheus metrics on /metrics\n");
+                printf("\t-T, --trace           Record the trace ring, SIGUSR1 writes it to this file\n");
+                printf("\t-L, --log             Write the library log to this file instead of stderr\n");
                 printf("\t-v, --version         Version of Open Offload Program\n");
                 printf("\t-h, --help:           Command line help \n\n");
                 exit(1);
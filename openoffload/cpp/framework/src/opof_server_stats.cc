@@ -0,0 +1,432 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup serverlibrary
+*
+* \brief Per-RPC counters and latency histograms for SessionTableImpl
+*
+*/
+#include <cmath>
+#include <iomanip>
+
+#include "opof_server_stats.h"
+
+/* set by the server's startup, read by every handler thread */
+static std::atomic<unsigned int> g_stage_timers(1);
+
+extern "C" {
+  /** \ingroup serverlibrary
+  * \brief enables or disables the per-stage timers of the session handlers
+  *
+  * \param enable  non-zero to enable
+  * \return the new setting
+  *
+  */
+  unsigned int opof_set_stage_timers(unsigned int enable){
+    g_stage_timers.store(enable ? 1 : 0, std::memory_order_relaxed);
+    return enable ? 1 : 0;
+  }
+  /** \ingroup serverlibrary
+  * \brief gets whether the per-stage timers are enabled
+  *
+  * \param void
+  * \return 1 when enabled, 0 otherwise
+  *
+  */
+  unsigned int opof_get_stage_timers(void){
+    return g_stage_timers.load(std::memory_order_relaxed);
+  }
+} // extern C
+
+static const struct {
+  OpofRpc rpc;
+  const char *name;
+} stages[OPOF_STAGE_COUNT] = {
+  {OPOF_RPC_ADD_SESSION, "read"},
+  {OPOF_RPC_ADD_SESSION, "convert"},
+  {OPOF_RPC_ADD_SESSION, "backend"},
+  {OPOF_RPC_ADD_SESSION, "response"},
+  {OPOF_RPC_GET_CLOSED_SESSIONS, "backend"},
+  {OPOF_RPC_GET_CLOSED_SESSIONS, "convert"},
+  {OPOF_RPC_GET_CLOSED_SESSIONS, "write"},
+  {OPOF_RPC_GET_ALL_SESSIONS, "alloc"},
+  {OPOF_RPC_GET_ALL_SESSIONS, "backend"},
+  {OPOF_RPC_GET_ALL_SESSIONS, "convert"},
+};
+
+LatencyHistogram::LatencyHistogram() {
+  for (int i = 0; i < BUCKETS; i++){
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+/**
+* \brief Map a value to its bucket
+*
+* Values below 2 * SUB_BUCKETS have a bucket each. Above that every power
+* of two is split into SUB_BUCKETS buckets using the bits below the msb.
+*/
+int LatencyHistogram::bucketIndex(uint64_t value) {
+  if (value < 2 * SUB_BUCKETS){
+    return (int)value;
+  }
+  int msb = 63 - __builtin_clzll(value);
+  int shift = msb - SUB_BUCKET_BITS;
+  int top = (int)(value >> shift);
+  return 2 * SUB_BUCKETS + (msb - SUB_BUCKET_BITS - 1) * SUB_BUCKETS + (top - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::bucketHighest(int index) {
+  if (index < 2 * SUB_BUCKETS){
+    return index;
+  }
+  int k = index - 2 * SUB_BUCKETS;
+  int shift = k / SUB_BUCKETS + 1;
+  uint64_t top = SUB_BUCKETS + k % SUB_BUCKETS;
+  return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+  counts_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  uint64_t current = max_.load(std::memory_order_relaxed);
+  while (value > current &&
+         !max_.compare_exchange_weak(current, value, std::memory_order_relaxed)){
+  }
+}
+
+uint64_t LatencyHistogram::count() const {
+  uint64_t total = 0;
+  for (int i = 0; i < BUCKETS; i++){
+    total += counts_[i].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+/**
+* \brief Number of recorded values that are at most value
+*
+* Exact when value is the highest value of a bucket, e.g. 2^k - 1.
+*/
+uint64_t LatencyHistogram::countAtOrBelow(uint64_t value) const {
+  uint64_t total = 0;
+  int last = bucketIndex(value);
+  for (int i = 0; i <= last; i++){
+    total += counts_[i].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+uint64_t LatencyHistogram::sum() const {
+  return sum_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const {
+  return max_.load(std::memory_order_relaxed);
+}
+
+/**
+* \brief Value at or below which a fraction p of the recorded values fall
+*
+* \param p  The fraction, e.g. 0.99
+* \return the highest value of the bucket holding the percentile, capped at max()
+*/
+uint64_t LatencyHistogram::percentile(double p) const {
+  uint64_t total = count();
+  uint64_t seen = 0;
+  uint64_t rank;
+
+  if (total == 0){
+    return 0;
+  }
+  rank = (uint64_t)std::ceil(p * total);
+  if (rank < 1){
+    rank = 1;
+  }
+  for (int i = 0; i < BUCKETS; i++){
+    seen += counts_[i].load(std::memory_order_relaxed);
+    if (seen >= rank){
+      return std::min(bucketHighest(i), max());
+    }
+  }
+  return max();
+}
+
+RpcStats::RpcStats() {
+  calls.store(0, std::memory_order_relaxed);
+  errors.store(0, std::memory_order_relaxed);
+  sessions.store(0, std::memory_order_relaxed);
+  for (int i = 0; i < RPC_STATUS_CODES; i++){
+    statusCounts[i].store(0, std::memory_order_relaxed);
+    backendErrors[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+StageStats::StageStats() {
+  calls.store(0, std::memory_order_relaxed);
+  totalTicks.store(0, std::memory_order_relaxed);
+}
+
+ServerStats::ServerStats()
+: start_(std::chrono::steady_clock::now()), startTicks_(opof_ticks()) {
+  sessionsAdded_.store(0, std::memory_order_relaxed);
+  sessionsDeleted_.store(0, std::memory_order_relaxed);
+  sessionsClosed_.store(0, std::memory_order_relaxed);
+}
+
+const char *ServerStats::rpcName(OpofRpc rpc) {
+  return opofRpcNames[rpc];
+}
+
+const char *ServerStats::stageName(OpofStage stage) {
+  return stages[stage].name;
+}
+
+/**
+* \brief TSC ticks per nanosecond, calibrated against steady_clock since the server started
+*/
+double ServerStats::ticksPerNano() const {
+#if defined(__x86_64__) || defined(__i386__)
+  uint64_t ticks = opof_ticks() - startTicks_;
+  uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start_).count();
+  if (nanos == 0 || ticks == 0){
+    return 1.0;
+  }
+  return (double)ticks / nanos;
+#else
+  return 1.0;
+#endif
+}
+
+uint64_t ServerStats::uptimeSeconds() const {
+  return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start_).count();
+}
+
+/**
+* \brief Record one completed RPC
+*
+* \param rpc       The RPC
+* \param code      The gRPC status code returned to the client
+* \param sessions  The number of sessions added, returned or deleted
+* \param micros    The time spent in the handler
+*/
+void ServerStats::record(OpofRpc rpc, StatusCode code, uint64_t sessions, uint64_t micros) {
+  RpcStats &stats = rpcs_[rpc];
+  stats.calls.fetch_add(1, std::memory_order_relaxed);
+  if (code != StatusCode::OK){
+    stats.errors.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (code >= 0 && code < RPC_STATUS_CODES){
+    stats.statusCounts[code].fetch_add(1, std::memory_order_relaxed);
+  }
+  if (sessions){
+    stats.sessions.fetch_add(sessions, std::memory_order_relaxed);
+  }
+  stats.latency.record(micros);
+}
+
+/**
+* \brief Record the ticks one RPC spent in a stage
+*/
+void ServerStats::recordStage(OpofStage stage, uint64_t ticks) {
+  StageStats &stats = stages_[stage];
+  stats.calls.fetch_add(1, std::memory_order_relaxed);
+  stats.totalTicks.fetch_add(ticks, std::memory_order_relaxed);
+  stats.ticks.record(ticks);
+}
+
+/**
+* \brief Record sessions the backend accepted, deleted or returned as closed
+*
+* Handlers count locally and call this once per RPC.
+*/
+void ServerStats::recordSessions(uint64_t added, uint64_t deleted, uint64_t closed) {
+  if (added){
+    sessionsAdded_.fetch_add(added, std::memory_order_relaxed);
+  }
+  if (deleted){
+    sessionsDeleted_.fetch_add(deleted, std::memory_order_relaxed);
+  }
+  if (closed){
+    sessionsClosed_.fetch_add(closed, std::memory_order_relaxed);
+  }
+}
+
+/**
+* \brief Record a status other than _OK returned by a backend hook
+*/
+void ServerStats::recordBackendError(OpofRpc rpc, int status) {
+  if (status > 0 && status < RPC_STATUS_CODES){
+    rpcs_[rpc].backendErrors[status].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void ServerStats::fill(serverStatsResponse *response) const {
+  response->set_uptimeseconds(uptimeSeconds());
+  for (int r = 0; r < OPOF_RPC_COUNT; r++){
+    const RpcStats &stats = rpcs_[r];
+    auto *rpc = response->add_rpcs();
+    rpc->set_name(opofRpcNames[r]);
+    rpc->set_calls(stats.calls.load(std::memory_order_relaxed));
+    rpc->set_errors(stats.errors.load(std::memory_order_relaxed));
+    rpc->set_sessions(stats.sessions.load(std::memory_order_relaxed));
+    for (int code = 1; code < RPC_STATUS_CODES; code++){
+      uint64_t count = stats.statusCounts[code].load(std::memory_order_relaxed);
+      if (count){
+        auto *error = rpc->add_errorcounts();
+        error->set_statuscode(code);
+        error->set_count(count);
+      }
+    }
+    rpc->set_p50micros(stats.latency.percentile(0.5));
+    rpc->set_p99micros(stats.latency.percentile(0.99));
+    rpc->set_p999micros(stats.latency.percentile(0.999));
+    rpc->set_maxmicros(stats.latency.max());
+  }
+  double perNano = ticksPerNano();
+  for (int st = 0; st < OPOF_STAGE_COUNT; st++){
+    const StageStats &stats = stages_[st];
+    uint64_t calls = stats.calls.load(std::memory_order_relaxed);
+    if (calls == 0){
+      continue;
+    }
+    auto *stage = response->add_stages();
+    stage->set_rpc(opofRpcNames[stages[st].rpc]);
+    stage->set_stage(stages[st].name);
+    stage->set_calls(calls);
+    stage->set_totalnanos(stats.totalTicks.load(std::memory_order_relaxed) / perNano);
+    stage->set_p50nanos(stats.ticks.percentile(0.5) / perNano);
+    stage->set_p99nanos(stats.ticks.percentile(0.99) / perNano);
+    stage->set_maxnanos(stats.ticks.max() / perNano);
+  }
+}
+
+/**
+* \brief Write one line per RPC that has been called
+*/
+void ServerStats::dump(std::ostream &out) const {
+  out << "OPOF server stats, uptime " << uptimeSeconds() << "s" << std::endl;
+  out << std::left << std::setw(20) << "rpc" << std::right
+      << std::setw(12) << "calls" << std::setw(10) << "errors" << std::setw(12) << "sessions"
+      << std::setw(10) << "p50us" << std::setw(10) << "p99us" << std::setw(10) << "p999us"
+      << std::setw(10) << "maxus" << std::endl;
+  for (int r = 0; r < OPOF_RPC_COUNT; r++){
+    const RpcStats &stats = rpcs_[r];
+    uint64_t calls = stats.calls.load(std::memory_order_relaxed);
+    if (calls == 0){
+      continue;
+    }
+    out << std::left << std::setw(20) << opofRpcNames[r] << std::right
+        << std::setw(12) << calls
+        << std::setw(10) << stats.errors.load(std::memory_order_relaxed)
+        << std::setw(12) << stats.sessions.load(std::memory_order_relaxed)
+        << std::setw(10) << stats.latency.percentile(0.5)
+        << std::setw(10) << stats.latency.percentile(0.99)
+        << std::setw(10) << stats.latency.percentile(0.999)
+        << std::setw(10) << stats.latency.max() << std::endl;
+  }
+  if (!opof_get_stage_timers()){
+    return;
+  }
+  double perNano = ticksPerNano();
+  out << std::left << std::setw(20) << "rpc" << std::setw(10) << "stage" << std::right
+      << std::setw(12) << "calls" << std::setw(12) << "totalus" << std::setw(10) << "p50ns"
+      << std::setw(10) << "p99ns" << std::setw(10) << "maxns" << std::endl;
+  for (int st = 0; st < OPOF_STAGE_COUNT; st++){
+    const StageStats &stats = stages_[st];
+    uint64_t calls = stats.calls.load(std::memory_order_relaxed);
+    if (calls == 0){
+      continue;
+    }
+    out << std::left << std::setw(20) << opofRpcNames[stages[st].rpc] << std::setw(10) << stages[st].name << std::right
+        << std::setw(12) << calls
+        << std::setw(12) << (uint64_t)(stats.totalTicks.load(std::memory_order_relaxed) / perNano / 1000)
+        << std::setw(10) << (uint64_t)(stats.ticks.percentile(0.5) / perNano)
+        << std::setw(10) << (uint64_t)(stats.ticks.percentile(0.99) / perNano)
+        << std::setw(10) << (uint64_t)(stats.ticks.max() / perNano) << std::endl;
+  }
+}
+
+/**
+* \brief Write the counters and histograms in the Prometheus text format
+*
+* Latency histograms are exported with power of two bucket bounds from
+* 1us to about 8s. Each bound is the highest value of an HDR bucket, so
+* the cumulative counts are exact.
+*/
+void ServerStats::prometheus(std::ostream &out) const {
+  out << std::setprecision(10);
+  out << "# HELP opof_uptime_seconds Time since the server started\n";
+  out << "# TYPE opof_uptime_seconds gauge\n";
+  out << "opof_uptime_seconds " << uptimeSeconds() << "\n";
+
+  out << "# HELP opof_sessions_added_total Sessions accepted by the backend\n";
+  out << "# TYPE opof_sessions_added_total counter\n";
+  out << "opof_sessions_added_total " << sessionsAdded_.load(std::memory_order_relaxed) << "\n";
+  out << "# HELP opof_sessions_deleted_total Sessions deleted by deleteSession\n";
+  out << "# TYPE opof_sessions_deleted_total counter\n";
+  out << "opof_sessions_deleted_total " << sessionsDeleted_.load(std::memory_order_relaxed) << "\n";
+  out << "# HELP opof_sessions_closed_total Closed sessions returned by getClosedSessions\n";
+  out << "# TYPE opof_sessions_closed_total counter\n";
+  out << "opof_sessions_closed_total " << sessionsClosed_.load(std::memory_order_relaxed) << "\n";
+
+  out << "# HELP opof_rpc_calls_total RPC calls by gRPC status code\n";
+  out << "# TYPE opof_rpc_calls_total counter\n";
+  for (int r = 0; r < OPOF_RPC_COUNT; r++){
+    for (int code = 0; code < RPC_STATUS_CODES; code++){
+      uint64_t count = rpcs_[r].statusCounts[code].load(std::memory_order_relaxed);
+      if (count || code == 0){
+        out << "opof_rpc_calls_total{rpc=\"" << opofRpcNames[r] << "\",code=\"" << code << "\"} " << count << "\n";
+      }
+    }
+  }
+  out << "# HELP opof_rpc_sessions_total Sessions added, returned or deleted by RPC\n";
+  out << "# TYPE opof_rpc_sessions_total counter\n";
+  for (int r = 0; r < OPOF_RPC_COUNT; r++){
+    out << "opof_rpc_sessions_total{rpc=\"" << opofRpcNames[r] << "\"} "
+        << rpcs_[r].sessions.load(std::memory_order_relaxed) << "\n";
+  }
+  out << "# HELP opof_backend_errors_total Statuses other than _OK returned by the backend\n";
+  out << "# TYPE opof_backend_errors_total counter\n";
+  for (int r = 0; r < OPOF_RPC_COUNT; r++){
+    for (int code = 1; code < RPC_STATUS_CODES; code++){
+      uint64_t count = rpcs_[r].backendErrors[code].load(std::memory_order_relaxed);
+      if (count){
+        out << "opof_backend_errors_total{rpc=\"" << opofRpcNames[r] << "\",status=\"" << code << "\"} " << count << "\n";
+      }
+    }
+  }
+
+  out << "# HELP opof_rpc_latency_seconds Time spent in the RPC handler\n";
+  out << "# TYPE opof_rpc_latency_seconds histogram\n";
+  for (int r = 0; r < OPOF_RPC_COUNT; r++){
+    const LatencyHistogram &latency = rpcs_[r].latency;
+    for (int k = 1; k <= 23; k++){
+      uint64_t bound = (1ULL << k) - 1;
+      out << "opof_rpc_latency_seconds_bucket{rpc=\"" << opofRpcNames[r] << "\",le=\""
+          << bound / 1e6 << "\"} " << latency.countAtOrBelow(bound) << "\n";
+    }
+    /* read after the buckets so +Inf is never below them while calls are recorded */
+    uint64_t count = latency.count();
+    out << "opof_rpc_latency_seconds_bucket{rpc=\"" << opofRpcNames[r] << "\",le=\"+Inf\"} " << count << "\n";
+    out << "opof_rpc_latency_seconds_sum{rpc=\"" << opofRpcNames[r] << "\"} " << latency.sum() / 1e6 << "\n";
+    out << "opof_rpc_latency_seconds_count{rpc=\"" << opofRpcNames[r] << "\"} " << count << "\n";
+  }
+}
@@ -17,14 +17,139 @@
 
 #include <stdlib.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include "opof.h"
 #include "opof_error.h"
+#include "opof_log.h"
 #include "opof_serverlib.h"
 #include "opof_hash.h"
 #include "opof_test_util.h"
+#include "opof_topn.h"
+#include "opof_aggregate.h"
 
 static record_t *sessions = NULL;
+/*
+* Held by every function below that reads or changes the session table, the
+* top-N trackers or the aggregate totals, since the server calls them from
+* its handler threads and the metrics listener at once.
+*/
+static pthread_mutex_t sessionLock = PTHREAD_MUTEX_INITIALIZER;
+/*
+* One top-N tracker per counter metric, sized above TOP_SESSIONS_MAX. The
+* counters of a session never change once it is added here, so a slot freed
+* by a removed session is not refilled by a later update: a query that finds
+* fewer tracked sessions than it asks for while the table holds more
+* rebuilds the trackers from the table. _RATE falls as a session ages, so it
+* is ranked from the whole table at query time in rateSessions.
+*/
+#define TOPN_CAPACITY (4 * TOP_SESSIONS_MAX)
+#define TOPN_METRICS _RATE
+static opof_topn_t *topSessions[TOPN_METRICS];
+static opof_topn_t *rateSessions;
+/*
+* Session and counter totals per inLif, outLif, protocol, action type and state
+*/
+static opof_aggregate_t *aggregate;
+
+/**
+* \ingroup servercinterface
+* \brief Utility function to update the top-N trackers after a session counter change
+*
+* \param *r   The session record with the new counter values
+*
+*/
+static void trackSession(record_t *r){
+  if (topSessions[0] == NULL){
+    for (int m = 0; m < TOPN_METRICS; m++){
+      topSessions[m] = opof_topn_create(TOPN_CAPACITY);
+    }
+    rateSessions = opof_topn_create(TOP_SESSIONS_MAX);
+  }
+  opof_topn_update(topSessions[_IN_BYTES], r->key.sessionId, r->inBytes);
+  opof_topn_update(topSessions[_OUT_BYTES], r->key.sessionId, r->outBytes);
+  opof_topn_update(topSessions[_PACKETS], r->key.sessionId, r->inPackets + r->outPackets);
+}
+
+/* called with sessionLock held */
+static void retrackSessions(void){
+  record_t *r, *tmp;
+
+  for (int m = 0; m < TOPN_METRICS; m++){
+    opof_topn_reset(topSessions[m]);
+  }
+  HASH_ITER(hh, sessions, r, tmp){
+    trackSession(r);
+  }
+}
+
+/* called with sessionLock held */
+static int rankRates(int count, unsigned long sessionIds[]){
+  time_t now = time(NULL);
+  record_t *r, *tmp;
+
+  opof_topn_reset(rateSessions);
+  HASH_ITER(hh, sessions, r, tmp){
+    time_t elapsed = now - r->startTime;
+    if (elapsed < 1){
+      elapsed = 1;
+    }
+    opof_topn_update(rateSessions, r->key.sessionId, (r->inBytes + r->outBytes) / elapsed);
+  }
+  return opof_topn_get(rateSessions, count, sessionIds, NULL);
+}
+
+static void untrackSession(unsigned long sessionId){
+  if (topSessions[0] == NULL){
+    return;
+  }
+  for (int m = 0; m < TOPN_METRICS; m++){
+    opof_topn_remove(topSessions[m], sessionId);
+  }
+}
+
+/**
+* \ingroup servercinterface
+* \brief Utility function to describe a session record for the aggregate counters
+*
+* \param *r   The session record
+* \param *s   Returns the groups and counters of the session
+*
+*/
+static void aggregateSession(const record_t *r, aggregateSession_t *s){
+  s->inlif = r->inLif;
+  s->outlif = r->outLif;
+  s->proto = r->protocolId;
+  s->actionType = r->actionValue;
+  s->sessionState = r->sessionState;
+  s->inPackets = r->inPackets;
+  s->outPackets = r->outPackets;
+  s->inBytes = r->inBytes;
+  s->outBytes = r->outBytes;
+}
+
+static void aggregateAdd(const record_t *r){
+  aggregateSession_t s;
+
+  if (aggregate == NULL){
+    aggregate = opof_aggregate_create();
+    if (aggregate == NULL){
+      return;
+    }
+  }
+  aggregateSession(r, &s);
+  opof_aggregate_add(aggregate, &s);
+}
+
+static void aggregateRemove(const record_t *r){
+  aggregateSession_t s;
+
+  if (aggregate == NULL){
+    return;
+  }
+  aggregateSession(r, &s);
+  opof_aggregate_remove(aggregate, &s);
+}
 /** 
 * \ingroup servercinterface
 * \brief Utility fumction to get all sessions from test hashtable
@@ -39,6 +164,7 @@ static record_t *sessions = NULL;
 *
 */
 static record_t *start;
+/* called with sessionLock held */
 int getAllSessionsPage(int size, uint64_t *sessionStart, sessionResponse_t **responses){
   int i=0;
 
@@ -46,11 +172,7 @@ int getAllSessionsPage(int size, uint64_t *sessionStart, sessionResponse_t **res
   if (*sessionStart == UINT_MAX){
     start = sessions;
   }
-#ifdef DEBUG
-  int max_size;
-  max_size = HASH_COUNT(sessions);
-  printf("DEBUG: getAllSessions number of sessions: %d\n", max_size);
-#endif
+  opof_log_debug("getAllSessions number of sessions: %u", HASH_COUNT(sessions));
   if (!start)
   {
     return i;
@@ -78,6 +200,85 @@ int getAllSessionsPage(int size, uint64_t *sessionStart, sessionResponse_t **res
  
   return i;
 }
+/**
+* \ingroup servercinterface
+* \brief Utility function to check a session record against a sessionFilter_t
+*
+* \param *r        The session record
+* \param *filter   The predicates to apply
+* \return true if all enabled predicates match
+*
+*/
+static bool matchSessionFilter(record_t *r, const sessionFilter_t *filter){
+  if (filter->sessionStateEnable && r->sessionState != filter->sessionState){
+    return false;
+  }
+  if (filter->protoEnable && r->protocolId != filter->proto){
+    return false;
+  }
+  if (filter->inlifEnable && r->inLif != filter->inlif){
+    return false;
+  }
+  if (filter->outlifEnable && r->outLif != filter->outlif){
+    return false;
+  }
+  if (filter->ipverEnable && r->ipVersion != filter->ipver){
+    return false;
+  }
+  if (filter->actionTypeEnable && r->actionValue != filter->actionType){
+    return false;
+  }
+  if (filter->nextHopIdEnable && r->inNextHopId != filter->nextHopId && r->outNextHopId != filter->nextHopId){
+    return false;
+  }
+  if (r->inBytes + r->outBytes < filter->minBytes){
+    return false;
+  }
+  if (r->inPackets + r->outPackets < filter->minPackets){
+    return false;
+  }
+  return true;
+}
+
+static record_t *filterStart;
+/**
+* \ingroup servercinterface
+* \brief Utility function to get a page of the sessions matching a filter from test hashtable
+*
+* Works like getAllSessionsPage but skips the records that do not match the filter,
+* so the page holds up to size matching sessions. Returns 0 at the end of the table.
+*
+*/
+/* called with sessionLock held */
+int getFilteredSessionsPage(int size, uint64_t *sessionStart, const sessionFilter_t *filter, sessionResponse_t **responses){
+  int i=0;
+
+  record_t *r;
+  if (*sessionStart == UINT_MAX){
+    filterStart = sessions;
+  }
+  for (r=filterStart; r != NULL; r=r->hh.next){
+    if (!matchSessionFilter(r, filter)){
+      continue;
+    }
+    responses[i]->sessionId = r->key.sessionId;
+    responses[i]->inPackets = r->inPackets;
+    responses[i]->outPackets = r->outPackets;
+    responses[i]->inBytes = r->inBytes;
+    responses[i]->outBytes = r->outBytes;
+    responses[i]->sessionState = r->sessionState;
+    responses[i]->sessionCloseCode = r->sessionClose;
+    responses[i]->requestStatus = _ACCEPTED;
+    *sessionStart = r->key.sessionId;
+    i++;
+    if (i == size){
+      filterStart = r->hh.next;
+      return i;
+    }
+  }
+  filterStart = NULL;
+  return i;
+}
 #if 0
 /** 
 * \ingroup servercinterface
@@ -142,18 +343,16 @@ int opof_add_session_server(sessionRequest_t *parameters, addSessionResponse_t *
 #endif
     record_t *r, *f,l;
     //record_t *records = NULL;
-    r =  (record_t *)malloc(sizeof (record_t));
-    memset(r,0,sizeof(*r));
     //parameters->sessId = 1234;
+    pthread_mutex_lock(&sessionLock);
     num_sessions = HASH_COUNT(sessions);
-#ifdef DEBUG
-    printf("MAX Sessions: %d\n", num_sessions);
-#endif
+    opof_log_debug("MAX Sessions: %d", num_sessions);
     /*
     * Check capacity of session table
     */
     if (num_sessions > HASHTABLE_SIZE){
       //response->requestStatus = _REJECTED_SESSION_TABLE_FULL;
+      pthread_mutex_unlock(&sessionLock);
       return _RESOURCE_EXHAUSTED;
     }
     /*
@@ -162,9 +361,12 @@ int opof_add_session_server(sessionRequest_t *parameters, addSessionResponse_t *
     l.key.sessionId = parameters->sessId;
     HASH_FIND(hh,sessions, &l.key, sizeof(record_key_t),f);
     if (f != NULL){
+      pthread_mutex_unlock(&sessionLock);
       return _ALREADY_EXISTS;
     }
 
+    r =  (record_t *)malloc(sizeof (record_t));
+    memset(r,0,sizeof(*r));
     r->key.sessionId = parameters->sessId;
     HASH_ADD(hh, sessions, key, sizeof(record_key_t),r);
     r->inLif = parameters->inlif;
@@ -182,6 +384,12 @@ int opof_add_session_server(sessionRequest_t *parameters, addSessionResponse_t *
     r->sessionState = _CLOSED;
     r->sessionClose = _NOT_CLOSED;
     r->actionValue = _FORWARD;
+    r->inNextHopId = parameters->actionParams.actionParams_inLif.nextHopId;
+    r->outNextHopId = parameters->actionParams.actionParams_outLif.nextHopId;
+    r->startTime = time(NULL);
+    trackSession(r);
+    aggregateAdd(r);
+    pthread_mutex_unlock(&sessionLock);
     //
     //response->requestStatus = _ACCEPTED;
     //
@@ -203,11 +411,13 @@ int opof_add_session_server(sessionRequest_t *parameters, addSessionResponse_t *
 int opof_get_session_server(unsigned long sessionId, sessionResponse_t *response){
   record_t *r,l;
   l.key.sessionId = sessionId;
+  pthread_mutex_lock(&sessionLock);
   HASH_FIND(hh,sessions, &l.key, sizeof(record_key_t),r);
   if (r == NULL){
      /*
     * Session does not exist in Session Table
     */
+    pthread_mutex_unlock(&sessionLock);
     return _NOT_FOUND;
   }   
     response->sessionId = sessionId;
@@ -218,6 +428,7 @@ int opof_get_session_server(unsigned long sessionId, sessionResponse_t *response
     response->sessionState = r->sessionState;
     response->sessionCloseCode = r->sessionClose;
     response->requestStatus = _ACCEPTED;
+    pthread_mutex_unlock(&sessionLock);
     return _OK;  
 }
 
@@ -237,11 +448,13 @@ int opof_del_session_server(unsigned long sessionId, sessionResponse_t *response
   record_t *r,l;
  
   l.key.sessionId = sessionId;
+  pthread_mutex_lock(&sessionLock);
   HASH_FIND(hh,sessions, &l.key, sizeof(record_key_t),r);
   if (r == NULL){
      /*
     * Session does not exist in Session Table
     */
+    pthread_mutex_unlock(&sessionLock);
     return _NOT_FOUND;
   }
   response->sessionId = sessionId;
@@ -252,7 +465,10 @@ int opof_del_session_server(unsigned long sessionId, sessionResponse_t *response
   response->sessionState = _CLOSED;
   response->sessionCloseCode = r->sessionClose;
   response->requestStatus = _ACCEPTED;
+  untrackSession(sessionId);
+  aggregateRemove(r);
   HASH_DEL(sessions,r);
+  pthread_mutex_unlock(&sessionLock);
   free(r);
   return _OK;
 }
@@ -275,6 +491,7 @@ int opof_get_closed_sessions_server(statisticsRequestArgs_t *request, sessionRes
   int i = 0;
   int size = request->pageSize;
  
+  pthread_mutex_lock(&sessionLock);
   HASH_ITER(hh, sessions, r, tmp) {
      if (r->sessionState == _CLOSED){
         responses[i].sessionId = r->key.sessionId;
@@ -285,14 +502,18 @@ int opof_get_closed_sessions_server(statisticsRequestArgs_t *request, sessionRes
         responses[i].sessionState = r->sessionState;
         responses[i].sessionCloseCode = _TIMEOUT;
         responses[i].requestStatus = _ACCEPTED;
+        untrackSession(r->key.sessionId);
+        aggregateRemove(r);
         HASH_DEL(sessions, r);  /* delete it (users advances to next) */
         free(r);             /* free it */
         i++;
         if (i == size){
+          pthread_mutex_unlock(&sessionLock);
           return i;
         }
       }
    }
+  pthread_mutex_unlock(&sessionLock);
   return i;
 }
 
@@ -312,9 +533,138 @@ int opof_get_all_sessions_server(int pageSize, uint64_t *sessionStart,int pageCo
   
   int itemCount = 0;
 
+  pthread_mutex_lock(&sessionLock);
   itemCount = getAllSessionsPage(pageSize, sessionStart, responses);
+  pthread_mutex_unlock(&sessionLock);
   //sessionCount = getAllSessionsPage(pageSize, pageCount,responses,r);
   return itemCount;
 }
 
+/** 
+* \ingroup servercinterface
+* \brief Utility function to get the sessions matching a filter from test hashtable
+*
+* The function is called from within the C++ server method when getAllSessions carries
+* a sessionFilter. The filter is evaluated during the table scan so only matching
+* sessions are returned to the server for serialization. The code here is just an example.
+*
+* \param  pageSize       The maximum number of sessions to return
+* \param  *sessionStart  The paging cursor, UINT_MAX starts a new scan
+* \param  *filter        The predicates the sessions must match
+* \param  **responses    The returned sessions
+* \return The number of sessions returned
+*
+*/
+int opof_get_filtered_sessions_server(int pageSize, uint64_t *sessionStart, const sessionFilter_t *filter, sessionResponse_t **responses){
+  int itemCount;
+
+  pthread_mutex_lock(&sessionLock);
+  itemCount = getFilteredSessionsPage(pageSize, sessionStart, filter, responses);
+  pthread_mutex_unlock(&sessionLock);
+  return itemCount;
+}
 
+/** 
+* \ingroup servercinterface
+* \brief Utility function to get the sessions with the largest value of a metric
+*
+* The function is called from within the C++ server method. The byte and packet rankings
+* come from the top-N trackers, and the table is only scanned to refill a tracker that
+* removed sessions left shorter than count. _RATE, bytes per second since the session
+* started, is ranked over the whole table on every query. The code here is just an example.
+*
+* \param  metric         The metric to rank the sessions by
+* \param  count          The maximum number of sessions to return
+* \param  responses      The returned sessions in descending metric order
+* \return The number of sessions returned
+*
+*/
+int opof_get_top_sessions_server(SESSION_METRIC_T metric, int count, sessionResponse_t responses[]){
+  unsigned long sessionIds[TOP_SESSIONS_MAX];
+  int n, i = 0;
+  record_t *r,l;
+
+  if (metric < 0 || metric > _RATE){
+    return 0;
+  }
+  if (count > TOP_SESSIONS_MAX){
+    count = TOP_SESSIONS_MAX;
+  }
+  pthread_mutex_lock(&sessionLock);
+  if (topSessions[0] == NULL){
+    pthread_mutex_unlock(&sessionLock);
+    return 0;
+  }
+  if (metric == _RATE){
+    n = rankRates(count, sessionIds);
+  } else {
+    n = opof_topn_get(topSessions[metric], count, sessionIds, NULL);
+    if (n < count && (unsigned int)n < HASH_COUNT(sessions)){
+      retrackSessions();
+      n = opof_topn_get(topSessions[metric], count, sessionIds, NULL);
+    }
+  }
+  for (int j = 0; j < n; j++){
+    l.key.sessionId = sessionIds[j];
+    HASH_FIND(hh,sessions, &l.key, sizeof(record_key_t),r);
+    if (r == NULL){
+      continue;
+    }
+    responses[i].sessionId = r->key.sessionId;
+    responses[i].inPackets = r->inPackets;
+    responses[i].outPackets = r->outPackets;
+    responses[i].inBytes = r->inBytes;
+    responses[i].outBytes = r->outBytes;
+    responses[i].sessionState = r->sessionState;
+    responses[i].sessionCloseCode = r->sessionClose;
+    responses[i].requestStatus = _ACCEPTED;
+    i++;
+  }
+  pthread_mutex_unlock(&sessionLock);
+  return i;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Utility function to get the aggregate counters of the test hashtable
+*
+* The function is called from within the C++ server method. It is the responsiblity of the server developer
+* to implement this function. The totals are kept up to date as sessions are added and removed, so this
+* only visits the groups of the requested grouping.
+*
+* \param  groupBy        The grouping to return
+* \param  stats          Returns one entry per group
+* \param  maxGroups      The size of the stats array
+* \return The number of groups returned
+*
+*/
+int opof_get_aggregate_stats_server(AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups){
+  int groupCount = 0;
+
+  pthread_mutex_lock(&sessionLock);
+  if (aggregate != NULL){
+    groupCount = opof_aggregate_get(aggregate, groupBy, stats, maxGroups);
+  }
+  pthread_mutex_unlock(&sessionLock);
+  return groupCount;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Utility function to get the occupancy and capacity of the test hashtable
+*
+* The function is called from the metrics listener thread. It takes the session
+* lock, as HASH_COUNT reads through the head record, which a delete may free.
+*
+* \param  sessionCount   Returns the number of sessions in the table
+* \param  capacity       Returns the maximum number of sessions
+* \return _OK
+*
+*/
+int opof_get_table_stats_server(unsigned long *sessionCount, unsigned long *capacity){
+  pthread_mutex_lock(&sessionLock);
+  *sessionCount = HASH_COUNT(sessions);
+  pthread_mutex_unlock(&sessionLock);
+  *capacity = HASHTABLE_SIZE;
+  return _OK;
+}
@@ -17,6 +17,7 @@
 
 extern "C" {
 #include "opof.h"
+#include "opof_log.h"
 #ifdef DEBUG
 #include "opof_test_util.h"
 #endif
@@ -50,6 +51,7 @@ extern "C" {
 #include "opof_util.h"
 #include "opof_grpc.h"
 #include "opof_session_client.h"
+#include "opof_trace.h"
 
 /**  \ingroup clientlibrary
 * \brief Retrieves version information from the offload service.
@@ -110,12 +112,11 @@ int SessionTableClient::addSessionClient(int size, sessionRequest_t **s, addSess
   ClientContext context;
   std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_deadline());
   context.set_deadline(deadline);
-  #ifdef DEBUG
-  std::cout << "Deadline set for add session: " << opof_get_deadline() << " milli seconds" << endl;
-  #endif
+  opof_log_debug("Deadline set for add session: %u milli seconds", opof_get_deadline());
   addSessionResponse response;
   std::unique_ptr<ClientWriter <sessionRequest> > writer(
           stub_->addSession(&context, &response));
+  opof_trace(OPOF_TRACE_STREAM_OPEN, OPOF_RPC_ADD_SESSION, 0, size);
 
   for (int i=0; i< size; i++){
     sessionRequest_t *request_c = s[i];
@@ -125,9 +126,11 @@ int SessionTableClient::addSessionClient(int size, sessionRequest_t **s, addSess
     sessionRequest request;
     convertSessionRequest2cpp(request_c, &request);
     writer->Write(request);
+    opof_trace(OPOF_TRACE_REQUEST_SENT, OPOF_RPC_ADD_SESSION, request_c->sessId, 0);
   }
   writer->WritesDone();
   Status status = writer->Finish();
+  opof_trace(OPOF_TRACE_STREAM_CLOSE, OPOF_RPC_ADD_SESSION, 0, status.error_code());
   convertAddSessionResponse2c(resp,&response);
   //std::cout << "Status code: " <<  static_cast<int>(status.error_code()) << endl;
   return static_cast<int>(status.error_code());
@@ -148,9 +151,7 @@ int SessionTableClient::getSessionClient(int sessionid,sessionResponse_t *resp){
   ClientContext context;
   std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_deadline());
   context.set_deadline(deadline);
-  #ifdef DEBUG
-  std::cout << "Deadline set for get session: " << opof_get_deadline() << " milli seconds" << endl;
-  #endif
+  opof_log_debug("Deadline set for get session: %u milli seconds", opof_get_deadline());
   Status status = stub_->getSession(&context, sid, &response);
   convertSessionResponse2c(&response, resp);
   return static_cast<int>(status.error_code());
@@ -172,9 +173,7 @@ int SessionTableClient::deleteSessionClient(int sessionid,sessionResponse_t *res
   ClientContext context;
   std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_deadline());
   context.set_deadline(deadline);
-  #ifdef DEBUG
-  std::cout << "Deadline set for delete session: " << opof_get_deadline() << " milli seconds" << endl;
-  #endif
+  opof_log_debug("Deadline set for delete session: %u milli seconds", opof_get_deadline());
   Status status = stub_->deleteSession(&context, sid, &response);
 
   convertSessionResponse2c(&response, resp);
@@ -199,9 +198,7 @@ int SessionTableClient::getClosedSessions(statisticsRequestArgs_t *args, session
   request.set_pagesize(args->pageSize);
   std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_deadline());
   context.set_deadline(deadline);
-  #ifdef DEBUG
-  std::cout << "Deadline set for get closed sessions: " << opof_get_deadline() << " milli seconds" << endl;
-  #endif
+  opof_log_debug("Deadline set for get closed sessions: %u milli seconds", opof_get_deadline());
   *sessionCount = 0;
   std::unique_ptr<ClientReader <sessionResponse> > reader(
         stub_->getClosedSessions(&context, request));
@@ -218,9 +215,10 @@ int SessionTableClient::getClosedSessions(statisticsRequestArgs_t *args, session
 * \param size
 * \param sessionRequest_t
 * \param addSeesionResponse_t
+* \param filter    Optional sessionFilter_t evaluated by the server, NULL for all sessions
 *
 */
-int  SessionTableClient::getAllSessions(int pageSize, uint64_t *session_start_id, uint64_t *session_count, sessionResponse_t responses[], unsigned long *sessionCount){
+int  SessionTableClient::getAllSessions(int pageSize, uint64_t *session_start_id, uint64_t *session_count, sessionResponse_t responses[], unsigned long *sessionCount, const sessionFilter_t *filter){
   
   Status status;
   sessionResponses response;
@@ -230,11 +228,12 @@ int  SessionTableClient::getAllSessions(int pageSize, uint64_t *session_start_id
   int array_size;
   std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_deadline());
   context.set_deadline(deadline);
-  #ifdef DEBUG
-  std::cout << "Deadline set for get all sessions: " << opof_get_deadline() << " milli seconds" << endl;
-  #endif
+  opof_log_debug("Deadline set for get all sessions: %u milli seconds", opof_get_deadline());
   request.set_pagesize(pageSize);
   request.set_startsession(*session_start_id);
+  if (filter != NULL){
+    convertSessionFilter2cpp(filter, request.mutable_filter());
+  }
   
   status = stub_->getAllSessions(&context, request, &response);
   array_size = response.sessioninfo_size();
@@ -250,6 +249,115 @@ int  SessionTableClient::getAllSessions(int pageSize, uint64_t *session_start_id
   return static_cast<int>(status.error_code());
 }
 
+/**  \ingroup clientlibrary
+* \brief getTopSessions
+*
+* \param metric          The metric the sessions are ranked by
+* \param count           The maximum number of sessions to return
+* \param responses       Returns the sessions in descending metric order
+* \param sessionCount    Returns the number of sessions
+*
+*/
+int SessionTableClient::getTopSessions(SESSION_METRIC_T metric, int count, sessionResponse_t responses[], unsigned long *sessionCount){
+  Status status;
+  sessionResponses response;
+  topSessionsRequest request;
+  ClientContext context;
+  std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_deadline());
+  context.set_deadline(deadline);
+
+  request.set_metric((SESSION_METRIC)metric);
+  request.set_count(count);
+
+  *sessionCount = 0;
+  status = stub_->getTopSessions(&context, request, &response);
+  for (int i = 0; i < response.sessioninfo_size() && i < count; i++){
+    convertSessionResponse2c(response.mutable_sessioninfo(i), &responses[i]);
+    (*sessionCount)++;
+  }
+  return static_cast<int>(status.error_code());
+}
+
+/**  \ingroup clientlibrary
+* \brief getAggregateStats
+*
+* \param groupBy         The grouping to return
+* \param stats           Returns one entry per group
+* \param maxGroups       The size of the stats array
+* \param groupCount      Returns the number of groups
+*
+*/
+int SessionTableClient::getAggregateStats(AGGREGATE_GROUP_T groupBy, aggregateStats_t stats[], int maxGroups, int *groupCount){
+  Status status;
+  aggregateStatsResponse response;
+  aggregateStatsRequest request;
+  ClientContext context;
+  std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_deadline());
+  context.set_deadline(deadline);
+
+  request.set_groupby((AGGREGATE_GROUP)groupBy);
+
+  *groupCount = 0;
+  status = stub_->getAggregateStats(&context, request, &response);
+  for (int i = 0; i < response.stats_size() && i < maxGroups; i++){
+    convertAggregateStats2c(&response.stats(i), &stats[i]);
+    (*groupCount)++;
+  }
+  return static_cast<int>(status.error_code());
+}
+
+/**  \ingroup clientlibrary
+* \brief getServerStats
+*
+* \param stats           Returns one entry per RPC
+* \param maxRpcs         The size of the stats array
+* \param rpcCount        Returns the number of RPCs
+* \param uptimeSeconds   Returns the time since the server started
+*
+*/
+int SessionTableClient::getServerStats(rpcStats_t stats[], int maxRpcs, int *rpcCount, unsigned long *uptimeSeconds){
+  Status status;
+  serverStatsResponse response;
+  serverStatsRequest request;
+  ClientContext context;
+  std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_deadline());
+  context.set_deadline(deadline);
+
+  *rpcCount = 0;
+  status = stub_->getServerStats(&context, request, &response);
+  *uptimeSeconds = response.uptimeseconds();
+  for (int i = 0; i < response.rpcs_size() && i < maxRpcs; i++){
+    convertRpcStats2c(&response.rpcs(i), &stats[i]);
+    (*rpcCount)++;
+  }
+  return static_cast<int>(status.error_code());
+}
+
+/**  \ingroup clientlibrary
+* \brief getStageStats
+*
+* \param stats           Returns one entry per handler stage with calls
+* \param maxStages       The size of the stats array
+* \param stageCount      Returns the number of stages
+*
+*/
+int SessionTableClient::getStageStats(stageStats_t stats[], int maxStages, int *stageCount){
+  Status status;
+  serverStatsResponse response;
+  serverStatsRequest request;
+  ClientContext context;
+  std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_deadline());
+  context.set_deadline(deadline);
+
+  *stageCount = 0;
+  status = stub_->getServerStats(&context, request, &response);
+  for (int i = 0; i < response.stages_size() && i < maxStages; i++){
+    convertStageStats2c(&response.stages(i), &stats[i]);
+    (*stageCount)++;
+  }
+  return static_cast<int>(status.error_code());
+}
+
 int SessionTableClient::addVlanFlow(uint16_t vlan_id, uint16_t vf_index)
 {
   Status status;
@@ -26,14 +26,17 @@
 extern "C" {
 #include "opof.h"
 #include "opof_error.h"
+#include "opof_log.h"
 #include "opof_serverlib.h"
 }
+#include <algorithm>
 
 #include "opof_util.h"
 #include "opof_grpc.h"
 #include "opof_session_server.h"
 
 Status SessionTableImpl::getServiceVersion(ServerContext* context, const versionRequest* request, versionResponse* response) {
+  RpcTimer timer(stats_, OPOF_RPC_GET_SERVICE_VERSION);
   static constexpr size_t STR_BUFFER_LENGTH = 512;
 
   char vendor[STR_BUFFER_LENGTH];
@@ -47,7 +50,7 @@ Status SessionTableImpl::getServiceVersion(ServerContext* context, const version
     copyright, STR_BUFFER_LENGTH);
   
   if (status) {
-    return Status::CANCELLED;
+    return timer.done(Status::CANCELLED);
   }
   
   response->set_vendor(vendor);
@@ -55,13 +58,14 @@ Status SessionTableImpl::getServiceVersion(ServerContext* context, const version
   response->set_version(version);
   response->set_copyright(copyright);
 
-  return Status::OK;
+  return timer.done(Status::OK);
 }
 
 Status SessionTableImpl::reset(ServerContext* context, const resetRequest *request, sessionResponse *response)
 {
+  RpcTimer timer(stats_, OPOF_RPC_RESET);
   opof_reset_server();
-  return Status::OK;
+  return timer.done(Status::OK);
 }
 
 /** \ingroup serverlibrary
@@ -72,6 +76,7 @@ Status SessionTableImpl::reset(ServerContext* context, const resetRequest *reque
 * \param response
 */
 Status SessionTableImpl::addSession(ServerContext* context, ServerReader<sessionRequest>* reader, addSessionResponse* response) {
+  RpcTimer timer(stats_, OPOF_RPC_ADD_SESSION);
   //int index=0;
   //ADD_SESSION_STATUS reqStatus = ADD_SESSION_STATUS::_SESSION_ACCEPTED;
   sessionRequest request;
@@ -83,23 +88,40 @@ Status SessionTableImpl::addSession(ServerContext* context, ServerReader<session
 #ifdef TESTS
   sleep(1);
 #endif
+  uint64_t added = 0;
+  StageTimer laps(stats_);
   while(reader->Read(&request)){
+    laps.lap(OPOF_STAGE_ADD_READ);
+    timer.addSessions(1);
     sessionRequest_t request_c = {};
     convertSessionRequest2c(request, &request_c);
+    laps.lap(OPOF_STAGE_ADD_CONVERT);
+    opof_trace(OPOF_TRACE_REQUEST_DECODED, OPOF_RPC_ADD_SESSION, request_c.sessId, 0);
     if (context->IsCancelled()) {
-      return Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning.");
+      stats_.recordSessions(added, 0, 0);
+      return timer.done(Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning."));
     }
     addSessionResponse_t addResponse_c = {};
+    opof_trace(OPOF_TRACE_BACKEND_START, OPOF_RPC_ADD_SESSION, request_c.sessId, 0);
     int status = opof_add_session_server(&request_c, &addResponse_c);
+    opof_trace(OPOF_TRACE_BACKEND_END, OPOF_RPC_ADD_SESSION, request_c.sessId, status);
+    laps.lap(OPOF_STAGE_ADD_BACKEND);
     if (status != _OK){
       sessionResponseError *errorMessage = response->add_responseerror();
       errorMessage->set_sessionid(request.sessionid());
       errorMessage->set_errorstatus(status);
+      stats_.recordBackendError(OPOF_RPC_ADD_SESSION, status);
+      opof_log_warn("addSession: session %lu rejected by the backend, status %d", request_c.sessId, status);
+    } else {
+      added++;
     }
+    laps.lap(OPOF_STAGE_ADD_RESPONSE);
     //index++;
   }
+  laps.lap(OPOF_STAGE_ADD_READ);
+  stats_.recordSessions(added, 0, 0);
   //response->set_requeststatus(reqStatus);
-  return Status::OK;
+  return timer.done(Status::OK);
 }
 
 /** \ingroup serverlibrary
@@ -111,21 +133,29 @@ Status SessionTableImpl::addSession(ServerContext* context, ServerReader<session
 */
 Status SessionTableImpl::getSession(ServerContext* context, const sessionId* sid,
   sessionResponse* response) {
-  sessionResponse_t response_c;
+  RpcTimer timer(stats_, OPOF_RPC_GET_SESSION);
+  sessionResponse_t response_c = {};
   int status;
   uint64_t session;
   if (context->IsCancelled()) {
-      return Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning.");
+      return timer.done(Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning."));
   }
   session = sid->sessionid();
+  opof_trace(OPOF_TRACE_BACKEND_START, OPOF_RPC_GET_SESSION, session, 0);
   status = opof_get_session_server(session, &response_c);
+  opof_trace(OPOF_TRACE_BACKEND_END, OPOF_RPC_GET_SESSION, session, status);
+  if (status != _OK){
+    stats_.recordBackendError(OPOF_RPC_GET_SESSION, status);
+  }
   if (status == _OK){
     convertSessionResponse2cpp(response, &response_c);
-    return Status::OK;
+    timer.addSessions(1);
+    return timer.done(Status::OK);
   } else if (status == _NOT_FOUND){
-    return Status(grpc::StatusCode::NOT_FOUND, "Get Session Not Found");
+    return timer.done(Status(grpc::StatusCode::NOT_FOUND, "Get Session Not Found"));
   } else {
-    return Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error");
+    opof_log_error("getSession: backend failed for session %lu, status %d", (unsigned long)session, status);
+    return timer.done(Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error"));
   }
 }
 
@@ -138,30 +168,43 @@ Status SessionTableImpl::getSession(ServerContext* context, const sessionId* sid
 */
 Status SessionTableImpl::deleteSession(ServerContext* context, const sessionId* sid,
   sessionResponse* response) {
+  RpcTimer timer(stats_, OPOF_RPC_DELETE_SESSION);
   int status;
-  sessionResponse_t response_c;
+  sessionResponse_t response_c = {};
   if (context->IsCancelled()) {
-    return Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning.");
+    return timer.done(Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning."));
   }
+  opof_trace(OPOF_TRACE_BACKEND_START, OPOF_RPC_DELETE_SESSION, sid->sessionid(), 0);
   status = opof_del_session_server(sid->sessionid(), &response_c);
+  opof_trace(OPOF_TRACE_BACKEND_END, OPOF_RPC_DELETE_SESSION, sid->sessionid(), status);
+  if (status != _OK){
+    stats_.recordBackendError(OPOF_RPC_DELETE_SESSION, status);
+  }
   if (status == _OK){
     convertSessionResponse2cpp(response, &response_c);
-    return Status::OK;
+    timer.addSessions(1);
+    stats_.recordSessions(0, 1, 0);
+    return timer.done(Status::OK);
   } else if (status == _NOT_FOUND){
-    return Status(grpc::StatusCode::NOT_FOUND, "Delete Session Not Found");
+    return timer.done(Status(grpc::StatusCode::NOT_FOUND, "Delete Session Not Found"));
   } else {
-    return Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error");
+    opof_log_error("deleteSession: backend failed for session %lu, status %d", (unsigned long)sid->sessionid(), status);
+    return timer.done(Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error"));
   }
 }
 
 /** \ingroup serverlibrary
 * \brief getAllSessions
 *
+* When the request carries a sessionFilter the backend applies it during
+* the scan, so only matching sessions are copied into the response.
+*
 * \param context
 * \param reader
 * \param response
 */
 Status SessionTableImpl::getAllSessions(ServerContext* context, const sessionRequestArgs* request, sessionResponses *responses) {
+  RpcTimer timer(stats_, OPOF_RPC_GET_ALL_SESSIONS);
   Status status;
   sessionResponse_t **allSessions= NULL;
   sessionResponse_t *closedResponse;
@@ -172,39 +215,46 @@ Status SessionTableImpl::getAllSessions(ServerContext* context, const sessionReq
   int nresponses = BUFFER_MAX;
   uint64_t start_session;
   if (context->IsCancelled()) {
-      return Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning.");
+      return timer.done(Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning."));
   }
   start_session = request->startsession();
   
+  StageTimer laps(stats_);
   allSessions = (sessionResponse_t **)malloc(nresponses * sizeof(sessionResponse_t *));
   for (int i = 0; i < nresponses; i++){
-    allSessions[i] = (sessionResponse_t *)malloc(sizeof(sessionResponse_t));
+    allSessions[i] = (sessionResponse_t *)calloc(1, sizeof(sessionResponse_t));
   }
+  laps.lap(OPOF_STAGE_ALL_ALLOC);
   
-  sessionCount = opof_get_all_sessions_server(nresponses, &start_session, pageCount, allSessions);
+  opof_trace(OPOF_TRACE_BACKEND_START, OPOF_RPC_GET_ALL_SESSIONS, 0, 0);
+  if (request->has_filter()){
+    sessionFilter_t filter_c = {};
+    convertSessionFilter2c(&request->filter(), &filter_c);
+    sessionCount = opof_get_filtered_sessions_server(nresponses, &start_session, &filter_c, allSessions);
+  } else {
+    sessionCount = opof_get_all_sessions_server(nresponses, &start_session, pageCount, allSessions);
+  }
+  opof_trace(OPOF_TRACE_BACKEND_END, OPOF_RPC_GET_ALL_SESSIONS, 0, sessionCount);
+  laps.lap(OPOF_STAGE_ALL_BACKEND);
 
   responses->set_nextkey(start_session);
   
   if (sessionCount > 0){
+    timer.addSessions(sessionCount);
     pageCount++;
     for (int i=0; i < sessionCount; i++){
       closedResponse = allSessions[i];
       response = responses->add_sessioninfo();
-      response->set_sessionid(closedResponse->sessionId);
-      response->set_sessionstate((SESSION_STATE)closedResponse->sessionState);
-      response->set_inpackets(closedResponse->inPackets);
-      response->set_outpackets(closedResponse->outPackets);
-      response->set_inbytes(closedResponse->inBytes);
-      response->set_outbytes(closedResponse->outBytes);
-      response->set_sessionclosecode((SESSION_CLOSE_CODE)closedResponse->sessionCloseCode);
-      response->set_requeststatus((REQUEST_STATUS)closedResponse->requestStatus);
+      convertSessionResponse2cpp(response, closedResponse);
     }
   }
+  laps.lap(OPOF_STAGE_ALL_CONVERT);
   for (int i=0; i <nresponses; i++){
     free(allSessions[i]);
   }
   free(allSessions);
-  return Status::OK;
+  laps.lap(OPOF_STAGE_ALL_ALLOC);
+  return timer.done(Status::OK);
 }
 
 /** \ingroup serverlibrary
@@ -215,55 +265,133 @@ Status SessionTableImpl::getAllSessions(ServerContext* context, const sessionReq
 * \param response
 */
 Status SessionTableImpl::getClosedSessions(ServerContext* context, const sessionRequestArgs* request, ServerWriter<sessionResponse>* writer) {
+  RpcTimer timer(stats_, OPOF_RPC_GET_CLOSED_SESSIONS);
   sessionResponse response;
   sessionResponse_t closedResponse;
   statisticsRequestArgs_t request_c;
   int sessionCount = 0;
   //Status status;
   if (context->IsCancelled()) {
-      return Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning.");
+      return timer.done(Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning."));
   }
   int nresponses = request->pagesize();
+  /* the page is returned in a fixed buffer, so an unpaged request gets one buffer's worth */
+  if (nresponses <= 0 || nresponses > BUFFER_MAX){
+    nresponses = BUFFER_MAX;
+  }
   request_c.pageSize = nresponses;
-  sessionResponse_t closedSessions[BUFFER_MAX];
+  sessionResponse_t closedSessions[BUFFER_MAX] = {};
 #ifdef TESTS
   sleep(1);
 #endif
+  StageTimer laps(stats_);
+  opof_trace(OPOF_TRACE_BACKEND_START, OPOF_RPC_GET_CLOSED_SESSIONS, 0, 0);
   sessionCount = opof_get_closed_sessions_server(&request_c, closedSessions);
+  opof_trace(OPOF_TRACE_BACKEND_END, OPOF_RPC_GET_CLOSED_SESSIONS, 0, sessionCount);
+  laps.lap(OPOF_STAGE_CLOSED_BACKEND);
   if (sessionCount == 0){
-    return Status(grpc::StatusCode::NOT_FOUND,"No Closed Sessions");
+    return timer.done(Status(grpc::StatusCode::NOT_FOUND,"No Closed Sessions"));
   }
+  timer.addSessions(sessionCount);
+  stats_.recordSessions(0, 0, sessionCount);
   for (int i=0; i < sessionCount; i++){
     closedResponse = closedSessions[i];
-    response.set_sessionid(closedResponse.sessionId);
-    response.set_sessionstate((SESSION_STATE)closedResponse.sessionState);
-    response.set_inpackets(closedResponse.inPackets);
-    response.set_outpackets(closedResponse.outPackets);
-    response.set_inbytes(closedResponse.inBytes);
-    response.set_outbytes(closedResponse.outBytes);
-    response.set_sessionclosecode((SESSION_CLOSE_CODE)closedResponse.sessionCloseCode);
+    convertSessionResponse2cpp(&response, &closedResponse);
     response.set_requeststatus(REQUEST_STATUS::_ACCEPTED);
+    laps.lap(OPOF_STAGE_CLOSED_CONVERT);
     writer->Write(response);
+    laps.lap(OPOF_STAGE_CLOSED_WRITE);
+    opof_trace(OPOF_TRACE_RESPONSE_WRITTEN, OPOF_RPC_GET_CLOSED_SESSIONS, closedResponse.sessionId, 0);
     
   }
   
-  return Status::OK;
+  return timer.done(Status::OK);
+}
+
+/** \ingroup serverlibrary
+* \brief getTopSessions
+*
+* Returns the sessions with the largest value of the requested metric, as
+* tracked by the backend. The count is limited to TOP_SESSIONS_MAX, and a
+* count of 0 returns no sessions.
+*
+* opof_topn_get sorts a copy of the whole tracker on every query, so its
+* cost grows with the tracker capacity rather than with the count. The
+* reference backend (opof_server_test.c) ranks _RATE over its whole table
+* at query time, so the rate of an idle session falls as it ages.
+*
+* \param context
+* \param request
+* \param responses
+*/
+Status SessionTableImpl::getTopSessions(ServerContext* context, const topSessionsRequest* request, sessionResponses *responses) {
+  RpcTimer timer(stats_, OPOF_RPC_GET_TOP_SESSIONS);
+  int sessionCount;
+  /* count is a uint32, compared unsigned so large ones are not negative */
+  int count = (int)std::min(request->count(), (uint32_t)TOP_SESSIONS_MAX);
+  if (context->IsCancelled()) {
+      return timer.done(Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning."));
+  }
+  if (count == 0){
+    return timer.done(Status::OK);
+  }
+  std::vector<sessionResponse_t> topSessions(count);
+  sessionCount = opof_get_top_sessions_server((SESSION_METRIC_T)request->metric(), count, topSessions.data());
+  if (sessionCount < 0){
+    return timer.done(Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error"));
+  }
+  for (int i=0; i < sessionCount; i++){
+    convertSessionResponse2cpp(responses->add_sessioninfo(), &topSessions[i]);
+  }
+  timer.addSessions(sessionCount);
+  return timer.done(Status::OK);
+}
+
+/** \ingroup serverlibrary
+* \brief getAggregateStats
+*
+* Returns the session and counter totals of each group, as maintained by the
+* backend. At most AGGREGATE_GROUPS_MAX groups are returned.
+*
+* \param context
+* \param request
+* \param response
+*/
+Status SessionTableImpl::getAggregateStats(ServerContext* context, const aggregateStatsRequest* request, aggregateStatsResponse *response) {
+  RpcTimer timer(stats_, OPOF_RPC_GET_AGGREGATE_STATS);
+  int groupCount;
+  if (context->IsCancelled()) {
+      return timer.done(Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning."));
+  }
+  std::vector<aggregateStats_t> stats(AGGREGATE_GROUPS_MAX);
+  groupCount = opof_get_aggregate_stats_server((AGGREGATE_GROUP_T)request->groupby(), stats.data(), AGGREGATE_GROUPS_MAX);
+  if (groupCount < 0){
+    return timer.done(Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error"));
+  }
+  response->set_groupby(request->groupby());
+  for (int i=0; i < groupCount; i++){
+    convertAggregateStats2cpp(&stats[i], response->add_stats());
+  }
+  return timer.done(Status::OK);
 }
 
 Status SessionTableImpl::addVlanFlow(ServerContext* context, const vlanFlowDef* request, sessionResponse* response) {
+  RpcTimer timer(stats_, OPOF_RPC_ADD_VLAN_FLOW);
   int status = opof_add_vlan_flow_server(request->vlanid(), request->internallif());
   response->set_requeststatus(status == 0 ? REQUEST_STATUS::_ACCEPTED : REQUEST_STATUS::_REJECTED);
-  return Status::OK;
+  return timer.done(Status::OK);
 }
 
 Status SessionTableImpl::removeVlanFlow(ServerContext* context, const vlanFlowDef* request, sessionResponse* response)
 {
+  RpcTimer timer(stats_, OPOF_RPC_REMOVE_VLAN_FLOW);
   int status = opof_remove_vlan_flow_server(request->vlanid());
   response->set_requeststatus(status == 0 ? REQUEST_STATUS::_ACCEPTED : REQUEST_STATUS::_REJECTED);
-  return Status::OK;
+  return timer.done(Status::OK);
 }
 
 Status SessionTableImpl::getVlanFlows(ServerContext* context, const vlanFlowListRequest* request, vlanFlowList* response) {
+  RpcTimer timer(stats_, OPOF_RPC_GET_VLAN_FLOWS);
   size_t nVlanFlows = opof_get_vlan_flow_count_server();
   size_t nVlanFlowsReturned = 0;
   std::vector<uint16_t> vlanIDs(nVlanFlows);
@@ -276,13 +404,14 @@ Status SessionTableImpl::getVlanFlows(ServerContext* context, const vlanFlowList
       flowDef->set_internallif(vfIndices[i]);
     }
   }
-  return Status::OK;
+  return timer.done(Status::OK);
 }
 
 Status SessionTableImpl::clearVlanFlows(ServerContext* context, const vlanFlowListRequest* request, sessionResponse* response) {
+  RpcTimer timer(stats_, OPOF_RPC_CLEAR_VLAN_FLOWS);
   opof_clear_vlan_flows_server();
   response->set_requeststatus(REQUEST_STATUS::_ACCEPTED);
-  return Status::OK;
+  return timer.done(Status::OK);
 }
 
 Status SessionTableImpl::setNextHop(
@@ -290,12 +419,13 @@ Status SessionTableImpl::setNextHop(
   const nextHopParameters *nextHop, 
   struct nextHopResponse *response)
 {
+  RpcTimer timer(stats_, OPOF_RPC_SET_NEXT_HOP);
   struct nextHopParameters_t nextHop_c = {};
   convertNextHop2c(nextHop, &nextHop_c);
   int status = opof_set_next_hop_server(&nextHop_c);
   response->set_errorstatus(status == 0 ? REQUEST_STATUS::_ACCEPTED : REQUEST_STATUS::_REJECTED);
 
-  return Status::OK;
+  return timer.done(Status::OK);
 }
 
 Status SessionTableImpl::destroyNextHop(
@@ -303,10 +433,11 @@ Status SessionTableImpl::destroyNextHop(
   const nextHopParameters *nextHop, 
   struct nextHopResponse *response)
 {
+  RpcTimer timer(stats_, OPOF_RPC_DESTROY_NEXT_HOP);
   int status = opof_destroy_next_hop_server(nextHop->nexthopid());
   response->set_errorstatus(status == 0 ? REQUEST_STATUS::_ACCEPTED : REQUEST_STATUS::_REJECTED);
 
-  return Status::OK;
+  return timer.done(Status::OK);
 }
 
 Status SessionTableImpl::clearNextHops(
@@ -314,8 +445,25 @@ Status SessionTableImpl::clearNextHops(
   const nextHopParameters *ignored, 
   struct nextHopResponse *response)
 {
+  RpcTimer timer(stats_, OPOF_RPC_CLEAR_NEXT_HOPS);
   int status = opof_clear_next_hops_server();
   response->set_errorstatus(status == 0 ? REQUEST_STATUS::_ACCEPTED : REQUEST_STATUS::_REJECTED);
 
-  return Status::OK;
+  return timer.done(Status::OK);
+}
+
+/** \ingroup serverlibrary
+* \brief getServerStats
+*
+* Returns the per-RPC counters and latency percentiles recorded since the
+* server started. Reading the counters takes no lock.
+*
+* \param context
+* \param request
+* \param response
+*/
+Status SessionTableImpl::getServerStats(ServerContext* context, const serverStatsRequest* request, serverStatsResponse *response) {
+  RpcTimer timer(stats_, OPOF_RPC_GET_SERVER_STATS);
+  stats_.fill(response);
+  return timer.done(Status::OK);
 }
@@ -0,0 +1,238 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Bounded top-N tracker for server backends
+*
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "uthash.h"
+#include "opof_topn.h"
+
+typedef struct topn_node {
+  unsigned long sessionId;
+  uint64_t value;
+  int pos;
+  UT_hash_handle hh;
+} topn_node_t;
+
+struct opof_topn {
+  int capacity;
+  int size;
+  topn_node_t *nodes;
+  topn_node_t **heap;
+  topn_node_t *index;
+};
+
+static void heap_swap(opof_topn_t *topn, int a, int b){
+  topn_node_t *tmp = topn->heap[a];
+  topn->heap[a] = topn->heap[b];
+  topn->heap[b] = tmp;
+  topn->heap[a]->pos = a;
+  topn->heap[b]->pos = b;
+}
+
+static void sift_up(opof_topn_t *topn, int pos){
+  while (pos > 0){
+    int parent = (pos - 1) / 2;
+    if (topn->heap[parent]->value <= topn->heap[pos]->value){
+      break;
+    }
+    heap_swap(topn, parent, pos);
+    pos = parent;
+  }
+}
+
+static void sift_down(opof_topn_t *topn, int pos){
+  for (;;){
+    int smallest = pos;
+    int left = 2 * pos + 1;
+    int right = left + 1;
+    if (left < topn->size && topn->heap[left]->value < topn->heap[smallest]->value){
+      smallest = left;
+    }
+    if (right < topn->size && topn->heap[right]->value < topn->heap[smallest]->value){
+      smallest = right;
+    }
+    if (smallest == pos){
+      break;
+    }
+    heap_swap(topn, pos, smallest);
+    pos = smallest;
+  }
+}
+
+/** \ingroup servercinterface
+* \brief Create a top-N tracker
+*
+* \param capacity  The maximum number of sessions tracked
+* \return the tracker or NULL on allocation failure
+*/
+opof_topn_t *opof_topn_create(int capacity){
+  opof_topn_t *topn;
+
+  if (capacity <= 0){
+    return NULL;
+  }
+  topn = (opof_topn_t *)calloc(1, sizeof(*topn));
+  if (topn == NULL){
+    return NULL;
+  }
+  topn->capacity = capacity;
+  topn->nodes = (topn_node_t *)calloc(capacity, sizeof(topn_node_t));
+  topn->heap = (topn_node_t **)calloc(capacity, sizeof(topn_node_t *));
+  if (topn->nodes == NULL || topn->heap == NULL){
+    opof_topn_destroy(topn);
+    return NULL;
+  }
+  /* nodes[size..capacity-1] are free, heap[i] always points into nodes */
+  for (int i = 0; i < capacity; i++){
+    topn->heap[i] = &topn->nodes[i];
+  }
+  return topn;
+}
+
+void opof_topn_destroy(opof_topn_t *topn){
+  if (topn == NULL){
+    return;
+  }
+  HASH_CLEAR(hh, topn->index);
+  free(topn->heap);
+  free(topn->nodes);
+  free(topn);
+}
+
+void opof_topn_reset(opof_topn_t *topn){
+  HASH_CLEAR(hh, topn->index);
+  topn->size = 0;
+}
+
+/** \ingroup servercinterface
+* \brief Record the current metric value of a session
+*
+* Tracked sessions are re-positioned in the heap. Untracked sessions are added
+* while there is room, otherwise they replace the minimum if they are larger.
+*
+* \param topn       The tracker
+* \param sessionId  The session
+* \param value      The new metric value
+*/
+void opof_topn_update(opof_topn_t *topn, unsigned long sessionId, uint64_t value){
+  topn_node_t *node;
+  uint64_t old;
+
+  HASH_FIND(hh, topn->index, &sessionId, sizeof(sessionId), node);
+  if (node != NULL){
+    old = node->value;
+    node->value = value;
+    if (value > old){
+      sift_down(topn, node->pos);
+    } else {
+      sift_up(topn, node->pos);
+    }
+    return;
+  }
+  if (topn->size < topn->capacity){
+    node = topn->heap[topn->size];
+    node->pos = topn->size++;
+    node->sessionId = sessionId;
+    node->value = value;
+    HASH_ADD(hh, topn->index, sessionId, sizeof(node->sessionId), node);
+    sift_up(topn, node->pos);
+    return;
+  }
+  node = topn->heap[0];
+  if (value <= node->value){
+    return;
+  }
+  HASH_DELETE(hh, topn->index, node);
+  node->sessionId = sessionId;
+  node->value = value;
+  HASH_ADD(hh, topn->index, sessionId, sizeof(node->sessionId), node);
+  sift_down(topn, 0);
+}
+
+/** \ingroup servercinterface
+* \brief Stop tracking a session, e.g. when it is deleted or closed
+*
+* \param topn       The tracker
+* \param sessionId  The session
+*/
+void opof_topn_remove(opof_topn_t *topn, unsigned long sessionId){
+  topn_node_t *node;
+  int pos;
+
+  HASH_FIND(hh, topn->index, &sessionId, sizeof(sessionId), node);
+  if (node == NULL){
+    return;
+  }
+  HASH_DELETE(hh, topn->index, node);
+  pos = node->pos;
+  topn->size--;
+  if (pos != topn->size){
+    heap_swap(topn, pos, topn->size);
+    sift_down(topn, pos);
+    sift_up(topn, pos);
+  }
+}
+
+static int compare_desc(const void *a, const void *b){
+  const topn_node_t *na = *(const topn_node_t * const *)a;
+  const topn_node_t *nb = *(const topn_node_t * const *)b;
+  if (na->value == nb->value){
+    return 0;
+  }
+  return (na->value < nb->value) ? 1 : -1;
+}
+
+/** \ingroup servercinterface
+* \brief Get the tracked sessions with the largest metric values
+*
+* \param topn         The tracker
+* \param n            The maximum number of sessions to return
+* \param sessionIds   Returns the sessions in descending metric order
+* \param values       Returns the metric values, may be NULL
+* \return the number of sessions returned
+*/
+int opof_topn_get(opof_topn_t *topn, int n, unsigned long sessionIds[], uint64_t values[]){
+  topn_node_t **sorted;
+  int count;
+
+  if (n > topn->size){
+    n = topn->size;
+  }
+  if (n <= 0){
+    return 0;
+  }
+  sorted = (topn_node_t **)malloc(topn->size * sizeof(topn_node_t *));
+  if (sorted == NULL){
+    return 0;
+  }
+  memcpy(sorted, topn->heap, topn->size * sizeof(topn_node_t *));
+  qsort(sorted, topn->size, sizeof(topn_node_t *), compare_desc);
+  for (count = 0; count < n; count++){
+    sessionIds[count] = sorted[count]->sessionId;
+    if (values != NULL){
+      values[count] = sorted[count]->value;
+    }
+  }
+  free(sorted);
+  return count;
+}
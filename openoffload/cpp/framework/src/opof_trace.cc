@@ -0,0 +1,317 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup serverlibrary
+*
+* \brief Per-thread binary trace ring (flight recorder)
+*
+*/
+extern "C" {
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "opof.h"
+}
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opof_trace.h"
+
+#define OPOF_TRACE_RING_MASK (OPOF_TRACE_RING_SIZE - 1)
+
+static_assert((OPOF_TRACE_RING_SIZE & OPOF_TRACE_RING_MASK) == 0, "OPOF_TRACE_RING_SIZE must be a power of two");
+static_assert(sizeof(OpofTraceRecord) == 32, "OpofTraceRecord is part of the dump file format");
+
+const char *const opofRpcNames[OPOF_RPC_COUNT] = {
+  "getServiceVersion",
+  "reset",
+  "addSession",
+  "getSession",
+  "deleteSession",
+  "getAllSessions",
+  "getClosedSessions",
+  "getTopSessions",
+  "getAggregateStats",
+  "addVlanFlow",
+  "removeVlanFlow",
+  "getVlanFlows",
+  "clearVlanFlows",
+  "setNextHop",
+  "destroyNextHop",
+  "clearNextHops",
+  "getServerStats",
+};
+
+const char *const opofTraceEventNames[OPOF_TRACE_EVENT_COUNT] = {
+  "unknown",
+  "streamOpen",
+  "requestSent",
+  "requestDecoded",
+  "backendStart",
+  "backendEnd",
+  "responseWritten",
+  "streamClose",
+};
+
+/*
+* Only the owning thread writes records and head. The dump reads head with
+* acquire ordering, copies the records and reads head again; records that the
+* owner may have overwritten during the copy are dropped.
+*/
+struct OpofTraceRing {
+    OpofTraceRecord records[OPOF_TRACE_RING_SIZE];
+    std::atomic<uint64_t> head;
+    std::atomic<bool> owned;
+    uint32_t thread;
+    OpofTraceRing *next;
+};
+
+/*
+* Rings are never freed. A thread that exits releases its ring and the next
+* new thread takes it over, so a pool that keeps replacing threads does not
+* grow the list.
+*/
+static std::atomic<OpofTraceRing *> rings(nullptr);
+/* the time base of every dump, taken at static initialization */
+static uint64_t startTicks = opof_ticks();
+static int64_t startNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+  std::chrono::system_clock::now().time_since_epoch()).count();
+static std::string traceFile = "opof_trace.bin";
+static int signalPipe[2] = {-1, -1};
+
+extern "C" {
+  //
+  unsigned int g_trace = 0;
+  /** \ingroup serverlibrary
+  * \brief enables or disables the trace ring
+  *
+  * \param enable  non-zero to enable
+  * \return the new setting
+  *
+  */
+  unsigned int opof_set_trace(unsigned int enable){
+    g_trace = enable ? 1 : 0;
+    return g_trace;
+  }
+  /** \ingroup serverlibrary
+  * \brief gets whether the trace ring is enabled
+  *
+  * \param void
+  * \return 1 when enabled, 0 otherwise
+  *
+  */
+  unsigned int opof_get_trace(void){
+    return g_trace;
+  }
+  /** \ingroup serverlibrary
+  * \brief sets the file written by a signal triggered dump
+  *
+  * \param path
+  * \return the new path
+  *
+  */
+  const char *opof_set_trace_file(const char *path){
+    traceFile = path;
+    return traceFile.c_str();
+  }
+  /** \ingroup serverlibrary
+  * \brief gets the file written by a signal triggered dump
+  *
+  * \param void
+  * \return the path
+  *
+  */
+  const char *opof_get_trace_file(void){
+    return traceFile.c_str();
+  }
+} // extern C
+
+static OpofTraceRing *acquireRing() {
+  OpofTraceRing *ring;
+  for (ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next){
+    bool owned = false;
+    if (!ring->owned.load(std::memory_order_relaxed) &&
+        ring->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)){
+      break;
+    }
+  }
+  if (ring == nullptr){
+    ring = new OpofTraceRing();
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->owned.store(true, std::memory_order_relaxed);
+    ring->next = rings.load(std::memory_order_relaxed);
+    while (!rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)){
+    }
+  }
+  ring->thread = (uint32_t)syscall(SYS_gettid);
+  return ring;
+}
+
+struct OpofTraceRingHolder {
+    OpofTraceRing *ring;
+
+    ~OpofTraceRingHolder() {
+      if (ring != nullptr){
+        ring->owned.store(false, std::memory_order_release);
+      }
+    }
+};
+
+static thread_local OpofTraceRingHolder holder = {nullptr};
+
+/**
+* \brief Append one record to the calling thread's ring
+*
+* Callers go through opof_trace(), which skips the call when tracing is off.
+*/
+void opofTraceRecord(OpofTraceEvent event, OpofRpc rpc, uint64_t sessionId, uint32_t arg) {
+  OpofTraceRing *ring = holder.ring;
+  if (ring == nullptr){
+    ring = holder.ring = acquireRing();
+  }
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  OpofTraceRecord &record = ring->records[head & OPOF_TRACE_RING_MASK];
+  record.ticks = opof_ticks();
+  record.sessionId = sessionId;
+  record.thread = ring->thread;
+  record.arg = arg;
+  record.event = event;
+  record.rpc = rpc;
+  record.seq = (uint32_t)head;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+static void copyRing(OpofTraceRing *ring, std::vector<OpofTraceRecord> &out) {
+  uint64_t end = ring->head.load(std::memory_order_acquire);
+  uint64_t begin = end > OPOF_TRACE_RING_SIZE ? end - OPOF_TRACE_RING_SIZE : 0;
+  size_t base = out.size();
+
+  for (uint64_t i = begin; i < end; i++){
+    out.push_back(ring->records[i & OPOF_TRACE_RING_MASK]);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t after = ring->head.load(std::memory_order_relaxed);
+  /* the writer may be filling record after, the slot of record after - OPOF_TRACE_RING_SIZE */
+  uint64_t oldest = after >= OPOF_TRACE_RING_SIZE ? after + 1 - OPOF_TRACE_RING_SIZE : 0;
+  if (oldest > begin){
+    uint64_t torn = std::min(oldest, end) - begin;
+    out.erase(out.begin() + base, out.begin() + base + torn);
+  }
+}
+
+extern "C" {
+  /** \ingroup serverlibrary
+  * \brief writes the contents of all trace rings to a file
+  *
+  * Safe to call while other threads keep recording. The file is decoded
+  * with opof_trace_decode.
+  *
+  * \param path  The file to write, NULL for the file set with opof_set_trace_file()
+  * \return _OK, or _INTERNAL when the file cannot be written
+  *
+  */
+  int opof_trace_dump(const char *path){
+    std::vector<OpofTraceRecord> records;
+    OpofTraceFileHeader header;
+    uint32_t threads = 0;
+
+    for (OpofTraceRing *ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next){
+      copyRing(ring, records);
+      threads++;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, OPOF_TRACE_MAGIC, sizeof(header.magic));
+    header.version = OPOF_TRACE_VERSION;
+    header.recordSize = sizeof(OpofTraceRecord);
+    header.records = records.size();
+    header.startTicks = startTicks;
+    header.startNanos = startNanos;
+    header.dumpTicks = opof_ticks();
+    header.dumpNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+    header.threads = threads;
+    header.pid = (uint32_t)getpid();
+
+    FILE *fp = fopen(path != NULL ? path : traceFile.c_str(), "wb");
+    if (fp == NULL){
+      return _INTERNAL;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (ok && !records.empty()){
+      ok = fwrite(records.data(), sizeof(OpofTraceRecord), records.size(), fp) == records.size();
+    }
+    if (fclose(fp) != 0){
+      ok = false;
+    }
+    return ok ? _OK : _INTERNAL;
+  }
+} // extern C
+
+static void traceSignalHandler(int signo) {
+  char c = (char)signo;
+  if (write(signalPipe[1], &c, 1) < 0){
+    /* a dump is already pending */
+  }
+}
+
+extern "C" {
+  /** \ingroup serverlibrary
+  * \brief dumps the trace rings to the trace file each time signo is received
+  *
+  * The handler only writes a byte to a pipe; a helper thread waiting on the
+  * pipe writes the file, so the dump never runs in signal context.
+  *
+  * \param signo  The signal, e.g. SIGUSR1
+  * \return _OK, or _INTERNAL when the handler cannot be installed
+  *
+  */
+  int opof_trace_dump_on_signal(int signo){
+    struct sigaction action;
+
+    if (signalPipe[0] < 0 && pipe(signalPipe) != 0){
+      return _INTERNAL;
+    }
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = traceSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(signo, &action, NULL) != 0){
+      return _INTERNAL;
+    }
+    static std::once_flag started;
+    std::call_once(started, []() {
+      std::thread([]() {
+        char c;
+        while (read(signalPipe[0], &c, 1) == 1){
+          if (opof_trace_dump(NULL) == _OK){
+            fprintf(stderr, "OPOF: trace written to %s\n", traceFile.c_str());
+          } else {
+            fprintf(stderr, "OPOF: could not write trace to %s\n", traceFile.c_str());
+          }
+        }
+      }).detach();
+    });
+    return _OK;
+  }
+} // extern C
@@ -0,0 +1,195 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup serverlibrary
+*
+* \brief Offline decoder of the files written by opof_trace_dump()
+*
+* Records are grouped per thread into requests, from a streamOpen to the
+* matching streamClose, and printed as one block per request with the time
+* of each event relative to the start of the request. A request whose
+* streamOpen was overwritten in the ring is printed as partial.
+*
+*   opof_trace_decode [-l micros] [-s sessionId] file
+*
+* -l only prints requests that took longer than micros, -s only prints
+* requests that touched the session.
+*/
+extern "C" {
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+}
+#include <algorithm>
+#include <vector>
+
+#include "opof_trace.h"
+
+struct TraceRequest {
+    size_t first;
+    size_t last;
+    bool partial;
+};
+
+static double ticksPerNano = 1.0;
+static OpofTraceFileHeader header;
+
+static const char *eventName(uint16_t event) {
+  return event < OPOF_TRACE_EVENT_COUNT ? opofTraceEventNames[event] : "unknown";
+}
+
+static const char *rpcName(uint16_t rpc) {
+  return rpc < OPOF_RPC_COUNT ? opofRpcNames[rpc] : "unknown";
+}
+
+static double toMicros(uint64_t ticks) {
+  return ticks / ticksPerNano / 1000.0;
+}
+
+static void printTime(uint64_t ticks) {
+  int64_t nanos = header.startNanos + (int64_t)(((int64_t)ticks - (int64_t)header.startTicks) / ticksPerNano);
+  time_t seconds = nanos / 1000000000;
+  struct tm tm;
+  char buffer[32];
+
+  localtime_r(&seconds, &tm);
+  strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+  printf("%s.%06" PRId64, buffer, (nanos % 1000000000) / 1000);
+}
+
+static bool hasSession(const std::vector<OpofTraceRecord> &records, const TraceRequest &request, uint64_t sessionId) {
+  for (size_t i = request.first; i <= request.last; i++){
+    if (records[i].sessionId == sessionId){
+      return true;
+    }
+  }
+  return false;
+}
+
+static void printRequest(const std::vector<OpofTraceRecord> &records, const TraceRequest &request) {
+  const OpofTraceRecord &open = records[request.first];
+  const OpofTraceRecord &close = records[request.last];
+
+  printTime(open.ticks);
+  printf(" thread %u %s %.3fus", open.thread, rpcName(open.rpc), toMicros(close.ticks - open.ticks));
+  if (close.event == OPOF_TRACE_STREAM_CLOSE){
+    printf(" status %u", close.arg);
+  }
+  printf("%s\n", request.partial ? " (partial)" : "");
+  for (size_t i = request.first; i <= request.last; i++){
+    const OpofTraceRecord &record = records[i];
+    printf("  %+12.3fus  %-16s", toMicros(record.ticks - open.ticks), eventName(record.event));
+    if (record.sessionId != 0 || record.event == OPOF_TRACE_REQUEST_SENT ||
+        record.event == OPOF_TRACE_REQUEST_DECODED || record.event == OPOF_TRACE_RESPONSE_WRITTEN){
+      printf(" session %" PRIu64, record.sessionId);
+    }
+    if (record.event == OPOF_TRACE_BACKEND_END || (record.event == OPOF_TRACE_STREAM_OPEN && record.arg != 0)){
+      printf(" arg %u", record.arg);
+    }
+    printf("\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  uint64_t sessionId = 0;
+  bool bySession = false;
+  double slowMicros = 0;
+  int c;
+
+  while ((c = getopt(argc, argv, "l:s:h")) != -1){
+    switch (c){
+      case 'l':
+        slowMicros = strtod(optarg, NULL);
+        break;
+      case 's':
+        sessionId = strtoull(optarg, NULL, 10);
+        bySession = true;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-l micros] [-s sessionId] file\n", argv[0]);
+        fprintf(stderr, "\t-l    only requests slower than micros\n");
+        fprintf(stderr, "\t-s    only requests that touched the session\n");
+        return 1;
+    }
+  }
+  if (optind >= argc){
+    fprintf(stderr, "usage: %s [-l micros] [-s sessionId] file\n", argv[0]);
+    return 1;
+  }
+
+  FILE *fp = fopen(argv[optind], "rb");
+  if (fp == NULL){
+    perror(argv[optind]);
+    return 1;
+  }
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      memcmp(header.magic, OPOF_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != OPOF_TRACE_VERSION || header.recordSize != sizeof(OpofTraceRecord)){
+    fprintf(stderr, "%s: not a version %d opof trace\n", argv[optind], OPOF_TRACE_VERSION);
+    fclose(fp);
+    return 1;
+  }
+  std::vector<OpofTraceRecord> records(header.records);
+  if (!records.empty() && fread(records.data(), sizeof(OpofTraceRecord), records.size(), fp) != records.size()){
+    fprintf(stderr, "%s: truncated, expected %" PRIu64 " records\n", argv[optind], header.records);
+    fclose(fp);
+    return 1;
+  }
+  fclose(fp);
+
+  if (header.dumpNanos > header.startNanos && header.dumpTicks > header.startTicks){
+    ticksPerNano = (double)(header.dumpTicks - header.startTicks) / (header.dumpNanos - header.startNanos);
+  }
+  printf("pid %u, %u threads, %" PRIu64 " records, %.3f ticks/ns\n",
+    header.pid, header.threads, header.records, ticksPerNano);
+
+  /* rings can change owner, so order by thread and time rather than by file position */
+  std::stable_sort(records.begin(), records.end(), [](const OpofTraceRecord &a, const OpofTraceRecord &b) {
+    return a.thread != b.thread ? a.thread < b.thread : a.ticks < b.ticks;
+  });
+
+  std::vector<TraceRequest> requests;
+  size_t i = 0;
+  while (i < records.size()){
+    TraceRequest request = {i, i, records[i].event != OPOF_TRACE_STREAM_OPEN};
+    while (request.last + 1 < records.size() &&
+           records[request.last].event != OPOF_TRACE_STREAM_CLOSE &&
+           records[request.last + 1].thread == records[i].thread &&
+           records[request.last + 1].event != OPOF_TRACE_STREAM_OPEN){
+      request.last++;
+    }
+    requests.push_back(request);
+    i = request.last + 1;
+  }
+  std::stable_sort(requests.begin(), requests.end(), [&records](const TraceRequest &a, const TraceRequest &b) {
+    return records[a.first].ticks < records[b.first].ticks;
+  });
+
+  for (const TraceRequest &request : requests){
+    if (toMicros(records[request.last].ticks - records[request.first].ticks) < slowMicros){
+      continue;
+    }
+    if (bySession && !hasSession(records, request, sessionId)){
+      continue;
+    }
+    printRequest(records, request);
+  }
+  return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+extern "C" {
+#include "opof.h"
+#include "opof_log.h"
+#include "opof_tunnel.h"
+  //
+  // Set default deadline on tunnel API calls to 100 milli seconds, kept
+  // apart from the session deadline
+  //
+  unsigned int g_tunnel_deadline = 100;
+  /**  \ingroup tunnelclientcinterface
+  * \brief gets the deadline value of the tunnel calls in milli-seconds
+  *
+  * \param void
+  * \return value of global value deadline
+  *
+  */
+  unsigned int opof_get_tunnel_deadline(void){
+    return g_tunnel_deadline;
+  }
+ /**  \ingroup tunnelclientcinterface
+  * \brief sets the deadline value of the tunnel calls in milli-seconds
+  *
+  * \param int
+  * \return value of global value deadline
+  *
+  */
+  unsigned int opof_set_tunnel_deadline(int deadline){
+    g_tunnel_deadline = deadline;
+    return g_tunnel_deadline;
+  }
+} // extern C
+
+#include "opof_tunnel_util.h"
+#include "opof_tunnel_grpc.h"
+#include "opof_tunnel_client.h"
+
+static void setTunnelDeadline(ClientContext *context)
+{
+  context->set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(opof_get_tunnel_deadline()));
+}
+
+/**  \ingroup clientlibrary
+* \brief getCapabilities
+*
+* \param capabilities    Returns the match, IPsec and GENEVE capabilities of the device
+*
+*/
+int TunnelTableClient::getCapabilities(tunnelCapabilities_t *capabilities){
+  ClientContext context;
+  CapabilityRequest request;
+  CapabilityResponse response;
+  setTunnelDeadline(&context);
+  Status status = stub_->Capabilities(&context, request, &response);
+  if (status.ok()){
+    convertTunnelCapabilities2c(response, capabilities);
+  }
+  return static_cast<int>(status.error_code());
+}
+
+/**  \ingroup clientlibrary
+* \brief createTunnels
+*
+* \param size
+* \param requests
+* \param response
+*
+*/
+int TunnelTableClient::createTunnels(int size, ipTunnelRequest_t **requests, createIpTunnelResponses_t *response){
+  ClientContext context;
+  createIpTunnelResponses responses;
+  setTunnelDeadline(&context);
+  opof_log_debug("Deadline set for create tunnels: %u milli seconds", opof_get_tunnel_deadline());
+  std::unique_ptr<ClientWriter<ipTunnelRequest> > writer(
+          stub_->createIpTunnel(&context, &responses));
+  for (int i = 0; i < size; i++){
+    ipTunnelRequest request;
+    convertTunnelRequest2cpp(requests[i], &request);
+    if (!writer->Write(request)){
+      break;
+    }
+  }
+  writer->WritesDone();
+  Status status = writer->Finish();
+  if (status.ok()){
+    convertCreateTunnelResponses2c(responses, response);
+  }
+  return static_cast<int>(status.error_code());
+}
+
+/**  \ingroup clientlibrary
+* \brief getTunnel
+*
+* \param tunnelId
+* \param response
+*
+*/
+int TunnelTableClient::getTunnel(uint64_t tunnelId, ipTunnelResponse_t *response){
+  ClientContext context;
+  tunnelIdRequest request;
+  ipTunnelResponse tunnel;
+  setTunnelDeadline(&context);
+  request.set_tunnelid(tunnelId);
+  Status status = stub_->getIpTunnel(&context, request, &tunnel);
+  if (status.ok()){
+    convertTunnelResponse2c(tunnel, response);
+  }
+  return static_cast<int>(status.error_code());
+}
+
+/**  \ingroup clientlibrary
+* \brief getTunnelStats
+*
+* \param tunnelId
+* \param response
+*
+*/
+int TunnelTableClient::getTunnelStats(uint64_t tunnelId, ipTunnelStatsResponse_t *response){
+  ClientContext context;
+  tunnelIdRequest request;
+  ipTunnelStatsResponse stats;
+  setTunnelDeadline(&context);
+  request.set_tunnelid(tunnelId);
+  Status status = stub_->getIpTunnelStats(&context, request, &stats);
+  if (status.ok()){
+    convertTunnelStatsResponse2c(stats, response);
+  }
+  return static_cast<int>(status.error_code());
+}
+
+/**  \ingroup clientlibrary
+* \brief getAllTunnels
+*
+* Reads every message of the stream, the tunnels beyond maxTunnels are
+* dropped.
+*
+* \param tunnelsPerRequest   Tunnels per stream message, 0 for TUNNEL_BUFFER_MAX
+* \param responses           Returns the tunnels
+* \param maxTunnels          The size of the responses array
+* \param tunnelCount         Returns the number of tunnels
+*
+*/
+int TunnelTableClient::getAllTunnels(unsigned int tunnelsPerRequest, ipTunnelResponse_t responses[], int maxTunnels, int *tunnelCount){
+  ClientContext context;
+  tunnelRequestArgs request;
+  ipTunnelResponses page;
+  setTunnelDeadline(&context);
+  request.set_tunnelsperrequest(tunnelsPerRequest);
+  *tunnelCount = 0;
+  std::unique_ptr<ClientReader<ipTunnelResponses> > reader(stub_->getAllIpTunnels(&context, request));
+  while (reader->Read(&page)){
+    for (int i = 0; i < page.responses_size() && *tunnelCount < maxTunnels; i++){
+      convertTunnelResponse2c(page.responses(i), &responses[(*tunnelCount)++]);
+    }
+  }
+  Status status = reader->Finish();
+  return static_cast<int>(status.error_code());
+}
+
+/**  \ingroup clientlibrary
+* \brief getAllTunnelsStats
+*
+* \param tunnelsPerRequest   Tunnels per stream message, 0 for TUNNEL_BUFFER_MAX
+* \param responses           Returns the tunnel counters
+* \param maxTunnels          The size of the responses array
+* \param tunnelCount         Returns the number of tunnels
+*
+*/
+int TunnelTableClient::getAllTunnelsStats(unsigned int tunnelsPerRequest, ipTunnelStatsResponse_t responses[], int maxTunnels, int *tunnelCount){
+  ClientContext context;
+  tunnelRequestArgs request;
+  ipTunnelStatsResponses page;
+  setTunnelDeadline(&context);
+  request.set_tunnelsperrequest(tunnelsPerRequest);
+  *tunnelCount = 0;
+  std::unique_ptr<ClientReader<ipTunnelStatsResponses> > reader(stub_->getAllIpTunnelsStats(&context, request));
+  while (reader->Read(&page)){
+    for (int i = 0; i < page.responses_size() && *tunnelCount < maxTunnels; i++){
+      convertTunnelStatsResponse2c(page.responses(i), &responses[(*tunnelCount)++]);
+    }
+  }
+  Status status = reader->Finish();
+  return static_cast<int>(status.error_code());
+}
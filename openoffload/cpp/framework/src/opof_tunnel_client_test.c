@@ -0,0 +1,418 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Tests of the tunnel client library against opof_tunnel_server_test
+*
+* The server must be empty and run with the default capacity of 1024 tunnels.
+* Test 4 fills the table in batches of TUNNEL_BUFFER_MAX and reports the
+* create rate.
+*
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "opof.h"
+#include "opof_test.h"
+#include "opof_test_util.h"
+#include "opof_tunnel.h"
+#include "opof_tunnel_clientlib.h"
+
+#define TUNNEL_TEST_CAPACITY 1024
+#define GRPC_NOT_FOUND 5
+
+#define CHECK(cond, ...) \
+  do { \
+    if (!(cond)){ \
+      printf("ERROR: " __VA_ARGS__); \
+      printf("\n"); \
+      return FAILURE; \
+    } \
+  } while (0)
+
+static void ipsecEncTunnel(ipTunnelRequest_t *request, uint64_t tunnelId, uint32_t spi){
+  memset(request, 0, sizeof(*request));
+  request->tunnelId = tunnelId;
+  request->operation = _TUNNEL_CREATE;
+  request->nextAction = _TUNNEL_FORWARD;
+  strcpy(request->match.ingressInterface, "eth0");
+  request->match.ipMatch.enable = true;
+  request->match.ipMatch.ipver = _IPV4;
+  inet_pton(AF_INET, "10.0.0.0", &request->match.ipMatch.sourceIp);
+  request->match.ipMatch.sourceIpPrefix = 24;
+  request->tunnelType = _IP_TUNNEL_IPSEC_ENC;
+  request->ipsec.tunnelType = _IPSEC_TUNNEL;
+  request->ipsec.encryptionType = _AES256GCM128;
+  request->ipsec.numberSAs = 1;
+  request->ipsec.sas[0].spi = spi;
+  request->ipsec.sas[0].operation = _TUNNEL_CREATE;
+  request->ipsec.sas[0].keyLength = 32;
+  for (int i = 0; i < 32; i++){
+    request->ipsec.sas[0].key[i] = (uint8_t)(spi + i);
+  }
+  request->ipsec.tunnelIps.enable = true;
+  request->ipsec.tunnelIps.ipver = _IPV6;
+  inet_pton(AF_INET6, "2001:db8::1", &request->ipsec.tunnelIps.sourceIpv6);
+  inet_pton(AF_INET6, "2001:db8::2", &request->ipsec.tunnelIps.destinationIpv6);
+}
+
+static void geneveEncapTunnel(ipTunnelRequest_t *request, uint64_t tunnelId, uint64_t matchTunnel, uint32_t vni){
+  static const uint8_t sourceMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  static const uint8_t destinationMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+
+  memset(request, 0, sizeof(*request));
+  request->tunnelId = tunnelId;
+  request->operation = _TUNNEL_CREATE;
+  request->nextAction = _TUNNEL_RECIRCULATE;
+  request->match.tunnelId = matchTunnel;
+  request->tunnelType = _IP_TUNNEL_GENEVE_ENCAP;
+  request->geneve.outerIps.enable = true;
+  request->geneve.outerIps.ipver = _IPV4;
+  inet_pton(AF_INET, "192.168.1.1", &request->geneve.outerIps.sourceIp);
+  inet_pton(AF_INET, "192.168.1.2", &request->geneve.outerIps.destinationIp);
+  request->geneve.innerMacPair.enable = true;
+  memcpy(request->geneve.innerMacPair.sourceMac, sourceMac, 6);
+  memcpy(request->geneve.innerMacPair.destinationMac, destinationMac, 6);
+  request->geneve.vni = vni;
+  request->geneve.protocolType = 0x6558;
+  request->geneve.numberOptions = 1;
+  request->geneve.options[0].optionClass = 0x0102;
+  request->geneve.options[0].type = 0x80;
+  request->geneve.options[0].length = 2;
+  request->geneve.options[0].dataLength = 8;
+  memcpy(request->geneve.options[0].data, "opofopof", 8);
+}
+
+static int createTunnels(tunnelTable_t *handle, ipTunnelRequest_t *requests, int size, createIpTunnelResponses_t *response){
+  ipTunnelRequest_t *batch[TUNNEL_BUFFER_MAX];
+  for (int i = 0; i < size; i++){
+    batch[i] = &requests[i];
+  }
+  memset(response, 0, sizeof(*response));
+  return opof_create_tunnels(handle, size, batch, response);
+}
+
+static int deleteTunnels(tunnelTable_t *handle, uint64_t first, int count){
+  ipTunnelRequest_t requests[TUNNEL_BUFFER_MAX];
+  createIpTunnelResponses_t response;
+  int status;
+
+  for (int done = 0; done < count; done += TUNNEL_BUFFER_MAX){
+    int size = count - done < TUNNEL_BUFFER_MAX ? count - done : TUNNEL_BUFFER_MAX;
+    memset(requests, 0, sizeof(requests));
+    for (int i = 0; i < size; i++){
+      requests[i].tunnelId = first + done + i;
+      requests[i].operation = _TUNNEL_DELETE;
+    }
+    status = createTunnels(handle, requests, size, &response);
+    if (status != SUCCESS || response.errorStatus != 0){
+      return FAILURE;
+    }
+  }
+  return SUCCESS;
+}
+
+/* Test 1: capabilities, then a chained IPsec and GENEVE pair read back field for field */
+static int tunnelTest1(tunnelTable_t *handle, bool verbose){
+  tunnelCapabilities_t capabilities = {};
+  ipTunnelRequest_t requests[2];
+  createIpTunnelResponses_t response;
+  ipTunnelResponse_t tunnel = {};
+  ipTunnelStatsResponse_t stats = {};
+  int status;
+
+  status = opof_get_tunnel_capabilities(handle, &capabilities);
+  CHECK(status == SUCCESS, "Capabilities returned %d", status);
+  CHECK(capabilities.geneveMatching && capabilities.spiMatching && !capabilities.vxlanMatching, "Unexpected match capabilities");
+  CHECK(capabilities.numberTunnelTypes == 4 && capabilities.numberEncryptionTypes == 3, "Unexpected IPsec capabilities");
+  CHECK(capabilities.numberGeneveOptionsSupported == 5, "Unexpected GENEVE capabilities");
+
+  ipsecEncTunnel(&requests[0], 1, 0x1001);
+  geneveEncapTunnel(&requests[1], 2, 1, 0x123456);
+  status = createTunnels(handle, requests, 2, &response);
+  CHECK(status == SUCCESS, "createIpTunnel returned %d", status);
+  CHECK(response.requestStatus == _TUNNEL_ACCEPTED && response.errorStatus == 0,
+    "Tunnels rejected, status %d errors 0x%lx: %s", response.requestStatus, response.errorStatus,
+    response.numberResponses ? response.responses[0].error.errorString : "");
+
+  status = opof_get_tunnel(handle, 1, &tunnel);
+  CHECK(status == SUCCESS, "getIpTunnel returned %d", status);
+  CHECK(tunnel.tunnelId == 1 && tunnel.ipTunnel.tunnelType == _IP_TUNNEL_IPSEC_ENC, "Wrong tunnel returned");
+  CHECK(strcmp(tunnel.ipTunnel.match.ingressInterface, "eth0") == 0, "Wrong ingress interface");
+  CHECK(tunnel.ipTunnel.match.ipMatch.enable && tunnel.ipTunnel.match.ipMatch.sourceIpPrefix == 24, "Wrong IP match");
+  CHECK(tunnel.ipTunnel.ipsec.numberSAs == 1 && tunnel.ipTunnel.ipsec.sas[0].spi == 0x1001, "Wrong SA");
+  CHECK(tunnel.ipTunnel.ipsec.sas[0].keyLength == 32 &&
+    memcmp(tunnel.ipTunnel.ipsec.sas[0].key, requests[0].ipsec.sas[0].key, 32) == 0, "Wrong IPsec key");
+  CHECK(tunnel.ipTunnel.ipsec.tunnelIps.ipver == _IPV6 &&
+    memcmp(&tunnel.ipTunnel.ipsec.tunnelIps.destinationIpv6, &requests[0].ipsec.tunnelIps.destinationIpv6, 16) == 0, "Wrong tunnel IPs");
+  CHECK(tunnel.counters.inPackets > 0 && tunnel.counters.inBytes == tunnel.counters.inPackets * 8, "Wrong counters");
+
+  memset(&tunnel, 0, sizeof(tunnel));
+  status = opof_get_tunnel(handle, 2, &tunnel);
+  CHECK(status == SUCCESS, "getIpTunnel returned %d", status);
+  CHECK(tunnel.ipTunnel.tunnelType == _IP_TUNNEL_GENEVE_ENCAP && tunnel.ipTunnel.match.tunnelId == 1, "Wrong GENEVE tunnel");
+  CHECK(tunnel.ipTunnel.geneve.vni == 0x123456 && tunnel.ipTunnel.geneve.protocolType == 0x6558, "Wrong GENEVE header");
+  CHECK(memcmp(tunnel.ipTunnel.geneve.innerMacPair.destinationMac, requests[1].geneve.innerMacPair.destinationMac, 6) == 0, "Wrong inner MAC");
+  CHECK(tunnel.ipTunnel.geneve.numberOptions == 1 && tunnel.ipTunnel.geneve.options[0].dataLength == 8 &&
+    memcmp(tunnel.ipTunnel.geneve.options[0].data, "opofopof", 8) == 0, "Wrong GENEVE option");
+
+  status = opof_get_tunnel_stats(handle, 2, &stats);
+  CHECK(status == SUCCESS && stats.tunnelId == 2 && stats.counters.outPackets > 0, "getIpTunnelStats returned %d", status);
+  status = opof_get_tunnel(handle, 99, &tunnel);
+  CHECK(status == GRPC_NOT_FOUND, "getIpTunnel of an unknown tunnel returned %d", status);
+
+  if (verbose){
+    printf("Tunnel 2: vni 0x%x in packets %lu\n", tunnel.ipTunnel.geneve.vni, stats.counters.inPackets);
+  }
+  CHECK(deleteTunnels(handle, 2, 1) == SUCCESS && deleteTunnels(handle, 1, 1) == SUCCESS, "Delete failed");
+  return SUCCESS;
+}
+
+/* Test 2: the tunnels that fail validation are reported, the others are created */
+static int tunnelTest2(tunnelTable_t *handle, bool verbose){
+  ipTunnelRequest_t requests[6];
+  createIpTunnelResponses_t response;
+  int status;
+
+  ipsecEncTunnel(&requests[0], 10, 0x2000);
+  ipsecEncTunnel(&requests[1], 11, 0x2001);
+  requests[1].ipsec.sas[0].keyLength = 16;                 /* 128 bit key */
+  geneveEncapTunnel(&requests[2], 12, 0, 1 << 24);         /* VNI too large */
+  geneveEncapTunnel(&requests[3], 13, 77, 10);             /* matches an unknown tunnel */
+  ipsecEncTunnel(&requests[4], 10, 0x2004);                /* duplicate */
+  geneveEncapTunnel(&requests[5], 15, 10, 10);
+  requests[5].geneve.numberOptions = 6;                    /* too many options */
+  for (int i = 1; i < 6; i++){
+    requests[5].geneve.options[i] = requests[5].geneve.options[0];
+  }
+
+  status = createTunnels(handle, requests, 6, &response);
+  CHECK(status == SUCCESS, "createIpTunnel returned %d", status);
+  CHECK(response.requestStatus == _TUNNEL_REJECTED, "Request status %d", response.requestStatus);
+  CHECK(response.errorStatus == 0x3e, "Error status 0x%lx", response.errorStatus);
+  CHECK(response.numberResponses == 5, "%d error responses", response.numberResponses);
+  CHECK(response.responses[0].tunnelId == 11 && response.responses[0].error.ipsecError == _IPSEC_INVALID_KEY, "Wrong key error");
+  CHECK(response.responses[1].tunnelId == 12 && response.responses[1].error.geneveError == _GENEVE_INVALID_FIELD, "Wrong VNI error");
+  CHECK(response.responses[2].error.matchError == _MATCH_INVALID_TUNNEL_ID, "Wrong match error");
+  CHECK(response.responses[3].tunnelId == 10 && response.responses[3].error.error, "Wrong duplicate error");
+  CHECK(response.responses[4].error.geneveError == _GENEVE_TOO_MANY_OPTIONS, "Wrong options error");
+  if (verbose){
+    for (int i = 0; i < response.numberResponses; i++){
+      printf("Tunnel %lu: %s\n", response.responses[i].tunnelId, response.responses[i].error.errorString);
+    }
+  }
+
+  ipsecEncTunnel(&requests[0], 10, 0x3000);
+  requests[0].operation = _TUNNEL_UPDATE;
+  requests[1] = requests[0];
+  requests[1].tunnelId = 16;
+  status = createTunnels(handle, requests, 2, &response);
+  CHECK(status == SUCCESS && response.errorStatus == 0x2, "Update errors 0x%lx", response.errorStatus);
+  CHECK(response.responses[0].error.matchError == _MATCH_INVALID_TUNNEL_ID, "Wrong update error");
+  CHECK(deleteTunnels(handle, 10, 1) == SUCCESS, "Delete failed");
+  return SUCCESS;
+}
+
+/* Test 3: getAllIpTunnels and getAllIpTunnelsStats with and without paging */
+static int tunnelTest3(tunnelTable_t *handle, bool verbose){
+  static ipTunnelResponse_t tunnels[3 * TUNNEL_BUFFER_MAX];
+  static ipTunnelStatsResponse_t stats[3 * TUNNEL_BUFFER_MAX];
+  ipTunnelRequest_t requests[TUNNEL_BUFFER_MAX];
+  createIpTunnelResponses_t response;
+  int total = 2 * TUNNEL_BUFFER_MAX + 7;
+  int count;
+  int status;
+
+  for (int done = 0; done < total; done += TUNNEL_BUFFER_MAX){
+    int size = total - done < TUNNEL_BUFFER_MAX ? total - done : TUNNEL_BUFFER_MAX;
+    for (int i = 0; i < size; i++){
+      ipsecEncTunnel(&requests[i], 100 + done + i, 0x4000 + done + i);
+    }
+    status = createTunnels(handle, requests, size, &response);
+    CHECK(status == SUCCESS && response.errorStatus == 0, "createIpTunnel returned %d errors 0x%lx", status, response.errorStatus);
+  }
+  status = opof_get_all_tunnels(handle, 0, tunnels, 3 * TUNNEL_BUFFER_MAX, &count);
+  CHECK(status == SUCCESS && count == total, "getAllIpTunnels returned %d, %d tunnels", status, count);
+  for (int i = 0; i < count; i++){
+    CHECK(tunnels[i].tunnelId == (uint64_t)(100 + i) && tunnels[i].ipTunnel.ipsec.sas[0].spi == (uint32_t)(0x4000 + i),
+      "Tunnel %d is %lu", i, tunnels[i].tunnelId);
+  }
+  status = opof_get_all_tunnels(handle, 10, tunnels, 3 * TUNNEL_BUFFER_MAX, &count);
+  CHECK(status == SUCCESS && count == total, "Paged getAllIpTunnels returned %d, %d tunnels", status, count);
+  status = opof_get_all_tunnels_stats(handle, 7, stats, 3 * TUNNEL_BUFFER_MAX, &count);
+  CHECK(status == SUCCESS && count == total, "getAllIpTunnelsStats returned %d, %d tunnels", status, count);
+  CHECK(stats[total - 1].tunnelId == (uint64_t)(100 + total - 1) && stats[total - 1].counters.inPackets > 0, "Wrong last stats");
+  status = opof_get_all_tunnels_stats(handle, 0, stats, 10, &count);
+  CHECK(status == SUCCESS && count == 10, "Truncated getAllIpTunnelsStats returned %d tunnels", count);
+  if (verbose){
+    printf("Read %d tunnels\n", total);
+  }
+  CHECK(deleteTunnels(handle, 100, total) == SUCCESS, "Delete failed");
+  status = opof_get_all_tunnels(handle, 0, tunnels, 3 * TUNNEL_BUFFER_MAX, &count);
+  CHECK(status == SUCCESS && count == 0, "%d tunnels left", count);
+  return SUCCESS;
+}
+
+/* Test 4: fill the table in full batches, then a batch that does not fit is refused as a whole */
+static int tunnelTest4(tunnelTable_t *handle, bool verbose){
+  ipTunnelRequest_t requests[TUNNEL_BUFFER_MAX];
+  createIpTunnelResponses_t response;
+  ipTunnelResponse_t tunnel;
+  struct timespec start, end;
+  double seconds;
+  int status;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int done = 0; done < TUNNEL_TEST_CAPACITY - 1; done += TUNNEL_BUFFER_MAX){
+    int size = TUNNEL_TEST_CAPACITY - 1 - done < TUNNEL_BUFFER_MAX ? TUNNEL_TEST_CAPACITY - 1 - done : TUNNEL_BUFFER_MAX;
+    for (int i = 0; i < size; i++){
+      geneveEncapTunnel(&requests[i], 1000 + done + i, 0, done + i);
+    }
+    status = createTunnels(handle, requests, size, &response);
+    CHECK(status == SUCCESS && response.errorStatus == 0, "createIpTunnel returned %d errors 0x%lx", status, response.errorStatus);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("Created %d tunnels in batches of %d: %.0f tunnels/s\n", TUNNEL_TEST_CAPACITY - 1, TUNNEL_BUFFER_MAX,
+    (TUNNEL_TEST_CAPACITY - 1) / seconds);
+
+  /* one free slot, two creates */
+  geneveEncapTunnel(&requests[0], 5000, 0, 1);
+  geneveEncapTunnel(&requests[1], 5001, 0, 2);
+  status = createTunnels(handle, requests, 2, &response);
+  CHECK(status == SUCCESS && response.requestStatus == _TUNNEL_TABLE_FULL, "Request status %d", response.requestStatus);
+  CHECK(opof_get_tunnel(handle, 5000, &tunnel) == GRPC_NOT_FOUND, "Tunnel of a refused batch was created");
+  status = createTunnels(handle, requests, 1, &response);
+  CHECK(status == SUCCESS && response.requestStatus == _TUNNEL_ACCEPTED, "Request status %d", response.requestStatus);
+  if (verbose){
+    printf("Table full at %d tunnels\n", TUNNEL_TEST_CAPACITY);
+  }
+  CHECK(deleteTunnels(handle, 1000, TUNNEL_TEST_CAPACITY - 1) == SUCCESS && deleteTunnels(handle, 5000, 1) == SUCCESS, "Delete failed");
+  return SUCCESS;
+}
+
+/* Test 5: decryption SAs are rekeyed make before break and an SPI belongs to one tunnel */
+static int tunnelTest5(tunnelTable_t *handle, bool verbose){
+  ipTunnelRequest_t requests[2];
+  createIpTunnelResponses_t response;
+  ipTunnelResponse_t tunnel;
+  int status;
+
+  ipsecEncTunnel(&requests[0], 30, 0x5001);
+  requests[0].tunnelType = _IP_TUNNEL_IPSEC_DEC;
+  requests[1] = requests[0];
+  requests[1].tunnelId = 31;
+  status = createTunnels(handle, requests, 2, &response);
+  CHECK(status == SUCCESS && response.errorStatus == 0x2, "Create errors 0x%lx", response.errorStatus);
+  CHECK(response.responses[0].tunnelId == 31 && response.responses[0].error.error, "Duplicate SPI accepted");
+  if (verbose){
+    printf("Tunnel 31: %s\n", response.responses[0].error.errorString);
+  }
+
+  /* new SPI next to the old one, then the old one goes */
+  requests[0].operation = _TUNNEL_UPDATE;
+  requests[0].ipsec.sas[0].spi = 0x5002;
+  status = createTunnels(handle, requests, 1, &response);
+  CHECK(status == SUCCESS && response.errorStatus == 0, "Rekey errors 0x%lx", response.errorStatus);
+  requests[0].ipsec.sas[0].spi = 0x5001;
+  requests[0].ipsec.sas[0].operation = _TUNNEL_DELETE;
+  status = createTunnels(handle, requests, 1, &response);
+  CHECK(status == SUCCESS && response.errorStatus == 0, "SA delete errors 0x%lx", response.errorStatus);
+  CHECK(opof_get_tunnel(handle, 30, &tunnel) == SUCCESS, "Tunnel 30 lost");
+
+  /* the released SPI can be used again, the new one can not */
+  status = createTunnels(handle, &requests[1], 1, &response);
+  CHECK(status == SUCCESS && response.errorStatus == 0, "Released SPI refused 0x%lx", response.errorStatus);
+  requests[1].tunnelId = 32;
+  requests[1].ipsec.sas[0].spi = 0x5002;
+  status = createTunnels(handle, &requests[1], 1, &response);
+  CHECK(status == SUCCESS && response.errorStatus == 0x1, "Rekeyed SPI accepted 0x%lx", response.errorStatus);
+  CHECK(deleteTunnels(handle, 30, 2) == SUCCESS, "Delete failed");
+  return SUCCESS;
+}
+
+int main(int argc, char ** argv){
+  int (*tests[])(tunnelTable_t *, bool) = {tunnelTest1, tunnelTest2, tunnelTest3, tunnelTest4, tunnelTest5};
+  int ntests = sizeof(tests) / sizeof(tests[0]);
+  unsigned short port = 3444;
+  char address[64] = "localhost";
+  char cert[2048] = "";
+  char *str_part;
+  int testId = -1;
+  bool verbose = false;
+  int failed = 0;
+  int c;
+
+  static struct option longopts[] = {
+    {"address", required_argument, 0, 'a'},
+    {"port", required_argument, 0 ,'p'},
+    {"test", required_argument, 0 ,'t'},
+    {"verbose", no_argument, 0 ,'v'},
+    {"help", no_argument, 0 ,'h'},
+    {0,0,0,0},
+  };
+  while ((c = getopt_long(argc, argv, "a:p:t:vh", longopts, NULL)) != -1){
+    switch (c){
+      case 'a':
+        strncpy(address, optarg, 63);
+        break;
+      case 'p':
+        port = strtoul(optarg, &str_part, 10);
+        break;
+      case 't':
+        testId = strtol(optarg, &str_part, 10);
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      case 'h':
+      default:
+        printf("\nCommand line arguments for OpenOffload tunnel client tests version: %s \n", OPOF_VERSION);
+        printf("\t-p, --port            gRPC Port \n");
+        printf("\t-a, --address         Address of gRPC Server\n");
+        printf("\t-t, --test            Run only this test, 1 to %d\n", ntests);
+        printf("\t-v, --verbose         Verbose output\n");
+        printf("\t-h, --help:           Command line help \n\n");
+        exit(1);
+    }
+  }
+#ifdef SSL
+  if (get_key(CERT_FILE, cert) == FAILURE){
+    printf("Error: could not read the server certificate\n");
+    exit(1);
+  }
+#endif
+  tunnelTable_t *handle = opof_create_tunnelTable(address, port, cert);
+  for (int i = 0; i < ntests; i++){
+    if (testId > 0 && testId != i + 1){
+      continue;
+    }
+    if (tests[i](handle, verbose) == SUCCESS){
+      printf("Tunnel test %d: PASSED\n", i + 1);
+    } else {
+      printf("Tunnel test %d: FAILED\n", i + 1);
+      failed++;
+    }
+  }
+  opof_delete_tunnelTable(handle);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+// Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdlib.h>
+
+
+extern "C" {
+#include "opof.h"
+#include "opof_log.h"
+#include "opof_tunnel.h"
+}
+
+#include "opof_tunnel_grpc.h"
+
+#include "opof_tunnel_client.h"
+#include "opof_tunnel_clientlib.h"
+
+
+struct tunnelTable{
+	void *obj;
+};
+
+/**
+* \ingroup tunnelclientcinterface
+* \brief Entry point for C Inteface to the TunnelTableClient
+*
+* \param host 		The address the server is listening on either the IP address or "localhost"
+* \param port   	The port the server is listening on
+* \param public_key The public key for the TLS connection
+* \return 	     	tunnelTable_t, returns a handle to the C++ instance as a void handle.
+*
+*/
+tunnelTable_t * opof_create_tunnelTable(const char * host, unsigned int port, const char *public_key){
+
+	tunnelTable_t *tunnelHandle;
+	TunnelTableClient *client;
+	std::string address(host);
+#ifdef SSL
+	grpc::SslCredentialsOptions sslOpts;
+	sslOpts.pem_root_certs = public_key;
+#endif
+	address.append(":");
+	address.append(std::to_string(port));
+	tunnelHandle = (tunnelTable_t *)malloc(sizeof(*tunnelHandle));
+#ifdef SSL
+	auto channel_creds = grpc::SslCredentials(grpc::SslCredentialsOptions(sslOpts));
+	opof_log_info("Creating Secure Tunnel Client Connection to: %s", address.c_str());
+	client = new TunnelTableClient(grpc::CreateChannel(address, channel_creds));
+#else
+	opof_log_info("Creating Insecure Tunnel Client Connection to: %s", address.c_str());
+	client = new TunnelTableClient(grpc::CreateChannel(address, grpc::InsecureChannelCredentials()));
+#endif
+	tunnelHandle->obj = client;
+	return tunnelHandle;
+}
+
+/**  \ingroup tunnelclientcinterface
+* \brief Destroy the client connection to the tunnel server
+*
+* \param  *tunnelHandle    Handle pointing to the C++ instance
+*
+*/
+void opof_delete_tunnelTable(tunnelTable_t *tunnelHandle){
+	TunnelTableClient *client;
+	client = static_cast<TunnelTableClient *>(tunnelHandle->obj);
+	delete client;
+	free(tunnelHandle);
+}
+
+/**  \ingroup tunnelclientcinterface
+* \brief Get the match, IPsec and GENEVE capabilities of the offload device
+*
+* \param  *tunnelHandle    Handle pointing to the C++ instance
+* \param  *capabilities    Returns the capabilities
+* \return  The gRPC status code
+*
+*/
+int opof_get_tunnel_capabilities(tunnelTable_t *tunnelHandle, tunnelCapabilities_t *capabilities){
+	TunnelTableClient *client = static_cast<TunnelTableClient *>(tunnelHandle->obj);
+	return client->getCapabilities(capabilities);
+}
+
+/**  \ingroup tunnelclientcinterface
+* \brief Create, update and delete tunnels in batches of up to 64.
+*
+* All the tunnels go in one createIpTunnel stream. When the creates of the
+* stream do not fit in the free capacity of the device none is made and
+* requestStatus is _TUNNEL_TABLE_FULL. Otherwise the tunnels that failed
+* have their bit set in errorStatus and an entry with the error in responses.
+*
+* \param  *tunnelHandle    Handle pointing to the C++ instance
+* \param  size             The number of tunnels, max 64.
+* \param  **requests       An array of pointers to ipTunnelRequest_t, allocated by the caller
+* \param  *response        Returns the status of the stream
+* \return  The gRPC status code
+*
+*/
+int opof_create_tunnels(tunnelTable_t *tunnelHandle, int size, ipTunnelRequest_t **requests, createIpTunnelResponses_t *response){
+	TunnelTableClient *client = static_cast<TunnelTableClient *>(tunnelHandle->obj);
+	return client->createTunnels(size, requests, response);
+}
+
+/**  \ingroup tunnelclientcinterface
+* \brief Get a tunnel with its counters
+*
+* \param  *tunnelHandle    Handle pointing to the C++ instance
+* \param  tunnelId         The tunnel
+* \param  *response        Returns the tunnel
+* \return  The gRPC status code, NOT_FOUND for an unknown tunnel
+*
+*/
+int opof_get_tunnel(tunnelTable_t *tunnelHandle, uint64_t tunnelId, ipTunnelResponse_t *response){
+	TunnelTableClient *client = static_cast<TunnelTableClient *>(tunnelHandle->obj);
+	return client->getTunnel(tunnelId, response);
+}
+
+/**  \ingroup tunnelclientcinterface
+* \brief Get the counters of a tunnel
+*
+* \param  *tunnelHandle    Handle pointing to the C++ instance
+* \param  tunnelId         The tunnel
+* \param  *response        Returns the counters
+* \return  The gRPC status code, NOT_FOUND for an unknown tunnel
+*
+*/
+int opof_get_tunnel_stats(tunnelTable_t *tunnelHandle, uint64_t tunnelId, ipTunnelStatsResponse_t *response){
+	TunnelTableClient *client = static_cast<TunnelTableClient *>(tunnelHandle->obj);
+	return client->getTunnelStats(tunnelId, response);
+}
+
+/**  \ingroup tunnelclientcinterface
+* \brief Get all the tunnels of the device
+*
+* \param  *tunnelHandle        Handle pointing to the C++ instance
+* \param  tunnelsPerRequest    Tunnels per stream message, 0 for TUNNEL_BUFFER_MAX
+* \param  responses            Returns the tunnels
+* \param  maxTunnels           The size of the responses array
+* \param  *tunnelCount         Returns the number of tunnels
+* \return  The gRPC status code
+*
+*/
+int opof_get_all_tunnels(tunnelTable_t *tunnelHandle, int tunnelsPerRequest, ipTunnelResponse_t responses[], int maxTunnels, int *tunnelCount){
+	TunnelTableClient *client = static_cast<TunnelTableClient *>(tunnelHandle->obj);
+	return client->getAllTunnels(tunnelsPerRequest, responses, maxTunnels, tunnelCount);
+}
+
+/**  \ingroup tunnelclientcinterface
+* \brief Get the counters of all the tunnels of the device
+*
+* \param  *tunnelHandle        Handle pointing to the C++ instance
+* \param  tunnelsPerRequest    Tunnels per stream message, 0 for TUNNEL_BUFFER_MAX
+* \param  responses            Returns the counters
+* \param  maxTunnels           The size of the responses array
+* \param  *tunnelCount         Returns the number of tunnels
+* \return  The gRPC status code
+*
+*/
+int opof_get_all_tunnels_stats(tunnelTable_t *tunnelHandle, int tunnelsPerRequest, ipTunnelStatsResponse_t responses[], int maxTunnels, int *tunnelCount){
+	TunnelTableClient *client = static_cast<TunnelTableClient *>(tunnelHandle->obj);
+	return client->getAllTunnelsStats(tunnelsPerRequest, responses, maxTunnels, tunnelCount);
+}
@@ -0,0 +1,447 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Encapsulation header templates of GENEVE and IPsec tunnels
+*
+* The fields a packet changes are left 0 in the template, so the partial
+* checksums summed at compile time only miss those fields, and the packet
+* adds them back. Checksums are summed RFC 1071 style in host order, 32 bits
+* at a time, and byte swapped once folded. All template parts have even
+* lengths, so a packet appended to the template stays 16 bit aligned in the
+* sum.
+*
+*/
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "opof.h"
+#include "opof_tunnel_encap.h"
+
+#define ENCAP_IPV4_HEADER 20
+#define ENCAP_IPV6_HEADER 40
+#define ENCAP_UDP_HEADER 8
+#define ENCAP_GENEVE_HEADER 8
+#define ENCAP_GENEVE_PORT 6081
+#define ENCAP_GENEVE_OPTIONS_MAX (0x3f * 4)
+#define ENCAP_ETHERNET_HEADER 14
+#define ENCAP_ETHER_BRIDGING 0x6558
+#define ENCAP_ESP_HEADER 8
+#define ENCAP_ESP_IV 8
+#define ENCAP_NAT_PORT 4500
+#define ENCAP_TTL 64
+/* the UDP source port carries the flow hash in the dynamic port range */
+#define ENCAP_SOURCE_PORT_BASE 0xc000
+#define ENCAP_SOURCE_PORT_MASK 0x3fff
+
+static int encapReject(tunnelError_t *error, const char *errorString){
+  error->error = true;
+  strncpy(error->errorString, errorString, TUNNEL_ERROR_STRING_MAX - 1);
+  return _INVALID_ARGUMENT;
+}
+
+static void put16(uint8_t *p, uint16_t value){
+  p[0] = value >> 8;
+  p[1] = value & 0xff;
+}
+
+static void put32(uint8_t *p, uint32_t value){
+  put16(p, value >> 16);
+  put16(p + 2, value & 0xffff);
+}
+
+/* the 16 bit ones complement sum of data, as a big endian value */
+static uint32_t csumPartial(const uint8_t *data, size_t length){
+  uint64_t sum = 0;
+  uint32_t word;
+
+  while (length >= 4){
+    memcpy(&word, data, 4);
+    sum += word;
+    data += 4;
+    length -= 4;
+  }
+  if (length > 0){
+    word = 0;
+    memcpy(&word, data, length);
+    sum += word;
+  }
+  sum = (sum & 0xffffffff) + (sum >> 32);
+  sum = (sum & 0xffffffff) + (sum >> 32);
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return ntohs((uint16_t)sum);
+}
+
+static uint16_t csumFold(uint64_t sum){
+  while (sum >> 16){
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (uint16_t)~sum;
+}
+
+/* writes the outer IP header with the lengths, checksum and flow label left 0 */
+static int compileIp(opof_tunnel_encap_t *encap, const tunnelIpPair_t *ips, uint8_t protocol){
+  uint8_t *ip = encap->header;
+
+  encap->ipver = ips->ipver;
+  encap->protocol = protocol;
+  if (ips->ipver == _IPV6){
+    ip[0] = 0x60;
+    ip[6] = protocol;
+    ip[7] = ENCAP_TTL;
+    memcpy(ip + 8, ips->sourceIpv6.s6_addr, 16);
+    memcpy(ip + 24, ips->destinationIpv6.s6_addr, 16);
+    return ENCAP_IPV6_HEADER;
+  }
+  ip[0] = 0x45;
+  /* DF with ID 0, RFC 6864 */
+  put16(ip + 6, 0x4000);
+  ip[8] = ENCAP_TTL;
+  ip[9] = protocol;
+  memcpy(ip + 12, &ips->sourceIp.s_addr, 4);
+  memcpy(ip + 16, &ips->destinationIp.s_addr, 4);
+  encap->ipSum = csumPartial(ip, ENCAP_IPV4_HEADER);
+  return ENCAP_IPV4_HEADER;
+}
+
+static void compileUdp(opof_tunnel_encap_t *encap, int offset, uint16_t sourcePort, uint16_t destinationPort){
+  encap->udp = true;
+  encap->udpOffset = offset;
+  put16(encap->header + offset, sourcePort);
+  put16(encap->header + offset + 2, destinationPort);
+}
+
+static int compileGeneve(const geneveEncap_t *geneve, opof_tunnel_encap_t *encap, tunnelError_t *error){
+  int optionBytes = 0;
+  bool critical = geneve->criticalOptionPresent;
+  uint8_t *p;
+  int offset;
+
+  if (!geneve->innerMacPair.enable){
+    error->geneveError = _GENEVE_INVALID_FIELD;
+    return encapReject(error, "No inner MAC pair in geneveEncap");
+  }
+  if (geneve->vni > 0xffffff){
+    error->geneveError = _GENEVE_INVALID_FIELD;
+    return encapReject(error, "VNI is more than 24 bit, invalid");
+  }
+  if (geneve->protocolType > 0xffff){
+    error->geneveError = _GENEVE_INVALID_FIELD;
+    return encapReject(error, "Protocol type is more than 16 bit, invalid");
+  }
+  if (!geneve->outerIps.enable){
+    error->geneveError = _GENEVE_INVALID_FIELD;
+    return encapReject(error, "No outer IP encapsulation found on geneve encap, invalid");
+  }
+  if (geneve->numberOptions < 0 || geneve->numberOptions > TUNNEL_GENEVE_OPTIONS_MAX){
+    error->geneveError = _GENEVE_TOO_MANY_OPTIONS;
+    return encapReject(error, "Too many GENEVE options");
+  }
+  for (int i = 0; i < geneve->numberOptions; i++){
+    const geneveOption_t *option = &geneve->options[i];
+    if (option->optionClass > 0xffff || option->type > 0xff || option->length > 0x1f){
+      error->geneveError = _GENEVE_INVALID_OPTION;
+      return encapReject(error, "GENEVE option class, type or length too large");
+    }
+    if (option->dataLength % 4 != 0 || option->dataLength / 4 != option->length){
+      error->geneveError = _GENEVE_INVALID_OPTION;
+      return encapReject(error, "Option data and length field aren't matched");
+    }
+    optionBytes += 4 + option->dataLength;
+    critical |= (option->type & 0x80) != 0;
+  }
+  if (optionBytes > ENCAP_GENEVE_OPTIONS_MAX){
+    error->geneveError = _GENEVE_TOO_MANY_OPTIONS;
+    return encapReject(error, "GENEVE options longer than 252 bytes");
+  }
+
+  offset = compileIp(encap, &geneve->outerIps, IPPROTO_UDP);
+  compileUdp(encap, offset, 0, ENCAP_GENEVE_PORT);
+  encap->udpChecksum = encap->ipver == _IPV6;
+  p = encap->header + offset + ENCAP_UDP_HEADER;
+  p[0] = optionBytes / 4;
+  p[1] = (geneve->controlPacket ? 0x80 : 0) | (critical ? 0x40 : 0);
+  put16(p + 2, geneve->protocolType);
+  put32(p + 4, geneve->vni << 8);
+  p += ENCAP_GENEVE_HEADER;
+  for (int i = 0; i < geneve->numberOptions; i++){
+    const geneveOption_t *option = &geneve->options[i];
+    put16(p, option->optionClass);
+    p[2] = option->type;
+    p[3] = option->length;
+    memcpy(p + 4, option->data, option->dataLength);
+    p += 4 + option->dataLength;
+  }
+  if (geneve->protocolType == ENCAP_ETHER_BRIDGING){
+    encap->innerEthernet = true;
+    memcpy(p, geneve->innerMacPair.destinationMac, 6);
+    memcpy(p + 6, geneve->innerMacPair.sourceMac, 6);
+    encap->etherTypeOffset = p + 12 - encap->header;
+    p += ENCAP_ETHERNET_HEADER;
+  }
+  encap->length = p - encap->header;
+  if (encap->udpChecksum){
+    /* pseudo header addresses and next header, then UDP onwards */
+    encap->udpSum = csumPartial(encap->header + 8, 32) + IPPROTO_UDP +
+      csumPartial(encap->header + encap->udpOffset, encap->length - encap->udpOffset);
+  }
+  return _OK;
+}
+
+static int compileEsp(const ipsecTunnel_t *ipsec, opof_tunnel_encap_t *encap, tunnelError_t *error){
+  static const uint8_t icvLengths[] = {8, 12, 16};
+  const ipsecSA_t *sa = NULL;
+  bool nat;
+  int offset = 0;
+
+  /* the tunnel encrypts with its last SA, as in opof_tunnel_sa */
+  for (int i = 0; i < ipsec->numberSAs && i < TUNNEL_IPSEC_SAS_MAX; i++){
+    if (ipsec->sas[i].spi != 0 && ipsec->sas[i].operation != _TUNNEL_DELETE){
+      sa = &ipsec->sas[i];
+    }
+  }
+  if (sa == NULL){
+    error->ipsecError = _IPSEC_MISSING_FIELDS;
+    return encapReject(error, "No SPI found on tunnel");
+  }
+  if (ipsec->encryptionType < _AES256GCM64 || ipsec->encryptionType > _AES128CCM128){
+    error->ipsecError = _IPSEC_NON_SUPPORTED_ENCRYPTION;
+    return encapReject(error, "Encryption type not supported");
+  }
+  switch (ipsec->tunnelType){
+    case _IPSEC_TRANSPORT:
+    case _IPSEC_TRANSPORT_NAT_TRAVERSAL:
+      encap->transport = true;
+      break;
+    case _IPSEC_TUNNEL:
+    case _IPSEC_TUNNEL_NAT_TRAVERSAL:
+      if (!ipsec->tunnelIps.enable){
+        error->ipsecError = _IPSEC_MISSING_FIELDS;
+        return encapReject(error, "Tunnel mode without tunnel IPs");
+      }
+      break;
+    default:
+      error->ipsecError = _IPSEC_NON_SUPPORTED_TUNNEL_TYPE;
+      return encapReject(error, "IPsec tunnel type not supported");
+  }
+  nat = ipsec->tunnelType == _IPSEC_TRANSPORT_NAT_TRAVERSAL || ipsec->tunnelType == _IPSEC_TUNNEL_NAT_TRAVERSAL;
+
+  encap->esp = true;
+  encap->protocol = nat ? IPPROTO_UDP : IPPROTO_ESP;
+  encap->ivLength = ENCAP_ESP_IV;
+  encap->icvLength = icvLengths[ipsec->encryptionType % 3];
+  if (!encap->transport){
+    offset = compileIp(encap, &ipsec->tunnelIps, encap->protocol);
+  }
+  if (nat){
+    compileUdp(encap, offset, ENCAP_NAT_PORT, ENCAP_NAT_PORT);
+    offset += ENCAP_UDP_HEADER;
+  }
+  encap->espOffset = offset;
+  put32(encap->header + offset, sa->spi);
+  encap->length = offset + ENCAP_ESP_HEADER + encap->ivLength;
+  return _OK;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Checks a tunnel and builds its encapsulation template
+*
+* \param  request  A GENEVE encap or IPsec encryption tunnel
+* \param  encap    The template
+* \param  error    Set when the tunnel is rejected
+* \return _OK, or _INVALID_ARGUMENT with error set
+*
+*/
+int opof_tunnel_encap_compile(const ipTunnelRequest_t *request, opof_tunnel_encap_t *encap, tunnelError_t *error){
+  memset(encap, 0, sizeof(*encap));
+  encap->tunnelId = request->tunnelId;
+  encap->tunnelType = request->tunnelType;
+  switch (request->tunnelType){
+    case _IP_TUNNEL_GENEVE_ENCAP:
+      return compileGeneve(&request->geneve, encap, error);
+    case _IP_TUNNEL_IPSEC_ENC:
+      return compileEsp(&request->ipsec, encap, error);
+    default:
+      error->tunnelError = _TUNNEL_NOT_SUPPORTED;
+      return encapReject(error, "Tunnel has no encapsulation");
+  }
+}
+
+/* the outer IP header of a template, total is the length of the whole packet */
+static void patchOuterIp(const opof_tunnel_encap_t *encap, uint8_t *ip, size_t total, uint32_t flowHash){
+  if (encap->ipver == _IPV6){
+    ip[1] = (flowHash >> 16) & 0x0f;
+    put16(ip + 2, flowHash & 0xffff);
+    put16(ip + 4, total - ENCAP_IPV6_HEADER);
+    return;
+  }
+  put16(ip + 2, total);
+  put16(ip + 10, csumFold(encap->ipSum + total));
+}
+
+/* the IP header a transport mode packet keeps, now followed by the template */
+static void patchTransportIp(const opof_tunnel_encap_t *encap, uint8_t *ip, size_t ipLength, size_t total){
+  if ((ip[0] >> 4) == 6){
+    ip[6] = encap->protocol;
+    put16(ip + 4, total - ENCAP_IPV6_HEADER);
+    return;
+  }
+  ip[9] = encap->protocol;
+  put16(ip + 2, total);
+  put16(ip + 10, 0);
+  put16(ip + 10, csumFold(csumPartial(ip, ipLength)));
+}
+
+static int encapGeneve(const opof_tunnel_encap_t *encap, const uint8_t *packet, size_t length, uint32_t flowHash,
+  uint8_t *out, size_t size, size_t *written){
+  size_t total = encap->length + length;
+  uint16_t sourcePort = ENCAP_SOURCE_PORT_BASE | (flowHash & ENCAP_SOURCE_PORT_MASK);
+  uint16_t etherType = 0;
+  uint16_t udpLength;
+  uint8_t *udp;
+
+  if (encap->innerEthernet){
+    switch (length > 0 ? packet[0] >> 4 : 0){
+      case 4:
+        etherType = 0x0800;
+        break;
+      case 6:
+        etherType = 0x86dd;
+        break;
+      default:
+        return _INVALID_ARGUMENT;
+    }
+  }
+  if (total > size || total > 0xffff){
+    return _RESOURCE_EXHAUSTED;
+  }
+  memcpy(out, encap->header, encap->length);
+  memcpy(out + encap->length, packet, length);
+  patchOuterIp(encap, out, total, flowHash);
+  udp = out + encap->udpOffset;
+  udpLength = total - encap->udpOffset;
+  put16(udp, sourcePort);
+  put16(udp + 4, udpLength);
+  if (encap->innerEthernet){
+    put16(out + encap->etherTypeOffset, etherType);
+  }
+  if (encap->udpChecksum){
+    uint16_t checksum = csumFold((uint64_t)encap->udpSum + 2 * udpLength + sourcePort + etherType +
+      csumPartial(packet, length));
+    put16(udp + 6, checksum == 0 ? 0xffff : checksum);
+  }
+  *written = total;
+  return _OK;
+}
+
+static int encapEsp(const opof_tunnel_encap_t *encap, const uint8_t *packet, size_t length, uint32_t flowHash,
+  uint64_t sequence, uint8_t *out, size_t size, size_t *written){
+  size_t ipLength = 0;
+  uint8_t nextHeader;
+  size_t payload, padding, total;
+  uint8_t *esp, *trailer;
+
+  switch (length > 0 ? packet[0] >> 4 : 0){
+    case 4:
+      if (length < ENCAP_IPV4_HEADER){
+        return _INVALID_ARGUMENT;
+      }
+      nextHeader = IPPROTO_IPIP;
+      if (encap->transport){
+        ipLength = (packet[0] & 0x0f) * 4;
+        nextHeader = packet[9];
+      }
+      break;
+    case 6:
+      if (length < ENCAP_IPV6_HEADER){
+        return _INVALID_ARGUMENT;
+      }
+      nextHeader = IPPROTO_IPV6;
+      if (encap->transport){
+        ipLength = ENCAP_IPV6_HEADER;
+        nextHeader = packet[6];
+        /* these extension headers have to stay ahead of ESP */
+        if (nextHeader == IPPROTO_HOPOPTS || nextHeader == IPPROTO_ROUTING || nextHeader == IPPROTO_FRAGMENT){
+          return _INVALID_ARGUMENT;
+        }
+      }
+      break;
+    default:
+      return _INVALID_ARGUMENT;
+  }
+  if (ipLength < (encap->transport ? ENCAP_IPV4_HEADER : 0) || ipLength > length){
+    return _INVALID_ARGUMENT;
+  }
+  payload = length - ipLength;
+  padding = (4 - (payload + 2) % 4) % 4;
+  total = ipLength + encap->length + payload + padding + 2 + encap->icvLength;
+  if (total > size || total > 0xffff){
+    return _RESOURCE_EXHAUSTED;
+  }
+  memcpy(out, packet, ipLength);
+  memcpy(out + ipLength, encap->header, encap->length);
+  memcpy(out + ipLength + encap->length, packet + ipLength, payload);
+  trailer = out + ipLength + encap->length + payload;
+  for (size_t i = 0; i < padding; i++){
+    trailer[i] = i + 1;
+  }
+  trailer[padding] = padding;
+  trailer[padding + 1] = nextHeader;
+  memset(trailer + padding + 2, 0, encap->icvLength);
+
+  esp = out + ipLength + encap->espOffset;
+  put32(esp + 4, sequence & 0xffffffff);
+  put32(esp + 8, sequence >> 32);
+  put32(esp + 12, sequence & 0xffffffff);
+  if (encap->udp){
+    put16(out + ipLength + encap->udpOffset + 4, total - ipLength - encap->udpOffset);
+  }
+  if (encap->transport){
+    patchTransportIp(encap, out, ipLength, total);
+  } else {
+    patchOuterIp(encap, out, total, flowHash);
+  }
+  *written = total;
+  return _OK;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Encapsulates one IP packet with a compiled template
+*
+* \param  encap     The template of the tunnel
+* \param  packet    The IPv4 or IPv6 packet
+* \param  length    The length of packet
+* \param  flowHash  The hash of the inner flow, for the UDP source port and IPv6 flow label
+* \param  sequence  The ESP sequence number, also used as IV, ignored for GENEVE
+* \param  out       The encapsulated packet, ESP left to be encrypted in place
+* \param  size      The room in out
+* \param  *written  The length of the encapsulated packet
+* \return _OK, _INVALID_ARGUMENT for a packet that is not IP and _RESOURCE_EXHAUSTED when out is too small
+*
+*/
+int opof_tunnel_encap(const opof_tunnel_encap_t *encap, const uint8_t *packet, size_t length, uint32_t flowHash,
+  uint64_t sequence, uint8_t *out, size_t size, size_t *written){
+  if (encap->esp){
+    return encapEsp(encap, packet, length, flowHash, sequence, out, size, written);
+  }
+  return encapGeneve(encap, packet, length, flowHash, out, size, written);
+}
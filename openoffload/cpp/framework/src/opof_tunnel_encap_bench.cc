@@ -0,0 +1,405 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Encapsulation rate of compiled tunnel templates
+*
+* Compiles random tunnels of four kinds, GENEVE over IPv4 with one option,
+* GENEVE over IPv6 with three options, ESP in tunnel mode over IPv4 and ESP
+* in transport mode, and encapsulates random inner IPv4 and IPv6 packets of
+* a fixed size with them. Each kind is timed once with the templates
+* compiled ahead, and once compiling the template for every packet, as a
+* path that builds the header from the tunnel for each packet would.
+*
+* A sample of the encapsulated packets is then parsed back, checking the
+* lengths, the IPv4 header and IPv6 UDP checksums against a byte by byte
+* sum, the GENEVE header and the ESP trailer, and that the inner packet is
+* intact. Any bad packet fails the run.
+*
+* Results are printed as JSON.
+*/
+extern "C" {
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_test.h"
+#include "opof_tunnel.h"
+#include "opof_tunnel_encap.h"
+}
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#define ENCAP_BENCH_KINDS 4
+#define ENCAP_BENCH_INNER 64
+#define ENCAP_BENCH_OUT 4096
+
+struct EncapBenchConfig {
+    unsigned long tunnels;
+    unsigned long packets;
+    unsigned int bytes;
+    unsigned long checks;
+    unsigned long seed;
+    std::string output;
+};
+
+struct EncapKind {
+    const char *name;
+    IP_TUNNEL_TYPE_T tunnelType;
+    IP_VERSION_T ipver;
+    int options;
+    IPSEC_TUNNEL_TYPE_T ipsecType;
+};
+
+static const EncapKind encapKinds[ENCAP_BENCH_KINDS] = {
+  {"geneveIpv4", _IP_TUNNEL_GENEVE_ENCAP, _IPV4, 1, _IPSEC_TUNNEL},
+  {"geneveIpv6", _IP_TUNNEL_GENEVE_ENCAP, _IPV6, 3, _IPSEC_TUNNEL},
+  {"espTunnel", _IP_TUNNEL_IPSEC_ENC, _IPV4, 0, _IPSEC_TUNNEL},
+  {"espTransport", _IP_TUNNEL_IPSEC_ENC, _IPV4, 0, _IPSEC_TRANSPORT},
+};
+
+struct KindResult {
+    double templateSeconds;
+    double rebuildSeconds;
+    uint64_t bytesOut;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+typedef std::mt19937_64 BenchRandom;
+
+static double secondsSince(BenchClock::time_point start) {
+  return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+static void randomBytes(BenchRandom &random, uint8_t *bytes, int length) {
+  for (int i = 0; i < length; i++){
+    bytes[i] = (uint8_t)random();
+  }
+}
+
+static void randomTunnel(BenchRandom &random, const EncapKind &kind, uint64_t tunnelId, ipTunnelRequest_t *request) {
+  tunnelIpPair_t *ips = kind.tunnelType == _IP_TUNNEL_GENEVE_ENCAP ? &request->geneve.outerIps : &request->ipsec.tunnelIps;
+
+  memset(request, 0, sizeof(*request));
+  request->tunnelId = tunnelId;
+  request->operation = _TUNNEL_CREATE;
+  request->tunnelType = kind.tunnelType;
+  ips->enable = true;
+  ips->ipver = kind.ipver;
+  randomBytes(random, (uint8_t *)&ips->sourceIp.s_addr, 4);
+  randomBytes(random, (uint8_t *)&ips->destinationIp.s_addr, 4);
+  randomBytes(random, ips->sourceIpv6.s6_addr, 16);
+  randomBytes(random, ips->destinationIpv6.s6_addr, 16);
+  if (kind.tunnelType == _IP_TUNNEL_GENEVE_ENCAP){
+    geneveEncap_t *geneve = &request->geneve;
+    geneve->innerMacPair.enable = true;
+    randomBytes(random, geneve->innerMacPair.sourceMac, 6);
+    randomBytes(random, geneve->innerMacPair.destinationMac, 6);
+    geneve->vni = random() & 0xffffff;
+    geneve->protocolType = 0x6558;
+    geneve->numberOptions = kind.options;
+    for (int i = 0; i < kind.options; i++){
+      geneveOption_t *option = &geneve->options[i];
+      option->optionClass = random() & 0xffff;
+      option->type = random() & 0x7f;
+      option->length = 1 + random() % 4;
+      option->dataLength = option->length * 4;
+      randomBytes(random, option->data, option->dataLength);
+    }
+    return;
+  }
+  request->ipsec.tunnelType = kind.ipsecType;
+  request->ipsec.encryptionType = (IPSEC_ENC_TYPE_T)(random() % 3);
+  request->ipsec.numberSAs = 1;
+  request->ipsec.sas[0].spi = 256 + (uint32_t)(random() & 0x7fffffff);
+  request->ipsec.sas[0].operation = _TUNNEL_CREATE;
+  request->ipsec.sas[0].keyLength = 32;
+  randomBytes(random, request->ipsec.sas[0].key, 32);
+}
+
+static void randomPacket(BenchRandom &random, std::vector<uint8_t> &packet, unsigned int bytes) {
+  packet.resize(bytes);
+  randomBytes(random, packet.data(), bytes);
+  if (random() % 4 == 0){
+    packet[0] = 0x60;
+    packet[4] = (bytes - 40) >> 8;
+    packet[5] = (bytes - 40) & 0xff;
+    packet[6] = IPPROTO_UDP;
+  } else {
+    packet[0] = 0x45;
+    packet[2] = bytes >> 8;
+    packet[3] = bytes & 0xff;
+    packet[9] = IPPROTO_UDP;
+  }
+}
+
+/* the reference sum, one 16 bit word at a time */
+static uint32_t wordSum(const uint8_t *data, size_t length) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i + 1 < length; i += 2){
+    sum += (data[i] << 8) | data[i + 1];
+  }
+  if (length % 2){
+    sum += data[length - 1] << 8;
+  }
+  return sum;
+}
+
+static uint16_t foldSum(uint32_t sum) {
+  while (sum >> 16){
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (uint16_t)sum;
+}
+
+static unsigned int get16(const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+/* parses an encapsulated packet back, returns an empty string when it is good */
+static std::string checkPacket(const ipTunnelRequest_t &request, const std::vector<uint8_t> &inner,
+                               const uint8_t *out, size_t length) {
+  bool transport = request.tunnelType == _IP_TUNNEL_IPSEC_ENC && request.ipsec.tunnelType == _IPSEC_TRANSPORT;
+  size_t ipLength, innerOffset;
+  const uint8_t *l4;
+  uint8_t protocol;
+
+  if ((out[0] >> 4) == 6){
+    ipLength = 40;
+    protocol = out[6];
+    if (get16(out + 4) != length - 40){
+      return "IPv6 payload length";
+    }
+  } else {
+    ipLength = (out[0] & 0x0f) * 4;
+    protocol = out[9];
+    if (get16(out + 2) != length){
+      return "IPv4 total length";
+    }
+    if (foldSum(wordSum(out, ipLength)) != 0xffff){
+      return "IPv4 header checksum";
+    }
+  }
+  l4 = out + ipLength;
+  if (request.tunnelType == _IP_TUNNEL_GENEVE_ENCAP){
+    size_t options = (l4[8] & 0x3f) * 4;
+    if (protocol != IPPROTO_UDP || get16(l4 + 2) != 6081 || get16(l4 + 4) != length - ipLength){
+      return "GENEVE UDP header";
+    }
+    if (get16(l4 + 10) != request.geneve.protocolType || (get16(l4 + 12) << 8 | l4[14]) != request.geneve.vni){
+      return "GENEVE header";
+    }
+    if ((out[0] >> 4) == 6){
+      uint32_t sum = wordSum(out + 8, 32) + IPPROTO_UDP + (length - ipLength) + wordSum(l4, length - ipLength);
+      if (foldSum(sum) != 0xffff){
+        return "IPv6 UDP checksum";
+      }
+    }
+    innerOffset = ipLength + 16 + options + 14;
+    if (memcmp(out + innerOffset - 14, request.geneve.innerMacPair.destinationMac, 6) != 0 ||
+        get16(out + innerOffset - 2) != ((inner[0] >> 4) == 6 ? 0x86dd : 0x0800)){
+      return "Inner Ethernet header";
+    }
+    if (innerOffset + inner.size() != length || memcmp(out + innerOffset, inner.data(), inner.size()) != 0){
+      return "Inner packet";
+    }
+    return "";
+  }
+
+  size_t icv = request.ipsec.encryptionType == _AES256GCM64 ? 8 : request.ipsec.encryptionType == _AES256GCM96 ? 12 : 16;
+  size_t innerIp = transport ? ((inner[0] >> 4) == 6 ? 40 : (inner[0] & 0x0f) * 4) : 0;
+  size_t payload = inner.size() - innerIp;
+  const uint8_t *trailer = l4 + 16 + payload;
+  uint8_t nextHeader = transport ? inner[(inner[0] >> 4) == 6 ? 6 : 9] : (inner[0] >> 4) == 6 ? IPPROTO_IPV6 : IPPROTO_IPIP;
+
+  if (protocol != IPPROTO_ESP || ((uint32_t)get16(l4) << 16 | get16(l4 + 2)) != request.ipsec.sas[0].spi){
+    return "ESP header";
+  }
+  if (memcmp(l4 + 16, inner.data() + innerIp, payload) != 0){
+    return "ESP payload";
+  }
+  size_t padding = (4 - (payload + 2) % 4) % 4;
+  if (trailer[padding] != padding || trailer[padding + 1] != nextHeader){
+    return "ESP trailer";
+  }
+  if (ipLength + 16 + payload + padding + 2 + icv != length){
+    return "ESP length";
+  }
+  if (transport && ((out[0] >> 4) == 6 ? memcmp(out + 8, inner.data() + 8, 32) : memcmp(out + 12, inner.data() + 12, 8)) != 0){
+    return "Transport addresses";
+  }
+  return "";
+}
+
+static void displayHelp(void) {
+  printf("\nCommand line arguments for the OpenOffload tunnel encapsulation benchmark version: %s \n", OPOF_VERSION);
+  printf("\t-n, --tunnels         Tunnels of each kind (default 1024)\n");
+  printf("\t-p, --packets         Packets encapsulated per kind and run (default 2000000)\n");
+  printf("\t-b, --bytes           Inner packet size (default 512)\n");
+  printf("\t-c, --checks          Packets parsed back per kind (default 10000)\n");
+  printf("\t-s, --seed            Random seed (default 1)\n");
+  printf("\t-o, --output          Write the JSON results to this file instead of stdout\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  EncapBenchConfig config = {1024, 2000000, 512, 10000, 1, ""};
+  static struct option longopts[] = {
+    {"tunnels", required_argument, NULL, 'n'},
+    {"packets", required_argument, NULL, 'p'},
+    {"bytes", required_argument, NULL, 'b'},
+    {"checks", required_argument, NULL, 'c'},
+    {"seed", required_argument, NULL, 's'},
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:p:b:c:s:o:h", longopts, NULL)) != -1){
+    switch (c){
+      case 'n':
+        config.tunnels = strtoul(optarg, NULL, 0);
+        break;
+      case 'p':
+        config.packets = strtoul(optarg, NULL, 0);
+        break;
+      case 'b':
+        config.bytes = strtoul(optarg, NULL, 0);
+        break;
+      case 'c':
+        config.checks = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        config.seed = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        config.output = optarg;
+        break;
+      case 'h':
+      default:
+        displayHelp();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  if (config.tunnels == 0 || config.bytes < 40 || config.bytes > ENCAP_BENCH_OUT - OPOF_TUNNEL_ENCAP_HEADER_MAX - OPOF_TUNNEL_ENCAP_TRAILER_MAX){
+    fprintf(stderr, "tunnels must be at least 1, bytes 40 to %d\n",
+            ENCAP_BENCH_OUT - OPOF_TUNNEL_ENCAP_HEADER_MAX - OPOF_TUNNEL_ENCAP_TRAILER_MAX);
+    return 1;
+  }
+
+  BenchRandom random(config.seed);
+  std::vector<std::vector<uint8_t> > inner(ENCAP_BENCH_INNER);
+  for (auto &packet : inner){
+    randomPacket(random, packet, config.bytes);
+  }
+  std::vector<uint8_t> out(ENCAP_BENCH_OUT);
+  std::vector<ipTunnelRequest_t> requests(config.tunnels);
+  std::vector<opof_tunnel_encap_t> encaps(config.tunnels);
+  KindResult results[ENCAP_BENCH_KINDS];
+  double compileSeconds = 0;
+  unsigned long badPackets = 0;
+  tunnelError_t error;
+  size_t written;
+
+  for (int k = 0; k < ENCAP_BENCH_KINDS; k++){
+    const EncapKind &kind = encapKinds[k];
+    for (unsigned long t = 0; t < config.tunnels; t++){
+      randomTunnel(random, kind, t + 1, &requests[t]);
+    }
+    BenchClock::time_point start = BenchClock::now();
+    for (unsigned long t = 0; t < config.tunnels; t++){
+      memset(&error, 0, sizeof(error));
+      if (opof_tunnel_encap_compile(&requests[t], &encaps[t], &error) != _OK){
+        fprintf(stderr, "Compiling a %s tunnel failed: %s\n", kind.name, error.errorString);
+        return 1;
+      }
+    }
+    compileSeconds += secondsSince(start);
+
+    std::vector<uint32_t> order(config.packets % 65536 + 65536);
+    for (auto &o : order){
+      o = (uint32_t)random();
+    }
+    uint64_t bytesOut = 0;
+    start = BenchClock::now();
+    for (unsigned long i = 0; i < config.packets; i++){
+      uint32_t r = order[i % order.size()];
+      const std::vector<uint8_t> &packet = inner[r % ENCAP_BENCH_INNER];
+      opof_tunnel_encap(&encaps[r % config.tunnels], packet.data(), packet.size(), r, i, out.data(), out.size(), &written);
+      bytesOut += written;
+    }
+    results[k].templateSeconds = secondsSince(start);
+    results[k].bytesOut = bytesOut;
+
+    opof_tunnel_encap_t rebuilt;
+    start = BenchClock::now();
+    for (unsigned long i = 0; i < config.packets; i++){
+      uint32_t r = order[i % order.size()];
+      const std::vector<uint8_t> &packet = inner[r % ENCAP_BENCH_INNER];
+      opof_tunnel_encap_compile(&requests[r % config.tunnels], &rebuilt, &error);
+      opof_tunnel_encap(&rebuilt, packet.data(), packet.size(), r, i, out.data(), out.size(), &written);
+    }
+    results[k].rebuildSeconds = secondsSince(start);
+
+    for (unsigned long i = 0; i < config.checks; i++){
+      uint32_t t = random() % config.tunnels;
+      const std::vector<uint8_t> &packet = inner[random() % ENCAP_BENCH_INNER];
+      std::string problem = "Encapsulation failed";
+      if (opof_tunnel_encap(&encaps[t], packet.data(), packet.size(), (uint32_t)random(), i, out.data(), out.size(),
+                            &written) == _OK){
+        problem = checkPacket(requests[t], packet, out.data(), written);
+      }
+      if (!problem.empty()){
+        if (badPackets++ < 10){
+          fprintf(stderr, "Bad %s packet on tunnel %u: %s\n", kind.name, t + 1, problem.c_str());
+        }
+      }
+    }
+  }
+
+  FILE *outFile = stdout;
+  if (!config.output.empty()){
+    outFile = fopen(config.output.c_str(), "w");
+    if (outFile == NULL){
+      fprintf(stderr, "Cannot write %s\n", config.output.c_str());
+      return 1;
+    }
+  }
+  fprintf(outFile, "{\n");
+  fprintf(outFile, "  \"config\": {\"tunnels\": %lu, \"packets\": %lu, \"bytes\": %u, \"checks\": %lu, \"seed\": %lu},\n",
+          config.tunnels, config.packets, config.bytes, config.checks, config.seed);
+  fprintf(outFile, "  \"compilesPerSecond\": %.0f,\n", ENCAP_BENCH_KINDS * config.tunnels / compileSeconds);
+  for (int k = 0; k < ENCAP_BENCH_KINDS; k++){
+    fprintf(outFile, "  \"%s\": {\"packetsPerSecond\": %.0f, \"rebuildPacketsPerSecond\": %.0f, \"gbitsPerSecond\": %.2f},\n",
+            encapKinds[k].name, config.packets / results[k].templateSeconds, config.packets / results[k].rebuildSeconds,
+            results[k].bytesOut * 8 / results[k].templateSeconds / 1e9);
+  }
+  fprintf(outFile, "  \"badPackets\": %lu\n", badPackets);
+  fprintf(outFile, "}\n");
+  if (outFile != stdout){
+    fclose(outFile);
+  }
+  return badPackets == 0 ? 0 : 1;
+}
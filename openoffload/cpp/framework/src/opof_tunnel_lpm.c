@@ -0,0 +1,1053 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Longest prefix match index of the tunnel MatchCriteria
+*
+* The IPv4 table is DIR-24-8: tbl24 has an entry for every /24 and tbl8
+* groups of 256 entries hold the last 8 bits below the /24s that have longer
+* prefixes. An entry has the valid bit, the depth of its prefix and the
+* index of the prefix in slots, or the extended bit and a tbl8 group. The
+* depth lets a prefix be added or removed in place: an add only overwrites
+* the entries of shorter prefixes, and a remove hands the entries of the
+* prefix back to its parent, the next shorter prefix covering it.
+*
+* The IPv6 table is a path compressed tree bitmap with a stride of 8 bits.
+* A node has a bitmap of the 255 prefixes of length 0 to 7 inside its 8 bits
+* and a bitmap of its 256 children, and keeps only the results and children
+* that are present, in bitmap order. A node with no prefixes and a single
+* child is not kept: the child holds the bytes skipped instead, so a lookup
+* costs one node per branch of the path rather than one per byte.
+*
+* Every prefix keeps its parent, so a lookup whose longest prefix has no
+* matching tunnel walks up the parents without another search. The match
+* keys of the tunnels are stored in their prefix so the walk stays on it.
+* The /0 prefixes stay out of the tables and are tried after the parents,
+* so a tunnel matching only a source prefix does not fill all of tbl24.
+*
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_tunnel_lpm.h"
+#include "uthash.h"
+
+#define LPM_ENTRY_VALID 0x80000000u
+#define LPM_ENTRY_EXT 0x40000000u
+#define LPM_DEPTH_SHIFT 22
+#define LPM_DEPTH_MASK 0xffu
+#define LPM_INDEX_MASK 0x3fffffu
+#define LPM_INDEX_LIMIT (LPM_INDEX_MASK + 1)
+#define LPM_TBL24_SIZE (1 << 24)
+#define LPM_TBL8_SIZE 256
+#define LPM_ADDRESS_MAX 16
+
+#define LPM_IPV4 0
+#define LPM_IPV6 1
+#define LPM_FAMILIES 2
+/* the family of a tunnel without ipMatch */
+#define LPM_ANY LPM_FAMILIES
+
+typedef struct lpm_prefix lpm_prefix_t;
+
+typedef struct lpm_dir24 {
+  uint32_t *tbl24;
+  uint32_t *tbl8;
+  uint32_t tbl8Count;
+  uint32_t tbl8Alloc;
+  uint32_t *freeTbl8;
+  uint32_t freeCount;
+} lpm_dir24_t;
+
+typedef struct tbm_node tbm_node_t;
+
+struct tbm_node {
+  uint64_t internal[4];
+  uint64_t external[4];
+  tbm_node_t *children;
+  uint32_t *results;
+  uint8_t skipLength;
+  uint8_t skip[LPM_ADDRESS_MAX - 1];
+};
+
+/* the fields of a MatchCriteria compared once the destination prefix matched */
+typedef struct lpm_match {
+  uint64_t tunnelId;
+  uint64_t matchTunnelId;
+  TUNNEL_MATCH_T matchType;
+  uint32_t key;
+  uint8_t sourceDepth;
+  uint8_t source[LPM_ADDRESS_MAX];
+} lpm_match_t;
+
+typedef struct lpm_prefix_key {
+  uint8_t family;
+  uint8_t depth;
+  uint8_t address[LPM_ADDRESS_MAX];
+} lpm_prefix_key_t;
+
+struct lpm_prefix {
+  lpm_prefix_key_t key;
+  uint32_t index;
+  lpm_prefix_t *parent;
+  int matchCount;
+  int matchAlloc;
+  lpm_match_t *matches;
+  UT_hash_handle hh;
+};
+
+typedef struct lpm_rule {
+  lpm_match_t match;
+  uint8_t family;
+  uint8_t destinationDepth;
+  uint8_t destination[LPM_ADDRESS_MAX];
+  lpm_prefix_t *prefix;
+  UT_hash_handle hh;
+} lpm_rule_t;
+
+struct opof_tunnel_lpm {
+  lpm_dir24_t ipv4;
+  tbm_node_t ipv6;
+  size_t ipv6Nodes;
+  lpm_prefix_t *prefixes;
+  lpm_prefix_t **slots;
+  uint32_t slotCount;
+  uint32_t slotAlloc;
+  uint32_t *freeSlots;
+  uint32_t freeSlotCount;
+  unsigned int depthCount[LPM_FAMILIES][LPM_ADDRESS_MAX * 8 + 1];
+  lpm_rule_t *rules;
+  lpm_prefix_t *defaults[LPM_FAMILIES];
+  lpm_prefix_t any;
+};
+
+static inline uint32_t leaf_entry(uint8_t depth, uint32_t index){
+  return LPM_ENTRY_VALID | ((uint32_t)depth << LPM_DEPTH_SHIFT) | index;
+}
+
+static inline uint8_t entry_depth(uint32_t entry){
+  return (entry >> LPM_DEPTH_SHIFT) & LPM_DEPTH_MASK;
+}
+
+static void mask_address(uint8_t *masked, const uint8_t *address, uint8_t depth){
+  memset(masked, 0, LPM_ADDRESS_MAX);
+  memcpy(masked, address, depth / 8);
+  if (depth % 8){
+    masked[depth / 8] = address[depth / 8] & (uint8_t)(0xff << (8 - depth % 8));
+  }
+}
+
+static inline bool prefix_matches(const uint8_t *prefix, const uint8_t *address, uint8_t depth){
+  int bytes = depth / 8;
+  int bits = depth % 8;
+
+  if (memcmp(prefix, address, bytes) != 0){
+    return false;
+  }
+  return bits == 0 || ((prefix[bytes] ^ address[bytes]) & (uint8_t)(0xff << (8 - bits))) == 0;
+}
+
+/*
+* Keeps the parents up to date for a prefix found inside an added or
+* removed prefix. An IPv4 prefix covered entirely by longer ones owns no
+* entry, so the walk goes up the parents of the prefix found to the one
+* directly inside the added or removed prefix: an add becomes its parent
+* when its parent is shorter, a remove hands it to its own parent.
+*/
+static void prefix_adopt(opof_tunnel_lpm_t *lpm, uint32_t entry, lpm_prefix_t *prefix, bool remove){
+  lpm_prefix_t *child = lpm->slots[entry & LPM_INDEX_MASK];
+
+  if (child == prefix){
+    return;
+  }
+  while (child->parent != NULL && child->parent != prefix && child->parent->key.depth > prefix->key.depth){
+    child = child->parent;
+  }
+  if (remove){
+    if (child->parent == prefix){
+      child->parent = prefix->parent;
+    }
+  } else if (child->parent == NULL || child->parent->key.depth < prefix->key.depth){
+    child->parent = prefix;
+  }
+}
+
+static inline uint32_t dir24_lookup(const lpm_dir24_t *dir24, const uint8_t *address){
+  uint32_t entry;
+
+  if (dir24->tbl24 == NULL){
+    return 0;
+  }
+  entry = dir24->tbl24[((uint32_t)address[0] << 16) | ((uint32_t)address[1] << 8) | address[2]];
+  if (entry & LPM_ENTRY_EXT){
+    entry = dir24->tbl8[(entry & LPM_INDEX_MASK) * LPM_TBL8_SIZE + address[3]];
+  }
+  return entry;
+}
+
+static int tbl8_alloc(lpm_dir24_t *dir24, uint32_t value, uint32_t *group){
+  uint32_t *entries;
+
+  if (dir24->freeCount > 0){
+    *group = dir24->freeTbl8[--dir24->freeCount];
+  } else {
+    if (dir24->tbl8Count == dir24->tbl8Alloc){
+      uint32_t alloc = dir24->tbl8Alloc ? dir24->tbl8Alloc * 2 : 64;
+      uint32_t *tbl8, *freeTbl8;
+      if (alloc > LPM_INDEX_LIMIT){
+        alloc = LPM_INDEX_LIMIT;
+      }
+      if (alloc == dir24->tbl8Alloc){
+        return _RESOURCE_EXHAUSTED;
+      }
+      tbl8 = (uint32_t *)realloc(dir24->tbl8, (size_t)alloc * LPM_TBL8_SIZE * sizeof(uint32_t));
+      if (tbl8 == NULL){
+        return _RESOURCE_EXHAUSTED;
+      }
+      dir24->tbl8 = tbl8;
+      freeTbl8 = (uint32_t *)realloc(dir24->freeTbl8, (size_t)alloc * sizeof(uint32_t));
+      if (freeTbl8 == NULL){
+        return _RESOURCE_EXHAUSTED;
+      }
+      dir24->freeTbl8 = freeTbl8;
+      dir24->tbl8Alloc = alloc;
+    }
+    *group = dir24->tbl8Count++;
+  }
+  entries = &dir24->tbl8[*group * LPM_TBL8_SIZE];
+  for (int i = 0; i < LPM_TBL8_SIZE; i++){
+    entries[i] = value;
+  }
+  return _OK;
+}
+
+/*
+* Applies an add or remove of prefix to an entry inside it, and to the tbl8
+* group below the entry.
+*/
+static void dir24_set(opof_tunnel_lpm_t *lpm, uint32_t *entry, lpm_prefix_t *prefix, uint32_t value, bool remove){
+  uint8_t depth = prefix->key.depth;
+
+  if (*entry & LPM_ENTRY_EXT){
+    uint32_t *group = &lpm->ipv4.tbl8[(*entry & LPM_INDEX_MASK) * LPM_TBL8_SIZE];
+    for (int i = 0; i < LPM_TBL8_SIZE; i++){
+      dir24_set(lpm, &group[i], prefix, value, remove);
+    }
+  } else if (!(*entry & LPM_ENTRY_VALID)){
+    if (!remove){
+      *entry = value;
+    }
+  } else if (entry_depth(*entry) > depth){
+    prefix_adopt(lpm, *entry, prefix, remove);
+  } else if (!remove || entry_depth(*entry) == depth){
+    *entry = value;
+  }
+}
+
+/*
+* Adds the prefix, or on remove gives its entries to the parent of the
+* prefix. A tbl8 group left with 256 equal entries is folded back into its
+* tbl24 entry.
+*/
+static int dir24_update(opof_tunnel_lpm_t *lpm, lpm_prefix_t *prefix, bool remove){
+  lpm_dir24_t *dir24 = &lpm->ipv4;
+  const uint8_t *address = prefix->key.address;
+  uint8_t depth = prefix->key.depth;
+  uint32_t index24 = ((uint32_t)address[0] << 16) | ((uint32_t)address[1] << 8) | address[2];
+  uint32_t value, span, start;
+  uint32_t *group;
+  bool uniform = true;
+
+  if (remove){
+    value = prefix->parent ? leaf_entry(prefix->parent->key.depth, prefix->parent->index) : 0;
+  } else {
+    value = leaf_entry(depth, prefix->index);
+  }
+  if (dir24->tbl24 == NULL){
+    if (remove){
+      return _OK;
+    }
+    dir24->tbl24 = (uint32_t *)calloc(LPM_TBL24_SIZE, sizeof(uint32_t));
+    if (dir24->tbl24 == NULL){
+      return _RESOURCE_EXHAUSTED;
+    }
+  }
+  if (depth <= 24){
+    span = 1u << (24 - depth);
+    start = index24 & ~(span - 1);
+    for (uint32_t i = 0; i < span; i++){
+      dir24_set(lpm, &dir24->tbl24[start + i], prefix, value, remove);
+    }
+    return _OK;
+  }
+  if (!(dir24->tbl24[index24] & LPM_ENTRY_EXT)){
+    uint32_t tbl8;
+    int status;
+    if (remove){
+      return _OK;
+    }
+    status = tbl8_alloc(dir24, dir24->tbl24[index24], &tbl8);
+    if (status != _OK){
+      return status;
+    }
+    dir24->tbl24[index24] = LPM_ENTRY_EXT | tbl8;
+  }
+  group = &dir24->tbl8[(dir24->tbl24[index24] & LPM_INDEX_MASK) * LPM_TBL8_SIZE];
+  span = 1u << (32 - depth);
+  start = address[3] & ~(span - 1);
+  for (uint32_t i = 0; i < span; i++){
+    dir24_set(lpm, &group[start + i], prefix, value, remove);
+  }
+  for (int i = 1; uniform && i < LPM_TBL8_SIZE; i++){
+    uniform = group[i] == group[0];
+  }
+  if (uniform){
+    dir24->freeTbl8[dir24->freeCount++] = dir24->tbl24[index24] & LPM_INDEX_MASK;
+    dir24->tbl24[index24] = group[0];
+  }
+  return _OK;
+}
+
+static inline bool bit_test(const uint64_t *map, int pos){
+  return (map[pos >> 6] >> (pos & 63)) & 1;
+}
+
+static inline void bit_flip(uint64_t *map, int pos){
+  map[pos >> 6] ^= 1ULL << (pos & 63);
+}
+
+/* the number of bits set below pos */
+static inline int bit_rank(const uint64_t *map, int pos){
+  int rank = 0;
+
+  for (int word = 0; word < (pos >> 6); word++){
+    rank += __builtin_popcountll(map[word]);
+  }
+  if (pos & 63){
+    rank += __builtin_popcountll(map[pos >> 6] & ((1ULL << (pos & 63)) - 1));
+  }
+  return rank;
+}
+
+static inline int bit_count(const uint64_t *map){
+  return __builtin_popcountll(map[0]) + __builtin_popcountll(map[1]) +
+         __builtin_popcountll(map[2]) + __builtin_popcountll(map[3]);
+}
+
+static inline bool bit_none(const uint64_t *map){
+  return (map[0] | map[1] | map[2] | map[3]) == 0;
+}
+
+/* the internal bitmap position of the first len bits of byte */
+static inline int tbm_position(int len, uint8_t byte){
+  return (1 << len) - 1 + (len ? byte >> (8 - len) : 0);
+}
+
+static inline uint32_t tbm_lookup(const tbm_node_t *node, const uint8_t *address){
+  uint32_t best = 0;
+  int level = 0;
+
+  for (;;){
+    uint8_t byte = level < LPM_ADDRESS_MAX ? address[level] : 0;
+    if (!bit_none(node->internal)){
+      for (int len = level < LPM_ADDRESS_MAX ? 7 : 0; len >= 0; len--){
+        int pos = tbm_position(len, byte);
+        if (bit_test(node->internal, pos)){
+          best = node->results[bit_rank(node->internal, pos)];
+          break;
+        }
+      }
+    }
+    if (level == LPM_ADDRESS_MAX || !bit_test(node->external, byte)){
+      return best;
+    }
+    node = &node->children[bit_rank(node->external, byte)];
+    level++;
+    if (node->skipLength){
+      if (memcmp(&address[level], node->skip, node->skipLength) != 0){
+        return best;
+      }
+      level += node->skipLength;
+    }
+  }
+}
+
+static tbm_node_t *tbm_add_child(opof_tunnel_lpm_t *lpm, tbm_node_t *node, uint8_t byte){
+  int count = bit_count(node->external);
+  int rank = bit_rank(node->external, byte);
+  tbm_node_t *children = (tbm_node_t *)realloc(node->children, (count + 1) * sizeof(tbm_node_t));
+
+  if (children == NULL){
+    return NULL;
+  }
+  memmove(&children[rank + 1], &children[rank], (count - rank) * sizeof(tbm_node_t));
+  memset(&children[rank], 0, sizeof(tbm_node_t));
+  node->children = children;
+  bit_flip(node->external, byte);
+  lpm->ipv6Nodes++;
+  return &children[rank];
+}
+
+/* a node without prefixes and with a single child is replaced by the child */
+static void tbm_merge(opof_tunnel_lpm_t *lpm, tbm_node_t *node){
+  tbm_node_t below;
+  int byte = 0;
+
+  if (!bit_none(node->internal) || bit_count(node->external) != 1){
+    return;
+  }
+  while (!bit_test(node->external, byte)){
+    byte++;
+  }
+  below = node->children[0];
+  free(node->children);
+  memmove(&below.skip[node->skipLength + 1], below.skip, below.skipLength);
+  memcpy(below.skip, node->skip, node->skipLength);
+  below.skip[node->skipLength] = byte;
+  below.skipLength += node->skipLength + 1;
+  *node = below;
+  lpm->ipv6Nodes--;
+}
+
+/*
+* Removes the prefix, drops the nodes it leaves empty and merges the ones
+* it leaves with a single child. Returns true when node is left empty.
+*/
+static bool tbm_remove(opof_tunnel_lpm_t *lpm, tbm_node_t *node, const uint8_t *address, uint8_t depth, int level){
+  int target = depth / 8;
+
+  if (level == target){
+    int pos = tbm_position(depth % 8, level < LPM_ADDRESS_MAX ? address[level] : 0);
+    if (bit_test(node->internal, pos)){
+      int rank = bit_rank(node->internal, pos);
+      int count = bit_count(node->internal);
+      memmove(&node->results[rank], &node->results[rank + 1], (count - rank - 1) * sizeof(uint32_t));
+      bit_flip(node->internal, pos);
+      if (count == 1){
+        free(node->results);
+        node->results = NULL;
+      }
+    }
+  } else if (level < target && bit_test(node->external, address[level])){
+    int rank = bit_rank(node->external, address[level]);
+    tbm_node_t *child = &node->children[rank];
+    int childLevel = level + 1 + child->skipLength;
+    if (childLevel <= target && memcmp(child->skip, &address[level + 1], child->skipLength) == 0){
+      if (tbm_remove(lpm, child, address, depth, childLevel)){
+        int count = bit_count(node->external);
+        memmove(&node->children[rank], &node->children[rank + 1], (count - rank - 1) * sizeof(tbm_node_t));
+        bit_flip(node->external, address[level]);
+        lpm->ipv6Nodes--;
+        if (count == 1){
+          free(node->children);
+          node->children = NULL;
+        }
+      } else {
+        tbm_merge(lpm, child);
+      }
+    }
+  }
+  return bit_none(node->internal) && bit_none(node->external);
+}
+
+static int tbm_insert(opof_tunnel_lpm_t *lpm, const uint8_t *address, uint8_t depth, uint32_t value){
+  tbm_node_t *node = &lpm->ipv6;
+  int target = depth / 8;
+  int level = 0;
+  int pos, rank;
+
+  while (level < target){
+    uint8_t byte = address[level];
+    tbm_node_t *child;
+    int common = 0;
+    if (!bit_test(node->external, byte)){
+      /* a new branch, its node goes straight to the level of the prefix */
+      child = tbm_add_child(lpm, node, byte);
+      if (child == NULL){
+        tbm_remove(lpm, &lpm->ipv6, address, depth, 0);
+        return _RESOURCE_EXHAUSTED;
+      }
+      child->skipLength = target - level - 1;
+      memcpy(child->skip, &address[level + 1], child->skipLength);
+      node = child;
+      break;
+    }
+    child = &node->children[bit_rank(node->external, byte)];
+    while (common < child->skipLength && level + 1 + common < target &&
+           child->skip[common] == address[level + 1 + common]){
+      common++;
+    }
+    if (common < child->skipLength){
+      /* the prefix ends or leaves inside the skipped bytes, split them */
+      tbm_node_t *below = (tbm_node_t *)malloc(sizeof(tbm_node_t));
+      if (below == NULL){
+        tbm_remove(lpm, &lpm->ipv6, address, depth, 0);
+        return _RESOURCE_EXHAUSTED;
+      }
+      *below = *child;
+      below->skipLength = child->skipLength - common - 1;
+      memmove(below->skip, &child->skip[common + 1], below->skipLength);
+      memset(child->internal, 0, sizeof(child->internal));
+      memset(child->external, 0, sizeof(child->external));
+      bit_flip(child->external, child->skip[common]);
+      child->children = below;
+      child->results = NULL;
+      child->skipLength = common;
+      lpm->ipv6Nodes++;
+    }
+    node = child;
+    level += 1 + common;
+  }
+  pos = tbm_position(depth % 8, target < LPM_ADDRESS_MAX ? address[target] : 0);
+  rank = bit_rank(node->internal, pos);
+  if (!bit_test(node->internal, pos)){
+    int count = bit_count(node->internal);
+    uint32_t *results = (uint32_t *)realloc(node->results, (count + 1) * sizeof(uint32_t));
+    if (results == NULL){
+      tbm_remove(lpm, &lpm->ipv6, address, depth, 0);
+      return _RESOURCE_EXHAUSTED;
+    }
+    memmove(&results[rank + 1], &results[rank], (count - rank) * sizeof(uint32_t));
+    node->results = results;
+    bit_flip(node->internal, pos);
+  }
+  node->results[rank] = value;
+  return _OK;
+}
+
+/* visits every prefix at or below node */
+static void tbm_walk(opof_tunnel_lpm_t *lpm, const tbm_node_t *node, lpm_prefix_t *prefix, bool remove){
+  int count = bit_count(node->internal);
+
+  for (int i = 0; i < count; i++){
+    prefix_adopt(lpm, node->results[i], prefix, remove);
+  }
+  count = bit_count(node->external);
+  for (int i = 0; i < count; i++){
+    tbm_walk(lpm, &node->children[i], prefix, remove);
+  }
+}
+
+/*
+* Visits the prefixes inside prefix, starting at node. The first level
+* bytes of path are the address bytes that lead to node.
+*/
+static void tbm_adopt(opof_tunnel_lpm_t *lpm, const tbm_node_t *node, int level, uint8_t *path,
+                      lpm_prefix_t *prefix, bool remove){
+  const uint8_t *address = prefix->key.address;
+  int depth = prefix->key.depth;
+  const tbm_node_t *child;
+  int len, bits;
+
+  if (level * 8 >= depth){
+    if (prefix_matches(address, path, depth)){
+      tbm_walk(lpm, node, prefix, remove);
+    }
+    return;
+  }
+  if (memcmp(address, path, level) != 0){
+    return;
+  }
+  len = depth - level * 8;
+  if (len < 8){
+    bits = address[level] >> (8 - len);
+    for (int longer = len + 1; longer < 8; longer++){
+      int first = (1 << longer) - 1 + (bits << (longer - len));
+      for (int pos = first; pos < first + (1 << (longer - len)); pos++){
+        if (bit_test(node->internal, pos)){
+          prefix_adopt(lpm, node->results[bit_rank(node->internal, pos)], prefix, remove);
+        }
+      }
+    }
+    for (int byte = bits << (8 - len); byte < (bits + 1) << (8 - len); byte++){
+      if (bit_test(node->external, byte)){
+        tbm_walk(lpm, &node->children[bit_rank(node->external, byte)], prefix, remove);
+      }
+    }
+    return;
+  }
+  if (!bit_test(node->external, address[level])){
+    return;
+  }
+  child = &node->children[bit_rank(node->external, address[level])];
+  path[level] = address[level];
+  memcpy(&path[level + 1], child->skip, child->skipLength);
+  tbm_adopt(lpm, child, level + 1 + child->skipLength, path, prefix, remove);
+}
+
+static void tbm_free(tbm_node_t *node){
+  int count = bit_count(node->external);
+
+  for (int i = 0; i < count; i++){
+    tbm_free(&node->children[i]);
+  }
+  free(node->children);
+  free(node->results);
+}
+
+/* 2 when the tunnel matches an SPI or VNI, 1 for any SPI, 0 without a tunnel header */
+static int match_keyed(const lpm_match_t *match){
+  if (match->matchType == _TUNNEL_MATCH_NONE){
+    return 0;
+  }
+  return match->matchType == _TUNNEL_MATCH_IPSEC && match->key == 0 ? 1 : 2;
+}
+
+static bool match_before(const lpm_match_t *a, const lpm_match_t *b){
+  if (a->sourceDepth != b->sourceDepth){
+    return a->sourceDepth > b->sourceDepth;
+  }
+  if (match_keyed(a) != match_keyed(b)){
+    return match_keyed(a) > match_keyed(b);
+  }
+  if ((a->matchTunnelId != 0) != (b->matchTunnelId != 0)){
+    return a->matchTunnelId != 0;
+  }
+  return a->tunnelId < b->tunnelId;
+}
+
+static inline bool match_flow(const lpm_match_t *match, const tunnelFlow_t *flow, const uint8_t *source){
+  if (match->matchType != _TUNNEL_MATCH_NONE){
+    if (flow->matchType != match->matchType){
+      return false;
+    }
+    if (match->matchType == _TUNNEL_MATCH_IPSEC){
+      if (match->key != 0 && match->key != flow->spi){
+        return false;
+      }
+    } else if (match->key != flow->vni){
+      return false;
+    }
+  }
+  if (match->matchTunnelId != 0 && match->matchTunnelId != flow->tunnelId){
+    return false;
+  }
+  return match->sourceDepth == 0 || prefix_matches(match->source, source, match->sourceDepth);
+}
+
+static inline const lpm_match_t *prefix_match(const lpm_prefix_t *prefix, const tunnelFlow_t *flow, const uint8_t *source){
+  for (int i = 0; i < prefix->matchCount; i++){
+    if (match_flow(&prefix->matches[i], flow, source)){
+      return &prefix->matches[i];
+    }
+  }
+  return NULL;
+}
+
+static int matches_insert(lpm_prefix_t *prefix, const lpm_match_t *match){
+  int pos;
+
+  if (prefix->matchCount == prefix->matchAlloc){
+    int alloc = prefix->matchAlloc ? prefix->matchAlloc * 2 : 1;
+    lpm_match_t *matches = (lpm_match_t *)realloc(prefix->matches, alloc * sizeof(lpm_match_t));
+    if (matches == NULL){
+      return _RESOURCE_EXHAUSTED;
+    }
+    prefix->matches = matches;
+    prefix->matchAlloc = alloc;
+  }
+  for (pos = prefix->matchCount; pos > 0 && match_before(match, &prefix->matches[pos - 1]); pos--){
+    prefix->matches[pos] = prefix->matches[pos - 1];
+  }
+  prefix->matches[pos] = *match;
+  prefix->matchCount++;
+  return _OK;
+}
+
+static void matches_remove(lpm_prefix_t *prefix, uint64_t tunnelId){
+  for (int i = 0; i < prefix->matchCount; i++){
+    if (prefix->matches[i].tunnelId == tunnelId){
+      memmove(&prefix->matches[i], &prefix->matches[i + 1], (prefix->matchCount - i - 1) * sizeof(lpm_match_t));
+      prefix->matchCount--;
+      return;
+    }
+  }
+}
+
+static void prefix_key(lpm_prefix_key_t *key, int family, const uint8_t *address, uint8_t depth){
+  memset(key, 0, sizeof(*key));
+  key->family = family;
+  key->depth = depth;
+  mask_address(key->address, address, depth);
+}
+
+static lpm_prefix_t *prefix_find(const opof_tunnel_lpm_t *lpm, int family, const uint8_t *address, uint8_t depth){
+  lpm_prefix_key_t key;
+  lpm_prefix_t *prefix = NULL;
+
+  prefix_key(&key, family, address, depth);
+  HASH_FIND(hh, lpm->prefixes, &key, sizeof(key), prefix);
+  return prefix;
+}
+
+static int slot_alloc(opof_tunnel_lpm_t *lpm, uint32_t *index){
+  if (lpm->freeSlotCount > 0){
+    *index = lpm->freeSlots[--lpm->freeSlotCount];
+    return _OK;
+  }
+  if (lpm->slotCount == lpm->slotAlloc){
+    uint32_t alloc = lpm->slotAlloc ? lpm->slotAlloc * 2 : 256;
+    lpm_prefix_t **slots;
+    uint32_t *freeSlots;
+    if (alloc > LPM_INDEX_LIMIT){
+      alloc = LPM_INDEX_LIMIT;
+    }
+    if (alloc == lpm->slotAlloc){
+      return _RESOURCE_EXHAUSTED;
+    }
+    slots = (lpm_prefix_t **)realloc(lpm->slots, alloc * sizeof(lpm_prefix_t *));
+    if (slots == NULL){
+      return _RESOURCE_EXHAUSTED;
+    }
+    lpm->slots = slots;
+    freeSlots = (uint32_t *)realloc(lpm->freeSlots, alloc * sizeof(uint32_t));
+    if (freeSlots == NULL){
+      return _RESOURCE_EXHAUSTED;
+    }
+    lpm->freeSlots = freeSlots;
+    lpm->slotAlloc = alloc;
+  }
+  *index = lpm->slotCount++;
+  return _OK;
+}
+
+static int prefix_get(opof_tunnel_lpm_t *lpm, int family, const uint8_t *address, uint8_t depth, lpm_prefix_t **found){
+  lpm_prefix_t *prefix = prefix_find(lpm, family, address, depth);
+  uint8_t path[LPM_ADDRESS_MAX];
+  uint32_t index;
+  int status;
+
+  if (prefix != NULL){
+    *found = prefix;
+    return _OK;
+  }
+  status = slot_alloc(lpm, &index);
+  if (status != _OK){
+    return status;
+  }
+  prefix = (lpm_prefix_t *)calloc(1, sizeof(lpm_prefix_t));
+  if (prefix == NULL){
+    lpm->freeSlots[lpm->freeSlotCount++] = index;
+    return _RESOURCE_EXHAUSTED;
+  }
+  prefix_key(&prefix->key, family, address, depth);
+  prefix->index = index;
+  for (int shorter = depth - 1; shorter > 0 && prefix->parent == NULL; shorter--){
+    if (lpm->depthCount[family][shorter] != 0){
+      prefix->parent = prefix_find(lpm, family, address, shorter);
+    }
+  }
+  lpm->slots[index] = prefix;
+  if (depth == 0){
+    lpm->defaults[family] = prefix;
+    status = _OK;
+  } else if (family == LPM_IPV4){
+    status = dir24_update(lpm, prefix, false);
+  } else {
+    status = tbm_insert(lpm, prefix->key.address, depth, leaf_entry(depth, index));
+    if (status == _OK){
+      tbm_adopt(lpm, &lpm->ipv6, 0, path, prefix, false);
+    }
+  }
+  if (status != _OK){
+    lpm->slots[index] = NULL;
+    lpm->freeSlots[lpm->freeSlotCount++] = index;
+    free(prefix);
+    return status;
+  }
+  lpm->depthCount[family][depth]++;
+  HASH_ADD(hh, lpm->prefixes, key, sizeof(lpm_prefix_key_t), prefix);
+  *found = prefix;
+  return _OK;
+}
+
+/* takes a prefix without tunnels out of the table, its children go to its parent */
+static void prefix_release(opof_tunnel_lpm_t *lpm, lpm_prefix_t *prefix){
+  uint8_t path[LPM_ADDRESS_MAX];
+  int family = prefix->key.family;
+
+  if (prefix->key.depth == 0){
+    lpm->defaults[family] = NULL;
+  } else if (family == LPM_IPV4){
+    dir24_update(lpm, prefix, true);
+  } else {
+    tbm_adopt(lpm, &lpm->ipv6, 0, path, prefix, true);
+    tbm_remove(lpm, &lpm->ipv6, prefix->key.address, prefix->key.depth, 0);
+  }
+  HASH_DEL(lpm->prefixes, prefix);
+  lpm->depthCount[family][prefix->key.depth]--;
+  lpm->slots[prefix->index] = NULL;
+  lpm->freeSlots[lpm->freeSlotCount++] = prefix->index;
+  free(prefix->matches);
+  free(prefix);
+}
+
+static int rule_from_match(lpm_rule_t *rule, uint64_t tunnelId, const tunnelMatch_t *match){
+  const tunnelIpMatch_t *ipMatch = &match->ipMatch;
+
+  memset(rule, 0, sizeof(*rule));
+  rule->match.tunnelId = tunnelId;
+  rule->match.matchTunnelId = match->tunnelId;
+  rule->match.matchType = match->matchType;
+  if (match->matchType == _TUNNEL_MATCH_IPSEC){
+    rule->match.key = match->spi;
+  } else if (match->matchType != _TUNNEL_MATCH_NONE){
+    rule->match.key = match->vni;
+  }
+  rule->family = LPM_ANY;
+  if (ipMatch->enable){
+    int family = ipMatch->ipver == _IPV6 ? LPM_IPV6 : LPM_IPV4;
+    int bits = family == LPM_IPV6 ? 128 : 32;
+    const uint8_t *source = family == LPM_IPV6 ? ipMatch->sourceIpv6.s6_addr : (const uint8_t *)&ipMatch->sourceIp.s_addr;
+    const uint8_t *destination = family == LPM_IPV6 ? ipMatch->destinationIpv6.s6_addr : (const uint8_t *)&ipMatch->destinationIp.s_addr;
+    if (ipMatch->sourceIpPrefix > bits || ipMatch->destinationIpPrefix > bits){
+      return _INVALID_ARGUMENT;
+    }
+    rule->family = family;
+    rule->match.sourceDepth = ipMatch->sourceIpPrefix;
+    rule->destinationDepth = ipMatch->destinationIpPrefix;
+    mask_address(rule->match.source, source, rule->match.sourceDepth);
+    mask_address(rule->destination, destination, rule->destinationDepth);
+  }
+  return _OK;
+}
+
+static int rule_attach(opof_tunnel_lpm_t *lpm, lpm_rule_t *rule){
+  lpm_prefix_t *prefix = &lpm->any;
+  int status;
+
+  if (rule->family != LPM_ANY){
+    status = prefix_get(lpm, rule->family, rule->destination, rule->destinationDepth, &prefix);
+    if (status != _OK){
+      return status;
+    }
+  }
+  status = matches_insert(prefix, &rule->match);
+  if (status != _OK){
+    if (prefix != &lpm->any && prefix->matchCount == 0){
+      prefix_release(lpm, prefix);
+    }
+    return status;
+  }
+  rule->prefix = prefix;
+  return _OK;
+}
+
+static void rule_detach(opof_tunnel_lpm_t *lpm, lpm_rule_t *rule){
+  lpm_prefix_t *prefix = rule->prefix;
+
+  if (prefix == NULL){
+    return;
+  }
+  matches_remove(prefix, rule->match.tunnelId);
+  if (prefix != &lpm->any && prefix->matchCount == 0){
+    prefix_release(lpm, prefix);
+  }
+  rule->prefix = NULL;
+}
+
+opof_tunnel_lpm_t *opof_tunnel_lpm_create(void){
+  return (opof_tunnel_lpm_t *)calloc(1, sizeof(opof_tunnel_lpm_t));
+}
+
+void opof_tunnel_lpm_destroy(opof_tunnel_lpm_t *lpm){
+  lpm_rule_t *rule, *tmpRule;
+  lpm_prefix_t *prefix, *tmpPrefix;
+
+  if (lpm == NULL){
+    return;
+  }
+  HASH_ITER(hh, lpm->rules, rule, tmpRule){
+    HASH_DEL(lpm->rules, rule);
+    free(rule);
+  }
+  HASH_ITER(hh, lpm->prefixes, prefix, tmpPrefix){
+    HASH_DEL(lpm->prefixes, prefix);
+    free(prefix->matches);
+    free(prefix);
+  }
+  free(lpm->ipv4.tbl24);
+  free(lpm->ipv4.tbl8);
+  free(lpm->ipv4.freeTbl8);
+  tbm_free(&lpm->ipv6);
+  free(lpm->any.matches);
+  free(lpm->slots);
+  free(lpm->freeSlots);
+  free(lpm);
+}
+
+/**
+* \ingroup servercinterface
+* \brief Adds the match of a tunnel to the index
+*
+* \param  lpm        The index
+* \param  tunnelId   The tunnel
+* \param  *match     The MatchCriteria of the tunnel
+* \return _OK, _ALREADY_EXISTS, _INVALID_ARGUMENT for a prefix longer than the
+*         address or _RESOURCE_EXHAUSTED
+*
+*/
+int opof_tunnel_lpm_add(opof_tunnel_lpm_t *lpm, uint64_t tunnelId, const tunnelMatch_t *match){
+  lpm_rule_t *rule = NULL;
+  int status;
+
+  HASH_FIND(hh, lpm->rules, &tunnelId, sizeof(uint64_t), rule);
+  if (rule != NULL){
+    return _ALREADY_EXISTS;
+  }
+  rule = (lpm_rule_t *)malloc(sizeof(lpm_rule_t));
+  if (rule == NULL){
+    return _RESOURCE_EXHAUSTED;
+  }
+  status = rule_from_match(rule, tunnelId, match);
+  if (status == _OK){
+    status = rule_attach(lpm, rule);
+  }
+  if (status != _OK){
+    free(rule);
+    return status;
+  }
+  HASH_ADD(hh, lpm->rules, match.tunnelId, sizeof(uint64_t), rule);
+  return _OK;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Replaces the match of a tunnel, the old match stays on failure
+*
+* \param  lpm        The index
+* \param  tunnelId   The tunnel
+* \param  *match     The new MatchCriteria of the tunnel
+* \return _OK, _NOT_FOUND, _INVALID_ARGUMENT or _RESOURCE_EXHAUSTED
+*
+*/
+int opof_tunnel_lpm_update(opof_tunnel_lpm_t *lpm, uint64_t tunnelId, const tunnelMatch_t *match){
+  lpm_rule_t *rule = NULL;
+  lpm_rule_t *next;
+  int status;
+
+  HASH_FIND(hh, lpm->rules, &tunnelId, sizeof(uint64_t), rule);
+  if (rule == NULL){
+    return _NOT_FOUND;
+  }
+  next = (lpm_rule_t *)malloc(sizeof(lpm_rule_t));
+  if (next == NULL){
+    return _RESOURCE_EXHAUSTED;
+  }
+  status = rule_from_match(next, tunnelId, match);
+  if (status != _OK){
+    free(next);
+    return status;
+  }
+  rule_detach(lpm, rule);
+  status = rule_attach(lpm, next);
+  if (status != _OK){
+    rule_attach(lpm, rule);
+    free(next);
+    return status;
+  }
+  HASH_DEL(lpm->rules, rule);
+  free(rule);
+  HASH_ADD(hh, lpm->rules, match.tunnelId, sizeof(uint64_t), next);
+  return _OK;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Removes a tunnel from the index
+*
+* \param  lpm        The index
+* \param  tunnelId   The tunnel
+* \return _OK or _NOT_FOUND
+*
+*/
+int opof_tunnel_lpm_remove(opof_tunnel_lpm_t *lpm, uint64_t tunnelId){
+  lpm_rule_t *rule = NULL;
+
+  HASH_FIND(hh, lpm->rules, &tunnelId, sizeof(uint64_t), rule);
+  if (rule == NULL){
+    return _NOT_FOUND;
+  }
+  rule_detach(lpm, rule);
+  HASH_DEL(lpm->rules, rule);
+  free(rule);
+  return _OK;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Finds the tunnel a packet maps to
+*
+* \param  lpm        The index
+* \param  *flow      The packet
+* \return The tunnelId, 0 when no tunnel matches
+*
+*/
+uint64_t opof_tunnel_lpm_lookup(const opof_tunnel_lpm_t *lpm, const tunnelFlow_t *flow){
+  bool ipv6 = flow->ipver == _IPV6;
+  const uint8_t *source = ipv6 ? flow->sourceIpv6.s6_addr : (const uint8_t *)&flow->sourceIp.s_addr;
+  const uint8_t *destination = ipv6 ? flow->destinationIpv6.s6_addr : (const uint8_t *)&flow->destinationIp.s_addr;
+  uint32_t entry = ipv6 ? tbm_lookup(&lpm->ipv6, destination) : dir24_lookup(&lpm->ipv4, destination);
+  const lpm_prefix_t *fallback = lpm->defaults[ipv6 ? LPM_IPV6 : LPM_IPV4];
+  const lpm_match_t *match;
+
+  if (entry & LPM_ENTRY_VALID){
+    /* when no tunnel of the longest prefix matches, try the shorter ones */
+    for (const lpm_prefix_t *prefix = lpm->slots[entry & LPM_INDEX_MASK]; prefix != NULL; prefix = prefix->parent){
+      match = prefix_match(prefix, flow, source);
+      if (match != NULL){
+        return match->tunnelId;
+      }
+    }
+  }
+  if (fallback != NULL){
+    match = prefix_match(fallback, flow, source);
+    if (match != NULL){
+      return match->tunnelId;
+    }
+  }
+  match = prefix_match(&lpm->any, flow, source);
+  return match != NULL ? match->tunnelId : 0;
+}
+
+unsigned long opof_tunnel_lpm_count(const opof_tunnel_lpm_t *lpm){
+  return HASH_COUNT(lpm->rules);
+}
+
+/**
+* \ingroup servercinterface
+* \brief The bytes allocated by the index
+*
+*/
+size_t opof_tunnel_lpm_memory(const opof_tunnel_lpm_t *lpm){
+  const lpm_prefix_t *prefix, *tmp;
+  size_t bytes = sizeof(*lpm);
+
+  if (lpm->ipv4.tbl24 != NULL){
+    bytes += (size_t)LPM_TBL24_SIZE * sizeof(uint32_t);
+  }
+  bytes += (size_t)lpm->ipv4.tbl8Alloc * (LPM_TBL8_SIZE + 1) * sizeof(uint32_t);
+  bytes += lpm->ipv6Nodes * sizeof(tbm_node_t);
+  bytes += lpm->slotAlloc * (sizeof(lpm_prefix_t *) + sizeof(uint32_t));
+  bytes += HASH_COUNT(lpm->rules) * sizeof(lpm_rule_t);
+  HASH_ITER(hh, lpm->prefixes, prefix, tmp){
+    bytes += sizeof(*prefix) + prefix->matchAlloc * sizeof(lpm_match_t);
+  }
+  return bytes;
+}
@@ -0,0 +1,503 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Lookup and update rate of the tunnel LPM index
+*
+* Fills an opof_tunnel_lpm index with random tunnels, by default 131072 of
+* which a quarter are IPv6, and measures the lookups per second of packets
+* that mostly fall inside a tunnel prefix, one in ten being random. The
+* destination prefixes are mostly /24 for IPv4 and /48 for IPv6 with some
+* shorter and longer ones down to /0, a fifth of the tunnels also match a source prefix,
+* and the tunnel header match is an SPI, a VNI or none.
+*
+* It then replaces the match of random tunnels, as an _UPDATE of
+* createIpTunnel would, and measures the updates per second. Last, a sample of
+* packets is looked up both in the index and by a linear scan of all tunnels,
+* and any difference is reported and fails the run. Random prefixes seldom
+* cover one another entirely, so nests of prefixes that do are also added
+* and removed in random orders on an index of their own, and checked the
+* same way after every change.
+*
+* Results are printed as JSON.
+*/
+extern "C" {
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_test.h"
+#include "opof_tunnel.h"
+#include "opof_tunnel_lpm.h"
+}
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#define LPM_BENCH_FLOWS (1 << 20)
+#define LPM_BENCH_NEST_TUNNELS 5
+#define LPM_BENCH_NEST_FLOWS 16
+
+struct LpmBenchConfig {
+    unsigned long tunnels;
+    unsigned int ipv6Percent;
+    unsigned long lookups;
+    unsigned long updates;
+    unsigned long checks;
+    unsigned long nests;
+    unsigned long seed;
+    std::string output;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+typedef std::mt19937_64 BenchRandom;
+
+static double secondsSince(BenchClock::time_point start) {
+  return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+static unsigned int pick(BenchRandom &random, unsigned int n) {
+  return (unsigned int)(random() % n);
+}
+
+static uint8_t *ipBytes(tunnelIpMatch_t *ipMatch, bool source) {
+  if (ipMatch->ipver == _IPV6){
+    return source ? ipMatch->sourceIpv6.s6_addr : ipMatch->destinationIpv6.s6_addr;
+  }
+  return (uint8_t *)(source ? &ipMatch->sourceIp.s_addr : &ipMatch->destinationIp.s_addr);
+}
+
+static uint8_t *flowBytes(tunnelFlow_t *flow, bool source) {
+  if (flow->ipver == _IPV6){
+    return source ? flow->sourceIpv6.s6_addr : flow->destinationIpv6.s6_addr;
+  }
+  return (uint8_t *)(source ? &flow->sourceIp.s_addr : &flow->destinationIp.s_addr);
+}
+
+static void randomBytes(BenchRandom &random, uint8_t *bytes, int length) {
+  for (int i = 0; i < length; i++){
+    bytes[i] = (uint8_t)random();
+  }
+}
+
+static bool inPrefix(const uint8_t *prefix, const uint8_t *address, int depth) {
+  for (int bit = 0; bit < depth; bit++){
+    uint8_t mask = 0x80 >> (bit % 8);
+    if ((prefix[bit / 8] & mask) != (address[bit / 8] & mask)){
+      return false;
+    }
+  }
+  return true;
+}
+
+/* keeps the first depth bits of prefix and takes the others from random */
+static void fillHost(BenchRandom &random, uint8_t *address, const uint8_t *prefix, int depth, int length) {
+  randomBytes(random, address, length);
+  for (int bit = 0; bit < depth; bit++){
+    uint8_t mask = 0x80 >> (bit % 8);
+    address[bit / 8] = (address[bit / 8] & ~mask) | (prefix[bit / 8] & mask);
+  }
+}
+
+static int destinationDepth(BenchRandom &random, bool ipv6) {
+  unsigned int p = pick(random, 100);
+  if (p == 0){
+    /* covers the /0 prefixes kept out of the tables */
+    return pick(random, 2) * 8;
+  }
+  if (ipv6){
+    return p < 50 ? 48 : p < 70 ? 56 + pick(random, 9) : p < 90 ? 32 + pick(random, 16) : 128;
+  }
+  return p < 60 ? 24 : p < 75 ? 16 + pick(random, 8) : p < 90 ? 25 + pick(random, 7) : 32;
+}
+
+static void randomMatch(BenchRandom &random, const LpmBenchConfig &config, uint64_t tunnelId, tunnelMatch_t *match) {
+  tunnelIpMatch_t *ipMatch = &match->ipMatch;
+  unsigned int p;
+
+  memset(match, 0, sizeof(*match));
+  /* a few tunnels match on the tunnel header only */
+  ipMatch->enable = pick(random, 1000) != 0;
+  ipMatch->ipver = pick(random, 100) < config.ipv6Percent ? _IPV6 : _IPV4;
+  int length = ipMatch->ipver == _IPV6 ? 16 : 4;
+  ipMatch->destinationIpPrefix = destinationDepth(random, ipMatch->ipver == _IPV6);
+  randomBytes(random, ipBytes(ipMatch, false), length);
+  if (pick(random, 5) == 0){
+    ipMatch->sourceIpPrefix = length * 4 + pick(random, length * 4 + 1);
+    randomBytes(random, ipBytes(ipMatch, true), length);
+  }
+  p = pick(random, 10);
+  if (p < 5){
+    match->matchType = _TUNNEL_MATCH_IPSEC;
+    match->spi = 256 + (uint32_t)pick(random, 0x7fffffff);
+  } else if (p < 9){
+    match->matchType = _TUNNEL_MATCH_GENEVE;
+    match->vni = pick(random, 1 << 24);
+  }
+  if (tunnelId > 1 && pick(random, 20) == 0){
+    match->tunnelId = 1 + pick(random, tunnelId - 1);
+  }
+}
+
+/*
+* A packet inside the match of the tunnel, or a random one for no tunnel.
+*/
+static void randomFlow(BenchRandom &random, const tunnelMatch_t *match, bool ipv6, tunnelFlow_t *flow) {
+  memset(flow, 0, sizeof(*flow));
+  flow->ipver = ipv6 ? _IPV6 : _IPV4;
+  int length = ipv6 ? 16 : 4;
+  if (match == NULL){
+    randomBytes(random, flowBytes(flow, false), length);
+    randomBytes(random, flowBytes(flow, true), length);
+    flow->matchType = pick(random, 2) ? _TUNNEL_MATCH_IPSEC : _TUNNEL_MATCH_GENEVE;
+    flow->spi = (uint32_t)random();
+    flow->vni = pick(random, 1 << 24);
+    return;
+  }
+  tunnelIpMatch_t ipMatch = match->ipMatch;
+  fillHost(random, flowBytes(flow, false), ipBytes(&ipMatch, false),
+           ipMatch.enable ? ipMatch.destinationIpPrefix : 0, length);
+  fillHost(random, flowBytes(flow, true), ipBytes(&ipMatch, true),
+           ipMatch.enable ? ipMatch.sourceIpPrefix : 0, length);
+  flow->matchType = match->matchType;
+  flow->spi = match->spi;
+  flow->vni = match->vni;
+  flow->tunnelId = match->tunnelId;
+}
+
+/*
+* The tunnel a linear scan picks, ranked as opof_tunnel_lpm.h documents it,
+* among those present when present is not NULL.
+*/
+static uint64_t scanTunnels(const std::vector<tunnelMatch_t> &matches, tunnelFlow_t *flow,
+                            const std::vector<bool> *present = NULL) {
+  uint64_t best = 0;
+  int bestRank[5] = {0};
+
+  for (size_t i = 1; i < matches.size(); i++){
+    if (present != NULL && !(*present)[i]){
+      continue;
+    }
+    tunnelMatch_t match = matches[i];
+    tunnelIpMatch_t *ipMatch = &match.ipMatch;
+    if (ipMatch->enable){
+      if (ipMatch->ipver != flow->ipver ||
+          !inPrefix(ipBytes(ipMatch, false), flowBytes(flow, false), ipMatch->destinationIpPrefix) ||
+          !inPrefix(ipBytes(ipMatch, true), flowBytes(flow, true), ipMatch->sourceIpPrefix)){
+        continue;
+      }
+    }
+    if (match.matchType != _TUNNEL_MATCH_NONE &&
+        (match.matchType != flow->matchType ||
+         (match.matchType == _TUNNEL_MATCH_IPSEC && match.spi != 0 && match.spi != flow->spi) ||
+         (match.matchType != _TUNNEL_MATCH_IPSEC && match.vni != flow->vni))){
+      continue;
+    }
+    if (match.tunnelId != 0 && match.tunnelId != flow->tunnelId){
+      continue;
+    }
+    int keyed = match.matchType == _TUNNEL_MATCH_NONE ? 0 :
+                (match.matchType == _TUNNEL_MATCH_IPSEC && match.spi == 0) ? 1 : 2;
+    int rank[5] = {ipMatch->enable, ipMatch->enable ? ipMatch->destinationIpPrefix : 0,
+                   ipMatch->enable ? ipMatch->sourceIpPrefix : 0, keyed, match.tunnelId != 0};
+    /* equal ranks go to the lowest tunnelId, the first one scanned */
+    if (best == 0 || std::lexicographical_compare(bestRank, bestRank + 5, rank, rank + 5)){
+      best = i;
+      memcpy(bestRank, rank, sizeof(rank));
+    }
+  }
+  return best;
+}
+
+/* the packets inside a nest, with the SPIs of its tunnels and one of none */
+static unsigned long checkNest(BenchRandom &random, opof_tunnel_lpm_t *lpm, const std::vector<tunnelMatch_t> &matches,
+                               const std::vector<bool> &present) {
+  static const uint32_t spis[] = {100, 200, 300, 400};
+  unsigned long mismatches = 0;
+
+  for (int i = 0; i < LPM_BENCH_NEST_FLOWS; i++){
+    tunnelFlow_t flow;
+    /* inside the middle prefix, or the outer one */
+    const tunnelMatch_t *match = &matches[1 + pick(random, 2)];
+    randomFlow(random, match, match->ipMatch.ipver == _IPV6, &flow);
+    flow.spi = spis[pick(random, 4)];
+    uint64_t expected = scanTunnels(matches, &flow, &present);
+    uint64_t found = opof_tunnel_lpm_lookup(lpm, &flow);
+    if (found != expected){
+      if (mismatches++ < 10){
+        fprintf(stderr, "Nested prefixes: index found tunnel %lu, linear scan %lu\n",
+                (unsigned long)found, (unsigned long)expected);
+      }
+    }
+  }
+  return mismatches;
+}
+
+/*
+* Builds nests of tunnels: an outer prefix, a middle one inside it, the two
+* halves of the middle one that cover it entirely and a quarter inside the
+* first half, each matching one of a few SPIs or any SPI so that lookups
+* fall back to covered prefixes. The tunnels of a nest are added and then
+* removed in random orders, and checked after every change.
+*/
+static unsigned long checkNests(BenchRandom &random, opof_tunnel_lpm_t *lpm, unsigned long nests) {
+  unsigned long mismatches = 0;
+
+  for (unsigned long n = 0; n < nests; n++){
+    bool ipv6 = pick(random, 4) == 0;
+    int middle = ipv6 ? 40 + pick(random, 86) : 17 + pick(random, 13);
+    int depths[LPM_BENCH_NEST_TUNNELS] = {8 + (int)pick(random, middle - 8), middle, middle + 1, middle + 1, middle + 2};
+    uint8_t base[16];
+    /* indexed by tunnelId as in main, 0 is no tunnel */
+    std::vector<tunnelMatch_t> matches(LPM_BENCH_NEST_TUNNELS + 1);
+    std::vector<bool> present(LPM_BENCH_NEST_TUNNELS + 1, false);
+    std::vector<uint64_t> order;
+
+    randomBytes(random, base, sizeof(base));
+    for (int i = 0; i < LPM_BENCH_NEST_TUNNELS; i++){
+      tunnelMatch_t &match = matches[i + 1];
+      memset(&match, 0, sizeof(match));
+      match.ipMatch.enable = true;
+      match.ipMatch.ipver = ipv6 ? _IPV6 : _IPV4;
+      match.ipMatch.destinationIpPrefix = depths[i];
+      uint8_t *address = ipBytes(&match.ipMatch, false);
+      memcpy(address, base, ipv6 ? 16 : 4);
+      if (i == 3){
+        /* the second half */
+        address[middle / 8] ^= 0x80 >> (middle % 8);
+      }
+      match.matchType = _TUNNEL_MATCH_IPSEC;
+      match.spi = pick(random, 4) * 100;
+      order.push_back(i + 1);
+    }
+    std::shuffle(order.begin(), order.end(), random);
+    for (uint64_t tunnelId : order){
+      if (opof_tunnel_lpm_add(lpm, tunnelId, &matches[tunnelId]) != _OK){
+        fprintf(stderr, "Adding nested tunnel %lu failed\n", (unsigned long)tunnelId);
+        return mismatches + 1;
+      }
+      present[tunnelId] = true;
+      mismatches += checkNest(random, lpm, matches, present);
+    }
+    std::shuffle(order.begin(), order.end(), random);
+    for (uint64_t tunnelId : order){
+      opof_tunnel_lpm_remove(lpm, tunnelId);
+      present[tunnelId] = false;
+      mismatches += checkNest(random, lpm, matches, present);
+    }
+  }
+  return mismatches;
+}
+
+struct LookupResult {
+    unsigned long lookups;
+    unsigned long hits;
+    double seconds;
+};
+
+static LookupResult measureLookups(opof_tunnel_lpm_t *lpm, const std::vector<tunnelFlow_t> &flows, unsigned long lookups) {
+  LookupResult result = {lookups, 0, 0.0};
+  uint64_t sum = 0;
+
+  BenchClock::time_point start = BenchClock::now();
+  for (unsigned long i = 0; i < lookups; i++){
+    uint64_t tunnelId = opof_tunnel_lpm_lookup(lpm, &flows[i & (LPM_BENCH_FLOWS - 1)]);
+    result.hits += tunnelId != 0;
+    sum += tunnelId;
+  }
+  result.seconds = secondsSince(start);
+  /* keeps the lookups from being optimized away */
+  if (sum == 1){
+    fprintf(stderr, " ");
+  }
+  return result;
+}
+
+static void printLookups(FILE *out, const char *name, const LookupResult &result, bool last) {
+  fprintf(out, "    \"%s\": {\"lookups\": %lu, \"hits\": %lu, \"lookupsPerSecond\": %.0f, \"nanosPerLookup\": %.1f}%s\n",
+          name, result.lookups, result.hits, result.lookups / result.seconds,
+          result.seconds * 1e9 / result.lookups, last ? "" : ",");
+}
+
+static void displayHelp(void) {
+  printf("\nCommand line arguments for the OpenOffload tunnel LPM benchmark version: %s \n", OPOF_VERSION);
+  printf("\t-n, --tunnels         Tunnels in the index (default 131072)\n");
+  printf("\t-6, --ipv6            Percent of IPv6 tunnels (default 25)\n");
+  printf("\t-l, --lookups         Lookups per address family (default 20000000)\n");
+  printf("\t-u, --updates         Match updates (default 100000)\n");
+  printf("\t-c, --check           Packets checked against a linear scan (default 1000)\n");
+  printf("\t-e, --nests           Nests of covered prefixes checked against a linear scan (default 1000)\n");
+  printf("\t-s, --seed            Random seed (default 1)\n");
+  printf("\t-o, --output          Write the JSON results to this file instead of stdout\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  LpmBenchConfig config = {131072, 25, 20000000, 100000, 1000, 1000, 1, ""};
+  static struct option longopts[] = {
+    {"tunnels", required_argument, NULL, 'n'},
+    {"ipv6", required_argument, NULL, '6'},
+    {"lookups", required_argument, NULL, 'l'},
+    {"updates", required_argument, NULL, 'u'},
+    {"check", required_argument, NULL, 'c'},
+    {"nests", required_argument, NULL, 'e'},
+    {"seed", required_argument, NULL, 's'},
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:6:l:u:c:e:s:o:h", longopts, NULL)) != -1){
+    switch (c){
+      case 'n':
+        config.tunnels = strtoul(optarg, NULL, 0);
+        break;
+      case '6':
+        config.ipv6Percent = strtoul(optarg, NULL, 0);
+        break;
+      case 'l':
+        config.lookups = strtoul(optarg, NULL, 0);
+        break;
+      case 'u':
+        config.updates = strtoul(optarg, NULL, 0);
+        break;
+      case 'c':
+        config.checks = strtoul(optarg, NULL, 0);
+        break;
+      case 'e':
+        config.nests = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        config.seed = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        config.output = optarg;
+        break;
+      case 'h':
+      default:
+        displayHelp();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  if (config.tunnels == 0 || config.ipv6Percent > 100){
+    fprintf(stderr, "tunnels must be at least 1, ipv6 0 to 100\n");
+    return 1;
+  }
+
+  BenchRandom random(config.seed);
+  opof_tunnel_lpm_t *lpm = opof_tunnel_lpm_create();
+  /* indexed by tunnelId, 0 is no tunnel */
+  std::vector<tunnelMatch_t> matches(config.tunnels + 1);
+
+  for (uint64_t tunnelId = 1; tunnelId <= config.tunnels; tunnelId++){
+    randomMatch(random, config, tunnelId, &matches[tunnelId]);
+  }
+  BenchClock::time_point start = BenchClock::now();
+  for (uint64_t tunnelId = 1; tunnelId <= config.tunnels; tunnelId++){
+    int status = opof_tunnel_lpm_add(lpm, tunnelId, &matches[tunnelId]);
+    if (status != _OK){
+      fprintf(stderr, "Adding tunnel %lu failed: %d\n", (unsigned long)tunnelId, status);
+      return 1;
+    }
+  }
+  double addSeconds = secondsSince(start);
+
+  std::vector<tunnelFlow_t> flows[2];
+  for (int family = 0; family < 2; family++){
+    flows[family].resize(LPM_BENCH_FLOWS);
+    for (size_t i = 0; i < flows[family].size(); i++){
+      const tunnelMatch_t *match = NULL;
+      if (pick(random, 10) != 0){
+        /* a tunnel of the family, or one without ipMatch */
+        for (int tries = 0; tries < 64 && match == NULL; tries++){
+          const tunnelMatch_t *candidate = &matches[1 + pick(random, config.tunnels)];
+          if (!candidate->ipMatch.enable || candidate->ipMatch.ipver == (family ? _IPV6 : _IPV4)){
+            match = candidate;
+          }
+        }
+      }
+      randomFlow(random, match, family == 1, &flows[family][i]);
+    }
+  }
+  LookupResult ipv4 = measureLookups(lpm, flows[0], config.lookups);
+  LookupResult ipv6 = measureLookups(lpm, flows[1], config.lookups);
+
+  start = BenchClock::now();
+  for (unsigned long i = 0; i < config.updates; i++){
+    uint64_t tunnelId = 1 + pick(random, config.tunnels);
+    randomMatch(random, config, tunnelId, &matches[tunnelId]);
+    int status = opof_tunnel_lpm_update(lpm, tunnelId, &matches[tunnelId]);
+    if (status != _OK){
+      fprintf(stderr, "Updating tunnel %lu failed: %d\n", (unsigned long)tunnelId, status);
+      return 1;
+    }
+  }
+  double updateSeconds = secondsSince(start);
+
+  unsigned long mismatches = 0;
+  for (unsigned long i = 0; i < config.checks; i++){
+    tunnelFlow_t flow;
+    const tunnelMatch_t *match = pick(random, 10) ? &matches[1 + pick(random, config.tunnels)] : NULL;
+    bool ipv6Flow = match != NULL && match->ipMatch.enable ? match->ipMatch.ipver == _IPV6 : pick(random, 2) == 1;
+    randomFlow(random, match, ipv6Flow, &flow);
+    uint64_t expected = scanTunnels(matches, &flow);
+    uint64_t found = opof_tunnel_lpm_lookup(lpm, &flow);
+    if (found != expected){
+      if (mismatches++ < 10){
+        fprintf(stderr, "Packet %lu: index found tunnel %lu, linear scan %lu\n", i,
+                (unsigned long)found, (unsigned long)expected);
+      }
+    }
+  }
+  opof_tunnel_lpm_t *nestLpm = opof_tunnel_lpm_create();
+  mismatches += checkNests(random, nestLpm, config.nests);
+  opof_tunnel_lpm_destroy(nestLpm);
+
+  FILE *out = stdout;
+  if (!config.output.empty()){
+    out = fopen(config.output.c_str(), "w");
+    if (out == NULL){
+      fprintf(stderr, "Cannot write %s\n", config.output.c_str());
+      return 1;
+    }
+  }
+  fprintf(out, "{\n");
+  fprintf(out, "  \"config\": {\"tunnels\": %lu, \"ipv6Percent\": %u, \"lookups\": %lu, \"updates\": %lu, "
+          "\"checks\": %lu, \"nests\": %lu, \"seed\": %lu},\n", config.tunnels, config.ipv6Percent, config.lookups,
+          config.updates, config.checks, config.nests, config.seed);
+  fprintf(out, "  \"memoryBytes\": %zu,\n", opof_tunnel_lpm_memory(lpm));
+  fprintf(out, "  \"addsPerSecond\": %.0f,\n", config.tunnels / addSeconds);
+  fprintf(out, "  \"lookups\": {\n");
+  printLookups(out, "ipv4", ipv4, false);
+  printLookups(out, "ipv6", ipv6, true);
+  fprintf(out, "  },\n");
+  fprintf(out, "  \"updatesPerSecond\": %.0f,\n", config.updates ? config.updates / updateSeconds : 0.0);
+  fprintf(out, "  \"mismatches\": %lu\n", mismatches);
+  fprintf(out, "}\n");
+  if (out != stdout){
+    fclose(out);
+  }
+  opof_tunnel_lpm_destroy(lpm);
+  return mismatches == 0 ? 0 : 1;
+}
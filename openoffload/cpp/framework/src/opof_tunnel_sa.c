@@ -0,0 +1,634 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief IPsec SA table keyed by SPI, with RCU style readers
+*
+* Both the SPI table and the tunnel table are chained hash tables whose
+* chains readers follow without a lock. A writer links a new entry at the
+* head of its chain with a release store, and unlinks one by pointing its
+* predecessor past it, leaving the next pointer of the entry intact for a
+* reader still on it. A rekey of an SPI links the new SA ahead of the old
+* one, so the new key is found first before the old SA goes.
+*
+* Reclaim is epoch based. A reader stores the global epoch in its slot on
+* entry to a read section and clears it on exit. A writer tags what it
+* unlinked with the epoch, then advances it, and frees an entry once every
+* busy slot holds a later epoch, as those readers started after the unlink.
+*
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "opof.h"
+#include "opof_tunnel_sa.h"
+
+#define SA_RETIRED_SA 0
+#define SA_RETIRED_SET 1
+#define SA_RETIRED_TUNNEL 2
+
+typedef struct sa_link sa_link_t;
+
+struct sa_link {
+  uint64_t key;
+  sa_link_t *next;
+};
+
+typedef struct sa_hash {
+  int shift;
+  sa_link_t **buckets;
+} sa_hash_t;
+
+typedef struct sa_retired sa_retired_t;
+
+struct sa_retired {
+  sa_retired_t *next;
+  uint64_t epoch;
+  int kind;
+  void *object;
+};
+
+typedef struct sa_tunnel sa_tunnel_t;
+
+typedef struct sa_node {
+  sa_link_t link;
+  opof_tunnel_sa_t sa;
+  sa_tunnel_t *tunnel;
+  /* the counters already added to the tunnel's retired counters */
+  uint64_t foldedPackets;
+  uint64_t foldedBytes;
+  sa_retired_t retired;
+} sa_node_t;
+
+typedef struct sa_set {
+  int count;
+  sa_node_t *sas[TUNNEL_IPSEC_SAS_MAX];
+  sa_retired_t retired;
+} sa_set_t;
+
+struct sa_tunnel {
+  sa_link_t link;
+  sa_set_t *set;
+  uint64_t retiredPackets;
+  uint64_t retiredBytes;
+  /* odd while the set and the retired counters change together */
+  uint32_t statsSeq;
+  sa_retired_t retired;
+};
+
+/* one cache line per reader, so readers do not share lines */
+typedef struct sa_reader {
+  uint64_t epoch;
+  int used;
+} __attribute__((aligned(64))) sa_reader_t;
+
+/* an SA of the set being built by opof_tunnel_sa_apply */
+typedef struct sa_work {
+  uint32_t spi;
+  const uint8_t *key;
+  uint8_t keyLength;
+  sa_node_t *node;
+} sa_work_t;
+
+struct opof_tunnel_sa_table {
+  pthread_mutex_t writerLock;
+  sa_hash_t spis;
+  sa_hash_t tunnels;
+  unsigned long count;
+  uint64_t epoch;
+  sa_retired_t *retired;
+  sa_retired_t **retiredTail;
+  sa_retired_t *pending;
+  sa_reader_t readers[OPOF_TUNNEL_SA_READERS_MAX];
+};
+
+static int hash_init(sa_hash_t *hash, unsigned long capacity){
+  int bits = 6;
+
+  while ((1UL << bits) < capacity && bits < 30){
+    bits++;
+  }
+  hash->shift = 64 - bits;
+  hash->buckets = (sa_link_t **)calloc(1UL << bits, sizeof(sa_link_t *));
+  return hash->buckets != NULL ? _OK : _RESOURCE_EXHAUSTED;
+}
+
+static inline sa_link_t **hash_bucket(const sa_hash_t *hash, uint64_t key){
+  return &hash->buckets[(key * 0x9e3779b97f4a7c15ULL) >> hash->shift];
+}
+
+static inline sa_link_t *hash_find(const sa_hash_t *hash, uint64_t key){
+  sa_link_t *link = __atomic_load_n(hash_bucket(hash, key), __ATOMIC_ACQUIRE);
+
+  while (link != NULL && link->key != key){
+    link = __atomic_load_n(&link->next, __ATOMIC_ACQUIRE);
+  }
+  return link;
+}
+
+static void hash_insert(sa_hash_t *hash, sa_link_t *link){
+  sa_link_t **bucket = hash_bucket(hash, link->key);
+
+  link->next = *bucket;
+  __atomic_store_n(bucket, link, __ATOMIC_RELEASE);
+}
+
+static void hash_unlink(sa_hash_t *hash, sa_link_t *link){
+  sa_link_t **prev = hash_bucket(hash, link->key);
+
+  while (*prev != link){
+    prev = &(*prev)->next;
+  }
+  __atomic_store_n(prev, link->next, __ATOMIC_RELEASE);
+}
+
+static void retire(opof_tunnel_sa_table_t *table, sa_retired_t *retired, int kind, void *object){
+  retired->kind = kind;
+  retired->object = object;
+  retired->next = table->pending;
+  table->pending = retired;
+}
+
+/*
+* Adds what an SA counted since the last fold to its tunnel's retired
+* counters: once when the SA leaves the set, then again when it is freed
+* for what the readers that could still see it counted in between.
+*/
+static void fold(sa_node_t *node){
+  uint64_t packets = __atomic_load_n(&node->sa.packets, __ATOMIC_RELAXED);
+  uint64_t bytes = __atomic_load_n(&node->sa.bytes, __ATOMIC_RELAXED);
+
+  __atomic_add_fetch(&node->tunnel->retiredPackets, packets - node->foldedPackets, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&node->tunnel->retiredBytes, bytes - node->foldedBytes, __ATOMIC_RELAXED);
+  node->foldedPackets = packets;
+  node->foldedBytes = bytes;
+}
+
+static void retired_free(sa_retired_t *retired){
+  if (retired->kind == SA_RETIRED_SA){
+    fold((sa_node_t *)retired->object);
+  }
+  free(retired->object);
+}
+
+static inline void stats_write_begin(sa_tunnel_t *tunnel){
+  __atomic_store_n(&tunnel->statsSeq, tunnel->statsSeq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void stats_write_end(sa_tunnel_t *tunnel){
+  __atomic_store_n(&tunnel->statsSeq, tunnel->statsSeq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+* Ends a writer update: tags what it unlinked with the current epoch,
+* advances the epoch and frees the entries no reader can see any more.
+*/
+static void synchronize(opof_tunnel_sa_table_t *table){
+  sa_retired_t *batch = NULL;
+  uint64_t oldest = UINT64_MAX;
+  uint64_t epoch;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  epoch = __atomic_fetch_add(&table->epoch, 1, __ATOMIC_SEQ_CST);
+  /*
+  * pending is newest first, the retired list oldest first: an SA is freed
+  * before the tunnel its counters are folded into
+  */
+  while (table->pending != NULL){
+    sa_retired_t *retired = table->pending;
+    table->pending = retired->next;
+    retired->epoch = epoch;
+    retired->next = batch;
+    batch = retired;
+  }
+  if (batch != NULL){
+    *table->retiredTail = batch;
+    while (batch->next != NULL){
+      batch = batch->next;
+    }
+    table->retiredTail = &batch->next;
+  }
+  for (int i = 0; i < OPOF_TUNNEL_SA_READERS_MAX; i++){
+    uint64_t readerEpoch = __atomic_load_n(&table->readers[i].epoch, __ATOMIC_ACQUIRE);
+    if (readerEpoch != 0 && readerEpoch < oldest){
+      oldest = readerEpoch;
+    }
+  }
+  while (table->retired != NULL && table->retired->epoch < oldest){
+    sa_retired_t *retired = table->retired;
+    table->retired = retired->next;
+    retired_free(retired);
+  }
+  if (table->retired == NULL){
+    table->retiredTail = &table->retired;
+  }
+}
+
+static void tunnel_remove(opof_tunnel_sa_table_t *table, sa_tunnel_t *tunnel){
+  sa_set_t *set = tunnel->set;
+
+  for (int i = 0; i < set->count; i++){
+    if (!set->sas[i]->sa.encryption){
+      hash_unlink(&table->spis, &set->sas[i]->link);
+    }
+    retire(table, &set->sas[i]->retired, SA_RETIRED_SA, set->sas[i]);
+  }
+  table->count -= set->count;
+  hash_unlink(&table->tunnels, &tunnel->link);
+  retire(table, &set->retired, SA_RETIRED_SET, set);
+  retire(table, &tunnel->retired, SA_RETIRED_TUNNEL, tunnel);
+}
+
+static int work_find(const sa_work_t *work, int count, uint32_t spi){
+  for (int i = 0; i < count; i++){
+    if (work[i].spi == spi){
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* the SA set the request leaves the tunnel with, nothing is changed yet */
+static int work_build(opof_tunnel_sa_table_t *table, uint64_t tunnelId, const sa_set_t *old,
+                      const ipsecTunnel_t *ipsec, bool encryption, sa_work_t *work, int *count){
+  *count = 0;
+  /* a tunnel changing direction starts over */
+  if (old != NULL && old->sas[0]->sa.encryption == encryption){
+    for (int i = 0; i < old->count; i++){
+      const opof_tunnel_sa_t *sa = &old->sas[i]->sa;
+      work[i].spi = sa->spi;
+      work[i].key = sa->key;
+      work[i].keyLength = sa->keyLength;
+      work[i].node = sa->encryptionType == ipsec->encryptionType ? old->sas[i] : NULL;
+    }
+    *count = old->count;
+  }
+  for (int i = 0; i < ipsec->numberSAs && i < TUNNEL_IPSEC_SAS_MAX; i++){
+    const ipsecSA_t *sa = &ipsec->sas[i];
+    int pos;
+    if (sa->spi == 0){
+      continue;
+    }
+    pos = work_find(work, *count, sa->spi);
+    if (sa->operation == _TUNNEL_DELETE){
+      if (pos >= 0){
+        memmove(&work[pos], &work[pos + 1], (*count - pos - 1) * sizeof(sa_work_t));
+        (*count)--;
+      }
+      continue;
+    }
+    if (encryption){
+      /* an encryption tunnel uses one SA, a rekey replaces it */
+      *count = 0;
+      pos = -1;
+    }
+    if (pos < 0){
+      if (!encryption){
+        sa_link_t *link = hash_find(&table->spis, sa->spi);
+        if (link != NULL && ((sa_node_t *)link)->sa.tunnelId != tunnelId){
+          return _ALREADY_EXISTS;
+        }
+      }
+      if (*count == TUNNEL_IPSEC_SAS_MAX){
+        return _RESOURCE_EXHAUSTED;
+      }
+      pos = (*count)++;
+      work[pos].spi = sa->spi;
+    }
+    work[pos].key = sa->key;
+    work[pos].keyLength = sa->keyLength < TUNNEL_IPSEC_KEY_MAX ? sa->keyLength : TUNNEL_IPSEC_KEY_MAX;
+    work[pos].node = NULL;
+  }
+  return _OK;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Creates an SA table
+*
+* \param  capacity   The expected number of SAs, sets the hash table size
+* \return The table, NULL when out of memory
+*
+*/
+opof_tunnel_sa_table_t *opof_tunnel_sa_create(unsigned long capacity){
+  opof_tunnel_sa_table_t *table = NULL;
+
+  if (posix_memalign((void **)&table, 64, sizeof(*table)) != 0){
+    return NULL;
+  }
+  memset(table, 0, sizeof(*table));
+  pthread_mutex_init(&table->writerLock, NULL);
+  table->epoch = 1;
+  table->retiredTail = &table->retired;
+  if (hash_init(&table->spis, capacity) != _OK || hash_init(&table->tunnels, capacity) != _OK){
+    opof_tunnel_sa_destroy(table);
+    return NULL;
+  }
+  return table;
+}
+
+/* no reader may be using the table */
+void opof_tunnel_sa_destroy(opof_tunnel_sa_table_t *table){
+  if (table == NULL){
+    return;
+  }
+  if (table->tunnels.buckets != NULL){
+    for (unsigned long i = 0; i < (1UL << (64 - table->tunnels.shift)); i++){
+      while (table->tunnels.buckets[i] != NULL){
+        tunnel_remove(table, (sa_tunnel_t *)table->tunnels.buckets[i]);
+      }
+    }
+  }
+  while (table->pending != NULL){
+    sa_retired_t *retired = table->pending;
+    table->pending = retired->next;
+    free(retired->object);
+  }
+  while (table->retired != NULL){
+    sa_retired_t *retired = table->retired;
+    table->retired = retired->next;
+    free(retired->object);
+  }
+  free(table->spis.buckets);
+  free(table->tunnels.buckets);
+  pthread_mutex_destroy(&table->writerLock);
+  free(table);
+}
+
+/**
+* \ingroup servercinterface
+* \brief Applies the SAs of a createIpTunnel request to a tunnel
+*
+* An encryption tunnel ends up with the last SA of the request. For
+* decryption each SA with a non zero SPI is applied in order: _DELETE
+* removes it, any other operation adds it or replaces its key. A tunnel
+* left without SAs is removed. Either the whole request is applied or, on
+* error, nothing.
+*
+* \param  table        The SA table
+* \param  tunnelId     The tunnel
+* \param  *ipsec       IPSecEnc or IPSecDec of the request
+* \param  encryption   true for IPSecEnc
+* \return _OK, _ALREADY_EXISTS when a decryption SPI belongs to another
+*         tunnel or _RESOURCE_EXHAUSTED
+*
+*/
+int opof_tunnel_sa_apply(opof_tunnel_sa_table_t *table, uint64_t tunnelId, const ipsecTunnel_t *ipsec, bool encryption){
+  sa_work_t work[TUNNEL_IPSEC_SAS_MAX];
+  sa_tunnel_t *tunnel;
+  sa_set_t *old, *set;
+  bool created = false;
+  int count = 0;
+  int status;
+
+  pthread_mutex_lock(&table->writerLock);
+  tunnel = (sa_tunnel_t *)hash_find(&table->tunnels, tunnelId);
+  old = tunnel != NULL ? tunnel->set : NULL;
+  status = work_build(table, tunnelId, old, ipsec, encryption, work, &count);
+  if (status != _OK || count == 0){
+    if (status == _OK && tunnel != NULL){
+      tunnel_remove(table, tunnel);
+      synchronize(table);
+    }
+    pthread_mutex_unlock(&table->writerLock);
+    return status;
+  }
+  /* allocate everything before the first change */
+  set = (sa_set_t *)calloc(1, sizeof(sa_set_t));
+  if (set != NULL && tunnel == NULL){
+    tunnel = (sa_tunnel_t *)calloc(1, sizeof(sa_tunnel_t));
+    created = tunnel != NULL;
+  }
+  for (int i = 0; set != NULL && tunnel != NULL && i < count; i++){
+    sa_node_t *node = work[i].node;
+    if (node == NULL){
+      node = (sa_node_t *)calloc(1, sizeof(sa_node_t));
+      if (node == NULL){
+        break;
+      }
+      node->link.key = work[i].spi;
+      node->sa.spi = work[i].spi;
+      node->sa.tunnelId = tunnelId;
+      node->sa.encryption = encryption;
+      node->sa.encryptionType = ipsec->encryptionType;
+      node->sa.keyLength = work[i].keyLength;
+      memcpy(node->sa.key, work[i].key, work[i].keyLength);
+      node->tunnel = tunnel;
+    }
+    set->sas[set->count++] = node;
+  }
+  if (set == NULL || tunnel == NULL || set->count < count){
+    for (int i = 0; set != NULL && i < set->count; i++){
+      if (set->sas[i] != work[i].node){
+        free(set->sas[i]);
+      }
+    }
+    free(set);
+    if (created){
+      free(tunnel);
+    }
+    pthread_mutex_unlock(&table->writerLock);
+    return _RESOURCE_EXHAUSTED;
+  }
+  /* make: the new SAs are found by SPI before the set switches to them */
+  for (int i = 0; i < count; i++){
+    if (set->sas[i] != work[i].node && !encryption){
+      hash_insert(&table->spis, &set->sas[i]->link);
+    }
+  }
+  if (created){
+    tunnel->link.key = tunnelId;
+    tunnel->set = set;
+    hash_insert(&table->tunnels, &tunnel->link);
+  } else {
+    /* stats readers see the new set and the dropped SAs' counters together */
+    stats_write_begin(tunnel);
+    __atomic_store_n(&tunnel->set, set, __ATOMIC_RELEASE);
+  }
+  table->count += count;
+  /* break: the SAs the new set dropped or rekeyed go, their counters to the tunnel */
+  if (old != NULL){
+    for (int i = 0; i < old->count; i++){
+      sa_node_t *node = old->sas[i];
+      bool kept = false;
+      for (int j = 0; j < count && !kept; j++){
+        kept = set->sas[j] == node;
+      }
+      if (kept){
+        continue;
+      }
+      if (!node->sa.encryption){
+        hash_unlink(&table->spis, &node->link);
+      }
+      fold(node);
+      retire(table, &node->retired, SA_RETIRED_SA, node);
+    }
+    table->count -= old->count;
+    retire(table, &old->retired, SA_RETIRED_SET, old);
+  }
+  if (!created){
+    stats_write_end(tunnel);
+  }
+  synchronize(table);
+  pthread_mutex_unlock(&table->writerLock);
+  return _OK;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Removes all SAs of a tunnel
+*
+* \return _OK or _NOT_FOUND
+*
+*/
+int opof_tunnel_sa_remove(opof_tunnel_sa_table_t *table, uint64_t tunnelId){
+  sa_tunnel_t *tunnel;
+
+  pthread_mutex_lock(&table->writerLock);
+  tunnel = (sa_tunnel_t *)hash_find(&table->tunnels, tunnelId);
+  if (tunnel == NULL){
+    pthread_mutex_unlock(&table->writerLock);
+    return _NOT_FOUND;
+  }
+  tunnel_remove(table, tunnel);
+  synchronize(table);
+  pthread_mutex_unlock(&table->writerLock);
+  return _OK;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Frees the retired SAs no reader can see any more, which every
+*        update also does. An idle table needs it to pass the counters of
+*        its last retired SAs on to their tunnels.
+*
+*/
+void opof_tunnel_sa_reclaim(opof_tunnel_sa_table_t *table){
+  pthread_mutex_lock(&table->writerLock);
+  synchronize(table);
+  pthread_mutex_unlock(&table->writerLock);
+}
+
+unsigned long opof_tunnel_sa_count(opof_tunnel_sa_table_t *table){
+  return __atomic_load_n(&table->count, __ATOMIC_RELAXED);
+}
+
+/**
+* \ingroup servercinterface
+* \brief Claims a reader slot for the calling thread
+*
+* \return The reader, -1 when all OPOF_TUNNEL_SA_READERS_MAX slots are
+*         taken
+*
+*/
+int opof_tunnel_sa_reader_register(opof_tunnel_sa_table_t *table){
+  for (int i = 0; i < OPOF_TUNNEL_SA_READERS_MAX; i++){
+    int unused = 0;
+    if (__atomic_compare_exchange_n(&table->readers[i].used, &unused, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)){
+      return i;
+    }
+  }
+  return -1;
+}
+
+void opof_tunnel_sa_reader_unregister(opof_tunnel_sa_table_t *table, int reader){
+  __atomic_store_n(&table->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&table->readers[reader].used, 0, __ATOMIC_RELEASE);
+}
+
+/**
+* \ingroup servercinterface
+* \brief Starts a read section, read sections do not nest
+*
+*/
+void opof_tunnel_sa_read_lock(opof_tunnel_sa_table_t *table, int reader){
+  uint64_t epoch = __atomic_load_n(&table->epoch, __ATOMIC_ACQUIRE);
+
+  __atomic_store_n(&table->readers[reader].epoch, epoch, __ATOMIC_RELAXED);
+  /* the slot is visible to writers before any entry is read */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void opof_tunnel_sa_read_unlock(opof_tunnel_sa_table_t *table, int reader){
+  __atomic_store_n(&table->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/**
+* \ingroup servercinterface
+* \brief Finds the decryption SA of an SPI, inside a read section
+*
+* \return The SA, NULL when no tunnel has the SPI
+*
+*/
+opof_tunnel_sa_t *opof_tunnel_sa_find(opof_tunnel_sa_table_t *table, uint32_t spi){
+  sa_link_t *link = hash_find(&table->spis, spi);
+
+  return link != NULL ? &((sa_node_t *)link)->sa : NULL;
+}
+
+/**
+* \ingroup servercinterface
+* \brief The SA an encryption tunnel uses, inside a read section
+*
+* \return The SA, NULL when the tunnel has no SAs. For a decryption tunnel
+*         the newest SA.
+*
+*/
+opof_tunnel_sa_t *opof_tunnel_sa_active(opof_tunnel_sa_table_t *table, uint64_t tunnelId){
+  sa_tunnel_t *tunnel = (sa_tunnel_t *)hash_find(&table->tunnels, tunnelId);
+  sa_set_t *set;
+
+  if (tunnel == NULL){
+    return NULL;
+  }
+  set = __atomic_load_n(&tunnel->set, __ATOMIC_ACQUIRE);
+  return &set->sas[set->count - 1]->sa;
+}
+
+/**
+* \ingroup servercinterface
+* \brief The packets and bytes of all SAs a tunnel has had, inside a read
+*        section. They never go backwards: a rekey that runs meanwhile
+*        makes the read start over.
+*
+* \return _OK or _NOT_FOUND
+*
+*/
+int opof_tunnel_sa_stats(opof_tunnel_sa_table_t *table, uint64_t tunnelId, uint64_t *packets, uint64_t *bytes){
+  sa_tunnel_t *tunnel = (sa_tunnel_t *)hash_find(&table->tunnels, tunnelId);
+  sa_set_t *set;
+  uint32_t seq;
+
+  if (tunnel == NULL){
+    return _NOT_FOUND;
+  }
+  do {
+    seq = __atomic_load_n(&tunnel->statsSeq, __ATOMIC_ACQUIRE);
+    set = __atomic_load_n(&tunnel->set, __ATOMIC_ACQUIRE);
+    *packets = __atomic_load_n(&tunnel->retiredPackets, __ATOMIC_RELAXED);
+    *bytes = __atomic_load_n(&tunnel->retiredBytes, __ATOMIC_RELAXED);
+    for (int i = 0; i < set->count; i++){
+      *packets += __atomic_load_n(&set->sas[i]->sa.packets, __ATOMIC_RELAXED);
+      *bytes += __atomic_load_n(&set->sas[i]->sa.bytes, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1) || seq != __atomic_load_n(&tunnel->statsSeq, __ATOMIC_RELAXED));
+  return _OK;
+}
@@ -0,0 +1,378 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Rekey throughput of the IPsec SA table
+*
+* Fills an opof_tunnel_sa table with decryption tunnels, by default 4096
+* with one SA each, and rekeys random tunnels the way IKE does: the new SPI
+* is added, the peer switches to it, then the old SPI is deleted.
+*
+* The rekeys are timed alone, then reader threads look up the SPI each
+* tunnel currently sends, count a packet on the SA and read the tunnel
+* stats, first alone and then during a rekey storm. The lookups per second
+* of the two runs show what the storm costs the readers. A lookup finding
+* the SA of another tunnel, stats of a tunnel that go backwards between two
+* reads of a reader, or packets missing from the stats once the readers
+* stop, fail the run.
+*
+* Results are printed as JSON.
+*/
+extern "C" {
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_test.h"
+#include "opof_tunnel.h"
+#include "opof_tunnel_sa.h"
+}
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* the lookups of a read section, like a burst of received packets */
+#define SA_BENCH_BURST 32
+#define SA_BENCH_PACKET_BYTES 64
+
+struct SaBenchConfig {
+    unsigned long tunnels;
+    unsigned int readers;
+    unsigned long rekeys;
+    unsigned long millis;
+    unsigned long seed;
+    std::string output;
+};
+
+struct ReaderCounters {
+    ReaderCounters() : lookups(0), hits(0), misses(0), wrongTunnel(0), statsReads(0), statsBackwards(0) {}
+    std::atomic<uint64_t> lookups;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> wrongTunnel;
+    std::atomic<uint64_t> statsReads;
+    std::atomic<uint64_t> statsBackwards;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+typedef std::mt19937_64 BenchRandom;
+
+static double secondsSince(BenchClock::time_point start) {
+  return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+class SaBench {
+  public:
+    SaBench(const SaBenchConfig &config) :
+        config_(config), random_(config.seed), current_(new std::atomic<uint32_t>[config.tunnels + 1]),
+        nextSpi_(config.tunnels + 1), stopping_(false) {
+      table_ = opof_tunnel_sa_create(config.tunnels * 2);
+    }
+    ~SaBench() {
+      opof_tunnel_sa_destroy(table_);
+    }
+
+    bool fill() {
+      if (table_ == NULL){
+        return false;
+      }
+      for (uint64_t tunnelId = 1; tunnelId <= config_.tunnels; tunnelId++){
+        if (!addSpi(tunnelId, (uint32_t)tunnelId)){
+          return false;
+        }
+        current_[tunnelId].store((uint32_t)tunnelId);
+      }
+      return true;
+    }
+
+    /* add the new SPI, let the peer use it, then delete the old one */
+    bool rekey() {
+      uint64_t tunnelId = 1 + random_() % config_.tunnels;
+      uint32_t oldSpi = current_[tunnelId].load(std::memory_order_relaxed);
+      uint32_t newSpi = nextSpi_++;
+      ipsecTunnel_t ipsec;
+
+      if (!addSpi(tunnelId, newSpi)){
+        return false;
+      }
+      current_[tunnelId].store(newSpi, std::memory_order_release);
+      decryption(&ipsec);
+      ipsec.sas[0].spi = oldSpi;
+      ipsec.sas[0].operation = _TUNNEL_DELETE;
+      return opof_tunnel_sa_apply(table_, tunnelId, &ipsec, false) == _OK;
+    }
+
+    void startReaders() {
+      stopping_ = false;
+      for (unsigned int i = 0; i < config_.readers; i++){
+        threads_.push_back(std::thread(&SaBench::read, this, i));
+      }
+    }
+
+    void stopReaders() {
+      stopping_ = true;
+      for (std::thread &thread : threads_){
+        thread.join();
+      }
+      threads_.clear();
+    }
+
+    /* the packets the readers counted that the tunnel stats do not show */
+    uint64_t lostPackets() {
+      uint64_t total = 0;
+      int reader = opof_tunnel_sa_reader_register(table_);
+
+      opof_tunnel_sa_reclaim(table_);
+      opof_tunnel_sa_read_lock(table_, reader);
+      for (uint64_t tunnelId = 1; tunnelId <= config_.tunnels; tunnelId++){
+        uint64_t packets = 0, bytes = 0;
+        opof_tunnel_sa_stats(table_, tunnelId, &packets, &bytes);
+        total += packets;
+      }
+      opof_tunnel_sa_read_unlock(table_, reader);
+      opof_tunnel_sa_reader_unregister(table_, reader);
+      return counters_.hits - total;
+    }
+
+    ReaderCounters &counters() {
+      return counters_;
+    }
+
+    unsigned long saCount() {
+      return opof_tunnel_sa_count(table_);
+    }
+
+  private:
+    void decryption(ipsecTunnel_t *ipsec) {
+      memset(ipsec, 0, sizeof(*ipsec));
+      ipsec->tunnelType = _IPSEC_TUNNEL;
+      ipsec->encryptionType = _AES256GCM128;
+      ipsec->numberSAs = 1;
+    }
+
+    bool addSpi(uint64_t tunnelId, uint32_t spi) {
+      ipsecTunnel_t ipsec;
+
+      decryption(&ipsec);
+      ipsec.sas[0].spi = spi;
+      ipsec.sas[0].operation = _TUNNEL_CREATE;
+      ipsec.sas[0].keyLength = TUNNEL_IPSEC_KEY_MAX;
+      for (int i = 0; i < TUNNEL_IPSEC_KEY_MAX; i++){
+        ipsec.sas[0].key[i] = (uint8_t)(random_() >> 56);
+      }
+      return opof_tunnel_sa_apply(table_, tunnelId, &ipsec, false) == _OK;
+    }
+
+    void read(unsigned int index) {
+      BenchRandom random(config_.seed + 1 + index);
+      int reader = opof_tunnel_sa_reader_register(table_);
+      uint64_t lookups = 0, hits = 0, misses = 0, wrongTunnel = 0, statsReads = 0, statsBackwards = 0;
+      /* the packets this reader last saw in the stats of each tunnel */
+      std::vector<uint64_t> seen(config_.tunnels + 1);
+
+      while (!stopping_.load(std::memory_order_relaxed)){
+        uint64_t packets, bytes;
+        opof_tunnel_sa_read_lock(table_, reader);
+        for (int i = 0; i < SA_BENCH_BURST; i++){
+          uint64_t tunnelId = 1 + random() % config_.tunnels;
+          opof_tunnel_sa_t *sa = opof_tunnel_sa_find(table_, current_[tunnelId].load(std::memory_order_acquire));
+          if (sa == NULL){
+            /* the tunnel rekeyed twice since its SPI was read */
+            misses++;
+          } else if (sa->tunnelId != tunnelId){
+            wrongTunnel++;
+          } else {
+            opof_tunnel_sa_account(sa, SA_BENCH_PACKET_BYTES);
+            hits++;
+          }
+        }
+        uint64_t statsTunnel = 1 + random() % config_.tunnels;
+        if (opof_tunnel_sa_stats(table_, statsTunnel, &packets, &bytes) == _OK){
+          statsReads++;
+          statsBackwards += packets < seen[statsTunnel];
+          seen[statsTunnel] = packets;
+        }
+        opof_tunnel_sa_read_unlock(table_, reader);
+        lookups += SA_BENCH_BURST;
+      }
+      opof_tunnel_sa_reader_unregister(table_, reader);
+      counters_.lookups += lookups;
+      counters_.hits += hits;
+      counters_.misses += misses;
+      counters_.wrongTunnel += wrongTunnel;
+      counters_.statsReads += statsReads;
+      counters_.statsBackwards += statsBackwards;
+    }
+
+    SaBenchConfig config_;
+    BenchRandom random_;
+    opof_tunnel_sa_table_t *table_;
+    std::unique_ptr<std::atomic<uint32_t>[]> current_;
+    uint32_t nextSpi_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> stopping_;
+    ReaderCounters counters_;
+};
+
+struct ReadResult {
+    uint64_t lookups;
+    uint64_t statsReads;
+    double seconds;
+};
+
+static ReadResult readerDelta(ReaderCounters &counters, const ReadResult &before, double seconds) {
+  ReadResult result;
+  result.lookups = counters.lookups - before.lookups;
+  result.statsReads = counters.statsReads - before.statsReads;
+  result.seconds = seconds;
+  return result;
+}
+
+static void printReads(FILE *out, const char *name, const ReadResult &result) {
+  fprintf(out, "  \"%s\": {\"lookups\": %lu, \"lookupsPerSecond\": %.0f, \"statsReadsPerSecond\": %.0f},\n",
+          name, (unsigned long)result.lookups, result.lookups / result.seconds, result.statsReads / result.seconds);
+}
+
+static void displayHelp(void) {
+  printf("\nCommand line arguments for the OpenOffload IPsec SA table benchmark version: %s \n", OPOF_VERSION);
+  printf("\t-n, --tunnels         Decryption tunnels in the table (default 4096)\n");
+  printf("\t-r, --readers         Reader threads (default 2)\n");
+  printf("\t-k, --rekeys          Rekeys per run (default 200000)\n");
+  printf("\t-m, --millis          Milliseconds the readers run alone (default 1000)\n");
+  printf("\t-s, --seed            Random seed (default 1)\n");
+  printf("\t-o, --output          Write the JSON results to this file instead of stdout\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  SaBenchConfig config = {4096, 2, 200000, 1000, 1, ""};
+  static struct option longopts[] = {
+    {"tunnels", required_argument, NULL, 'n'},
+    {"readers", required_argument, NULL, 'r'},
+    {"rekeys", required_argument, NULL, 'k'},
+    {"millis", required_argument, NULL, 'm'},
+    {"seed", required_argument, NULL, 's'},
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:r:k:m:s:o:h", longopts, NULL)) != -1){
+    switch (c){
+      case 'n':
+        config.tunnels = strtoul(optarg, NULL, 0);
+        break;
+      case 'r':
+        config.readers = strtoul(optarg, NULL, 0);
+        break;
+      case 'k':
+        config.rekeys = strtoul(optarg, NULL, 0);
+        break;
+      case 'm':
+        config.millis = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        config.seed = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        config.output = optarg;
+        break;
+      case 'h':
+      default:
+        displayHelp();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  if (config.tunnels == 0 || config.readers == 0 || config.readers >= OPOF_TUNNEL_SA_READERS_MAX){
+    fprintf(stderr, "tunnels must be at least 1, readers 1 to %d\n", OPOF_TUNNEL_SA_READERS_MAX - 1);
+    return 1;
+  }
+
+  SaBench bench(config);
+  if (!bench.fill()){
+    fprintf(stderr, "Filling the SA table failed\n");
+    return 1;
+  }
+
+  BenchClock::time_point start = BenchClock::now();
+  for (unsigned long i = 0; i < config.rekeys; i++){
+    if (!bench.rekey()){
+      fprintf(stderr, "Rekey %lu failed\n", i);
+      return 1;
+    }
+  }
+  double aloneSeconds = secondsSince(start);
+
+  ReadResult before = {0, 0, 0};
+  start = BenchClock::now();
+  bench.startReaders();
+  std::this_thread::sleep_for(std::chrono::milliseconds(config.millis));
+  bench.stopReaders();
+  ReadResult quiet = readerDelta(bench.counters(), before, secondsSince(start));
+
+  before = quiet;
+  start = BenchClock::now();
+  bench.startReaders();
+  for (unsigned long i = 0; i < config.rekeys; i++){
+    if (!bench.rekey()){
+      fprintf(stderr, "Rekey %lu failed\n", i);
+      bench.stopReaders();
+      return 1;
+    }
+  }
+  double stormSeconds = secondsSince(start);
+  bench.stopReaders();
+  ReadResult storm = readerDelta(bench.counters(), before, secondsSince(start));
+
+  uint64_t lostPackets = bench.lostPackets();
+  uint64_t wrongTunnel = bench.counters().wrongTunnel;
+  uint64_t statsBackwards = bench.counters().statsBackwards;
+
+  FILE *out = stdout;
+  if (!config.output.empty()){
+    out = fopen(config.output.c_str(), "w");
+    if (out == NULL){
+      fprintf(stderr, "Cannot write %s\n", config.output.c_str());
+      return 1;
+    }
+  }
+  fprintf(out, "{\n");
+  fprintf(out, "  \"config\": {\"tunnels\": %lu, \"readers\": %u, \"rekeys\": %lu, \"millis\": %lu, \"seed\": %lu},\n",
+          config.tunnels, config.readers, config.rekeys, config.millis, config.seed);
+  fprintf(out, "  \"sas\": %lu,\n", bench.saCount());
+  fprintf(out, "  \"rekeysPerSecond\": %.0f,\n", config.rekeys / aloneSeconds);
+  fprintf(out, "  \"rekeysPerSecondWithReaders\": %.0f,\n", config.rekeys / stormSeconds);
+  printReads(out, "readersAlone", quiet);
+  printReads(out, "readersDuringRekeys", storm);
+  fprintf(out, "  \"misses\": %lu,\n", (unsigned long)bench.counters().misses);
+  fprintf(out, "  \"wrongTunnel\": %lu,\n", (unsigned long)wrongTunnel);
+  fprintf(out, "  \"statsBackwards\": %lu,\n", (unsigned long)statsBackwards);
+  fprintf(out, "  \"lostPackets\": %lu\n", (unsigned long)lostPackets);
+  fprintf(out, "}\n");
+  if (out != stdout){
+    fclose(out);
+  }
+  return wrongTunnel == 0 && statsBackwards == 0 && lostPackets == 0 ? 0 : 1;
+}
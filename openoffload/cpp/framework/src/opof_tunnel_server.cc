@@ -0,0 +1,76 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+* \ingroup serverlibrary
+*
+* \brief gRPC Server of the ipTunnelService
+*
+*/
+extern "C" {
+#include "opof.h"
+}
+#include "opof_tunnel_grpc.h"
+#include "opof_tunnel_service.h"
+
+extern "C" {
+  void opof_tunnel_server(const char *address, unsigned short port, const char* cert, const char* key);
+} // extern C
+
+/**
+* \brief  gRPC C++ Tunnel Server Implementation
+*
+* \param address The address the server is listening on either the IP address or "localhost"
+* \param port    The port the server is listening on
+* \param cert    The public key of the TLS connection
+* \param key     The private key of the TLS connection
+*
+*/
+void opof_tunnel_server(const char* address, unsigned short port, const char* cert, const char* key){
+
+  TunnelTableImpl service;
+  std::string cppaddress(address);
+#ifdef SSL
+  grpc::SslServerCredentialsOptions::PemKeyCertPair pkcp;
+  pkcp.private_key = std::string(key);
+  pkcp.cert_chain = std::string(cert);
+
+  grpc::SslServerCredentialsOptions ssl_opts;
+  ssl_opts.pem_root_certs="";
+  ssl_opts.pem_key_cert_pairs.push_back(pkcp);
+
+  std::shared_ptr<grpc::ServerCredentials> creds;
+  creds = grpc::SslServerCredentials(ssl_opts);
+#endif
+  cppaddress.append(":");
+  cppaddress.append(std::to_string(port));
+  ServerBuilder builder;
+  builder.SetSyncServerOption(ServerBuilder::SyncServerOption::NUM_CQS, 10);
+  builder.SetSyncServerOption(ServerBuilder::SyncServerOption::MIN_POLLERS, 2);
+  builder.SetSyncServerOption(ServerBuilder::SyncServerOption::MAX_POLLERS, 20);
+  builder.SetSyncServerOption(ServerBuilder::SyncServerOption::CQ_TIMEOUT_MSEC, 100);
+
+#ifdef SSL
+  builder.AddListeningPort(cppaddress, creds);
+#else
+  builder.AddListeningPort(cppaddress, grpc::InsecureServerCredentials());
+#endif
+  builder.RegisterService(&service);
+
+  std::unique_ptr<Server> server(builder.BuildAndStart());
+  std::cout << "Tunnel Server listening on: " << cppaddress << std::endl;
+
+  // Wait for the server to shutdown. Note that some other thread must be
+  // responsible for shutting down the server for this call to ever return.
+  server->Wait();
+}
@@ -0,0 +1,128 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+* \ingroup testlibrary
+*
+* \brief Test server of the ipTunnelService, backed by opof_tunnel_server_test.c
+*
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <signal.h>
+#include <syslog.h>
+
+#include "opof.h"
+#include "opof_test.h"
+#include "opof_error.h"
+#include "opof_log.h"
+#include "opof_test_util.h"
+
+/*
+ * Declare functions
+ */
+void signal_handler(int sig);
+void opof_tunnel_server(const char *address, unsigned short port, const char *cert, const char *key);
+/*
+ * Main routine
+ */
+int main(int argc, char ** argv){
+    /*
+     * Command Line Arguments
+     */
+    char cert[2048];
+    char key [2048];
+    int c;
+    struct sigaction newSigAction;
+    unsigned short port = 3444;
+    char address[64];
+    char *str_part;
+    char *default_address ="localhost";
+
+    strncpy(address,default_address,strlen(default_address)+1);
+    //
+    static struct option longopts[] = {
+        {"version", no_argument,0,'v'},
+        {"address", required_argument, 0, 'a'},
+        {"port", required_argument, 0 ,'p'},
+        {"log", required_argument, 0 ,'L'},
+        {"help",no_argument,0,'h'},
+        {0,0,0,0},
+    };
+    /*
+     * Loop over input
+     */
+    while (( c = getopt_long(argc,argv, "a:p:L:vh",longopts,NULL))!=    -1){
+        switch(c) {
+            case 'v':
+                printf("\nVersion of OPOF Program: %s\n\n", OPOF_VERSION);
+                exit(0);
+                break;
+            case 'p':
+                port = strtoul(optarg, &str_part,10);
+                break;
+            case 'a':
+                strncpy(address, optarg,63);
+                break;
+            case 'L':
+                if (opof_log_open(optarg) != _OK){
+                    fprintf(stderr, "Could not open log file: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'h':
+                printf("\nCommand line arguments for OpenOffload tunnel server tests version: %s \n", OPOF_VERSION);
+                printf("\t-p, --port            gRPC Port \n");
+                printf("\t-a, --address         Address of gRPC Server\n");
+                printf("\t-L, --log             Write the library log to this file instead of stderr\n");
+                printf("\t-v, --version         Version of Open Offload Program\n");
+                printf("\t-h, --help:           Command line help \n\n");
+                exit(1);
+            default:
+                printf("Ignoring unrecognized command line option:%d\n ",c);
+                break;
+        }
+    }
+    setlogmask(LOG_UPTO(LOG_INFO));
+    openlog("OPOF", LOG_CONS | LOG_PERROR, LOG_USER);
+    syslog(LOG_INFO,"Starting OPOF Test Tunnel Server: Version  %s", OPOF_VERSION);
+    /*
+     * Set up a signal handler
+     */
+    newSigAction.sa_handler = signal_handler;
+    sigemptyset(&newSigAction.sa_mask);
+    newSigAction.sa_flags = 0;
+    sigaction(SIGHUP, &newSigAction, NULL);
+    sigaction(SIGTERM, &newSigAction, NULL);
+    sigaction(SIGINT, &newSigAction, NULL);
+
+#ifdef SSL
+    if ((get_key(CERT_FILE, cert) != FAILURE) && (get_key(KEY_FILE, key) != FAILURE)){
+        opof_tunnel_server(address, port, cert, key);
+    } else {
+        printf("Error: could not read server credentials\n");
+        exit(-1);
+    }
+#else
+    printf("Info: Creating Insecure Tunnel Server\n");
+    opof_tunnel_server(address, port, cert, key);
+#endif
+    printf("Exiting normally\n");
+    return 0;
+}
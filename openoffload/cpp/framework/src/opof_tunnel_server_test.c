@@ -0,0 +1,486 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Test backend of the ipTunnelService
+*
+* Keeps the tunnels in a uthash table ordered by tunnelId and checks them the
+* way tests/basicIPT/tunnels_server.py does: GENEVE needs an outer IP, an
+* inner MAC pair, a 24 bit VNI and well formed options, IPsec needs one of
+* the AES-256-GCM encryptions, an SPI and 256 bit keys. The GENEVE checks
+* are done by compiling the opof_tunnel_encap template that GENEVE encap and
+* IPsec encryption tunnels keep. Counters start random and are kept in
+* per core opof_tunnel_stats shards, so the pages of getAllIpTunnelsStats sum
+* them without stopping the counting. The capacity is OPOF_TUNNEL_CAPACITY
+* tunnels, 1024 by default. The MatchCriteria of the tunnels are kept in an
+* opof_tunnel_lpm index, which also rejects prefixes longer than their
+* address, and the IPsec SAs in an opof_tunnel_sa table, which rejects a
+* decryption SPI another tunnel has.
+*
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "opof.h"
+#include "opof_error.h"
+#include "opof_log.h"
+#include "opof_tunnel.h"
+#include "opof_tunnel_encap.h"
+#include "opof_tunnel_lpm.h"
+#include "opof_tunnel_sa.h"
+#include "opof_tunnel_stats.h"
+#include "opof_tunnel_serverlib.h"
+#include "uthash.h"
+
+#define TUNNEL_CAPACITY_DEFAULT 1024
+#define TUNNEL_GENEVE_OPTIONS_SUPPORTED 5
+#define TUNNEL_MAX_PACKETS 5000
+
+typedef struct tunnelRecord_t {
+  uint64_t tunnelId;
+  ipTunnelRequest_t request;
+  opof_tunnel_encap_t encap;
+  long statsSlot;
+  UT_hash_handle hh;
+} tunnelRecord_t;
+
+static tunnelRecord_t *tunnels = NULL;
+static opof_tunnel_lpm_t *tunnelIndex = NULL;
+static opof_tunnel_sa_table_t *saTable = NULL;
+static opof_tunnel_stats_t *tunnelStats = NULL;
+static pthread_mutex_t tunnelLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const IPSEC_ENC_TYPE_T supportedEncryption[] = {_AES256GCM64, _AES256GCM96, _AES256GCM128};
+#define SUPPORTED_ENCRYPTION_COUNT (int)(sizeof(supportedEncryption) / sizeof(supportedEncryption[0]))
+
+static unsigned long tunnelCapacity(void){
+  static unsigned long capacity = 0;
+  if (capacity == 0){
+    const char *value = getenv("OPOF_TUNNEL_CAPACITY");
+    capacity = value ? strtoul(value, NULL, 10) : 0;
+    if (capacity == 0){
+      capacity = TUNNEL_CAPACITY_DEFAULT;
+    }
+  }
+  return capacity;
+}
+
+static int compareTunnels(const tunnelRecord_t *a, const tunnelRecord_t *b){
+  return (a->tunnelId > b->tunnelId) - (a->tunnelId < b->tunnelId);
+}
+
+/* called with tunnelLock held, tunnels mostly come in tunnelId order so try the tail first */
+static void addTunnel(tunnelRecord_t *record){
+  tunnelRecord_t *last = NULL;
+
+  if (tunnels != NULL){
+    last = (tunnelRecord_t *)ELMT_FROM_HH(tunnels->hh.tbl, tunnels->hh.tbl->tail);
+  }
+  if (last == NULL || last->tunnelId < record->tunnelId){
+    HASH_ADD(hh, tunnels, tunnelId, sizeof(uint64_t), record);
+  } else {
+    HASH_ADD_INORDER(hh, tunnels, tunnelId, sizeof(uint64_t), record, compareTunnels);
+  }
+}
+
+/*
+ * Called with tunnelLock held, returns the first tunnel at or after the
+ * paging cursor. The cursor is one past the last tunnel of the previous
+ * page, so that tunnel is found by hash and the page resumes after it;
+ * only when it was deleted meanwhile is the list scanned.
+ */
+static tunnelRecord_t *seekTunnel(uint64_t startTunnel){
+  tunnelRecord_t *record = NULL;
+
+  if (startTunnel == 0){
+    return tunnels;
+  }
+  HASH_FIND(hh, tunnels, &startTunnel, sizeof(uint64_t), record);
+  if (record != NULL){
+    return record;
+  }
+  startTunnel--;
+  HASH_FIND(hh, tunnels, &startTunnel, sizeof(uint64_t), record);
+  if (record != NULL){
+    return (tunnelRecord_t *)record->hh.next;
+  }
+  record = tunnels;
+  while (record != NULL && record->tunnelId <= startTunnel){
+    record = (tunnelRecord_t *)record->hh.next;
+  }
+  return record;
+}
+
+static int rejectTunnel(tunnelError_t *error, const char *errorString){
+  error->error = true;
+  strncpy(error->errorString, errorString, TUNNEL_ERROR_STRING_MAX - 1);
+  return _INVALID_ARGUMENT;
+}
+
+static void randomCounters(tunnelCounters_t *counters){
+  counters->inPackets = 1 + rand() % TUNNEL_MAX_PACKETS;
+  counters->outPackets = 1 + rand() % TUNNEL_MAX_PACKETS;
+  counters->inPacketsDrops = 1 + rand() % TUNNEL_MAX_PACKETS;
+  counters->outPacketsDrops = 1 + rand() % TUNNEL_MAX_PACKETS;
+  counters->inBytes = counters->inPackets * 8;
+  counters->outBytes = counters->outPackets * 8;
+  counters->inBytesDrops = counters->inPacketsDrops * 8;
+  counters->outBytesDrops = counters->outPacketsDrops * 8;
+}
+
+static int validateIpsec(const ipsecTunnel_t *ipsec, bool encryption, tunnelError_t *error){
+  bool supported = false;
+  bool spiFound = false;
+
+  for (int i = 0; i < SUPPORTED_ENCRYPTION_COUNT; i++){
+    supported |= ipsec->encryptionType == supportedEncryption[i];
+  }
+  if (!supported){
+    error->ipsecError = _IPSEC_NON_SUPPORTED_ENCRYPTION;
+    return rejectTunnel(error, "Encryption type not supported");
+  }
+  /* only encryption carries the tunnel addresses */
+  if (encryption && !ipsec->tunnelIps.enable &&
+      (ipsec->tunnelType == _IPSEC_TUNNEL || ipsec->tunnelType == _IPSEC_TUNNEL_NAT_TRAVERSAL)){
+    error->ipsecError = _IPSEC_MISSING_FIELDS;
+    return rejectTunnel(error, "Tunnel mode without tunnel IPs");
+  }
+  for (int i = 0; i < ipsec->numberSAs; i++){
+    const ipsecSA_t *sa = &ipsec->sas[i];
+    if (sa->spi == 0){
+      continue;
+    }
+    spiFound = true;
+    if (sa->operation != _TUNNEL_DELETE && sa->keyLength != 32){
+      error->ipsecError = _IPSEC_INVALID_KEY;
+      return rejectTunnel(error, "Key used for IPSec isnt in right size of 256-bit");
+    }
+  }
+  if (!spiFound){
+    error->ipsecError = _IPSEC_MISSING_FIELDS;
+    return rejectTunnel(error, "No SPI found on tunnel");
+  }
+  return _OK;
+}
+
+/* the GENEVE and IPsec encryption tunnels are checked by compiling their encapsulation */
+static int compileEncap(const ipTunnelRequest_t *request, opof_tunnel_encap_t *encap, tunnelError_t *error){
+  if (request->tunnelType == _IP_TUNNEL_GENEVE_ENCAP && request->geneve.numberOptions > TUNNEL_GENEVE_OPTIONS_SUPPORTED){
+    error->geneveError = _GENEVE_TOO_MANY_OPTIONS;
+    return rejectTunnel(error, "Too many GENEVE options");
+  }
+  return opof_tunnel_encap_compile(request, encap, error);
+}
+
+/* called with tunnelLock held */
+static int validateTunnel(const ipTunnelRequest_t *request, opof_tunnel_encap_t *encap, tunnelError_t *error){
+  tunnelRecord_t *matched = NULL;
+  int status;
+
+  memset(encap, 0, sizeof(*encap));
+  if (request->match.matchType == _TUNNEL_MATCH_VXLAN){
+    error->matchError = _MATCH_INVALID_CAPABILITIES;
+    return rejectTunnel(error, "VXLAN matching is not supported");
+  }
+  if (request->match.tunnelId != 0){
+    HASH_FIND(hh, tunnels, &request->match.tunnelId, sizeof(uint64_t), matched);
+    if (matched == NULL){
+      error->matchError = _MATCH_INVALID_TUNNEL_ID;
+      return rejectTunnel(error, "Matched tunnel does not exist");
+    }
+  }
+  switch (request->tunnelType){
+    case _IP_TUNNEL_IPSEC_ENC:
+      status = validateIpsec(&request->ipsec, true, error);
+      return status == _OK ? compileEncap(request, encap, error) : status;
+    case _IP_TUNNEL_IPSEC_DEC:
+      return validateIpsec(&request->ipsec, false, error);
+    case _IP_TUNNEL_GENEVE_ENCAP:
+      return compileEncap(request, encap, error);
+    case _IP_TUNNEL_GENEVE_DECAP:
+      return _OK;
+    case _IP_TUNNEL_NONE:
+      error->tunnelError = _TUNNEL_NOT_SUPPORTED;
+      return rejectTunnel(error, "No tunnel type passed to tunnel");
+    default:
+      error->tunnelError = _TUNNEL_NOT_SUPPORTED;
+      return rejectTunnel(error, "Tunnel type not supported");
+  }
+}
+
+/* called with tunnelLock held */
+static int indexTunnel(const ipTunnelRequest_t *request, bool update, tunnelError_t *error){
+  int status;
+
+  if (tunnelIndex == NULL){
+    tunnelIndex = opof_tunnel_lpm_create();
+    if (tunnelIndex == NULL){
+      rejectTunnel(error, "Tunnel index allocation failed");
+      return _RESOURCE_EXHAUSTED;
+    }
+  }
+  if (update){
+    status = opof_tunnel_lpm_update(tunnelIndex, request->tunnelId, &request->match);
+  } else {
+    status = opof_tunnel_lpm_add(tunnelIndex, request->tunnelId, &request->match);
+  }
+  if (status == _INVALID_ARGUMENT){
+    error->matchError = _MATCH_INVALID_FIELD;
+    return rejectTunnel(error, "IP match prefix longer than its address");
+  }
+  if (status != _OK){
+    rejectTunnel(error, "Tunnel index full");
+  }
+  return status;
+}
+
+/* called with tunnelLock held, a tunnel that is no longer IPsec loses its SAs */
+static int applySas(const ipTunnelRequest_t *request, tunnelError_t *error){
+  bool encryption = request->tunnelType == _IP_TUNNEL_IPSEC_ENC;
+  int status;
+
+  if (!encryption && request->tunnelType != _IP_TUNNEL_IPSEC_DEC){
+    if (saTable != NULL){
+      opof_tunnel_sa_remove(saTable, request->tunnelId);
+    }
+    return _OK;
+  }
+  if (saTable == NULL){
+    saTable = opof_tunnel_sa_create(tunnelCapacity());
+    if (saTable == NULL){
+      rejectTunnel(error, "SA table allocation failed");
+      return _RESOURCE_EXHAUSTED;
+    }
+  }
+  status = opof_tunnel_sa_apply(saTable, request->tunnelId, &request->ipsec, encryption);
+  if (status == _ALREADY_EXISTS){
+    rejectTunnel(error, "SPI is used by another tunnel");
+  } else if (status != _OK){
+    rejectTunnel(error, "Too many SAs on tunnel");
+  }
+  return status;
+}
+
+int opof_get_tunnel_capabilities_server(tunnelCapabilities_t *capabilities){
+  capabilities->geneveMatching = true;
+  capabilities->ingressInterfaceMatching = true;
+  capabilities->spiMatching = true;
+  capabilities->tunnelMatching = true;
+  capabilities->numberTunnelTypes = 4;
+  capabilities->tunnelTypeSupported[0] = _IPSEC_TRANSPORT;
+  capabilities->tunnelTypeSupported[1] = _IPSEC_TUNNEL;
+  capabilities->tunnelTypeSupported[2] = _IPSEC_TRANSPORT_NAT_TRAVERSAL;
+  capabilities->tunnelTypeSupported[3] = _IPSEC_TUNNEL_NAT_TRAVERSAL;
+  capabilities->numberEncryptionTypes = SUPPORTED_ENCRYPTION_COUNT;
+  for (int i = 0; i < SUPPORTED_ENCRYPTION_COUNT; i++){
+    capabilities->encryptionSupported[i] = supportedEncryption[i];
+  }
+  capabilities->numberGeneveOptionsSupported = TUNNEL_GENEVE_OPTIONS_SUPPORTED;
+  return _OK;
+}
+
+int opof_get_tunnel_table_stats_server(unsigned long *tunnelCount, unsigned long *capacity){
+  pthread_mutex_lock(&tunnelLock);
+  *tunnelCount = HASH_COUNT(tunnels);
+  pthread_mutex_unlock(&tunnelLock);
+  *capacity = tunnelCapacity();
+  return _OK;
+}
+
+int opof_create_tunnel_server(ipTunnelRequest_t *request, tunnelError_t *error){
+  tunnelRecord_t *record = NULL;
+  opof_tunnel_encap_t encap;
+  int status;
+
+  if (request->tunnelId == 0){
+    error->matchError = _MATCH_INVALID_TUNNEL_ID;
+    return rejectTunnel(error, "Tunnel ID 0 is reserved");
+  }
+  pthread_mutex_lock(&tunnelLock);
+  HASH_FIND(hh, tunnels, &request->tunnelId, sizeof(uint64_t), record);
+  if (record != NULL){
+    pthread_mutex_unlock(&tunnelLock);
+    error->matchError = _MATCH_INVALID_TUNNEL_ID;
+    rejectTunnel(error, "Tunnel already exists");
+    return _ALREADY_EXISTS;
+  }
+  if (HASH_COUNT(tunnels) >= tunnelCapacity()){
+    pthread_mutex_unlock(&tunnelLock);
+    rejectTunnel(error, "Tunnel table full");
+    return _RESOURCE_EXHAUSTED;
+  }
+  if (tunnelStats == NULL){
+    tunnelStats = opof_tunnel_stats_create(tunnelCapacity(), 0);
+    if (tunnelStats == NULL){
+      pthread_mutex_unlock(&tunnelLock);
+      rejectTunnel(error, "Tunnel counters allocation failed");
+      return _RESOURCE_EXHAUSTED;
+    }
+  }
+  status = validateTunnel(request, &encap, error);
+  if (status == _OK){
+    status = indexTunnel(request, false, error);
+  }
+  if (status == _OK){
+    status = applySas(request, error);
+    if (status != _OK){
+      opof_tunnel_lpm_remove(tunnelIndex, request->tunnelId);
+    }
+  }
+  if (status != _OK){
+    pthread_mutex_unlock(&tunnelLock);
+    return status;
+  }
+  record = (tunnelRecord_t *)calloc(1, sizeof(tunnelRecord_t));
+  record->tunnelId = request->tunnelId;
+  record->request = *request;
+  record->encap = encap;
+  record->statsSlot = opof_tunnel_stats_alloc(tunnelStats);
+  randomCounters(opof_tunnel_stats_counters(tunnelStats, 0, record->statsSlot));
+  addTunnel(record);
+  pthread_mutex_unlock(&tunnelLock);
+  return _OK;
+}
+
+int opof_update_tunnel_server(ipTunnelRequest_t *request, tunnelError_t *error){
+  tunnelRecord_t *record = NULL;
+  opof_tunnel_encap_t encap;
+  int status;
+
+  pthread_mutex_lock(&tunnelLock);
+  HASH_FIND(hh, tunnels, &request->tunnelId, sizeof(uint64_t), record);
+  if (record == NULL){
+    pthread_mutex_unlock(&tunnelLock);
+    error->matchError = _MATCH_INVALID_TUNNEL_ID;
+    rejectTunnel(error, "Tunnel does not exist");
+    return _NOT_FOUND;
+  }
+  status = validateTunnel(request, &encap, error);
+  if (status == _OK){
+    status = indexTunnel(request, true, error);
+  }
+  if (status == _OK){
+    status = applySas(request, error);
+    if (status != _OK){
+      opof_tunnel_lpm_update(tunnelIndex, request->tunnelId, &record->request.match);
+    }
+  }
+  if (status == _OK){
+    record->request = *request;
+    record->request.operation = _TUNNEL_CREATE;
+    record->encap = encap;
+  }
+  pthread_mutex_unlock(&tunnelLock);
+  return status;
+}
+
+int opof_delete_tunnel_server(uint64_t tunnelId, tunnelError_t *error){
+  tunnelRecord_t *record = NULL;
+
+  pthread_mutex_lock(&tunnelLock);
+  HASH_FIND(hh, tunnels, &tunnelId, sizeof(uint64_t), record);
+  if (record == NULL){
+    pthread_mutex_unlock(&tunnelLock);
+    error->matchError = _MATCH_INVALID_TUNNEL_ID;
+    rejectTunnel(error, "Tunnel does not exist");
+    return _NOT_FOUND;
+  }
+  HASH_DEL(tunnels, record);
+  opof_tunnel_stats_free(tunnelStats, record->statsSlot);
+  opof_tunnel_lpm_remove(tunnelIndex, tunnelId);
+  if (saTable != NULL){
+    opof_tunnel_sa_remove(saTable, tunnelId);
+  }
+  pthread_mutex_unlock(&tunnelLock);
+  free(record);
+  return _OK;
+}
+
+int opof_get_tunnel_server(uint64_t tunnelId, ipTunnelResponse_t *response){
+  tunnelRecord_t *record = NULL;
+
+  pthread_mutex_lock(&tunnelLock);
+  HASH_FIND(hh, tunnels, &tunnelId, sizeof(uint64_t), record);
+  if (record == NULL){
+    pthread_mutex_unlock(&tunnelLock);
+    return _NOT_FOUND;
+  }
+  response->tunnelId = record->tunnelId;
+  response->ipTunnel = record->request;
+  opof_tunnel_stats_read(tunnelStats, record->statsSlot, &response->counters);
+  pthread_mutex_unlock(&tunnelLock);
+  return _OK;
+}
+
+int opof_get_tunnel_stats_server(uint64_t tunnelId, ipTunnelStatsResponse_t *response){
+  tunnelRecord_t *record = NULL;
+
+  pthread_mutex_lock(&tunnelLock);
+  HASH_FIND(hh, tunnels, &tunnelId, sizeof(uint64_t), record);
+  if (record == NULL){
+    pthread_mutex_unlock(&tunnelLock);
+    return _NOT_FOUND;
+  }
+  response->tunnelId = record->tunnelId;
+  opof_tunnel_stats_read(tunnelStats, record->statsSlot, &response->counters);
+  pthread_mutex_unlock(&tunnelLock);
+  return _OK;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Returns the next page of tunnels in tunnelId order
+*
+* \param  pageSize       The maximum number of tunnels to return
+* \param  *startTunnel   The paging cursor, the first tunnelId to return, 0 starts the scan;
+*                        it wraps to 0 after tunnelId UINT64_MAX, which also ends the scan
+* \param  responses      The returned tunnels
+* \return The number of tunnels returned, fewer than pageSize on the last page
+*
+*/
+int opof_get_all_tunnels_server(int pageSize, uint64_t *startTunnel, ipTunnelResponse_t responses[]){
+  tunnelRecord_t *record;
+  int count = 0;
+
+  pthread_mutex_lock(&tunnelLock);
+  for (record = seekTunnel(*startTunnel); record != NULL && count < pageSize; record = (tunnelRecord_t *)record->hh.next){
+    responses[count].tunnelId = record->tunnelId;
+    responses[count].ipTunnel = record->request;
+    opof_tunnel_stats_read(tunnelStats, record->statsSlot, &responses[count].counters);
+    *startTunnel = record->tunnelId + 1;
+    count++;
+  }
+  pthread_mutex_unlock(&tunnelLock);
+  return count;
+}
+
+/* the counters are summed over the shards without stopping the datapath */
+int opof_get_all_tunnels_stats_server(int pageSize, uint64_t *startTunnel, ipTunnelStatsResponse_t responses[]){
+  tunnelRecord_t *record;
+  int count = 0;
+
+  pthread_mutex_lock(&tunnelLock);
+  for (record = seekTunnel(*startTunnel); record != NULL && count < pageSize; record = (tunnelRecord_t *)record->hh.next){
+    responses[count].tunnelId = record->tunnelId;
+    opof_tunnel_stats_read(tunnelStats, record->statsSlot, &responses[count].counters);
+    *startTunnel = record->tunnelId + 1;
+    count++;
+  }
+  pthread_mutex_unlock(&tunnelLock);
+  return count;
+}
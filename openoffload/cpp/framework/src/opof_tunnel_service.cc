@@ -0,0 +1,269 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup serverlibrary
+*
+* \brief gRPC ipTunnelService implementation
+*
+* The service converts between the tunneloffload classes and the C structs
+* and calls the hooks of opof_tunnel_serverlib.h, the same way the
+* SessionTable does with opof_serverlib.h.
+*
+*/
+
+extern "C" {
+#include "opof.h"
+#include "opof_log.h"
+#include "opof_tunnel.h"
+#include "opof_tunnel_serverlib.h"
+}
+
+#include <algorithm>
+#include <vector>
+
+#include "opof_tunnel_util.h"
+#include "opof_tunnel_grpc.h"
+#include "opof_tunnel_service.h"
+
+static ADD_TUNNEL_STATUS_T tunnelStatus(int status)
+{
+  switch (status){
+    case _OK:
+      return _TUNNEL_ACCEPTED;
+    case _ALREADY_EXISTS:
+      return _TUNNEL_ALREADY_EXISTS;
+    case _RESOURCE_EXHAUSTED:
+      return _TUNNEL_TABLE_FULL;
+    default:
+      return _TUNNEL_REJECTED;
+  }
+}
+
+/** \ingroup serverlibrary
+* \brief Capabilities
+*
+* \param context
+* \param request
+* \param response
+*/
+Status TunnelTableImpl::Capabilities(ServerContext* context, const CapabilityRequest* request, CapabilityResponse* response) {
+  tunnelCapabilities_t capabilities_c = {};
+  if (opof_get_tunnel_capabilities_server(&capabilities_c) != _OK){
+    return Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error");
+  }
+  convertTunnelCapabilities2cpp(&capabilities_c, response);
+  return Status::OK;
+}
+
+/** \ingroup serverlibrary
+* \brief createIpTunnel
+*
+* The stream is read to the end before anything reaches the backend, so a
+* stream whose creates do not fit in the free capacity of the table is
+* refused as a whole with _TUNNEL_TABLE_FULL. Otherwise the tunnels are
+* created, updated and deleted in stream order, a tunnel that fails gets an
+* entry in the responses and its bit in errorStatus, and requestStatus
+* reflects the first failure.
+*
+* The capacity check is advisory: it is not atomic with the creates, and
+* another stream may fill the table in between. What enforces the capacity
+* is the backend, whose opof_create_tunnel_server returns
+* _RESOURCE_EXHAUSTED for a create that does not fit.
+*
+* \param context
+* \param reader
+* \param response
+*/
+Status TunnelTableImpl::createIpTunnel(ServerContext* context, ServerReader<ipTunnelRequest>* reader, createIpTunnelResponses* response) {
+  std::vector<ipTunnelRequest> requests;
+  ipTunnelRequest request;
+  unsigned long creates = 0;
+  while (reader->Read(&request)){
+    if (request.operation() == OPERATION::_CREATE){
+      creates++;
+    }
+    requests.push_back(request);
+  }
+  if (context->IsCancelled()) {
+    return Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning.");
+  }
+
+  unsigned long tunnelCount = 0;
+  unsigned long capacity = 0;
+  if (opof_get_tunnel_table_stats_server(&tunnelCount, &capacity) != _OK){
+    response->set_requeststatus(ADD_TUNNEL_STATUS::_TUNNEL_TABLE_UNAVAILABLE);
+    return Status::OK;
+  }
+  if (creates > capacity - std::min(tunnelCount, capacity)){
+    opof_log_warn("createIpTunnel: %lu creates do not fit, %lu of %lu tunnels in use", creates, tunnelCount, capacity);
+    response->set_requeststatus(ADD_TUNNEL_STATUS::_TUNNEL_TABLE_FULL);
+    return Status::OK;
+  }
+
+  ADD_TUNNEL_STATUS_T requestStatus = _TUNNEL_ACCEPTED;
+  uint64_t errorStatus = 0;
+  for (size_t i = 0; i < requests.size(); i++){
+    ipTunnelRequest_t request_c = {};
+    tunnelError_t error_c = {};
+    int status = convertTunnelRequest2c(requests[i], &request_c, &error_c);
+    if (status == _OK){
+      switch (request_c.operation){
+        case _TUNNEL_CREATE:
+          status = opof_create_tunnel_server(&request_c, &error_c);
+          break;
+        case _TUNNEL_UPDATE:
+          status = opof_update_tunnel_server(&request_c, &error_c);
+          break;
+        case _TUNNEL_DELETE:
+          status = opof_delete_tunnel_server(request_c.tunnelId, &error_c);
+          break;
+        default:
+          status = _INVALID_ARGUMENT;
+          setTunnelError(&error_c, "Missing tunnel operation");
+          break;
+      }
+    }
+    if (status != _OK){
+      if (!error_c.error){
+        setTunnelError(&error_c, "Tunnel rejected by the offload device");
+      }
+      createIpTunnelResponse *tunnelResponse = response->add_responses();
+      tunnelResponse->set_tunnelid(request_c.tunnelId);
+      convertTunnelError2cpp(&error_c, tunnelResponse->mutable_error());
+      if (i < 64){
+        errorStatus |= 1ULL << i;
+      }
+      if (requestStatus == _TUNNEL_ACCEPTED){
+        requestStatus = tunnelStatus(status);
+      }
+      opof_log_warn("createIpTunnel: tunnel %lu rejected by the backend, status %d", request_c.tunnelId, status);
+    }
+  }
+  response->set_requeststatus((ADD_TUNNEL_STATUS)requestStatus);
+  response->set_errorstatus(errorStatus);
+  return Status::OK;
+}
+
+/** \ingroup serverlibrary
+* \brief getIpTunnel
+*
+* \param context
+* \param request
+* \param response
+*/
+Status TunnelTableImpl::getIpTunnel(ServerContext* context, const tunnelIdRequest* request, ipTunnelResponse* response) {
+  ipTunnelResponse_t response_c = {};
+  if (context->IsCancelled()) {
+    return Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning.");
+  }
+  int status = opof_get_tunnel_server(request->tunnelid(), &response_c);
+  if (status == _NOT_FOUND){
+    return Status(grpc::StatusCode::NOT_FOUND, "Tunnel Not Found");
+  } else if (status != _OK){
+    return Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error");
+  }
+  convertTunnelResponse2cpp(&response_c, response);
+  return Status::OK;
+}
+
+/** \ingroup serverlibrary
+* \brief getIpTunnelStats
+*
+* \param context
+* \param request
+* \param response
+*/
+Status TunnelTableImpl::getIpTunnelStats(ServerContext* context, const tunnelIdRequest* request, ipTunnelStatsResponse* response) {
+  ipTunnelStatsResponse_t response_c = {};
+  if (context->IsCancelled()) {
+    return Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning.");
+  }
+  int status = opof_get_tunnel_stats_server(request->tunnelid(), &response_c);
+  if (status == _NOT_FOUND){
+    return Status(grpc::StatusCode::NOT_FOUND, "Tunnel Not Found");
+  } else if (status != _OK){
+    return Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error");
+  }
+  convertTunnelStatsResponse2cpp(&response_c, response);
+  return Status::OK;
+}
+
+/*
+ * Pages through the backend TUNNEL_BUFFER_MAX tunnels at a time and writes
+ * a message every tunnelsPerRequest tunnels. A tunnelsPerRequest of 0 gets
+ * TUNNEL_BUFFER_MAX per message too: one message with every tunnel would
+ * pass gRPC's default 4 MB message limit long before the table is full. The
+ * scan ends on a short page, or when the cursor wraps to 0 after the tunnel
+ * with the largest tunnelId.
+ */
+template <typename Response_c, typename Response, typename Responses>
+static Status writeAllTunnels(ServerContext* context, unsigned int tunnelsPerRequest,
+  ServerWriter<Responses>* writer,
+  int (*getPage)(int, uint64_t *, Response_c[]),
+  void (*convert)(const Response_c *, Response *))
+{
+  std::vector<Response_c> page(TUNNEL_BUFFER_MAX);
+  Responses responses;
+  uint64_t startTunnel = 0;
+  int count;
+  if (tunnelsPerRequest == 0){
+    tunnelsPerRequest = TUNNEL_BUFFER_MAX;
+  }
+  do {
+    if (context->IsCancelled()) {
+      return Status(StatusCode::CANCELLED, "Deadline exceeded or Client cancelled, abandoning.");
+    }
+    std::fill(page.begin(), page.end(), Response_c());
+    count = getPage(TUNNEL_BUFFER_MAX, &startTunnel, page.data());
+    if (count < 0){
+      return Status(grpc::StatusCode::UNKNOWN, "Internal Open Offload Server Error");
+    }
+    for (int i = 0; i < count; i++){
+      convert(&page[i], responses.add_responses());
+      if ((unsigned int)responses.responses_size() == tunnelsPerRequest){
+        writer->Write(responses);
+        responses.Clear();
+      }
+    }
+  } while (count == TUNNEL_BUFFER_MAX && startTunnel != 0);
+  if (responses.responses_size() > 0){
+    writer->Write(responses);
+  }
+  return Status::OK;
+}
+
+/** \ingroup serverlibrary
+* \brief getAllIpTunnels
+*
+* \param context
+* \param request
+* \param writer
+*/
+Status TunnelTableImpl::getAllIpTunnels(ServerContext* context, const tunnelRequestArgs* request, ServerWriter<ipTunnelResponses>* writer) {
+  return writeAllTunnels<ipTunnelResponse_t, ipTunnelResponse>(context, request->tunnelsperrequest(), writer,
+    opof_get_all_tunnels_server, convertTunnelResponse2cpp);
+}
+
+/** \ingroup serverlibrary
+* \brief getAllIpTunnelsStats
+*
+* \param context
+* \param request
+* \param writer
+*/
+Status TunnelTableImpl::getAllIpTunnelsStats(ServerContext* context, const tunnelRequestArgs* request, ServerWriter<ipTunnelStatsResponses>* writer) {
+  return writeAllTunnels<ipTunnelStatsResponse_t, ipTunnelStatsResponse>(context, request->tunnelsperrequest(), writer,
+    opof_get_all_tunnels_stats_server, convertTunnelStatsResponse2cpp);
+}
@@ -0,0 +1,160 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup servercinterface
+*
+* \brief Per core sharded tunnel counters
+*
+* The shards are separate cache aligned arrays indexed by slot, so the
+* counters of a tunnel are one cache line in each shard. Free slots are
+* kept on a stack, slots never handed out are taken in order.
+*
+*/
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "opof.h"
+#include "opof_tunnel_stats.h"
+
+struct opof_tunnel_stats {
+  unsigned long capacity;
+  int shards;
+  unsigned long used;
+  unsigned long freeCount;
+  long *freeSlots;
+  tunnelCounters_t *counters[OPOF_TUNNEL_STATS_SHARDS_MAX];
+};
+
+/**
+* \ingroup servercinterface
+* \brief Creates the counters of capacity tunnels
+*
+* \param  capacity  The number of slots
+* \param  shards    The number of shards, 0 for one per online CPU
+* \return The counters, NULL when out of memory
+*
+*/
+opof_tunnel_stats_t *opof_tunnel_stats_create(unsigned long capacity, int shards){
+  opof_tunnel_stats_t *stats;
+
+  if (shards <= 0){
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    shards = cpus > 0 ? (int)cpus : 1;
+  }
+  if (shards > OPOF_TUNNEL_STATS_SHARDS_MAX){
+    shards = OPOF_TUNNEL_STATS_SHARDS_MAX;
+  }
+  stats = (opof_tunnel_stats_t *)calloc(1, sizeof(*stats));
+  if (stats == NULL){
+    return NULL;
+  }
+  stats->capacity = capacity;
+  stats->shards = shards;
+  stats->freeSlots = (long *)malloc(capacity * sizeof(long));
+  if (stats->freeSlots == NULL){
+    opof_tunnel_stats_destroy(stats);
+    return NULL;
+  }
+  for (int shard = 0; shard < shards; shard++){
+    if (posix_memalign((void **)&stats->counters[shard], 64, capacity * sizeof(tunnelCounters_t)) != 0){
+      stats->counters[shard] = NULL;
+      opof_tunnel_stats_destroy(stats);
+      return NULL;
+    }
+  }
+  return stats;
+}
+
+void opof_tunnel_stats_destroy(opof_tunnel_stats_t *stats){
+  if (stats == NULL){
+    return;
+  }
+  for (int shard = 0; shard < stats->shards; shard++){
+    free(stats->counters[shard]);
+  }
+  free(stats->freeSlots);
+  free(stats);
+}
+
+int opof_tunnel_stats_shards(opof_tunnel_stats_t *stats){
+  return stats->shards;
+}
+
+/* the shard of the CPU the caller runs on, worth keeping for a burst of packets */
+int opof_tunnel_stats_current_shard(opof_tunnel_stats_t *stats){
+  int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : cpu % stats->shards;
+}
+
+/**
+* \ingroup servercinterface
+* \brief Takes a slot with all counters at zero
+*
+* \param  stats  The counters
+* \return The slot, -1 when all capacity slots are taken
+*
+*/
+long opof_tunnel_stats_alloc(opof_tunnel_stats_t *stats){
+  long slot;
+
+  if (stats->freeCount > 0){
+    slot = stats->freeSlots[--stats->freeCount];
+  } else if (stats->used < stats->capacity){
+    slot = stats->used++;
+  } else {
+    return -1;
+  }
+  for (int shard = 0; shard < stats->shards; shard++){
+    memset(&stats->counters[shard][slot], 0, sizeof(tunnelCounters_t));
+  }
+  return slot;
+}
+
+void opof_tunnel_stats_free(opof_tunnel_stats_t *stats, long slot){
+  if (slot >= 0 && (unsigned long)slot < stats->used){
+    stats->freeSlots[stats->freeCount++] = slot;
+  }
+}
+
+/* the counters of slot the given shard adds to with opof_tunnel_stats_add */
+tunnelCounters_t *opof_tunnel_stats_counters(opof_tunnel_stats_t *stats, int shard, long slot){
+  return &stats->counters[shard][slot];
+}
+
+/**
+* \ingroup servercinterface
+* \brief Sums the counters of a slot over all shards
+*
+* \param  stats     The counters
+* \param  slot      The slot of the tunnel
+* \param  counters  The sums
+*
+*/
+void opof_tunnel_stats_read(opof_tunnel_stats_t *stats, long slot, tunnelCounters_t *counters){
+  uint64_t sums[sizeof(tunnelCounters_t) / sizeof(uint64_t)] = {0};
+
+  for (int shard = 0; shard < stats->shards; shard++){
+    uint64_t *shardCounters = (uint64_t *)&stats->counters[shard][slot];
+    for (unsigned int i = 0; i < sizeof(sums) / sizeof(sums[0]); i++){
+      sums[i] += __atomic_load_n(&shardCounters[i], __ATOMIC_RELAXED);
+    }
+  }
+  memcpy(counters, sums, sizeof(sums));
+}
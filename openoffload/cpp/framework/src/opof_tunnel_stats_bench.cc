@@ -0,0 +1,235 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup testlibrary
+*
+* \brief Counter update and stats polling rate of the sharded tunnel counters
+*
+* Writer threads count packets on random tunnels of an opof_tunnel_stats,
+* by default 100000 tunnels, each writer on its own shard as the cores of a
+* datapath would be. A poller reads the counters of all tunnels a page at a
+* time, taking a lock per page the way the tunnel server pages
+* getAllIpTunnelsStats.
+*
+* The writers run alone and then with the poller, once with a shard per
+* writer and once with all writers on a single shard, and the updates per
+* second of the runs show what polling and sharing cost the writers. The
+* counters read once the writers stop must add up to the packets counted,
+* or the run fails.
+*
+* Results are printed as JSON.
+*/
+extern "C" {
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opof.h"
+#include "opof_test.h"
+#include "opof_tunnel.h"
+#include "opof_tunnel_stats.h"
+}
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct StatsBenchConfig {
+    unsigned long tunnels;
+    unsigned int writers;
+    unsigned long millis;
+    unsigned int pageSize;
+    std::string output;
+};
+
+struct StatsRun {
+    double updatesPerSecond;
+    double sweepsPerSecond;
+    uint64_t packets;
+    uint64_t counted;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double secondsSince(BenchClock::time_point start) {
+  return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+static uint64_t countAll(opof_tunnel_stats_t *stats, unsigned long tunnels) {
+  tunnelCounters_t counters;
+  uint64_t packets = 0;
+  for (unsigned long slot = 0; slot < tunnels; slot++){
+    opof_tunnel_stats_read(stats, slot, &counters);
+    packets += counters.inPackets;
+  }
+  return packets;
+}
+
+static StatsRun runWriters(const StatsBenchConfig &config, int shards, bool poll) {
+  opof_tunnel_stats_t *stats = opof_tunnel_stats_create(config.tunnels, shards);
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> updates(config.writers);
+  std::atomic<bool> running(true);
+  std::atomic<uint64_t> sweeps(0);
+  std::mutex pageLock;
+  StatsRun run = {0, 0, 0, 0};
+
+  if (stats == NULL){
+    return run;
+  }
+  for (unsigned long i = 0; i < config.tunnels; i++){
+    opof_tunnel_stats_alloc(stats);
+  }
+  for (unsigned int w = 0; w < config.writers; w++){
+    threads.emplace_back([&, w]() {
+      int shard = w % opof_tunnel_stats_shards(stats);
+      uint64_t x = 0x9e3779b97f4a7c15ull * (w + 1);
+      uint64_t n = 0;
+      while (running.load(std::memory_order_relaxed)){
+        for (int i = 0; i < 256; i++){
+          x ^= x << 13;
+          x ^= x >> 7;
+          x ^= x << 17;
+          tunnelCounters_t *counters = opof_tunnel_stats_counters(stats, shard, x % config.tunnels);
+          opof_tunnel_stats_add(&counters->inPackets, 1);
+          opof_tunnel_stats_add(&counters->inBytes, 64 + (x >> 40) % 1437);
+        }
+        n += 256;
+      }
+      updates[w] = n;
+    });
+  }
+  if (poll){
+    threads.emplace_back([&]() {
+      std::vector<tunnelCounters_t> page(config.pageSize);
+      while (running.load(std::memory_order_relaxed)){
+        for (unsigned long slot = 0; slot < config.tunnels; ){
+          std::lock_guard<std::mutex> guard(pageLock);
+          for (unsigned int i = 0; i < config.pageSize && slot < config.tunnels; i++, slot++){
+            opof_tunnel_stats_read(stats, slot, &page[i]);
+          }
+        }
+        sweeps++;
+      }
+    });
+  }
+  BenchClock::time_point start = BenchClock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(config.millis));
+  running = false;
+  for (auto &thread : threads){
+    thread.join();
+  }
+  double seconds = secondsSince(start);
+  for (uint64_t n : updates){
+    run.packets += n;
+  }
+  run.updatesPerSecond = run.packets / seconds;
+  run.sweepsPerSecond = sweeps / seconds;
+  run.counted = countAll(stats, config.tunnels);
+  opof_tunnel_stats_destroy(stats);
+  return run;
+}
+
+static void printRun(FILE *out, const char *name, const StatsRun &run, bool last) {
+  fprintf(out, "  \"%s\": {\"updatesPerSecond\": %.0f, \"sweepsPerSecond\": %.1f, \"packets\": %lu, \"counted\": %lu}%s\n",
+          name, run.updatesPerSecond, run.sweepsPerSecond, (unsigned long)run.packets, (unsigned long)run.counted,
+          last ? "" : ",");
+}
+
+static void displayHelp(void) {
+  printf("\nCommand line arguments for the OpenOffload tunnel counters benchmark version: %s \n", OPOF_VERSION);
+  printf("\t-n, --tunnels         Tunnels counted on (default 100000)\n");
+  printf("\t-w, --writers         Writer threads (default 2)\n");
+  printf("\t-m, --millis          Milliseconds per run (default 1000)\n");
+  printf("\t-p, --page            Tunnels the poller reads per lock (default 64)\n");
+  printf("\t-o, --output          Write the JSON results to this file instead of stdout\n");
+  printf("\t-h, --help:           Command line help \n\n");
+}
+
+int main(int argc, char **argv) {
+  StatsBenchConfig config = {100000, 2, 1000, TUNNEL_BUFFER_MAX, ""};
+  static struct option longopts[] = {
+    {"tunnels", required_argument, NULL, 'n'},
+    {"writers", required_argument, NULL, 'w'},
+    {"millis", required_argument, NULL, 'm'},
+    {"page", required_argument, NULL, 'p'},
+    {"output", required_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:w:m:p:o:h", longopts, NULL)) != -1){
+    switch (c){
+      case 'n':
+        config.tunnels = strtoul(optarg, NULL, 0);
+        break;
+      case 'w':
+        config.writers = strtoul(optarg, NULL, 0);
+        break;
+      case 'm':
+        config.millis = strtoul(optarg, NULL, 0);
+        break;
+      case 'p':
+        config.pageSize = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        config.output = optarg;
+        break;
+      case 'h':
+      default:
+        displayHelp();
+        return c == 'h' ? 0 : 1;
+    }
+  }
+  if (config.tunnels == 0 || config.writers == 0 || config.writers > OPOF_TUNNEL_STATS_SHARDS_MAX || config.pageSize == 0){
+    fprintf(stderr, "tunnels and page must be at least 1, writers 1 to %d\n", OPOF_TUNNEL_STATS_SHARDS_MAX);
+    return 1;
+  }
+
+  StatsRun sharded = runWriters(config, config.writers, false);
+  StatsRun shardedPolled = runWriters(config, config.writers, true);
+  StatsRun shared = runWriters(config, 1, false);
+  StatsRun sharedPolled = runWriters(config, 1, true);
+  bool counted = sharded.packets == sharded.counted && shardedPolled.packets == shardedPolled.counted &&
+    shared.packets == shared.counted && sharedPolled.packets == sharedPolled.counted && sharded.packets > 0;
+
+  FILE *out = stdout;
+  if (!config.output.empty()){
+    out = fopen(config.output.c_str(), "w");
+    if (out == NULL){
+      fprintf(stderr, "Cannot write %s\n", config.output.c_str());
+      return 1;
+    }
+  }
+  fprintf(out, "{\n");
+  fprintf(out, "  \"config\": {\"tunnels\": %lu, \"writers\": %u, \"millis\": %lu, \"page\": %u},\n",
+          config.tunnels, config.writers, config.millis, config.pageSize);
+  printRun(out, "sharded", sharded, false);
+  printRun(out, "shardedPolled", shardedPolled, false);
+  printRun(out, "shared", shared, false);
+  printRun(out, "sharedPolled", sharedPolled, false);
+  fprintf(out, "  \"countsMatch\": %s\n", counted ? "true" : "false");
+  fprintf(out, "}\n");
+  if (out != stdout){
+    fclose(out);
+  }
+  return counted ? 0 : 1;
+}
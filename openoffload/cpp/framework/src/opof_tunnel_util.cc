@@ -0,0 +1,636 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup utilities
+*
+* \brief Mapping between the tunneloffload classes and the C structs of opof_tunnel.h
+*
+* The proto leaves the encoding of the bytes fields open. The Python client
+* of tests/basicIPT sends MAC addresses, IPv6 addresses and IPsec keys as hex
+* text, so this is what is written, while both hex text and plain binary are
+* read.
+*
+*/
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+#include "opof.h"
+#include "opof_tunnel.h"
+}
+
+#include <algorithm>
+
+#include "opof_tunnel_util.h"
+#include "opof_tunnel_grpc.h"
+
+static int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static std::string bytes2hex(const uint8_t *bytes, size_t len)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(len * 2, '0');
+  for (size_t i = 0; i < len; i++){
+    hex[2 * i] = digits[bytes[i] >> 4];
+    hex[2 * i + 1] = digits[bytes[i] & 0xf];
+  }
+  return hex;
+}
+
+/*
+ * Reads len bytes either as binary or as 2 * len hex digits, anything else
+ * is rejected.
+ */
+static bool bytes2c(const std::string &in, uint8_t *out, size_t len)
+{
+  if (in.size() == len * 2){
+    for (size_t i = 0; i < len; i++){
+      int hi = hexDigit(in[2 * i]);
+      int lo = hexDigit(in[2 * i + 1]);
+      if (hi < 0 || lo < 0){
+        return false;
+      }
+      out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+  }
+  if (in.size() == len){
+    memcpy(out, in.data(), len);
+    return true;
+  }
+  return false;
+}
+
+void setTunnelError(tunnelError_t *error, const char *errorString)
+{
+  error->error = true;
+  strncpy(error->errorString, errorString, TUNNEL_ERROR_STRING_MAX - 1);
+  error->errorString[TUNNEL_ERROR_STRING_MAX - 1] = '\0';
+}
+
+static void convertMacPair2cpp(const tunnelMacPair_t *mac_c, MacPair *mac)
+{
+  mac->set_sourcemac(bytes2hex(mac_c->sourceMac, 6));
+  mac->set_destinationmac(bytes2hex(mac_c->destinationMac, 6));
+}
+
+static bool convertMacPair2c(const MacPair &mac, tunnelMacPair_t *mac_c)
+{
+  mac_c->enable = true;
+  return bytes2c(mac.sourcemac(), mac_c->sourceMac, 6) &&
+         bytes2c(mac.destinationmac(), mac_c->destinationMac, 6);
+}
+
+static void convertIpPair2cpp(const tunnelIpPair_t *ips_c, IPV4Pair *ipv4, IPV6Pair *ipv6)
+{
+  if (ips_c->ipver == _IPV6){
+    ipv6->set_sourceip(bytes2hex(ips_c->sourceIpv6.s6_addr, 16));
+    ipv6->set_destinationip(bytes2hex(ips_c->destinationIpv6.s6_addr, 16));
+  } else {
+    ipv4->set_sourceip(ips_c->sourceIp.s_addr);
+    ipv4->set_destinationip(ips_c->destinationIp.s_addr);
+  }
+}
+
+static void convertIpv4Pair2c(const IPV4Pair &ipv4, tunnelIpPair_t *ips_c)
+{
+  ips_c->enable = true;
+  ips_c->ipver = _IPV4;
+  ips_c->sourceIp.s_addr = ipv4.sourceip();
+  ips_c->destinationIp.s_addr = ipv4.destinationip();
+}
+
+static bool convertIpv6Pair2c(const IPV6Pair &ipv6, tunnelIpPair_t *ips_c)
+{
+  ips_c->enable = true;
+  ips_c->ipver = _IPV6;
+  return bytes2c(ipv6.sourceip(), ips_c->sourceIpv6.s6_addr, 16) &&
+         bytes2c(ipv6.destinationip(), ips_c->destinationIpv6.s6_addr, 16);
+}
+
+static void convertIpMatch2cpp(const tunnelIpMatch_t *match_c, IPV4Match *ipv4, IPV6Match *ipv6)
+{
+  if (match_c->ipver == _IPV6){
+    ipv6->set_sourceip(bytes2hex(match_c->sourceIpv6.s6_addr, 16));
+    ipv6->set_sourceipprefix(match_c->sourceIpPrefix);
+    ipv6->set_destinationip(bytes2hex(match_c->destinationIpv6.s6_addr, 16));
+    ipv6->set_destinationipprefix(match_c->destinationIpPrefix);
+  } else {
+    ipv4->set_sourceip(match_c->sourceIp.s_addr);
+    ipv4->set_sourceipprefix(match_c->sourceIpPrefix);
+    ipv4->set_destinationip(match_c->destinationIp.s_addr);
+    ipv4->set_destinationipprefix(match_c->destinationIpPrefix);
+  }
+}
+
+static void convertIpv4Match2c(const IPV4Match &ipv4, tunnelIpMatch_t *match_c)
+{
+  match_c->enable = true;
+  match_c->ipver = _IPV4;
+  match_c->sourceIp.s_addr = ipv4.sourceip();
+  match_c->sourceIpPrefix = (uint8_t)ipv4.sourceipprefix();
+  match_c->destinationIp.s_addr = ipv4.destinationip();
+  match_c->destinationIpPrefix = (uint8_t)ipv4.destinationipprefix();
+}
+
+static bool convertIpv6Match2c(const IPV6Match &ipv6, tunnelIpMatch_t *match_c)
+{
+  match_c->enable = true;
+  match_c->ipver = _IPV6;
+  match_c->sourceIpPrefix = (uint8_t)ipv6.sourceipprefix();
+  match_c->destinationIpPrefix = (uint8_t)ipv6.destinationipprefix();
+  return bytes2c(ipv6.sourceip(), match_c->sourceIpv6.s6_addr, 16) &&
+         bytes2c(ipv6.destinationip(), match_c->destinationIpv6.s6_addr, 16);
+}
+
+static void convertSA2cpp(const ipsecSA_t *sa_c, IPSecSAParams *sa)
+{
+  sa->set_spi(sa_c->spi);
+  sa->set_encryptionkey(bytes2hex(sa_c->key, sa_c->keyLength));
+  sa->set_operation((OPERATION)sa_c->operation);
+}
+
+/*
+ * Keys of either AES size come as hex text or binary. Text made only of hex
+ * digits is taken as hex, which a random binary key practically never is,
+ * anything else is kept as it came, up to TUNNEL_IPSEC_KEY_MAX bytes. The
+ * backend checks keyLength against the encryption type.
+ */
+static void convertSA2c(const IPSecSAParams &sa, ipsecSA_t *sa_c)
+{
+  const std::string &key = sa.encryptionkey();
+  sa_c->spi = sa.spi();
+  sa_c->operation = (TUNNEL_OPERATION_T)sa.operation();
+  if (key.size() % 2 == 0 && key.size() <= 2 * TUNNEL_IPSEC_KEY_MAX &&
+      bytes2c(key, sa_c->key, key.size() / 2)){
+    sa_c->keyLength = (uint8_t)(key.size() / 2);
+  } else {
+    sa_c->keyLength = (uint8_t)std::min(key.size(), (size_t)TUNNEL_IPSEC_KEY_MAX);
+    memcpy(sa_c->key, key.data(), sa_c->keyLength);
+  }
+}
+
+static void convertMatch2cpp(const tunnelMatch_t *match_c, MatchCriteria *match)
+{
+  match->set_ingressinterface(match_c->ingressInterface);
+  if (match_c->macMatch.enable){
+    convertMacPair2cpp(&match_c->macMatch, match->mutable_macmatch());
+  }
+  if (match_c->ipMatch.enable){
+    if (match_c->ipMatch.ipver == _IPV6){
+      convertIpMatch2cpp(&match_c->ipMatch, NULL, match->mutable_ipv6match());
+    } else {
+      convertIpMatch2cpp(&match_c->ipMatch, match->mutable_ipv4match(), NULL);
+    }
+  }
+  match->set_tunnelid(match_c->tunnelId);
+  switch (match_c->matchType){
+    case _TUNNEL_MATCH_IPSEC:
+      match->mutable_ipsecmatch()->set_spi(match_c->spi);
+      match->mutable_ipsecmatch()->set_sn(match_c->sn);
+      break;
+    case _TUNNEL_MATCH_GENEVE: {
+      MatchCriteria::GeneveMatch *geneve = match->mutable_genevematch();
+      geneve->set_vni(match_c->vni);
+      geneve->set_protocoltype(match_c->protocolType);
+      if (match_c->innerMacMatch.enable){
+        convertMacPair2cpp(&match_c->innerMacMatch, geneve->mutable_macmatch());
+      }
+      if (match_c->innerIpMatch.enable){
+        if (match_c->innerIpMatch.ipver == _IPV6){
+          convertIpMatch2cpp(&match_c->innerIpMatch, NULL, geneve->mutable_ipv6match());
+        } else {
+          convertIpMatch2cpp(&match_c->innerIpMatch, geneve->mutable_ipv4match(), NULL);
+        }
+      }
+      break;
+    }
+    case _TUNNEL_MATCH_VXLAN: {
+      MatchCriteria::VXLanMatch *vxlan = match->mutable_vxlanmatch();
+      vxlan->set_vni(match_c->vni);
+      if (match_c->innerMacMatch.enable){
+        convertMacPair2cpp(&match_c->innerMacMatch, vxlan->mutable_macmatch());
+      }
+      if (match_c->innerIpMatch.enable){
+        if (match_c->innerIpMatch.ipver == _IPV6){
+          convertIpMatch2cpp(&match_c->innerIpMatch, NULL, vxlan->mutable_ipv6match());
+        } else {
+          convertIpMatch2cpp(&match_c->innerIpMatch, vxlan->mutable_ipv4match(), NULL);
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+static bool convertMatch2c(const MatchCriteria &match, tunnelMatch_t *match_c)
+{
+  bool valid = true;
+  strncpy(match_c->ingressInterface, match.ingressinterface().c_str(), TUNNEL_INTERFACE_MAX - 1);
+  if (match.has_macmatch()){
+    valid &= convertMacPair2c(match.macmatch(), &match_c->macMatch);
+  }
+  if (match.ip_match_case() == MatchCriteria::kIpv4Match){
+    convertIpv4Match2c(match.ipv4match(), &match_c->ipMatch);
+  } else if (match.ip_match_case() == MatchCriteria::kIpv6Match){
+    valid &= convertIpv6Match2c(match.ipv6match(), &match_c->ipMatch);
+  }
+  match_c->tunnelId = match.tunnelid();
+  switch (match.match_case()){
+    case MatchCriteria::kIpsecMatch:
+      match_c->matchType = _TUNNEL_MATCH_IPSEC;
+      match_c->spi = match.ipsecmatch().spi();
+      match_c->sn = match.ipsecmatch().sn();
+      break;
+    case MatchCriteria::kGeneveMatch: {
+      const MatchCriteria::GeneveMatch &geneve = match.genevematch();
+      match_c->matchType = _TUNNEL_MATCH_GENEVE;
+      match_c->vni = geneve.vni();
+      match_c->protocolType = geneve.protocoltype();
+      if (geneve.has_macmatch()){
+        valid &= convertMacPair2c(geneve.macmatch(), &match_c->innerMacMatch);
+      }
+      if (geneve.ip_match_case() == MatchCriteria::GeneveMatch::kIpv4Match){
+        convertIpv4Match2c(geneve.ipv4match(), &match_c->innerIpMatch);
+      } else if (geneve.ip_match_case() == MatchCriteria::GeneveMatch::kIpv6Match){
+        valid &= convertIpv6Match2c(geneve.ipv6match(), &match_c->innerIpMatch);
+      }
+      break;
+    }
+    case MatchCriteria::kVxlanMatch: {
+      const MatchCriteria::VXLanMatch &vxlan = match.vxlanmatch();
+      match_c->matchType = _TUNNEL_MATCH_VXLAN;
+      match_c->vni = vxlan.vni();
+      if (vxlan.has_macmatch()){
+        valid &= convertMacPair2c(vxlan.macmatch(), &match_c->innerMacMatch);
+      }
+      if (vxlan.ip_match_case() == MatchCriteria::VXLanMatch::kIpv4Match){
+        convertIpv4Match2c(vxlan.ipv4match(), &match_c->innerIpMatch);
+      } else if (vxlan.ip_match_case() == MatchCriteria::VXLanMatch::kIpv6Match){
+        valid &= convertIpv6Match2c(vxlan.ipv6match(), &match_c->innerIpMatch);
+      }
+      break;
+    }
+    default:
+      match_c->matchType = _TUNNEL_MATCH_NONE;
+      break;
+  }
+  return valid;
+}
+
+static void convertGeneveEncap2cpp(const geneveEncap_t *geneve_c, GENEVEEncap *geneve)
+{
+  if (geneve_c->outerIps.enable){
+    if (geneve_c->outerIps.ipver == _IPV6){
+      convertIpPair2cpp(&geneve_c->outerIps, NULL, geneve->mutable_outeripv6pair());
+    } else {
+      convertIpPair2cpp(&geneve_c->outerIps, geneve->mutable_outeripv4pair(), NULL);
+    }
+  }
+  if (geneve_c->innerMacPair.enable){
+    convertMacPair2cpp(&geneve_c->innerMacPair, geneve->mutable_innermacpair());
+  }
+  geneve->set_optionlength(geneve_c->optionLength);
+  geneve->set_controlpacket(geneve_c->controlPacket);
+  geneve->set_criticaloptionpresent(geneve_c->criticalOptionPresent);
+  geneve->set_vni(geneve_c->vni);
+  geneve->set_protocoltype(geneve_c->protocolType);
+  for (int i = 0; i < geneve_c->numberOptions && i < TUNNEL_GENEVE_OPTIONS_MAX; i++){
+    const geneveOption_t *option_c = &geneve_c->options[i];
+    GENEVEOption *option = geneve->add_geneveoption();
+    option->set_optionclass(option_c->optionClass);
+    option->set_type(option_c->type);
+    option->set_length(option_c->length);
+    option->set_data(option_c->data, option_c->dataLength);
+  }
+}
+
+/*
+ * Options beyond TUNNEL_GENEVE_OPTIONS_MAX are counted but not copied, so
+ * the backend can still report tooManyOptions.
+ */
+static bool convertGeneveEncap2c(const GENEVEEncap &geneve, geneveEncap_t *geneve_c)
+{
+  bool valid = true;
+  if (geneve.ip_case() == GENEVEEncap::kOuterIpv4Pair){
+    convertIpv4Pair2c(geneve.outeripv4pair(), &geneve_c->outerIps);
+  } else if (geneve.ip_case() == GENEVEEncap::kOuterIpv6Pair){
+    valid &= convertIpv6Pair2c(geneve.outeripv6pair(), &geneve_c->outerIps);
+  }
+  if (geneve.has_innermacpair()){
+    valid &= convertMacPair2c(geneve.innermacpair(), &geneve_c->innerMacPair);
+  }
+  geneve_c->optionLength = geneve.optionlength();
+  geneve_c->controlPacket = geneve.controlpacket();
+  geneve_c->criticalOptionPresent = geneve.criticaloptionpresent();
+  geneve_c->vni = geneve.vni();
+  geneve_c->protocolType = geneve.protocoltype();
+  geneve_c->numberOptions = geneve.geneveoption_size();
+  for (int i = 0; i < geneve.geneveoption_size() && i < TUNNEL_GENEVE_OPTIONS_MAX; i++){
+    const GENEVEOption &option = geneve.geneveoption(i);
+    geneveOption_t *option_c = &geneve_c->options[i];
+    option_c->optionClass = option.optionclass();
+    option_c->type = option.type();
+    option_c->length = option.length();
+    option_c->dataLength = (uint8_t)std::min(option.data().size(), (size_t)TUNNEL_GENEVE_OPTION_DATA_MAX);
+    memcpy(option_c->data, option.data().data(), option_c->dataLength);
+    if (option.data().size() > TUNNEL_GENEVE_OPTION_DATA_MAX){
+      valid = false;
+    }
+  }
+  return valid;
+}
+
+/** \ingroup utilities
+*
+* \brief Convert a C ipTunnelRequest_t to a C++ ipTunnelRequest Class instance
+*
+* \param *request_c    The ipTunnelRequest_t struct to convert
+* \param *request      The ipTunnelRequest to fill
+*
+*/
+void convertTunnelRequest2cpp(const ipTunnelRequest_t *request_c, ipTunnelRequest *request)
+{
+  request->set_tunnelid(request_c->tunnelId);
+  request->set_operation((OPERATION)request_c->operation);
+  convertMatch2cpp(&request_c->match, request->mutable_match_criteria());
+  request->set_nextaction((ACTION)request_c->nextAction);
+  switch (request_c->tunnelType){
+    case _IP_TUNNEL_IPSEC_ENC: {
+      const ipsecTunnel_t *ipsec_c = &request_c->ipsec;
+      IPSecEnc *enc = request->mutable_ipsectunnel()->mutable_ipsecenc();
+      enc->set_tunneltype((IPSecTunnelType)ipsec_c->tunnelType);
+      enc->set_encryptiontype((ENC_TYPE)ipsec_c->encryptionType);
+      if (ipsec_c->numberSAs > 0){
+        convertSA2cpp(&ipsec_c->sas[0], enc->mutable_ipsecsa());
+      }
+      if (ipsec_c->tunnelIps.enable){
+        if (ipsec_c->tunnelIps.ipver == _IPV6){
+          convertIpPair2cpp(&ipsec_c->tunnelIps, NULL, enc->mutable_ipv6_tunnel());
+        } else {
+          convertIpPair2cpp(&ipsec_c->tunnelIps, enc->mutable_ipv4_tunnel(), NULL);
+        }
+      }
+      break;
+    }
+    case _IP_TUNNEL_IPSEC_DEC: {
+      const ipsecTunnel_t *ipsec_c = &request_c->ipsec;
+      IPSecDec *dec = request->mutable_ipsectunnel()->mutable_ipsecdec();
+      dec->set_tunneltype((IPSecTunnelType)ipsec_c->tunnelType);
+      dec->set_encryptiontype((ENC_TYPE)ipsec_c->encryptionType);
+      for (int i = 0; i < ipsec_c->numberSAs && i < TUNNEL_IPSEC_SAS_MAX; i++){
+        convertSA2cpp(&ipsec_c->sas[i], dec->add_ipsecsas());
+      }
+      break;
+    }
+    case _IP_TUNNEL_GENEVE_ENCAP:
+      convertGeneveEncap2cpp(&request_c->geneve, request->mutable_geneve()->mutable_geneveencap());
+      break;
+    case _IP_TUNNEL_GENEVE_DECAP:
+      request->mutable_geneve()->mutable_genevedecap();
+      break;
+    case _IP_TUNNEL_NAT:
+      request->mutable_nat()->set_sourceip(request_c->natSourceIp);
+      break;
+    default:
+      break;
+  }
+}
+
+/** \ingroup utilities
+*
+* \brief Convert a C++ ipTunnelRequest Class instance to a C ipTunnelRequest_t
+*
+* \param &request      The ipTunnelRequest to convert
+* \param *request_c    The zeroed ipTunnelRequest_t to fill
+* \param *error        Set when a MAC, IPv6 address or GENEVE option can not be read
+* \return _OK, or _INVALID_ARGUMENT with the error set
+*
+*/
+int convertTunnelRequest2c(const ipTunnelRequest &request, ipTunnelRequest_t *request_c, tunnelError_t *error)
+{
+  request_c->tunnelId = request.tunnelid();
+  request_c->operation = (TUNNEL_OPERATION_T)request.operation();
+  request_c->nextAction = (TUNNEL_ACTION_T)request.nextaction();
+  if (!convertMatch2c(request.match_criteria(), &request_c->match)){
+    error->matchError = _MATCH_INVALID_FIELD;
+    setTunnelError(error, "Invalid MAC or IPv6 address in the match");
+    return _INVALID_ARGUMENT;
+  }
+  switch (request.tunnel_case()){
+    case ipTunnelRequest::kIpsecTunnel:
+      if (request.ipsectunnel().ipsec_case() == IPSecTunnel::kIpsecEnc){
+        const IPSecEnc &enc = request.ipsectunnel().ipsecenc();
+        ipsecTunnel_t *ipsec_c = &request_c->ipsec;
+        request_c->tunnelType = _IP_TUNNEL_IPSEC_ENC;
+        ipsec_c->tunnelType = (IPSEC_TUNNEL_TYPE_T)enc.tunneltype();
+        ipsec_c->encryptionType = (IPSEC_ENC_TYPE_T)enc.encryptiontype();
+        if (enc.has_ipsecsa()){
+          ipsec_c->numberSAs = 1;
+          convertSA2c(enc.ipsecsa(), &ipsec_c->sas[0]);
+        }
+        bool valid = true;
+        if (enc.tunnelIps_case() == IPSecEnc::kIpv4Tunnel){
+          convertIpv4Pair2c(enc.ipv4_tunnel(), &ipsec_c->tunnelIps);
+        } else if (enc.tunnelIps_case() == IPSecEnc::kIpv6Tunnel){
+          valid = convertIpv6Pair2c(enc.ipv6_tunnel(), &ipsec_c->tunnelIps);
+        }
+        if (!valid){
+          error->ipsecError = _IPSEC_MISSING_FIELDS;
+          setTunnelError(error, "Invalid IPv6 tunnel address");
+          return _INVALID_ARGUMENT;
+        }
+      } else if (request.ipsectunnel().ipsec_case() == IPSecTunnel::kIpsecDec){
+        const IPSecDec &dec = request.ipsectunnel().ipsecdec();
+        ipsecTunnel_t *ipsec_c = &request_c->ipsec;
+        request_c->tunnelType = _IP_TUNNEL_IPSEC_DEC;
+        ipsec_c->tunnelType = (IPSEC_TUNNEL_TYPE_T)dec.tunneltype();
+        ipsec_c->encryptionType = (IPSEC_ENC_TYPE_T)dec.encryptiontype();
+        if (dec.ipsecsas_size() > TUNNEL_IPSEC_SAS_MAX){
+          error->ipsecError = _IPSEC_MISSING_FIELDS;
+          setTunnelError(error, "Too many SAs in the IPSec decryption tunnel");
+          return _INVALID_ARGUMENT;
+        }
+        ipsec_c->numberSAs = dec.ipsecsas_size();
+        for (int i = 0; i < dec.ipsecsas_size(); i++){
+          convertSA2c(dec.ipsecsas(i), &ipsec_c->sas[i]);
+        }
+      }
+      break;
+    case ipTunnelRequest::kGeneve:
+      if (request.geneve().encap_decap_case() == GENEVE::kGeneveEncap){
+        request_c->tunnelType = _IP_TUNNEL_GENEVE_ENCAP;
+        if (!convertGeneveEncap2c(request.geneve().geneveencap(), &request_c->geneve)){
+          error->geneveError = _GENEVE_INVALID_FIELD;
+          setTunnelError(error, "Invalid MAC, IPv6 address or option data in GENEVE");
+          return _INVALID_ARGUMENT;
+        }
+      } else if (request.geneve().encap_decap_case() == GENEVE::kGeneveDecap){
+        request_c->tunnelType = _IP_TUNNEL_GENEVE_DECAP;
+      }
+      break;
+    case ipTunnelRequest::kNat:
+      request_c->tunnelType = _IP_TUNNEL_NAT;
+      request_c->natSourceIp = request.nat().sourceip();
+      break;
+    default:
+      request_c->tunnelType = _IP_TUNNEL_NONE;
+      break;
+  }
+  return _OK;
+}
+
+void convertTunnelCounters2cpp(const tunnelCounters_t *counters_c, tunnelCounters *counters)
+{
+  counters->set_inpackets(counters_c->inPackets);
+  counters->set_outpackets(counters_c->outPackets);
+  counters->set_inbytes(counters_c->inBytes);
+  counters->set_outbytes(counters_c->outBytes);
+  counters->set_inpacketsdrops(counters_c->inPacketsDrops);
+  counters->set_outpacketsdrops(counters_c->outPacketsDrops);
+  counters->set_inbytesdrops(counters_c->inBytesDrops);
+  counters->set_outbytesdrops(counters_c->outBytesDrops);
+}
+
+void convertTunnelCounters2c(const tunnelCounters &counters, tunnelCounters_t *counters_c)
+{
+  counters_c->inPackets = counters.inpackets();
+  counters_c->outPackets = counters.outpackets();
+  counters_c->inBytes = counters.inbytes();
+  counters_c->outBytes = counters.outbytes();
+  counters_c->inPacketsDrops = counters.inpacketsdrops();
+  counters_c->outPacketsDrops = counters.outpacketsdrops();
+  counters_c->inBytesDrops = counters.inbytesdrops();
+  counters_c->outBytesDrops = counters.outbytesdrops();
+}
+
+void convertTunnelError2cpp(const tunnelError_t *error_c, tunnelErrorMessage *error)
+{
+  tunnelAdditionError *message = error->mutable_errormessage();
+  message->set_matcherror((MatchError)error_c->matchError);
+  message->set_tunnelerror((TunnelError)error_c->tunnelError);
+  message->set_ipsecerror((IPSecError)error_c->ipsecError);
+  message->set_geneveerror((GeneveError)error_c->geneveError);
+  error->set_errorstring(error_c->errorString);
+}
+
+void convertTunnelError2c(const tunnelErrorMessage &error, tunnelError_t *error_c)
+{
+  const tunnelAdditionError &message = error.errormessage();
+  error_c->matchError = (MATCH_ERROR_T)message.matcherror();
+  error_c->tunnelError = (TUNNEL_ERROR_T)message.tunnelerror();
+  error_c->ipsecError = (IPSEC_ERROR_T)message.ipsecerror();
+  error_c->geneveError = (GENEVE_ERROR_T)message.geneveerror();
+  setTunnelError(error_c, error.errorstring().c_str());
+}
+
+void convertTunnelResponse2cpp(const ipTunnelResponse_t *response_c, ipTunnelResponse *response)
+{
+  response->set_tunnelid(response_c->tunnelId);
+  convertTunnelRequest2cpp(&response_c->ipTunnel, response->mutable_iptunnel());
+  convertTunnelCounters2cpp(&response_c->counters, response->mutable_tunnelcounters());
+  if (response_c->error.error){
+    convertTunnelError2cpp(&response_c->error, response->mutable_error());
+  }
+}
+
+void convertTunnelResponse2c(const ipTunnelResponse &response, ipTunnelResponse_t *response_c)
+{
+  tunnelError_t ignored = {};
+  response_c->tunnelId = response.tunnelid();
+  convertTunnelRequest2c(response.iptunnel(), &response_c->ipTunnel, &ignored);
+  convertTunnelCounters2c(response.tunnelcounters(), &response_c->counters);
+  if (response.has_error()){
+    convertTunnelError2c(response.error(), &response_c->error);
+  }
+}
+
+void convertTunnelStatsResponse2cpp(const ipTunnelStatsResponse_t *response_c, ipTunnelStatsResponse *response)
+{
+  response->set_tunnelid(response_c->tunnelId);
+  convertTunnelCounters2cpp(&response_c->counters, response->mutable_tunnelcounters());
+  if (response_c->error.error){
+    convertTunnelError2cpp(&response_c->error, response->mutable_error());
+  }
+}
+
+void convertTunnelStatsResponse2c(const ipTunnelStatsResponse &response, ipTunnelStatsResponse_t *response_c)
+{
+  response_c->tunnelId = response.tunnelid();
+  convertTunnelCounters2c(response.tunnelcounters(), &response_c->counters);
+  if (response.has_error()){
+    convertTunnelError2c(response.error(), &response_c->error);
+  }
+}
+
+void convertCreateTunnelResponses2c(const createIpTunnelResponses &response, createIpTunnelResponses_t *response_c)
+{
+  response_c->requestStatus = (ADD_TUNNEL_STATUS_T)response.requeststatus();
+  response_c->errorStatus = response.errorstatus();
+  response_c->numberResponses = std::min(response.responses_size(), TUNNEL_BUFFER_MAX);
+  for (int i = 0; i < response_c->numberResponses; i++){
+    const createIpTunnelResponse &tunnel = response.responses(i);
+    response_c->responses[i].tunnelId = tunnel.tunnelid();
+    if (tunnel.has_error()){
+      convertTunnelError2c(tunnel.error(), &response_c->responses[i].error);
+    }
+  }
+}
+
+void convertTunnelCapabilities2cpp(const tunnelCapabilities_t *capabilities_c, CapabilityResponse *capabilities)
+{
+  CapabilityResponse::MatchCapabilities *match = capabilities->mutable_matchcapabilities();
+  match->set_ingressinterfacematching(capabilities_c->ingressInterfaceMatching);
+  match->set_vxlanmatching(capabilities_c->vxlanMatching);
+  match->set_genevematching(capabilities_c->geneveMatching);
+  match->set_tunnelmatching(capabilities_c->tunnelMatching);
+  match->set_spimatching(capabilities_c->spiMatching);
+  CapabilityResponse::IPSecCapabilities *ipsec = capabilities->mutable_ipseccapabilities();
+  for (int i = 0; i < capabilities_c->numberTunnelTypes && i < TUNNEL_IPSEC_TYPES_MAX; i++){
+    ipsec->add_tunneltypesupported((IPSecTunnelType)capabilities_c->tunnelTypeSupported[i]);
+  }
+  for (int i = 0; i < capabilities_c->numberEncryptionTypes && i < TUNNEL_ENC_TYPES_MAX; i++){
+    ipsec->add_encryptionsupported((ENC_TYPE)capabilities_c->encryptionSupported[i]);
+  }
+  capabilities->mutable_genevecapabilities()->set_numbergeneveoptionssupported(capabilities_c->numberGeneveOptionsSupported);
+}
+
+void convertTunnelCapabilities2c(const CapabilityResponse &capabilities, tunnelCapabilities_t *capabilities_c)
+{
+  const CapabilityResponse::MatchCapabilities &match = capabilities.matchcapabilities();
+  capabilities_c->ingressInterfaceMatching = match.ingressinterfacematching();
+  capabilities_c->vxlanMatching = match.vxlanmatching();
+  capabilities_c->geneveMatching = match.genevematching();
+  capabilities_c->tunnelMatching = match.tunnelmatching();
+  capabilities_c->spiMatching = match.spimatching();
+  const CapabilityResponse::IPSecCapabilities &ipsec = capabilities.ipseccapabilities();
+  capabilities_c->numberTunnelTypes = std::min(ipsec.tunneltypesupported_size(), TUNNEL_IPSEC_TYPES_MAX);
+  for (int i = 0; i < capabilities_c->numberTunnelTypes; i++){
+    capabilities_c->tunnelTypeSupported[i] = (IPSEC_TUNNEL_TYPE_T)ipsec.tunneltypesupported(i);
+  }
+  capabilities_c->numberEncryptionTypes = std::min(ipsec.encryptionsupported_size(), TUNNEL_ENC_TYPES_MAX);
+  for (int i = 0; i < capabilities_c->numberEncryptionTypes; i++){
+    capabilities_c->encryptionSupported[i] = (IPSEC_ENC_TYPE_T)ipsec.encryptionsupported(i);
+  }
+  capabilities_c->numberGeneveOptionsSupported = capabilities.genevecapabilities().numbergeneveoptionssupported();
+}
@@ -25,9 +25,12 @@
 
 extern "C" {
 #include <stdio.h>
+#include <string.h>
 #include "opof.h"
 }
 
+#include <algorithm>
+
 #include "opof_util.h"
 #include "opof_grpc.h"
 
@@ -224,7 +227,7 @@ void convertAddSessionResponse2c(addSessionResponse_t *response_c, addSessionRes
   sessionResponseError responseError;
   //response_c->requestStatus = (REQUEST_STATUS_T)response->requeststatus();
   if (response->responseerror_size() > 0){
-    response_c->number_errors = response->responseerror_size();
+    response_c->number_errors = std::min(response->responseerror_size(), BUFFER_MAX);
     for (int i=0; i< response_c->number_errors; i++){
       responseError = response->responseerror(i);
       response_c->sessionErrors[i].sessionId = responseError.sessionid();
@@ -254,6 +257,10 @@ void convertSessionResponse2c(sessionResponse *responsecpp, sessionResponse_t *r
   responsec->outPackets = responsecpp->outpackets();
   responsec->inBytes = responsecpp->inbytes();
   responsec->outBytes = responsecpp->outbytes();
+  responsec->startTime.tv_sec = responsecpp->starttime().seconds();
+  responsec->startTime.tv_nsec = responsecpp->starttime().nanos();
+  responsec->endTime.tv_sec = responsecpp->endtime().seconds();
+  responsec->endTime.tv_nsec = responsecpp->endtime().nanos();
 }
 
 void convertSessionResponse2cpp(sessionResponse *responsecpp, sessionResponse_t *responsec){
@@ -265,6 +272,18 @@ void convertSessionResponse2cpp(sessionResponse *responsecpp, sessionResponse_t
   responsecpp->set_outpackets(responsec->outPackets);
   responsecpp->set_inbytes(responsec->inBytes);
   responsecpp->set_outbytes(responsec->outBytes);
+  if (responsec->startTime.tv_sec != 0){
+    responsecpp->mutable_starttime()->set_seconds(responsec->startTime.tv_sec);
+    responsecpp->mutable_starttime()->set_nanos(responsec->startTime.tv_nsec);
+  } else {
+    responsecpp->clear_starttime();
+  }
+  if (responsec->endTime.tv_sec != 0){
+    responsecpp->mutable_endtime()->set_seconds(responsec->endTime.tv_sec);
+    responsecpp->mutable_endtime()->set_nanos(responsec->endTime.tv_nsec);
+  } else {
+    responsecpp->clear_endtime();
+  }
 }
 void convertSessionRequest2c(sessionRequest &request, sessionRequest_t *request_c){
     actionParameters action;
@@ -310,3 +329,167 @@ void convertNextHopResponse2cpp(
   responsecpp->set_nexthopid(responsec->nextHopId);
   responsecpp->set_errorstatus(responsec->errorStatus);
 }
+
+/** \ingroup utilities
+*
+* \brief Convert a C sessionFilter_t to a C++ sessionFilter Class instance
+*
+* \param *filter_c    The sessionFilter_t struct to convert
+*
+* \param *filter_pb   The sessionFilter object to create
+*
+* \return void
+*/
+void convertSessionFilter2cpp(
+  const struct sessionFilter_t *filter_c,
+  sessionFilter *filter_pb)
+{
+  filter_pb->set_matchsessionstate(filter_c->sessionStateEnable);
+  filter_pb->set_sessionstate((SESSION_STATE)filter_c->sessionState);
+  filter_pb->set_matchprotocolid(filter_c->protoEnable);
+  filter_pb->set_protocolid((PROTOCOL_ID)filter_c->proto);
+  filter_pb->set_matchinlif(filter_c->inlifEnable);
+  filter_pb->set_inlif(filter_c->inlif);
+  filter_pb->set_matchoutlif(filter_c->outlifEnable);
+  filter_pb->set_outlif(filter_c->outlif);
+  filter_pb->set_matchipversion(filter_c->ipverEnable);
+  filter_pb->set_ipversion((IP_VERSION)filter_c->ipver);
+  filter_pb->set_matchactiontype(filter_c->actionTypeEnable);
+  filter_pb->set_actiontype((ACTION_TYPE)filter_c->actionType);
+  filter_pb->set_matchnexthopid(filter_c->nextHopIdEnable);
+  filter_pb->set_nexthopid(filter_c->nextHopId);
+  filter_pb->set_minbytes(filter_c->minBytes);
+  filter_pb->set_minpackets(filter_c->minPackets);
+}
+
+/** \ingroup utilities
+*
+* \brief Convert a C++ sessionFilter Class instance to a C sessionFilter_t
+*
+* \param *filter_pb   The sessionFilter object to convert
+*
+* \param *filter_c    The sessionFilter_t struct to fill in
+*
+* \return void
+*/
+void convertSessionFilter2c(
+  const sessionFilter *filter_pb,
+  struct sessionFilter_t *filter_c)
+{
+  filter_c->sessionStateEnable = filter_pb->matchsessionstate();
+  filter_c->sessionState = (SESSION_STATE_T)filter_pb->sessionstate();
+  filter_c->protoEnable = filter_pb->matchprotocolid();
+  filter_c->proto = (PROTOCOL_ID_T)filter_pb->protocolid();
+  filter_c->inlifEnable = filter_pb->matchinlif();
+  filter_c->inlif = filter_pb->inlif();
+  filter_c->outlifEnable = filter_pb->matchoutlif();
+  filter_c->outlif = filter_pb->outlif();
+  filter_c->ipverEnable = filter_pb->matchipversion();
+  filter_c->ipver = (IP_VERSION_T)filter_pb->ipversion();
+  filter_c->actionTypeEnable = filter_pb->matchactiontype();
+  filter_c->actionType = (ACTION_VALUE_T)filter_pb->actiontype();
+  filter_c->nextHopIdEnable = filter_pb->matchnexthopid();
+  filter_c->nextHopId = filter_pb->nexthopid();
+  filter_c->minBytes = filter_pb->minbytes();
+  filter_c->minPackets = filter_pb->minpackets();
+}
+
+/** \ingroup utilities
+*
+* \brief Convert a C aggregateStats_t to a C++ aggregateStats Class instance
+*
+* \param *stats_c     The aggregateStats_t struct to convert
+*
+* \param *stats_pb    The aggregateStats object to create
+*
+* \return void
+*/
+void convertAggregateStats2cpp(
+  const struct aggregateStats_t *stats_c,
+  aggregateStats *stats_pb)
+{
+  stats_pb->set_key(stats_c->key);
+  stats_pb->set_sessions(stats_c->sessions);
+  stats_pb->set_inpackets(stats_c->inPackets);
+  stats_pb->set_outpackets(stats_c->outPackets);
+  stats_pb->set_inbytes(stats_c->inBytes);
+  stats_pb->set_outbytes(stats_c->outBytes);
+}
+
+/** \ingroup utilities
+*
+* \brief Convert a C++ aggregateStats Class instance to a C aggregateStats_t
+*
+* \param *stats_pb    The aggregateStats object to convert
+*
+* \param *stats_c     The aggregateStats_t struct to fill in
+*
+* \return void
+*/
+void convertAggregateStats2c(
+  const aggregateStats *stats_pb,
+  struct aggregateStats_t *stats_c)
+{
+  stats_c->key = stats_pb->key();
+  stats_c->sessions = stats_pb->sessions();
+  stats_c->inPackets = stats_pb->inpackets();
+  stats_c->outPackets = stats_pb->outpackets();
+  stats_c->inBytes = stats_pb->inbytes();
+  stats_c->outBytes = stats_pb->outbytes();
+}
+
+/** \ingroup utilities
+*
+* \brief Convert a C++ rpcStats Class instance to a C rpcStats_t
+*
+* \param *stats_pb    The rpcStats object to convert
+*
+* \param *stats_c     The rpcStats_t struct to fill in
+*
+* \return void
+*/
+void convertRpcStats2c(
+  const rpcStats *stats_pb,
+  struct rpcStats_t *stats_c)
+{
+  memset(stats_c, 0, sizeof(*stats_c));
+  strncpy(stats_c->name, stats_pb->name().c_str(), RPC_NAME_MAX - 1);
+  stats_c->calls = stats_pb->calls();
+  stats_c->errors = stats_pb->errors();
+  stats_c->statusCounts[0] = stats_pb->calls() - stats_pb->errors();
+  for (int i = 0; i < stats_pb->errorcounts_size(); i++){
+    unsigned int code = stats_pb->errorcounts(i).statuscode();
+    if (code < RPC_STATUS_CODES){
+      stats_c->statusCounts[code] = stats_pb->errorcounts(i).count();
+    }
+  }
+  stats_c->sessions = stats_pb->sessions();
+  stats_c->p50Micros = stats_pb->p50micros();
+  stats_c->p99Micros = stats_pb->p99micros();
+  stats_c->p999Micros = stats_pb->p999micros();
+  stats_c->maxMicros = stats_pb->maxmicros();
+}
+
+/** \ingroup utilities
+*
+* \brief Convert a C++ stageStats Class instance to a C stageStats_t
+*
+* \param *stats_pb    The stageStats object to convert
+*
+* \param *stats_c     The stageStats_t struct to fill in
+*
+* \return void
+*/
+void convertStageStats2c(
+  const stageStats *stats_pb,
+  struct stageStats_t *stats_c)
+{
+  memset(stats_c, 0, sizeof(*stats_c));
+  strncpy(stats_c->rpc, stats_pb->rpc().c_str(), RPC_NAME_MAX - 1);
+  strncpy(stats_c->stage, stats_pb->stage().c_str(), RPC_NAME_MAX - 1);
+  stats_c->calls = stats_pb->calls();
+  stats_c->totalNanos = stats_pb->totalnanos();
+  stats_c->p50Nanos = stats_pb->p50nanos();
+  stats_c->p99Nanos = stats_pb->p99nanos();
+  stats_c->maxNanos = stats_pb->maxnanos();
+}
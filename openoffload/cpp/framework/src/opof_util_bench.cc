@@ -0,0 +1,282 @@
+/*
+ *  Copyright (C) 2020 Palo Alto Networks Intellectual Property. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* \ingroup utilities
+*
+* \brief Microbenchmarks of the C <-> protobuf conversions in opof_util.cc
+*
+* Each conversion runs once per session on the client or the server, so a
+* regression here is a regression of every RPC. The session request
+* conversions are measured for IPv4 and IPv6, with and without source and
+* destination NAT on both links, and the next hop conversions with and
+* without MAC rewrite.
+*
+* Besides the time, every benchmark reports allocs/op, the heap allocations
+* made per conversion, counted by replacing the global operator new. The
+* Reused variant keeps one message across sessions, as a caller that wants
+* to avoid the per session message would; proto3 Clear() still frees the
+* sub-messages, so it only saves the allocations of the top level message.
+*
+*   opof_util_bench [--benchmark_filter=regex] [--benchmark_format=json]
+*/
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+}
+#include <atomic>
+#include <new>
+
+#include <benchmark/benchmark.h>
+
+#include "opof_util.h"
+#include "opof_grpc.h"
+
+static std::atomic<uint64_t> allocations(0);
+
+/* the library operator delete frees with free(), so only new is replaced */
+__attribute__((noinline)) void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr){
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+/*
+* Reports the allocations made since the benchmark loop started as allocs/op.
+*/
+class AllocCounter {
+public:
+    explicit AllocCounter(benchmark::State &state) : state_(state), start_(allocations.load()) {}
+
+    ~AllocCounter() {
+      state_.counters["allocs/op"] = benchmark::Counter(
+        (double)(allocations.load() - start_), benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    benchmark::State &state_;
+    uint64_t start_;
+};
+
+static void fillNat(nat_t *nat, IP_VERSION_T ipver, uint32_t seed) {
+  nat->ipver = ipver;
+  nat->ipv4.s_addr = htonl(0xc0a80000 | (seed & 0xffff));
+  for (int i = 0; i < 16; i++){
+    nat->ipv6.s6_addr[i] = (uint8_t)(seed + i);
+  }
+  nat->proto = _TCP;
+  nat->port = (uint16_t)(1024 + seed);
+}
+
+/*
+* A session request as the client fills it, IPv4 or IPv6, with NAT on both
+* links when nat is set.
+*/
+static void fillSessionRequest(sessionRequest_t *request, IP_VERSION_T ipver, bool nat) {
+  memset(request, 0, sizeof(*request));
+  request->sessId = 123456789;
+  request->inlif = 1;
+  request->outlif = 2;
+  request->encapType = _NONE;
+  request->vlan_inLif = 100;
+  request->vlan_outLif = 200;
+  request->ipver = ipver;
+  request->srcIP.s_addr = htonl(0x0a000101);
+  request->dstIP.s_addr = htonl(0x0a010001);
+  for (int i = 0; i < 16; i++){
+    request->srcIPV6.s6_addr[i] = (uint8_t)(0x20 + i);
+    request->dstIPV6.s6_addr[i] = (uint8_t)(0x40 + i);
+  }
+  request->srcPort = 49152;
+  request->dstPort = 443;
+  request->proto = _TCP;
+  request->cacheTimeout = 120;
+  request->actionParams.actionType = _FORWARD;
+  request->actionParams.actionParams_inLif.nextHopId = 7;
+  request->actionParams.actionParams_outLif.nextHopId = 8;
+  request->actionParams.actionParams_outLif.vlan = 300;
+  if (nat){
+    perLinkActionParameters_t *links[2] = {&request->actionParams.actionParams_inLif,
+                                           &request->actionParams.actionParams_outLif};
+    for (int i = 0; i < 2; i++){
+      links[i]->snatEnable = true;
+      fillNat(&links[i]->snat, ipver, 2 * i);
+      links[i]->dnatEnable = true;
+      fillNat(&links[i]->dnat, ipver, 2 * i + 1);
+    }
+  }
+}
+
+static void fillSessionResponse(sessionResponse_t *response) {
+  memset(response, 0, sizeof(*response));
+  response->sessionId = 123456789;
+  response->requestStatus = _ACCEPTED;
+  response->sessionState = _ESTABLISHED;
+  response->sessionCloseCode = _NOT_CLOSED;
+  response->inPackets = 1000;
+  response->outPackets = 2000;
+  response->inBytes = 1500000;
+  response->outBytes = 3000000;
+}
+
+static void fillNextHop(nextHopParameters_t *nextHop, IP_VERSION_T ipver, bool macRewrite) {
+  memset(nextHop, 0, sizeof(*nextHop));
+  nextHop->nextHopId = 42;
+  nextHop->ipver = ipver;
+  nextHop->macRewriteEnable = macRewrite;
+  for (int i = 0; i < 6; i++){
+    nextHop->macRewrite.srcMac[i] = (uint8_t)(0x02 + i);
+    nextHop->macRewrite.dstMac[i] = (uint8_t)(0x0a + i);
+  }
+}
+
+static IP_VERSION_T ipVersion(const benchmark::State &state) {
+  return state.range(0) == 6 ? _IPV6 : _IPV4;
+}
+
+/* the client builds a new message for every session it writes */
+static void BM_SessionRequest2cpp(benchmark::State &state) {
+  sessionRequest_t request_c;
+  fillSessionRequest(&request_c, ipVersion(state), state.range(1) != 0);
+  AllocCounter counter(state);
+  for (auto _ : state){
+    sessionRequest request;
+    convertSessionRequest2cpp(&request_c, &request);
+    benchmark::DoNotOptimize(request);
+  }
+}
+
+/* the same conversion into one message cleared between sessions */
+static void BM_SessionRequest2cppReused(benchmark::State &state) {
+  sessionRequest_t request_c;
+  sessionRequest request;
+  fillSessionRequest(&request_c, ipVersion(state), state.range(1) != 0);
+  convertSessionRequest2cpp(&request_c, &request);
+  AllocCounter counter(state);
+  for (auto _ : state){
+    request.Clear();
+    convertSessionRequest2cpp(&request_c, &request);
+    benchmark::DoNotOptimize(request);
+  }
+}
+
+static void BM_SessionRequest2c(benchmark::State &state) {
+  sessionRequest_t request_c;
+  sessionRequest request;
+  fillSessionRequest(&request_c, ipVersion(state), state.range(1) != 0);
+  convertSessionRequest2cpp(&request_c, &request);
+  AllocCounter counter(state);
+  for (auto _ : state){
+    sessionRequest_t out = {};
+    convertSessionRequest2c(request, &out);
+    benchmark::DoNotOptimize(out);
+  }
+}
+
+static void BM_SessionResponse2cpp(benchmark::State &state) {
+  sessionResponse_t response_c;
+  sessionResponse response;
+  fillSessionResponse(&response_c);
+  AllocCounter counter(state);
+  for (auto _ : state){
+    convertSessionResponse2cpp(&response, &response_c);
+    benchmark::DoNotOptimize(response);
+  }
+}
+
+static void BM_SessionResponse2c(benchmark::State &state) {
+  sessionResponse_t response_c;
+  sessionResponse response;
+  fillSessionResponse(&response_c);
+  convertSessionResponse2cpp(&response, &response_c);
+  AllocCounter counter(state);
+  for (auto _ : state){
+    convertSessionResponse2c(&response, &response_c);
+    benchmark::DoNotOptimize(response_c);
+  }
+}
+
+/* range(0) errors in the response, more than BUFFER_MAX are clamped */
+static void BM_AddSessionResponse2c(benchmark::State &state) {
+  addSessionResponse response;
+  addSessionResponse_t response_c;
+  for (int i = 0; i < state.range(0); i++){
+    sessionResponseError *error = response.add_responseerror();
+    error->set_sessionid(i);
+    error->set_errorstatus(_SESSION_ALREADY_EXISTS);
+  }
+  AllocCounter counter(state);
+  for (auto _ : state){
+    convertAddSessionResponse2c(&response_c, &response);
+    benchmark::DoNotOptimize(response_c);
+  }
+}
+
+static void BM_NextHop2cpp(benchmark::State &state) {
+  nextHopParameters_t nextHop_c;
+  fillNextHop(&nextHop_c, ipVersion(state), state.range(1) != 0);
+  AllocCounter counter(state);
+  for (auto _ : state){
+    nextHopParameters nextHop;
+    convertNextHop2cpp(&nextHop_c, &nextHop);
+    benchmark::DoNotOptimize(nextHop);
+  }
+}
+
+static void BM_NextHop2c(benchmark::State &state) {
+  nextHopParameters_t nextHop_c;
+  nextHopParameters nextHop;
+  fillNextHop(&nextHop_c, ipVersion(state), state.range(1) != 0);
+  convertNextHop2cpp(&nextHop_c, &nextHop);
+  AllocCounter counter(state);
+  for (auto _ : state){
+    nextHopParameters_t out = {};
+    convertNextHop2c(&nextHop, &out);
+    benchmark::DoNotOptimize(out);
+  }
+}
+
+static void sessionVariants(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"ip", "nat"});
+  for (int ip : {4, 6}){
+    for (int nat : {0, 1}){
+      b->Args({ip, nat});
+    }
+  }
+}
+
+static void nextHopVariants(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"ip", "mac"});
+  for (int ip : {4, 6}){
+    for (int mac : {0, 1}){
+      b->Args({ip, mac});
+    }
+  }
+}
+
+BENCHMARK(BM_SessionRequest2cpp)->Apply(sessionVariants);
+BENCHMARK(BM_SessionRequest2cppReused)->Apply(sessionVariants);
+BENCHMARK(BM_SessionRequest2c)->Apply(sessionVariants);
+BENCHMARK(BM_SessionResponse2cpp);
+BENCHMARK(BM_SessionResponse2c);
+BENCHMARK(BM_AddSessionResponse2c)->ArgName("errors")->Arg(0)->Arg(1)->Arg(BUFFER_MAX)->Arg(4 * BUFFER_MAX);
+BENCHMARK(BM_NextHop2cpp)->Apply(nextHopVariants);
+BENCHMARK(BM_NextHop2c)->Apply(nextHopVariants);
+
+BENCHMARK_MAIN();